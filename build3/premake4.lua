@@ -295,6 +295,8 @@ end
 --			include "../test/hello_gtest"
 			include "../test/collision"
 			include "../test/BulletDynamics/pendulum"
+			include "../test/BulletDynamics/actions"
+			include "../test/BulletDynamics/solver"
 			if not _OPTIONS["no-bullet3"] then
 				if not _OPTIONS["no-extras"] then
 					include "../test/InverseDynamics"
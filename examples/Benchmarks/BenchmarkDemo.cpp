@@ -36,6 +36,8 @@ subject to the following restrictions:
 class btDynamicsWorld;
 
 #define NUMRAYS 500
+#define NUMFRUSTUMPROXIES 100000
+#define NUMFRUSTUMPLANES 6
 
 class btRigidBody;
 class btBroadphaseInterface;
@@ -75,6 +77,7 @@ class BenchmarkDemo : public CommonRigidBodyBase
 	void	createTest5();
 	void	createTest6();
 	void	createTest7();
+	void	createTest8();
 
 	void createWall(const btVector3& offsetPosition,int stackSize,const btVector3& boxSize);
 	void createPyramid(const btVector3& offsetPosition,int stackSize,const btVector3& boxSize);
@@ -88,6 +91,9 @@ class BenchmarkDemo : public CommonRigidBodyBase
 	void castRays();
 	void initRays();
 
+	void cullFrustum();
+	void initFrustum();
+
 	public:
 
 	BenchmarkDemo(struct GUIHelperInterface* helper, int benchmark)
@@ -327,6 +333,240 @@ public:
 
 static btRaycastBar2 raycastBar;
 
+
+
+///frustum culling of static proxies in a btDbvtBroadphase
+///compares the leaf test computing the shape extents along each plane with getAabb
+///against the test on the cached local box of the object (btCollisionObject::m_otLocalBox*)
+class btFrustumCullBench
+{
+public:
+	btDbvtBroadphase* m_broadphase;
+	btAlignedObjectArray<btCollisionObject*> m_objects;
+	btAlignedObjectArray<btCollisionShape*> m_shapes;
+
+	btVector3 m_normals[NUMFRUSTUMPLANES];
+	btScalar m_offsets[NUMFRUSTUMPLANES];
+	btVector3 m_eye;
+	btScalar m_yaw;
+
+	int frame_counter;
+	unsigned long long aabb_us;
+	unsigned long long box_us;
+	int aabb_hits;
+	int box_hits;
+
+#ifdef USE_BT_CLOCK
+	btClock frame_timer;
+#endif //USE_BT_CLOCK
+
+	struct LeafCollector : btDbvt::ICollide
+	{
+		const btFrustumCullBench* m_bench;
+		bool m_cachedBox;
+		int m_hits;
+
+		LeafCollector(const btFrustumCullBench* bench, bool cachedBox)
+			:m_bench(bench), m_cachedBox(cachedBox), m_hits(0)
+		{
+		}
+
+		void Process(const btDbvtNode* leaf)
+		{
+			const btCollisionObject* obj = (const btCollisionObject*)((btBroadphaseProxy*)leaf->data)->m_clientObject;
+			if (m_cachedBox ? m_bench->boxTest(obj) : m_bench->aabbTest(obj))
+				m_hits++;
+		}
+	};
+
+	btFrustumCullBench()
+		:m_broadphase(0), m_yaw(0), frame_counter(0), aabb_us(0), box_us(0), aabb_hits(0), box_hits(0)
+	{
+	}
+
+	void init()
+	{
+		m_broadphase = new btDbvtBroadphase();
+
+		m_shapes.push_back(new btBoxShape(btVector3(1.f, 0.5f, 2.f)));
+		m_shapes.push_back(new btCapsuleShape(0.5f, 3.f));
+		m_shapes.push_back(new btCylinderShape(btVector3(1.f, 2.f, 1.f)));
+		m_shapes.push_back(new btSphereShape(1.f));
+
+		btCompoundShape* compound = new btCompoundShape();
+		btTransform local;
+		local.setIdentity();
+		local.setOrigin(btVector3(0, 1.5f, 0));
+		compound->addChildShape(local, m_shapes[0]);
+		local.setOrigin(btVector3(2.f, 0, 0));
+		compound->addChildShape(local, m_shapes[1]);
+		m_shapes.push_back(compound);
+
+		srand(1);
+
+		for (int i = 0; i < NUMFRUSTUMPROXIES; i++)
+		{
+			btCollisionObject* obj = new btCollisionObject();
+			obj->setCollisionShape(m_shapes[i % m_shapes.size()]);
+
+			btTransform tr;
+			tr.setIdentity();
+			tr.setOrigin(btVector3(btScalar(rand() % 2000) - 1000, btScalar(rand() % 100), btScalar(rand() % 2000) - 1000));
+			tr.setRotation(btQuaternion(btScalar(rand() % 628) * 0.01f, btScalar(rand() % 314) * 0.01f, 0));
+			obj->setWorldTransform(tr);
+
+			btVector3 minAabb, maxAabb;
+			obj->getCollisionShape()->getAabb(tr, minAabb, maxAabb);
+			obj->setBroadphaseHandle(m_broadphase->createProxy(minAabb, maxAabb, obj->getCollisionShape()->getShapeType(), obj,
+				btBroadphaseProxy::StaticFilter, btBroadphaseProxy::AllFilter ^ btBroadphaseProxy::StaticFilter, 0, 0));
+
+			refreshLocalBox(obj);
+			m_objects.push_back(obj);
+		}
+
+		m_broadphase->optimize();
+	}
+
+	void exit()
+	{
+		for (int i = 0; i < m_objects.size(); i++)
+		{
+			delete m_objects[i];
+		}
+		m_objects.clear();
+
+		for (int i = m_shapes.size() - 1; i >= 0; i--)
+		{
+			delete m_shapes[i];
+		}
+		m_shapes.clear();
+
+		delete m_broadphase;
+		m_broadphase = 0;
+	}
+
+	static void refreshLocalBox(btCollisionObject* obj)
+	{
+		const btCollisionShape* shape = obj->getCollisionShape();
+		btVector3 minAabb, maxAabb;
+		shape->getAabb(btTransform::getIdentity(), minAabb, maxAabb);
+
+		obj->m_otLocalBoxCenter = (minAabb + maxAabb) * btScalar(0.5);
+		obj->m_otLocalBoxHalfExtents = (maxAabb - minAabb) * btScalar(0.5);
+		obj->m_otLocalBoxScaling = shape->getLocalScaling();
+		obj->m_otLocalBoxShape = shape;
+	}
+
+	///shape extents along each plane normal, one getAabb per plane
+	bool aabbTest(const btCollisionObject* obj) const
+	{
+		const btTransform& tr = obj->getWorldTransform();
+
+		for (int p = 0; p < NUMFRUSTUMPLANES; p++)
+		{
+			const btVector3 n = m_normals[p] * tr.getBasis();
+			btTransform t(btMatrix3x3(n.x(), n.y(), n.z(), 0, 0, 0, 0, 0, 0));
+			btVector3 minAabb, maxAabb;
+			obj->getCollisionShape()->getAabb(t, minAabb, maxAabb);
+
+			if (m_normals[p].dot(tr.getOrigin()) + m_offsets[p] + (maxAabb[0] + minAabb[0]) * btScalar(0.5) + (maxAabb[0] - minAabb[0]) * btScalar(0.5) < 0)
+				return false;
+		}
+		return true;
+	}
+
+	///cached local box against all planes, the box axes are projected once per plane
+	bool boxTest(const btCollisionObject* obj) const
+	{
+		const btTransform& tr = obj->getWorldTransform();
+		const btMatrix3x3& basis = tr.getBasis();
+		const btVector3 center = tr(obj->m_otLocalBoxCenter);
+		const btVector3& half = obj->m_otLocalBoxHalfExtents;
+
+		btScalar dist[NUMFRUSTUMPLANES];
+		for (int p = 0; p < NUMFRUSTUMPLANES; p++)
+		{
+			const btVector3 n = m_normals[p] * basis;
+			dist[p] = m_normals[p].dot(center) + m_offsets[p]
+				+ btFabs(n.x()) * half.x() + btFabs(n.y()) * half.y() + btFabs(n.z()) * half.z();
+		}
+
+		int outside = 0;
+		for (int p = 0; p < NUMFRUSTUMPLANES; p++)
+		{
+			outside |= dist[p] < 0;
+		}
+		return !outside;
+	}
+
+	void move(btScalar dt)
+	{
+		m_yaw += dt * btScalar(0.3);
+		m_eye.setValue(0, 60, 0);
+
+		const btVector3 fwd(btCos(m_yaw), btScalar(-0.2), btSin(m_yaw));
+		const btVector3 dir = fwd.normalized();
+		const btVector3 right = dir.cross(btVector3(0, 1, 0)).normalized();
+		const btVector3 up = right.cross(dir);
+
+		// 60 degrees fov, inside is n.x + o >= 0 as in btDbvt::collideKDOP
+		const btScalar s = btSin(SIMD_PI / 6), c = btCos(SIMD_PI / 6);
+		const btScalar zNear = 1, zFar = 500;
+
+		m_normals[0] = dir;
+		m_offsets[0] = -dir.dot(m_eye + dir * zNear);
+		m_normals[1] = -dir;
+		m_offsets[1] = dir.dot(m_eye + dir * zFar);
+		m_normals[2] = right * c + dir * s;
+		m_normals[3] = -right * c + dir * s;
+		m_normals[4] = up * c + dir * s;
+		m_normals[5] = -up * c + dir * s;
+
+		for (int p = 2; p < NUMFRUSTUMPLANES; p++)
+		{
+			m_offsets[p] = -m_normals[p].dot(m_eye);
+		}
+	}
+
+	void cull(btScalar dt)
+	{
+		move(dt);
+
+		for (int pass = 0; pass < 2; pass++)
+		{
+			LeafCollector collector(this, pass == 1);
+
+#ifdef USE_BT_CLOCK
+			frame_timer.reset();
+#endif //USE_BT_CLOCK
+
+			for (int i = 0; i < 2; i++)
+			{
+				btDbvt::collideKDOP(m_broadphase->m_sets[i].m_root, m_normals, m_offsets, NUMFRUSTUMPLANES, collector);
+			}
+
+#ifdef USE_BT_CLOCK
+			(pass ? box_us : aabb_us) += frame_timer.getTimeMicroseconds();
+#endif //USE_BT_CLOCK
+			(pass ? box_hits : aabb_hits) += collector.m_hits;
+		}
+
+		frame_counter++;
+		if (frame_counter >= 50)
+		{
+			printf("%d frusta vs %d proxies: per plane aabb %f ms (%d hits), cached box %f ms (%d hits)\n",
+				frame_counter, m_objects.size(),
+				aabb_us * 0.001 / frame_counter, aabb_hits / frame_counter,
+				box_us * 0.001 / frame_counter, box_hits / frame_counter);
+			frame_counter = 0;
+			aabb_us = box_us = 0;
+			aabb_hits = box_hits = 0;
+		}
+	}
+};
+
+static btFrustumCullBench frustumBench;
+
 void BenchmarkDemo::stepSimulation(float deltaTime)
 {
 	if (m_dynamicsWorld)
@@ -342,6 +582,11 @@ void BenchmarkDemo::stepSimulation(float deltaTime)
 	
 	}
 
+	if (m_benchmark==8)
+	{
+		cullFrustum();
+	}
+
 }
 
 
@@ -466,6 +711,11 @@ void	BenchmarkDemo::initPhysics()
 			createTest7();
 			break;
 		}
+		case 8:
+		{
+			createTest8();
+			break;
+		}
 
 
 	default:
@@ -1253,10 +1503,31 @@ void	BenchmarkDemo::createTest7()
 	initRays();
 }
 
+void BenchmarkDemo::initFrustum()
+{
+	frustumBench.init();
+}
+
+void BenchmarkDemo::cullFrustum()
+{
+	frustumBench.cull(btScalar(1./60.));
+}
+
+void	BenchmarkDemo::createTest8()
+{
+	setCameraDistance(btScalar(150.));
+	initFrustum();
+}
+
 void	BenchmarkDemo::exitPhysics()
 {
 	int i;
 
+	if (m_benchmark==8)
+	{
+		frustumBench.exit();
+	}
+
 	for (i=0;i<m_ragdolls.size();i++)
 	{
 		RagDoll* doll = m_ragdolls[i];
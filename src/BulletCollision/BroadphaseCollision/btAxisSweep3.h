@@ -99,6 +99,12 @@ protected:
 	btDbvtBroadphase*	m_raycastAccelerator;
 	btOverlappingPairCache*	m_nullPairCache;
 
+	///number of handles added by createProxyDeferred since the last endDeferredProxies
+	int	m_numDeferredHandles;
+	///scratch arrays of endDeferredProxies
+	btAlignedObjectArray<Edge>	m_sortEdges;
+	btAlignedObjectArray<BP_FP_INT_TYPE>	m_activeHandles;
+
 
 	// allocation/deallocation
 	BP_FP_INT_TYPE allocHandle();
@@ -132,13 +138,19 @@ public:
 		return m_numHandles;
 	}
 
+	///number of handles the broadphase was created for, excluding the sentinel
+	BP_FP_INT_TYPE getMaxHandles() const
+	{
+		return static_cast<BP_FP_INT_TYPE>(m_maxHandles - 1);
+	}
+
 	bool ownsProxy(btBroadphaseProxy * proxy) {
 		return (m_pHandles < proxy) && (proxy < m_pHandles + m_maxHandles);
 	}
 
 	virtual void	calculateOverlappingPairs(btDispatcher* dispatcher);
 
-	BP_FP_INT_TYPE addHandle(const btVector3& aabbMin,const btVector3& aabbMax, void* pOwner, unsigned short int collisionFilterGroup, unsigned short int collisionFilterMask,btDispatcher* dispatcher, void* multiSapProxy);
+	BP_FP_INT_TYPE addHandle(const btVector3& aabbMin,const btVector3& aabbMax, void* pOwner, unsigned short int collisionFilterGroup, unsigned short int collisionFilterMask,btDispatcher* dispatcher, void* multiSapProxy, bool deferSort = false);
 	void removeHandle(BP_FP_INT_TYPE handle,btDispatcher* dispatcher);
 	void updateHandle(BP_FP_INT_TYPE handle, const btVector3& aabbMin,const btVector3& aabbMax,btDispatcher* dispatcher);
 	SIMD_FORCE_INLINE Handle* getHandle(BP_FP_INT_TYPE index) const {return m_pHandles + index;}
@@ -153,6 +165,13 @@ public:
 	virtual void	setAabb(btBroadphaseProxy* proxy,const btVector3& aabbMin,const btVector3& aabbMax,btDispatcher* dispatcher);
 	virtual void  getAabb(btBroadphaseProxy* proxy,btVector3& aabbMin, btVector3& aabbMax ) const;
 
+	///bulk insertion, the edges are appended unsorted and sorted once in endDeferredProxies
+	///no other proxy may be created, destroyed or moved until endDeferredProxies is called
+	btBroadphaseProxy*	createProxyDeferred(const btVector3& aabbMin, const btVector3& aabbMax, int shapeType, void* userPtr, short int collisionFilterGroup, short int collisionFilterMask, btDispatcher* dispatcher, void* multiSapProxy);
+	///sorts the edge arrays once instead of per proxy
+	///with findOverlaps the overlapping pairs are collected in a single sweep, existing pairs are reported to the user callback again
+	void	endDeferredProxies(btDispatcher* dispatcher, bool findOverlaps);
+
 	virtual void	rayTest(const btVector3& rayFrom,const btVector3& rayTo, btBroadphaseRayCallback& rayCallback, const btVector3& aabbMin=btVector3(0,0,0), const btVector3& aabbMax = btVector3(0,0,0));
 	virtual void	aabbTest(const btVector3& aabbMin, const btVector3& aabbMax, btBroadphaseAabbCallback& callback);
 
@@ -259,6 +278,110 @@ btBroadphaseProxy*	btAxisSweep3Internal<BP_FP_INT_TYPE>::createProxy(  const btV
 		return handle;
 }
 
+template <typename BP_FP_INT_TYPE>
+btBroadphaseProxy*	btAxisSweep3Internal<BP_FP_INT_TYPE>::createProxyDeferred(const btVector3& aabbMin, const btVector3& aabbMax, int shapeType, void* userPtr, short int collisionFilterGroup, short int collisionFilterMask, btDispatcher* dispatcher, void* multiSapProxy)
+{
+	BP_FP_INT_TYPE handleId = addHandle(aabbMin,aabbMax, userPtr,collisionFilterGroup,collisionFilterMask,dispatcher,multiSapProxy,true);
+
+	Handle* handle = getHandle(handleId);
+
+	if (m_raycastAccelerator)
+	{
+		btBroadphaseProxy* rayProxy = m_raycastAccelerator->createProxy(aabbMin,aabbMax,shapeType,userPtr,collisionFilterGroup,collisionFilterMask,dispatcher,0);
+		handle->m_dbvtProxy = rayProxy;
+	}
+
+	handle->m_aabbMin = aabbMin;
+	handle->m_aabbMax = aabbMax;
+
+	m_numDeferredHandles++;
+
+	return handle;
+}
+
+struct btAxisSweep3EdgeSortPredicate
+{
+	template <typename Edge>
+	bool operator()(const Edge& a, const Edge& b) const
+	{
+		return a.m_pos < b.m_pos;
+	}
+};
+
+template <typename BP_FP_INT_TYPE>
+void	btAxisSweep3Internal<BP_FP_INT_TYPE>::endDeferredProxies(btDispatcher* dispatcher, bool findOverlaps)
+{
+	(void)dispatcher;
+	if (!m_numDeferredHandles)
+		return;
+
+	// edges 1 .. 2*m_numHandles, the boundary sentinels stay in place
+	const int numEdges = int(m_numHandles) * 2;
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		Edge* pEdges = m_pEdges[axis];
+
+		m_sortEdges.resize(numEdges);
+		for (int i = 0; i < numEdges; i++)
+			m_sortEdges[i] = pEdges[i + 1];
+
+		m_sortEdges.quickSort(btAxisSweep3EdgeSortPredicate());
+
+		for (int i = 0; i < numEdges; i++)
+		{
+			const BP_FP_INT_TYPE index = static_cast<BP_FP_INT_TYPE>(i + 1);
+			pEdges[index] = m_sortEdges[i];
+
+			Handle* pHandle = getHandle(pEdges[index].m_handle);
+			if (pEdges[index].IsMax())
+				pHandle->m_maxEdges[axis] = index;
+			else
+				pHandle->m_minEdges[axis] = index;
+		}
+	}
+
+	if (findOverlaps)
+	{
+		// sweep along the x axis, the active handles are tested on the other two axes
+		m_activeHandles.resize(0);
+		const Edge* pEdges = m_pEdges[0];
+
+		for (int i = 1; i <= numEdges; i++)
+		{
+			const BP_FP_INT_TYPE handle = pEdges[i].m_handle;
+
+			if (pEdges[i].IsMax())
+			{
+				const int n = m_activeHandles.findLinearSearch(handle);
+				m_activeHandles.swap(n, m_activeHandles.size() - 1);
+				m_activeHandles.pop_back();
+				continue;
+			}
+
+			Handle* pHandle = getHandle(handle);
+			for (int j = 0; j < m_activeHandles.size(); j++)
+			{
+				Handle* pOther = getHandle(m_activeHandles[j]);
+				if (testOverlap2D(pHandle, pOther, 1, 2))
+				{
+					m_pairCache->addOverlappingPair(pHandle, pOther);
+					if (m_userPairCallback)
+						m_userPairCallback->addOverlappingPair(pHandle, pOther);
+				}
+			}
+
+			m_activeHandles.push_back(handle);
+		}
+	}
+
+	// rebuild the raycast tree when most of it was inserted in bulk
+	if (m_raycastAccelerator && m_numDeferredHandles * 2 >= int(m_numHandles))
+		m_raycastAccelerator->optimize();
+
+	m_numDeferredHandles = 0;
+}
+
 
 
 template <typename BP_FP_INT_TYPE>
@@ -372,7 +495,8 @@ m_pairCache(pairCache),
 m_userPairCallback(0),
 m_ownsPairCache(false),
 m_invalidPair(0),
-m_raycastAccelerator(0)
+m_raycastAccelerator(0),
+m_numDeferredHandles(0)
 {
 	BP_FP_INT_TYPE maxHandles = static_cast<BP_FP_INT_TYPE>(userMaxHandles+1);//need to add one sentinel handle
 
@@ -518,8 +642,11 @@ void btAxisSweep3Internal<BP_FP_INT_TYPE>::freeHandle(BP_FP_INT_TYPE handle)
 
 
 template <typename BP_FP_INT_TYPE>
-BP_FP_INT_TYPE btAxisSweep3Internal<BP_FP_INT_TYPE>::addHandle(const btVector3& aabbMin,const btVector3& aabbMax, void* pOwner, unsigned short collisionFilterGroup, unsigned short int collisionFilterMask,btDispatcher* dispatcher,void* multiSapProxy)
+BP_FP_INT_TYPE btAxisSweep3Internal<BP_FP_INT_TYPE>::addHandle(const btVector3& aabbMin,const btVector3& aabbMax, void* pOwner, unsigned short collisionFilterGroup, unsigned short int collisionFilterMask,btDispatcher* dispatcher,void* multiSapProxy, bool deferSort)
 {
+	// incremental insertion needs sorted edges
+	btAssert(deferSort || !m_numDeferredHandles);
+
 	// quantize the bounds
 	BP_FP_INT_TYPE min[3], max[3];
 	quantize(min, aabbMin, 0);
@@ -560,6 +687,9 @@ BP_FP_INT_TYPE btAxisSweep3Internal<BP_FP_INT_TYPE>::addHandle(const btVector3&
 		pHandle->m_maxEdges[axis] = limit;
 	}
 
+	if (deferSort)
+		return handle;
+
 	// now sort the new edges to their correct position
 	sortMinDown(0, pHandle->m_minEdges[0], dispatcher,false);
 	sortMaxDown(0, pHandle->m_maxEdges[0], dispatcher,false);
@@ -577,6 +707,8 @@ template <typename BP_FP_INT_TYPE>
 void btAxisSweep3Internal<BP_FP_INT_TYPE>::removeHandle(BP_FP_INT_TYPE handle,btDispatcher* dispatcher)
 {
 
+	btAssert(!m_numDeferredHandles);
+
 	Handle* pHandle = getHandle(handle);
 
 	//explicitly remove the pairs containing the proxy
@@ -773,6 +905,7 @@ void btAxisSweep3Internal<BP_FP_INT_TYPE>::updateHandle(BP_FP_INT_TYPE handle, c
 {
 //	btAssert(bounds.IsFinite());
 	//btAssert(bounds.HasVolume());
+	btAssert(!m_numDeferredHandles);
 
 	Handle* pHandle = getHandle(handle);
 
@@ -106,6 +106,7 @@ BT_DECLARE_ALIGNED_ALLOCATOR();
 	void*	m_multiSapParentProxy;
 	int			m_uniqueId;//m_uniqueId is introduced for paircache. could get rid of this, by calculating the address offset etc.
 	unsigned int m_ot_revision = 0xffffffff;
+	void*	m_ot_owner = 0;		///< outerra external broadphase the proxy was created in
 
 	btVector3	m_aabbMin;
 	btVector3	m_aabbMax;
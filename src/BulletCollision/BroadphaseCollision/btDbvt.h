@@ -267,7 +267,6 @@ struct	btDbvt
 
 	
 	btAlignedObjectArray<sStkNN>	m_stkStack;
-	mutable btAlignedObjectArray<const btDbvtNode*>	m_rayTestStack;
 
 
 	// Methods
@@ -348,6 +347,7 @@ struct	btDbvt
 		DBVT_IPOLICY);
 	///rayTestInternal is faster than rayTest, because it uses a persistent stack (to reduce dynamic memory allocations to a minimum) and it uses precomputed signs/rayInverseDirections
 	///rayTestInternal is used by btDbvtBroadphase to accelerate world ray casts
+	///the stack is kept per thread, so the same tree can be ray tested from several threads as long as it's not modified meanwhile
 	DBVT_PREFIX
 		void		rayTestInternal(	const btDbvtNode* root,
 								const btVector3& rayFrom,
@@ -1016,7 +1016,7 @@ inline void		btDbvt::rayTestInternal(	const btDbvtNode* root,
 
 		int								depth=1;
 		int								treshold=DOUBLE_STACKSIZE-2;
-		btAlignedObjectArray<const btDbvtNode*>&	stack = m_rayTestStack;
+		static thread_local btAlignedObjectArray<const btDbvtNode*>	stack;
 		stack.resize(DOUBLE_STACKSIZE);
 		stack[0]=root;
 		btVector3 bounds[2];
@@ -61,6 +61,12 @@ protected:
 
 	btCollisionConfiguration*	m_collisionConfiguration;
 
+	///construct a manifold of the pair in pool or heap memory, without registering it
+	btPersistentManifold*	constructManifold(void* mem,const btCollisionObject* body0,const btCollisionObject* body1);
+
+	///destruct an unregistered manifold and free its memory, btCollisionDispatcher calls it with the manifold lock held
+	virtual void	destroyManifold(btPersistentManifold* manifold);
+
 
 public:
 
@@ -0,0 +1,201 @@
+/*
+Bullet Continuous Collision Detection and Physics Library
+Copyright (c) 2003-2006 Erwin Coumans  http://continuousphysics.com/Bullet/
+
+This software is provided 'as-is', without any express or implied warranty.
+In no event will the authors be held liable for any damages arising from the use of this software.
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it freely,
+subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must not claim that you wrote the original software. If you use this software in a product, an acknowledgment in the product documentation would be appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "btCollisionDispatcherMt.h"
+#include "BulletCollision/BroadphaseCollision/btOverlappingPairCache.h"
+#include "LinearMath/btPoolAllocator.h"
+#include "LinearMath/btThreadSafePoolAllocator.h"
+#include "LinearMath/btThreads.h"
+#include "LinearMath/btQuickprof.h"
+#include "LinearMath/btStepProfiler.h"
+
+#include <mutex>
+#include <new>
+
+extern int gNumManifold;
+extern std::mutex g_manifold_mutex;
+
+///batch processed by the current thread, manifolds created outside of a batch are registered right away
+static thread_local btCollisionDispatcherMt::Batch* tCurrentBatch = 0;
+
+
+btCollisionDispatcherMt::btCollisionDispatcherMt(btCollisionConfiguration* collisionConfiguration, int grainSize)
+	:btCollisionDispatcher(collisionConfiguration),
+	m_taskScheduler(0),
+	m_grainSize(grainSize > 0 ? grainSize : 1),
+	m_batchUpdating(false)
+{
+	void* mem = btAlignedAlloc(sizeof(btThreadSafePoolAllocator), 16);
+	m_manifoldPool = new (mem) btThreadSafePoolAllocator(sizeof(btPersistentManifold), m_persistentManifoldPoolAllocator->getMaxCount());
+
+	mem = btAlignedAlloc(sizeof(btThreadSafePoolAllocator), 16);
+	m_algorithmPool = new (mem) btThreadSafePoolAllocator(m_collisionAlgorithmPoolAllocator->getElementSize(), m_collisionAlgorithmPoolAllocator->getMaxCount());
+}
+
+btCollisionDispatcherMt::~btCollisionDispatcherMt()
+{
+	m_manifoldPool->~btThreadSafePoolAllocator();
+	btAlignedFree(m_manifoldPool);
+
+	m_algorithmPool->~btThreadSafePoolAllocator();
+	btAlignedFree(m_algorithmPool);
+}
+
+btPersistentManifold* btCollisionDispatcherMt::getNewManifold(const btCollisionObject* body0, const btCollisionObject* body1)
+{
+	void* mem = m_manifoldPool->allocate(sizeof(btPersistentManifold), (m_dispatcherFlags & CD_DISABLE_CONTACTPOOL_DYNAMIC_ALLOCATION) == 0);
+	if (!mem)
+	{
+		btAssert(0);
+		//make sure to increase the m_defaultMaxPersistentManifoldPoolSize in the btDefaultCollisionConstructionInfo/btDefaultCollisionConfiguration
+		return 0;
+	}
+
+	btPersistentManifold* manifold = constructManifold(mem, body0, body1);
+
+	Batch* batch = tCurrentBatch;
+	if (m_batchUpdating && batch)
+	{
+		//registered in mergeBatches
+		manifold->m_index1a = -1;
+		ManifoldOp op = { manifold, false };
+		batch->m_manifoldOps.push_back(op);
+		return manifold;
+	}
+
+	std::lock_guard<std::mutex> lock(g_manifold_mutex);
+	gNumManifold++;
+	manifold->m_index1a = m_manifoldsPtr.size();
+	m_manifoldsPtr.push_back(manifold);
+	return manifold;
+}
+
+void btCollisionDispatcherMt::releaseManifold(btPersistentManifold* manifold)
+{
+	Batch* batch = tCurrentBatch;
+	if (m_batchUpdating && batch)
+	{
+		//removed from the manifold array and freed in mergeBatches, in the order of the serial dispatch
+		ManifoldOp op = { manifold, true };
+		batch->m_manifoldOps.push_back(op);
+		return;
+	}
+
+	btCollisionDispatcher::releaseManifold(manifold);
+}
+
+void btCollisionDispatcherMt::destroyManifold(btPersistentManifold* manifold)
+{
+	manifold->~btPersistentManifold();
+	m_manifoldPool->freeMemory(manifold);
+}
+
+void* btCollisionDispatcherMt::allocateCollisionAlgorithm(int size)
+{
+	return m_algorithmPool->allocate(size);
+}
+
+void btCollisionDispatcherMt::freeCollisionAlgorithm(void* ptr)
+{
+	m_algorithmPool->freeMemory(ptr);
+}
+
+struct btDispatchPairsLoop : public btIParallelForBody
+{
+	btCollisionDispatcherMt*	m_dispatcher;
+	btBroadphasePair*	m_pairs;
+	int					m_numPairs;
+	int					m_grainSize;
+	const btDispatcherInfo&	m_dispatchInfo;
+	btCollisionDispatcherMt::Batch*	m_batches;
+
+	btDispatchPairsLoop(btCollisionDispatcherMt* dispatcher, btBroadphasePair* pairs, int numPairs, int grainSize, const btDispatcherInfo& dispatchInfo, btCollisionDispatcherMt::Batch* batches)
+		:m_dispatcher(dispatcher),
+		m_pairs(pairs),
+		m_numPairs(numPairs),
+		m_grainSize(grainSize),
+		m_dispatchInfo(dispatchInfo),
+		m_batches(batches)
+	{
+	}
+
+	virtual void forLoop(int iBegin, int iEnd) const
+	{
+		btNearCallback nearCallback = m_dispatcher->getNearCallback();
+
+		for (int b = iBegin; b < iEnd; b++)
+		{
+			BT_PROFILE("dispatchPairBatch");
+			tCurrentBatch = &m_batches[b];
+
+			const int pairEnd = btMin((b + 1) * m_grainSize, m_numPairs);
+			for (int i = b * m_grainSize; i < pairEnd; i++)
+				(*nearCallback)(m_pairs[i], *m_dispatcher, m_dispatchInfo);
+
+			tCurrentBatch = 0;
+		}
+	}
+};
+
+void btCollisionDispatcherMt::dispatchAllCollisionPairs(btOverlappingPairCache* pairCache, const btDispatcherInfo& dispatchInfo, btDispatcher* dispatcher)
+{
+	BT_STEP_PROFILE_COUNTER("manifold pool high water", m_manifoldPool->getHighWaterMark());
+	BT_STEP_PROFILE_COUNTER("manifold pool fallbacks", m_manifoldPool->getFallbackCount());
+	BT_STEP_PROFILE_COUNTER("algorithm pool high water", m_algorithmPool->getHighWaterMark());
+	BT_STEP_PROFILE_COUNTER("algorithm pool fallbacks", m_algorithmPool->getFallbackCount());
+
+	const int numPairs = pairCache->getNumOverlappingPairs();
+	if (!m_taskScheduler || numPairs <= m_grainSize)
+	{
+		btCollisionDispatcher::dispatchAllCollisionPairs(pairCache, dispatchInfo, dispatcher);
+		return;
+	}
+
+	const int numBatches = (numPairs + m_grainSize - 1) / m_grainSize;
+	if (m_batches.size() < numBatches)
+		m_batches.resize(numBatches);
+
+	m_batchUpdating = true;
+
+	btDispatchPairsLoop loop(this, pairCache->getOverlappingPairArrayPtr(), numPairs, m_grainSize, dispatchInfo, &m_batches[0]);
+	m_taskScheduler->parallelFor(0, numBatches, 1, loop);
+
+	m_batchUpdating = false;
+
+	mergeBatches();
+}
+
+void btCollisionDispatcherMt::mergeBatches()
+{
+	//the batches are replayed in pair order, the manifold array changes as with the serial dispatch
+	for (int b = 0; b < m_batches.size(); b++)
+	{
+		Batch& batch = m_batches[b];
+		for (int i = 0; i < batch.m_manifoldOps.size(); i++)
+		{
+			btPersistentManifold* manifold = batch.m_manifoldOps[i].m_manifold;
+			if (batch.m_manifoldOps[i].m_release)
+			{
+				btCollisionDispatcher::releaseManifold(manifold);
+				continue;
+			}
+
+			manifold->m_index1a = m_manifoldsPtr.size();
+			m_manifoldsPtr.push_back(manifold);
+			gNumManifold++;
+		}
+		batch.m_manifoldOps.resizeNoInitialize(0);
+	}
+}
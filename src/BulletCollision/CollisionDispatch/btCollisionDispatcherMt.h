@@ -0,0 +1,98 @@
+/*
+Bullet Continuous Collision Detection and Physics Library
+Copyright (c) 2003-2006 Erwin Coumans  http://continuousphysics.com/Bullet/
+
+This software is provided 'as-is', without any express or implied warranty.
+In no event will the authors be held liable for any damages arising from the use of this software.
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it freely,
+subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must not claim that you wrote the original software. If you use this software in a product, an acknowledgment in the product documentation would be appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef BT_COLLISION_DISPATCHER_MT_H
+#define BT_COLLISION_DISPATCHER_MT_H
+
+#include "btCollisionDispatcher.h"
+
+class btITaskScheduler;
+class btThreadSafePoolAllocator;
+
+///btCollisionDispatcherMt runs the near callbacks of the overlapping pairs on a btITaskScheduler.
+///The pairs are split into batches of a fixed size, independent of the thread count. Each batch records the manifolds it creates and releases in its own list.
+///Manifolds and algorithms are allocated from btThreadSafePoolAllocator pools owned by the dispatcher, sized after the pools of the
+///collision configuration and growing by the same amount when exhausted.
+///The lists are applied to the manifold array in batch order, so the manifold order is the same as with btCollisionDispatcher.
+///Manifolds released by a batch are cleared and freed when the lists are applied.
+///The collision configuration must provide per thread simplex and penetration depth solvers, and custom near callbacks must be reentrant.
+class btCollisionDispatcherMt : public btCollisionDispatcher
+{
+public:
+
+	btCollisionDispatcherMt(btCollisionConfiguration* collisionConfiguration, int grainSize = 40);
+
+	virtual ~btCollisionDispatcherMt();
+
+	///pairs are dispatched on the calling thread without a scheduler
+	void	setTaskScheduler(btITaskScheduler* scheduler)
+	{
+		m_taskScheduler = scheduler;
+	}
+
+	btITaskScheduler*	getTaskScheduler() const
+	{
+		return m_taskScheduler;
+	}
+
+	virtual btPersistentManifold*	getNewManifold(const btCollisionObject* b0,const btCollisionObject* b1);
+
+	virtual void releaseManifold(btPersistentManifold* manifold);
+
+	virtual void	dispatchAllCollisionPairs(btOverlappingPairCache* pairCache,const btDispatcherInfo& dispatchInfo,btDispatcher* dispatcher);
+
+	virtual	void* allocateCollisionAlgorithm(int size);
+
+	virtual	void freeCollisionAlgorithm(void* ptr);
+
+	///pool statistics, for tuning the pool sizes of the collision configuration
+	btThreadSafePoolAllocator*	getManifoldPool() const
+	{
+		return m_manifoldPool;
+	}
+
+	btThreadSafePoolAllocator*	getCollisionAlgorithmPool() const
+	{
+		return m_algorithmPool;
+	}
+
+	///manifold created or released by a pair of a batch
+	struct ManifoldOp
+	{
+		btPersistentManifold*	m_manifold;
+		bool	m_release;
+	};
+
+	///state of a batch of pairs, used by one thread at a time
+	struct Batch
+	{
+		btAlignedObjectArray<ManifoldOp>	m_manifoldOps;
+	};
+
+protected:
+
+	virtual void	destroyManifold(btPersistentManifold* manifold);
+
+	void	mergeBatches();
+
+	btAlignedObjectArray<Batch>	m_batches;
+	btThreadSafePoolAllocator*	m_manifoldPool;
+	btThreadSafePoolAllocator*	m_algorithmPool;
+	btITaskScheduler*	m_taskScheduler;
+	int		m_grainSize;
+	bool	m_batchUpdating;
+};
+
+#endif //BT_COLLISION_DISPATCHER_MT_H
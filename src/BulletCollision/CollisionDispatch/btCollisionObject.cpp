@@ -17,6 +17,8 @@ subject to the following restrictions:
 #include "btCollisionObject.h"
 #include "LinearMath/btSerializer.h"
 
+SleepingStateChangedCallback	gSleepingStateChangedCallback = 0;
+
 btCollisionObject::btCollisionObject()
 	:	m_anisotropicFriction(1.f,1.f,1.f),
 	m_hasAnisotropicFriction(false),
@@ -34,6 +34,10 @@ struct btCollisionShapeData;
 
 typedef btAlignedObjectArray<class btCollisionObject*> btCollisionObjectArray;
 
+///called when an object falls asleep (ISLAND_SLEEPING) or wakes up, may be called from several threads
+typedef void (*SleepingStateChangedCallback)(const class btCollisionObject* colObj, int oldState);
+extern SleepingStateChangedCallback	gSleepingStateChangedCallback;
+
 #ifdef BT_USE_DOUBLE_PRECISION
 #define btCollisionObjectData btCollisionObjectDoubleData
 #define btCollisionObjectDataName "btCollisionObjectDoubleData"
@@ -121,6 +125,17 @@ public:
 	unsigned int	m_otFlags = 0;
 	unsigned int	m_last_collision_pair_frame = 0;
 
+	/// outerra local space box of the collision shape, used by the frustum queries
+	/// valid while m_otLocalBoxShape, m_otLocalBoxScaling and m_otLocalBoxGeneration match the current shape
+	const btCollisionShape*	m_otLocalBoxShape = 0;
+	btVector3		m_otLocalBoxScaling;
+	int				m_otLocalBoxGeneration = 0;
+	btVector3		m_otLocalBoxCenter;
+	btVector3		m_otLocalBoxHalfExtents;
+
+	/// outerra index in the list of awake terrain colliders of the world, -1 when not listed
+	int				m_otTerrainColliderIndex = -1;
+
 	union {
 		void*		m_userDataExt;
 		intptr_t	m_userIndex;
@@ -315,7 +330,7 @@ public:
 	void setActivationState(int newState) const
 	{
 		if ( (m_activationState1 != DISABLE_DEACTIVATION) && (m_activationState1 != DISABLE_SIMULATION))
-			m_activationState1 = newState;
+			changeActivationState(newState);
 	}
 
 	void setDeactivationTime(btScalar time)
@@ -329,7 +344,7 @@ public:
 
 	void forceActivationState(int newState) const
 	{
-		m_activationState1 = newState;
+		changeActivationState(newState);
 	}
 
 	void activate(bool forceActivation = false) const
@@ -578,6 +593,17 @@ public:
 	void setTerrainManifoldHandle(unsigned int terrainManifoldHandle) {
 		m_terrainManifoldHandle = terrainManifoldHandle;
 	}
+
+private:
+
+	SIMD_FORCE_INLINE void changeActivationState(int newState) const
+	{
+		const int oldState = m_activationState1;
+		m_activationState1 = newState;
+
+		if (gSleepingStateChangedCallback && (oldState == ISLAND_SLEEPING) != (newState == ISLAND_SLEEPING))
+			gSleepingStateChangedCallback(this, oldState);
+	}
 };
 
 ///do not change those serialization structures, it requires an updated sBulletDNAstr/sBulletDNAstr64
@@ -31,6 +31,7 @@ subject to the following restrictions:
 #include "BulletCollision/BroadphaseCollision/btDbvt.h"
 #include "LinearMath/btAabbUtil2.h"
 #include "LinearMath/btQuickprof.h"
+#include "LinearMath/btStepProfiler.h"
 #include "LinearMath/btSerializer.h"
 #include "BulletCollision/CollisionShapes/btConvexPolyhedron.h"
 #include "BulletCollision/CollisionDispatch/btCollisionObjectWrapper.h"
@@ -231,6 +232,8 @@ void	btCollisionWorld::performDiscreteCollisionDetection()
 
 	computeOverlappingPairs();
 
+	BT_STEP_PROFILE_COUNTER("overlapping pairs", m_broadphasePairCache->getOverlappingPairCache()->getNumOverlappingPairs());
+
 	btDispatcher* dispatcher = getDispatcher();
 	{
 		BT_PROFILE("dispatchAllCollisionPairs");
@@ -238,6 +241,17 @@ void	btCollisionWorld::performDiscreteCollisionDetection()
 			dispatcher->dispatchAllCollisionPairs(m_broadphasePairCache->getOverlappingPairCache(),dispatchInfo,m_dispatcher1);
 	}
 
+	if (dispatcher && btStepProfiler::isEnabled())
+	{
+		const int numManifolds = dispatcher->getNumManifolds();
+		int numContacts = 0;
+		for (int i=0;i<numManifolds;i++)
+			numContacts += dispatcher->getManifoldByIndexInternal(i)->getNumContacts();
+
+		BT_STEP_PROFILE_COUNTER("manifolds", numManifolds);
+		BT_STEP_PROFILE_COUNTER("contacts", numContacts);
+	}
+
 }
 
 
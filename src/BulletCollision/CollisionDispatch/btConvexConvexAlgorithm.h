@@ -88,6 +88,13 @@ public:
 		return m_manifoldPtr;
 	}
 
+	///retarget an algorithm created with an external manifold, so one instance can serve several object pairs
+	void	setManifold(btPersistentManifold* manifold)
+	{
+		btAssert(!m_ownManifold);
+		m_manifoldPtr = manifold;
+	}
+
 	struct CreateFunc :public 	btCollisionAlgorithmCreateFunc
 	{
 
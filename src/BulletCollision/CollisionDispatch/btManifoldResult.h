@@ -32,6 +32,10 @@ class btManifoldPoint;
 typedef bool (*ContactAddedCallback)(btManifoldPoint& cp,	const btCollisionObjectWrapper* colObj0Wrap,int partId0,int index0,const btCollisionObjectWrapper* colObj1Wrap,int partId1,int index1);
 extern ContactAddedCallback		gContactAddedCallback;
 
+///per-result variant of ContactAddedCallback, userData is the pointer passed to btManifoldResult::setContactAddedHook
+///when set, it is used instead of gContactAddedCallback (same CF_CUSTOM_MATERIAL_CALLBACK rules apply)
+typedef bool (*ContactAddedHook)(void* userData, btManifoldPoint& cp,	const btCollisionObjectWrapper* colObj0Wrap,int partId0,int index0,const btCollisionObjectWrapper* colObj1Wrap,int partId1,int index1);
+
 //#define DEBUG_PART_INDEX 1
 
 
@@ -48,18 +52,23 @@ protected:
 	int m_partId1;
 	int m_index0;
 	int m_index1;
+
+	ContactAddedHook m_contactAddedHook;
+	void* m_contactAddedHookUserData;
 	
 
 public:
 
 	btManifoldResult()
-#ifdef DEBUG_PART_INDEX
 		:
+#ifdef DEBUG_PART_INDEX
 	m_partId0(-1),
 	m_partId1(-1),
 	m_index0(-1),
-	m_index1(-1)
+	m_index1(-1),
 #endif //DEBUG_PART_INDEX
+	m_contactAddedHook(0),
+	m_contactAddedHookUserData(0)
 	{
 	}
 
@@ -94,6 +103,23 @@ public:
 	}
 
 
+	///thread-safe alternative to gContactAddedCallback, the hook applies to contacts added through this result only
+	void	setContactAddedHook(ContactAddedHook hook, void* userData)
+	{
+		m_contactAddedHook = hook;
+		m_contactAddedHookUserData = userData;
+	}
+
+	ContactAddedHook	getContactAddedHook() const
+	{
+		return m_contactAddedHook;
+	}
+
+	void*	getContactAddedHookUserData() const
+	{
+		return m_contactAddedHookUserData;
+	}
+
 	virtual void addContactPoint(const btVector3& normalOnBInWorld,const btVector3& pointInWorld,btScalar depth);
 
 	SIMD_FORCE_INLINE	void refreshContactPoints()
@@ -24,14 +24,374 @@ subject to the following restrictions:
 
 //#include <stdio.h>
 #include "LinearMath/btQuickprof.h"
+#include "LinearMath/btThreads.h"
+
+#include <new>
+
+inline	int	getIslandId(const btPersistentManifold* lhs)
+{
+	int islandId;
+	const btCollisionObject* rcolObj0 = static_cast<const btCollisionObject*>(lhs->getBody0());
+	const btCollisionObject* rcolObj1 = static_cast<const btCollisionObject*>(lhs->getBody1());
+	islandId= rcolObj0->getIslandTag()>=0?rcolObj0->getIslandTag():rcolObj1->getIslandTag();
+	return islandId;
+
+}
+
+template <typename F>
+struct btIslandLoopBody : public btIParallelForBody
+{
+	const F&	m_func;
+
+	btIslandLoopBody(const F& func)
+		:m_func(func)
+	{
+	}
+
+	virtual void forLoop(int iBegin, int iEnd) const
+	{
+		m_func(iBegin, iEnd);
+	}
+};
+
+template <typename F>
+static void btIslandParallelFor(btITaskScheduler* scheduler, int count, int grainSize, const F& func)
+{
+	if (count > 0)
+	{
+		btIslandLoopBody<F> body(func);
+		scheduler->parallelFor(0, count, grainSize, body);
+	}
+}
+
+///bodies of an island in collision object order
+class btElementObjectSortPredicate
+{
+	public:
+
+		bool operator() ( const btElement& lhs, const btElement& rhs ) const
+		{
+			return lhs.m_sz < rhs.m_sz;
+		}
+};
+
+///manifolds of an island in dispatcher order
+class btManifoldIndexSortPredicate
+{
+	public:
+
+		bool operator() ( const btPersistentManifold* lhs, const btPersistentManifold* rhs ) const
+		{
+			return lhs->m_index1a < rhs->m_index1a;
+		}
+};
+
+///state of the union find and island gather run on a task scheduler
+struct btIslandGatherMt
+{
+	///islands are several per loop iteration, take fewer of them at once
+	enum { ISLAND_GRAIN_SIZE = 64 };
+
+	btITaskScheduler*		m_scheduler;
+	int						m_grainSize;
+	btConcurrentUnionFind	m_unionFind;
+
+	///first tag of each range of grainSize collision objects
+	btAlignedObjectArray<int>	m_chunkOffsets;
+
+	///body and manifold counts per island id, then the scatter positions
+	std::atomic<int>*	m_counters;
+	int					m_numCounters;
+
+	btAlignedObjectArray<int>	m_elementIslands;
+	btAlignedObjectArray<btElement>	m_sortedElements;
+	btAlignedObjectArray<btPersistentManifold*>	m_manifolds;
+
+	///all islands in id order, sleeping ones included
+	btAlignedObjectArray<btSimulationIslandManager::Island>	m_islands;
+	btAlignedObjectArray<int>	m_islandAwake;
+	///activation change of the island found by the parallel pass of gatherBodies
+	btAlignedObjectArray<int>	m_islandActivation;
+
+	enum IslandActivation
+	{
+		ISLAND_KEEP,
+		ISLAND_FALL_ASLEEP,
+		ISLAND_WAKE_UP
+	};
+
+	btIslandGatherMt(btITaskScheduler* scheduler, int grainSize)
+		:m_scheduler(scheduler),
+		m_grainSize(grainSize > 0 ? grainSize : 1),
+		m_counters(0),
+		m_numCounters(0)
+	{
+	}
+
+	~btIslandGatherMt()
+	{
+		btAlignedFree(m_counters);
+	}
+
+	void	resetCounters(int n)
+	{
+		if (n > m_numCounters)
+		{
+			btAlignedFree(m_counters);
+			m_counters = (std::atomic<int>*)btAlignedAlloc(sizeof(std::atomic<int>) * n, 16);
+			for (int i = 0; i < n; i++)
+				new (&m_counters[i]) std::atomic<int>(0);
+			m_numCounters = n;
+			return;
+		}
+
+		std::atomic<int>* counters = m_counters;
+		btIslandParallelFor(m_scheduler, n, m_grainSize, [=](int iBegin, int iEnd) {
+			for (int i = iBegin; i < iEnd; i++)
+				counters[i].store(0, std::memory_order_relaxed);
+		});
+	}
+
+	///counts the objects that take part in the union find per range of grainSize objects, returns the total
+	int		countDynamicObjects(const btCollisionObjectArray& objects)
+	{
+		const int numObjects = objects.size();
+		const int grainSize = m_grainSize;
+		const int numChunks = (numObjects + grainSize - 1) / grainSize;
+		m_chunkOffsets.resize(numChunks + 1);
+
+		int* offsets = &m_chunkOffsets[0];
+		btIslandParallelFor(m_scheduler, numChunks, 1, [&](int cBegin, int cEnd) {
+			for (int c = cBegin; c < cEnd; c++)
+			{
+				const int end = btMin((c + 1) * grainSize, numObjects);
+				int count = 0;
+				for (int i = c * grainSize; i < end; i++)
+				{
+#ifdef STATIC_SIMULATION_ISLAND_OPTIMIZATION
+					if (!objects[i]->isStaticOrKinematicObject())
+#endif //STATIC_SIMULATION_ISLAND_OPTIMIZATION
+						count++;
+				}
+				offsets[c + 1] = count;
+			}
+		});
+
+		offsets[0] = 0;
+		for (int c = 0; c < numChunks; c++)
+			offsets[c + 1] += offsets[c];
+
+		return offsets[numChunks];
+	}
+
+	///groups the union find elements by island, in collision object order within an island, and updates the sleeping state of the islands
+	void	gatherBodies(btUnionFind& unionFind, btCollisionObjectArray& collisionObjects)
+	{
+		BT_PROFILE("gatherIslandBodies");
+
+		const int numElem = unionFind.getNumElements();
+		m_islands.resize(0);
+		if (!numElem)
+			return;
+
+		resetCounters(numElem);
+		m_elementIslands.resize(numElem);
+		m_sortedElements.resize(numElem);
+
+		std::atomic<int>* counters = m_counters;
+		int* elementIslands = &m_elementIslands[0];
+
+		btIslandParallelFor(m_scheduler, numElem, m_grainSize, [&](int iBegin, int iEnd) {
+			for (int i = iBegin; i < iEnd; i++)
+			{
+				const int islandId = unionFind.findRoot(i);
+				elementIslands[i] = islandId;
+				counters[islandId].fetch_add(1, std::memory_order_relaxed);
+			}
+		});
+
+		//prefix sum over the counts, the islands come out in id order
+		int offset = 0;
+		for (int i = 0; i < numElem; i++)
+		{
+			const int count = counters[i].load(std::memory_order_relaxed);
+			if (!count)
+				continue;
+
+			btSimulationIslandManager::Island& island = m_islands.expand();
+			island.m_id = i;
+			island.m_firstBody = offset;
+			island.m_numBodies = count;
+			island.m_firstManifold = 0;
+			island.m_numManifolds = 0;
+
+			counters[i].store(offset, std::memory_order_relaxed);
+			offset += count;
+		}
+
+		btElement* sortedElements = &m_sortedElements[0];
+		btIslandParallelFor(m_scheduler, numElem, m_grainSize, [&](int iBegin, int iEnd) {
+			for (int i = iBegin; i < iEnd; i++)
+			{
+				const int islandId = elementIslands[i];
+				btElement& element = sortedElements[counters[islandId].fetch_add(1, std::memory_order_relaxed)];
+				element.m_id = islandId;
+#ifdef STATIC_SIMULATION_ISLAND_OPTIMIZATION
+				element.m_sz = unionFind.getElement(i).m_sz;
+#else
+				element.m_sz = i;
+#endif //STATIC_SIMULATION_ISLAND_OPTIMIZATION
+			}
+		});
+
+		//the scatter order within an island depends on the threads, sort it back
+		m_islandAwake.resize(m_islands.size());
+		m_islandActivation.resize(m_islands.size());
+		int* islandActivation = m_islands.size() ? &m_islandActivation[0] : 0;
+		btIslandParallelFor(m_scheduler, m_islands.size(), ISLAND_GRAIN_SIZE, [&](int iBegin, int iEnd) {
+			for (int i = iBegin; i < iEnd; i++)
+			{
+				const btSimulationIslandManager::Island& island = m_islands[i];
+				const int first = island.m_firstBody;
+				const int end = first + island.m_numBodies;
+
+				if (island.m_numBodies > 1)
+					m_sortedElements.quickSortInternal(btElementObjectSortPredicate(), first, end - 1);
+
+				bool allSleeping = true;
+				bool anySleeping = false;
+				bool allSleepingOrFixed = true;
+				for (int idx = first; idx < end; idx++)
+				{
+					unionFind.getElement(idx) = sortedElements[idx];
+
+					btCollisionObject* colObj0 = collisionObjects[sortedElements[idx].m_sz];
+					btAssert((colObj0->getIslandTag() == island.m_id) || (colObj0->getIslandTag() == -1));
+					if (colObj0->getIslandTag() == island.m_id)
+					{
+						const int state = colObj0->getActivationState();
+						if (state == ACTIVE_TAG || state == DISABLE_DEACTIVATION)
+							allSleeping = false;
+						if (state == ISLAND_SLEEPING)
+							anySleeping = true;
+						else if (state != DISABLE_SIMULATION)
+							allSleepingOrFixed = false;
+					}
+				}
+
+				//only the islands whose bodies change their state go through the serial pass
+				if (allSleeping)
+					islandActivation[i] = allSleepingOrFixed ? ISLAND_KEEP : ISLAND_FALL_ASLEEP;
+				else
+					islandActivation[i] = anySleeping ? ISLAND_WAKE_UP : ISLAND_KEEP;
+			}
+		});
+
+		//the state changes reach gSleepingStateChangedCallback, they are made on this thread in island and object order
+		for (int i = 0; i < m_islands.size(); i++)
+		{
+			if (islandActivation[i] == ISLAND_KEEP)
+				continue;
+
+			const btSimulationIslandManager::Island& island = m_islands[i];
+			for (int idx = island.m_firstBody; idx < island.m_firstBody + island.m_numBodies; idx++)
+			{
+				btCollisionObject* colObj0 = collisionObjects[sortedElements[idx].m_sz];
+				if (colObj0->getIslandTag() != island.m_id)
+					continue;
+
+				if (islandActivation[i] == ISLAND_FALL_ASLEEP)
+				{
+					colObj0->setActivationState( ISLAND_SLEEPING );
+				}
+				else if (colObj0->getActivationState() == ISLAND_SLEEPING)
+				{
+					colObj0->setActivationState( WANTS_DEACTIVATION);
+					colObj0->setDeactivationTime(0.f);
+				}
+			}
+		}
+	}
+
+	///scatters m_manifolds into islandManifolds by island, in dispatcher order within an island
+	void	gatherManifolds(btAlignedObjectArray<btPersistentManifold*>& islandManifolds)
+	{
+		BT_PROFILE("gatherIslandManifolds");
+
+		const int numManifolds = m_manifolds.size();
+		islandManifolds.resize(numManifolds);
+		if (!numManifolds)
+			return;
+
+		std::atomic<int>* counters = m_counters;
+		btIslandParallelFor(m_scheduler, m_islands.size(), ISLAND_GRAIN_SIZE, [&](int iBegin, int iEnd) {
+			for (int i = iBegin; i < iEnd; i++)
+				counters[m_islands[i].m_id].store(0, std::memory_order_relaxed);
+		});
+
+		btPersistentManifold** manifolds = &m_manifolds[0];
+		btIslandParallelFor(m_scheduler, numManifolds, m_grainSize, [&](int iBegin, int iEnd) {
+			for (int i = iBegin; i < iEnd; i++)
+				counters[getIslandId(manifolds[i])].fetch_add(1, std::memory_order_relaxed);
+		});
+
+		int offset = 0;
+		for (int i = 0; i < m_islands.size(); i++)
+		{
+			btSimulationIslandManager::Island& island = m_islands[i];
+			island.m_firstManifold = offset;
+			island.m_numManifolds = counters[island.m_id].load(std::memory_order_relaxed);
+			counters[island.m_id].store(offset, std::memory_order_relaxed);
+			offset += island.m_numManifolds;
+		}
+		btAssert(offset == numManifolds);
+
+		btPersistentManifold** sorted = &islandManifolds[0];
+		btIslandParallelFor(m_scheduler, numManifolds, m_grainSize, [&](int iBegin, int iEnd) {
+			for (int i = iBegin; i < iEnd; i++)
+				sorted[counters[getIslandId(manifolds[i])].fetch_add(1, std::memory_order_relaxed)] = manifolds[i];
+		});
+
+		btIslandParallelFor(m_scheduler, m_islands.size(), ISLAND_GRAIN_SIZE, [&](int iBegin, int iEnd) {
+			for (int i = iBegin; i < iEnd; i++)
+			{
+				const btSimulationIslandManager::Island& island = m_islands[i];
+				if (island.m_numManifolds > 1)
+					islandManifolds.quickSortInternal(btManifoldIndexSortPredicate(), island.m_firstManifold, island.m_firstManifold + island.m_numManifolds - 1);
+			}
+		});
+	}
+};
+
 
 btSimulationIslandManager::btSimulationIslandManager():
-m_splitIslands(true)
+m_splitIslands(true),
+m_taskScheduler(0),
+m_gatherMt(0)
 {
 }
 
 btSimulationIslandManager::~btSimulationIslandManager()
 {
+	setTaskScheduler(0);
+}
+
+void btSimulationIslandManager::setTaskScheduler(btITaskScheduler* scheduler, int grainSize)
+{
+	m_taskScheduler = scheduler;
+
+	if (m_gatherMt)
+	{
+		m_gatherMt->~btIslandGatherMt();
+		btAlignedFree(m_gatherMt);
+		m_gatherMt = 0;
+	}
+
+	if (scheduler)
+	{
+		void* mem = btAlignedAlloc(sizeof(btIslandGatherMt),16);
+		m_gatherMt = new (mem) btIslandGatherMt(scheduler, grainSize);
+	}
 }
 
 
@@ -43,7 +403,41 @@ void btSimulationIslandManager::initUnionFind(int n)
 
 void btSimulationIslandManager::findUnions(btDispatcher* /* dispatcher */,btCollisionWorld* colWorld)
 {
-	
+	if (m_gatherMt)
+	{
+		BT_PROFILE("findUnionsMt");
+
+		btConcurrentUnionFind& unionFind = m_gatherMt->m_unionFind;
+		unionFind.reset(m_unionFind.getNumElements());
+
+		btOverlappingPairCache* pairCachePtr = colWorld->getPairCache();
+		const int numOverlappingPairs = pairCachePtr->getNumOverlappingPairs();
+		btBroadphasePair* pairPtr = numOverlappingPairs ? pairCachePtr->getOverlappingPairArrayPtr() : 0;
+
+		btIslandParallelFor(m_taskScheduler, numOverlappingPairs, m_gatherMt->m_grainSize, [&](int iBegin, int iEnd) {
+			for (int i = iBegin; i < iEnd; i++)
+			{
+				const btBroadphasePair& collisionPair = pairPtr[i];
+				btCollisionObject* colObj0 = (btCollisionObject*)collisionPair.m_pProxy0->m_clientObject;
+				btCollisionObject* colObj1 = (btCollisionObject*)collisionPair.m_pProxy1->m_clientObject;
+
+				if (((colObj0) && ((colObj0)->mergesSimulationIslands())) &&
+					((colObj1) && ((colObj1)->mergesSimulationIslands())))
+				{
+					unionFind.unite((colObj0)->getIslandTag(),
+						(colObj1)->getIslandTag());
+				}
+			}
+		});
+
+		//hand the flattened subsets over to the serial union find, for the unions of the constraints
+		btIslandParallelFor(m_taskScheduler, unionFind.getNumElements(), m_gatherMt->m_grainSize, [&](int iBegin, int iEnd) {
+			for (int i = iBegin; i < iEnd; i++)
+				m_unionFind.getElement(i).m_id = unionFind.find(i);
+		});
+		return;
+	}
+
 	{
 		btOverlappingPairCache* pairCachePtr = colWorld->getPairCache();
 		const int numOverlappingPairs = pairCachePtr->getNumOverlappingPairs();
@@ -72,6 +466,36 @@ void btSimulationIslandManager::findUnions(btDispatcher* /* dispatcher */,btColl
 #ifdef STATIC_SIMULATION_ISLAND_OPTIMIZATION
 void   btSimulationIslandManager::updateActivationState(btCollisionWorld* colWorld,btDispatcher* dispatcher)
 {
+	if (m_gatherMt)
+	{
+		btCollisionObjectArray& collisionObjects = colWorld->getCollisionObjectArray();
+		const int numTagged = m_gatherMt->countDynamicObjects(collisionObjects);
+		const int grainSize = m_gatherMt->m_grainSize;
+		const int* offsets = &m_gatherMt->m_chunkOffsets[0];
+
+		btIslandParallelFor(m_taskScheduler, m_gatherMt->m_chunkOffsets.size() - 1, 1, [&](int cBegin, int cEnd) {
+			for (int c = cBegin; c < cEnd; c++)
+			{
+				int index = offsets[c];
+				const int end = btMin((c + 1) * grainSize, collisionObjects.size());
+				for (int i = c * grainSize; i < end; i++)
+				{
+					btCollisionObject* collisionObject = collisionObjects[i];
+					if (!collisionObject->isStaticOrKinematicObject())
+					{
+						collisionObject->setIslandTag(index++);
+					}
+					collisionObject->setCompanionId(-1);
+					collisionObject->setHitFraction(btScalar(1.));
+				}
+			}
+		});
+
+		initUnionFind( numTagged );
+
+		findUnions(dispatcher,colWorld);
+		return;
+	}
 
 	// put the index into m_controllers into m_tag   
 	int index = 0;
@@ -99,6 +523,39 @@ void   btSimulationIslandManager::updateActivationState(btCollisionWorld* colWor
 
 void   btSimulationIslandManager::storeIslandActivationState(btCollisionWorld* colWorld)
 {
+	if (m_gatherMt)
+	{
+		btCollisionObjectArray& collisionObjects = colWorld->getCollisionObjectArray();
+		m_gatherMt->countDynamicObjects(collisionObjects);
+		const int grainSize = m_gatherMt->m_grainSize;
+		const int* offsets = &m_gatherMt->m_chunkOffsets[0];
+
+		btIslandParallelFor(m_taskScheduler, m_gatherMt->m_chunkOffsets.size() - 1, 1, [&](int cBegin, int cEnd) {
+			for (int c = cBegin; c < cEnd; c++)
+			{
+				int index = offsets[c];
+				const int end = btMin((c + 1) * grainSize, collisionObjects.size());
+				for (int i = c * grainSize; i < end; i++)
+				{
+					btCollisionObject* collisionObject = collisionObjects[i];
+					if (!collisionObject->isStaticOrKinematicObject())
+					{
+						collisionObject->setIslandTag( m_unionFind.findRoot(index) );
+						//Set the correct object offset in Collision Object Array
+						m_unionFind.getElement(index).m_sz = i;
+						collisionObject->setCompanionId(-1);
+						index++;
+					} else
+					{
+						collisionObject->setIslandTag(-1);
+						collisionObject->setCompanionId(-2);
+					}
+				}
+			}
+		});
+		return;
+	}
+
 	// put the islandId ('find' value) into m_tag   
 	{
 		int index = 0;
@@ -176,17 +633,6 @@ void	btSimulationIslandManager::storeIslandActivationState(btCollisionWorld* col
 
 #endif //STATIC_SIMULATION_ISLAND_OPTIMIZATION
 
-inline	int	getIslandId(const btPersistentManifold* lhs)
-{
-	int islandId;
-	const btCollisionObject* rcolObj0 = static_cast<const btCollisionObject*>(lhs->getBody0());
-	const btCollisionObject* rcolObj1 = static_cast<const btCollisionObject*>(lhs->getBody1());
-	islandId= rcolObj0->getIslandTag()>=0?rcolObj0->getIslandTag():rcolObj1->getIslandTag();
-	return islandId;
-
-}
-
-
 
 /// function object that routes calls to operator<
 class btPersistentManifoldSortPredicate
@@ -212,8 +658,13 @@ void btSimulationIslandManager::buildIslands(btDispatcher* dispatcher,btCollisio
 	//we are going to sort the unionfind array, and store the element id in the size
 	//afterwards, we clean unionfind, to make sure no-one uses it anymore
 	
-	getUnionFind().sortIslands();
-	int numElem = getUnionFind().getNumElements();
+	if (m_gatherMt)
+		m_gatherMt->gatherBodies(getUnionFind(),collisionObjects);
+	else
+		getUnionFind().sortIslands();
+
+	//the gather updates the sleeping state of the islands itself
+	int numElem = m_gatherMt ? 0 : getUnionFind().getNumElements();
 
 	int endIslandIndex=1;
 	int startIslandIndex;
@@ -308,6 +759,9 @@ void btSimulationIslandManager::buildIslands(btDispatcher* dispatcher,btCollisio
 	int i;
 	int maxNumManifolds = dispatcher->getNumManifolds();
 
+	btAlignedObjectArray<btPersistentManifold*>& responseManifolds = m_gatherMt ? m_gatherMt->m_manifolds : m_islandmanifold;
+	responseManifolds.resize(0);
+
 //#define SPLIT_ISLANDS 1
 //#ifdef SPLIT_ISLANDS
 
@@ -342,109 +796,157 @@ void btSimulationIslandManager::buildIslands(btDispatcher* dispatcher,btCollisio
 			{ 
 				//filtering for response
 				if (dispatcher->needsResponse(colObj0,colObj1))
-					m_islandmanifold.push_back(manifold);
+					responseManifolds.push_back(manifold);
 			}
 		}
 	}
+
+	if (m_gatherMt && m_splitIslands)
+		m_gatherMt->gatherManifolds(m_islandmanifold);
 }
 
 
 
-///@todo: this is random access, it can be walked 'cache friendly'!
-void btSimulationIslandManager::buildAndProcessIslands(btDispatcher* dispatcher,btCollisionWorld* collisionWorld, IslandCallback* callback)
+void btSimulationIslandManager::buildIslandList(btDispatcher* dispatcher,btCollisionWorld* collisionWorld, btAlignedObjectArray<Island>& islands)
 {
 	btCollisionObjectArray& collisionObjects = collisionWorld->getCollisionObjectArray();
 
 	buildIslands(dispatcher,collisionWorld);
 
+	islands.resize(0);
+	m_islandBodies.resize(0);
+
+	if (m_gatherMt)
+	{
+		BT_PROFILE("gatherIslandList");
+
+		//the bodies of the sleeping islands stay in the array, outside of the ranges
+		const btAlignedObjectArray<Island>& gathered = m_gatherMt->m_islands;
+		m_islandBodies.resize(getUnionFind().getNumElements());
+		int* islandAwake = gathered.size() ? &m_gatherMt->m_islandAwake[0] : 0;
+
+		btIslandParallelFor(m_taskScheduler, gathered.size(), btIslandGatherMt::ISLAND_GRAIN_SIZE, [&](int iBegin, int iEnd) {
+			for (int i = iBegin; i < iEnd; i++)
+			{
+				const Island& island = gathered[i];
+				bool islandSleeping = true;
+				for (int idx = island.m_firstBody; idx < island.m_firstBody + island.m_numBodies; idx++)
+				{
+					btCollisionObject* colObj0 = collisionObjects[getUnionFind().getElement(idx).m_sz];
+					m_islandBodies[idx] = colObj0;
+					if (colObj0->isActive())
+						islandSleeping = false;
+				}
+				islandAwake[i] = !islandSleeping;
+			}
+		});
+
+		for (int i = 0; i < gathered.size(); i++)
+		{
+			if (islandAwake[i])
+				islands.push_back(gathered[i]);
+		}
+		return;
+	}
+
 	int endIslandIndex=1;
 	int startIslandIndex;
 	int numElem = getUnionFind().getNumElements();
 
-	BT_PROFILE("processIslands");
+	int numManifolds = int (m_islandmanifold.size());
 
-	if(!m_splitIslands)
-	{
-		btPersistentManifold** manifold = dispatcher->getInternalManifoldPointer();
-		int maxNumManifolds = dispatcher->getNumManifolds();
-		callback->processIsland(&collisionObjects[0],collisionObjects.size(),manifold,maxNumManifolds, -1);
-	}
-	else
-	{
-		// Sort manifolds, based on islands
-		// Sort the vector using predicate and std::sort
-		//std::sort(islandmanifold.begin(), islandmanifold.end(), btPersistentManifoldSortPredicate);
+	//tried a radix sort, but quicksort/heapsort seems still faster
+	//@todo rewrite island management
+	m_islandmanifold.quickSort(btPersistentManifoldSortPredicate());
 
-		int numManifolds = int (m_islandmanifold.size());
+	int startManifoldIndex = 0;
+	int endManifoldIndex = 1;
 
-		//tried a radix sort, but quicksort/heapsort seems still faster
-		//@todo rewrite island management
-		m_islandmanifold.quickSort(btPersistentManifoldSortPredicate());
-		//m_islandmanifold.heapSort(btPersistentManifoldSortPredicate());
+	//gather the simulation islands, unless all objects are sleeping/deactivated
+	for ( startIslandIndex=0;startIslandIndex<numElem;startIslandIndex = endIslandIndex)
+	{
+		int islandId = getUnionFind().getElement(startIslandIndex).m_id;
+		int firstBody = m_islandBodies.size();
 
-		//now process all active islands (sets of manifolds for now)
+		bool islandSleeping = true;
 
-		int startManifoldIndex = 0;
-		int endManifoldIndex = 1;
+		for (endIslandIndex = startIslandIndex;(endIslandIndex<numElem) && (getUnionFind().getElement(endIslandIndex).m_id == islandId);endIslandIndex++)
+		{
+			int i = getUnionFind().getElement(endIslandIndex).m_sz;
+			btCollisionObject* colObj0 = collisionObjects[i];
+			m_islandBodies.push_back(colObj0);
+			if (colObj0->isActive())
+				islandSleeping = false;
+		}
 
-		//int islandId;
+		//find the accompanying contact manifold for this islandId
+		int numIslandManifolds = 0;
 
-		
+		if (startManifoldIndex<numManifolds)
+		{
+			int curIslandId = getIslandId(m_islandmanifold[startManifoldIndex]);
+			if (curIslandId == islandId)
+			{
+				for (endManifoldIndex = startManifoldIndex+1;(endManifoldIndex<numManifolds) && (islandId == getIslandId(m_islandmanifold[endManifoldIndex]));endManifoldIndex++)
+				{
 
-	//	printf("Start Islands\n");
+				}
+				numIslandManifolds = endManifoldIndex-startManifoldIndex;
+			}
+		}
 
-		//traverse the simulation islands, and call the solver, unless all objects are sleeping/deactivated
-		for ( startIslandIndex=0;startIslandIndex<numElem;startIslandIndex = endIslandIndex)
+		if (islandSleeping)
 		{
-			int islandId = getUnionFind().getElement(startIslandIndex).m_id;
+			m_islandBodies.resize(firstBody);
+		}
+		else
+		{
+			Island& island = islands.expand();
+			island.m_id = islandId;
+			island.m_firstBody = firstBody;
+			island.m_numBodies = m_islandBodies.size() - firstBody;
+			island.m_firstManifold = startManifoldIndex;
+			island.m_numManifolds = numIslandManifolds;
+		}
 
+		if (numIslandManifolds)
+		{
+			startManifoldIndex = endManifoldIndex;
+		}
+	}
+}
 
-			   bool islandSleeping = true;
-	                
-					for (endIslandIndex = startIslandIndex;(endIslandIndex<numElem) && (getUnionFind().getElement(endIslandIndex).m_id == islandId);endIslandIndex++)
-					{
-							int i = getUnionFind().getElement(endIslandIndex).m_sz;
-							btCollisionObject* colObj0 = collisionObjects[i];
-							m_islandBodies.push_back(colObj0);
-							if (colObj0->isActive())
-									islandSleeping = false;
-					}
-	                
 
-			//find the accompanying contact manifold for this islandId
-			int numIslandManifolds = 0;
-			btPersistentManifold** startManifold = 0;
+///@todo: this is random access, it can be walked 'cache friendly'!
+void btSimulationIslandManager::buildAndProcessIslands(btDispatcher* dispatcher,btCollisionWorld* collisionWorld, IslandCallback* callback)
+{
+	btCollisionObjectArray& collisionObjects = collisionWorld->getCollisionObjectArray();
 
-			if (startManifoldIndex<numManifolds)
-			{
-				int curIslandId = getIslandId(m_islandmanifold[startManifoldIndex]);
-				if (curIslandId == islandId)
-				{
-					startManifold = &m_islandmanifold[startManifoldIndex];
-				
-					for (endManifoldIndex = startManifoldIndex+1;(endManifoldIndex<numManifolds) && (islandId == getIslandId(m_islandmanifold[endManifoldIndex]));endManifoldIndex++)
-					{
+	if(!m_splitIslands)
+	{
+		buildIslands(dispatcher,collisionWorld);
 
-					}
-					/// Process the actual simulation, only if not sleeping/deactivated
-					numIslandManifolds = endManifoldIndex-startManifoldIndex;
-				}
+		BT_PROFILE("processIslands");
 
-			}
+		btPersistentManifold** manifold = dispatcher->getInternalManifoldPointer();
+		int maxNumManifolds = dispatcher->getNumManifolds();
+		callback->processIsland(&collisionObjects[0],collisionObjects.size(),manifold,maxNumManifolds, -1);
+	}
+	else
+	{
+		buildIslandList(dispatcher,collisionWorld,m_islands);
 
-			if (!islandSleeping)
-			{
-				callback->processIsland(&m_islandBodies[0],m_islandBodies.size(),startManifold,numIslandManifolds, islandId);
-	//			printf("Island callback of size:%d bodies, %d manifolds\n",islandBodies.size(),numIslandManifolds);
-			}
-			
-			if (numIslandManifolds)
-			{
-				startManifoldIndex = endManifoldIndex;
-			}
+		BT_PROFILE("processIslands");
 
-			m_islandBodies.resize(0);
+		//now process all active islands (sets of manifolds for now)
+		for (int i=0;i<m_islands.size();i++)
+		{
+			const Island& island = m_islands[i];
+			btPersistentManifold** startManifold = island.m_numManifolds ? &m_islandmanifold[island.m_firstManifold] : 0;
+			callback->processIsland(&m_islandBodies[island.m_firstBody],island.m_numBodies,startManifold,island.m_numManifolds, island.m_id);
 		}
+
+		m_islandBodies.resize(0);
 	} // else if(!splitIslands) 
 
 }
@@ -25,9 +25,14 @@ class btCollisionObject;
 class btCollisionWorld;
 class btDispatcher;
 class btPersistentManifold;
+class btITaskScheduler;
+struct btIslandGatherMt;
 
 
 ///SimulationIslandManager creates and handles simulation islands, using btUnionFind
+///With a task scheduler the unions of the overlapping pairs are found with a btConcurrentUnionFind, and the islands are gathered
+///by counting their bodies and manifolds, a prefix sum over the counts and a scatter, all on the scheduler. The islands then come
+///with their bodies and manifolds in collision object and manifold order, and with the smallest body index of each as its id.
 class btSimulationIslandManager
 {
 	btUnionFind m_unionFind;
@@ -36,7 +41,24 @@ class btSimulationIslandManager
 	btAlignedObjectArray<btCollisionObject* >  m_islandBodies;
 	
 	bool m_splitIslands;
+
+	btITaskScheduler*	m_taskScheduler;
+	btIslandGatherMt*	m_gatherMt;
 	
+public:
+	///awake island, as ranges of getIslandBodyArray and getIslandManifoldArray
+	struct	Island
+	{
+		int	m_id;
+		int	m_firstBody;
+		int	m_numBodies;
+		int	m_firstManifold;
+		int	m_numManifolds;
+	};
+
+private:
+	btAlignedObjectArray<Island>	m_islands;
+
 public:
 	btSimulationIslandManager();
 	virtual ~btSimulationIslandManager();
@@ -66,6 +88,20 @@ public:
 
 	void buildIslands(btDispatcher* dispatcher,btCollisionWorld* colWorld);
 
+	///builds the islands and lists the awake ones in ascending id order, without processing them.
+	///The ranges stay valid until the next build
+	void	buildIslandList(btDispatcher* dispatcher,btCollisionWorld* collisionWorld, btAlignedObjectArray<Island>& islands);
+
+	btAlignedObjectArray<btCollisionObject*>& getIslandBodyArray()
+	{
+		return m_islandBodies;
+	}
+
+	btAlignedObjectArray<btPersistentManifold*>& getIslandManifoldArray()
+	{
+		return m_islandmanifold;
+	}
+
 	bool getSplitIslands()
 	{
 		return m_splitIslands;
@@ -75,6 +111,15 @@ public:
 		m_splitIslands = doSplitIslands;
 	}
 
+	///the union find and the island gather run on the calling thread without a scheduler.
+	///The loops over objects, pairs and manifolds are split into ranges of grainSize
+	void	setTaskScheduler(btITaskScheduler* scheduler, int grainSize = 1024);
+
+	btITaskScheduler*	getTaskScheduler() const
+	{
+		return m_taskScheduler;
+	}
+
 };
 
 #endif //BT_SIMULATION_ISLAND_MANAGER_H
@@ -14,6 +14,9 @@ subject to the following restrictions:
 */
 
 #include "btUnionFind.h"
+#include "LinearMath/btAlignedAllocator.h"
+
+#include <new>
 
 
 
@@ -80,3 +83,32 @@ void	btUnionFind::sortIslands()
 	  m_elements.quickSort(btUnionFindElementSortPredicate());
 
 }
+
+
+
+btConcurrentUnionFind::btConcurrentUnionFind()
+	:m_parents(0),
+	m_numElements(0),
+	m_capacity(0)
+{
+}
+
+btConcurrentUnionFind::~btConcurrentUnionFind()
+{
+	btAlignedFree(m_parents);
+}
+
+void	btConcurrentUnionFind::reset(int N)
+{
+	if (N > m_capacity)
+	{
+		btAlignedFree(m_parents);
+		m_parents = (std::atomic<int>*)btAlignedAlloc(sizeof(std::atomic<int>) * N, 16);
+		m_capacity = N;
+	}
+
+	for (int i = 0; i < N; i++)
+		new (&m_parents[i]) std::atomic<int>(i);
+
+	m_numElements = N;
+}
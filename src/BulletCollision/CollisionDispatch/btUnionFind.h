@@ -18,6 +18,8 @@ subject to the following restrictions:
 
 #include "LinearMath/btAlignedObjectArray.h"
 
+#include <atomic>
+
 #define USE_PATH_COMPRESSION 1
 
 ///see for discussion of static island optimizations by Vroonsh here: http://code.google.com/p/bullet/issues/detail?id=406
@@ -99,6 +101,14 @@ class btUnionFind
 #endif //USE_PATH_COMPRESSION
 		}
 
+		///find without path compression, can be called concurrently as long as nothing is united
+		int findRoot(int x) const
+		{
+			while (x != m_elements[x].m_id)
+				x = m_elements[x].m_id;
+			return x;
+		}
+
 		int find(int x)
 		{ 
 			//btAssert(x < m_N);
@@ -125,5 +135,66 @@ class btUnionFind
 
   };
 
+///btConcurrentUnionFind calculates connected subsets, with unite and find called from several threads at once.
+///A root is linked under the other root with a compare and swap, always under the one with the smaller index, so each subset
+///ends up with its smallest element as the root whatever the order of the unions. find halves the paths it walks.
+class btConcurrentUnionFind
+{
+	std::atomic<int>*	m_parents;
+	int					m_numElements;
+	int					m_capacity;
+
+	btConcurrentUnionFind(const btConcurrentUnionFind&);
+	btConcurrentUnionFind& operator=(const btConcurrentUnionFind&);
+
+public:
+
+	btConcurrentUnionFind();
+	~btConcurrentUnionFind();
+
+	///not thread safe
+	void	reset(int N);
+
+	int		getNumElements() const
+	{
+		return m_numElements;
+	}
+
+	int		find(int x)
+	{
+		for (;;)
+		{
+			int parent = m_parents[x].load(std::memory_order_relaxed);
+			if (parent == x)
+				return x;
+
+			const int grandParent = m_parents[parent].load(std::memory_order_relaxed);
+			if (grandParent != parent)
+				m_parents[x].compare_exchange_weak(parent, grandParent, std::memory_order_relaxed);
+			x = grandParent;
+		}
+	}
+
+	void	unite(int p, int q)
+	{
+		for (;;)
+		{
+			int i = find(p), j = find(q);
+			if (i == j)
+				return;
+
+			if (i < j)
+			{
+				const int tmp = i; i = j; j = tmp;
+			}
+
+			//fails when another thread linked i meanwhile, then retry from the new roots
+			int expected = i;
+			if (m_parents[i].compare_exchange_strong(expected, j, std::memory_order_relaxed))
+				return;
+		}
+	}
+};
+
 
 #endif //BT_UNION_FIND_H
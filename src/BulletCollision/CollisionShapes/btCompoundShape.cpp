@@ -24,7 +24,9 @@ m_localAabbMax(btScalar(-BT_LARGE_FLOAT),btScalar(-BT_LARGE_FLOAT),btScalar(-BT_
 m_dynamicAabbTree(0),
 m_updateRevision(1),
 m_collisionMargin(btScalar(0.)),
-m_localScaling(btScalar(1.),btScalar(1.),btScalar(1.))
+m_localScaling(btScalar(1.),btScalar(1.),btScalar(1.)),
+m_childrenGeneration(1),
+m_leavesGeneration(0)
 {
 	m_shapeType = COMPOUND_SHAPE_PROXYTYPE;
 
@@ -51,6 +53,7 @@ btCompoundShape::~btCompoundShape()
 void	btCompoundShape::addChildShape(const btTransform& localTransform,btCollisionShape* shape)
 {
 	m_updateRevision++;
+	m_childrenGeneration++;
 	//m_childTransforms.push_back(localTransform);
 	//m_childShapes.push_back(shape);
 	btCompoundShapeChild child;
@@ -90,6 +93,7 @@ void	btCompoundShape::addChildShape(const btTransform& localTransform,btCollisio
 void	btCompoundShape::updateChildTransform(int childIndex, const btTransform& newChildTransform,bool shouldRecalculateLocalAabb)
 {
 	m_children[childIndex].m_transform = newChildTransform;
+	m_childrenGeneration++;
 
 	if (m_dynamicAabbTree)
 	{
@@ -110,6 +114,7 @@ void	btCompoundShape::updateChildTransform(int childIndex, const btTransform& ne
 void btCompoundShape::removeChildShapeByIndex(int childShapeIndex)
 {
 	m_updateRevision++;
+	m_childrenGeneration++;
 	btAssert(childShapeIndex >=0 && childShapeIndex < m_children.size());
 	if (m_dynamicAabbTree)
 	{
@@ -146,6 +151,7 @@ void btCompoundShape::recalculateLocalAabb()
 {
 	// Recalculate the local aabb
 	// Brute force, it iterates over all the shapes left.
+	m_childrenGeneration++;
 
 	m_localAabbMin = btVector3(btScalar(BT_LARGE_FLOAT),btScalar(BT_LARGE_FLOAT),btScalar(BT_LARGE_FLOAT));
 	m_localAabbMax = btVector3(btScalar(-BT_LARGE_FLOAT),btScalar(-BT_LARGE_FLOAT),btScalar(-BT_LARGE_FLOAT));
@@ -165,6 +171,56 @@ void btCompoundShape::recalculateLocalAabb()
 	}
 }
 
+void btCompoundShape::updateLeaves()
+{
+	if (m_leavesGeneration == m_childrenGeneration)
+	{
+		int i = 0;
+		while (i < m_nestedCompounds.size() && m_nestedCompounds[i].m_shape->m_childrenGeneration == m_nestedCompounds[i].m_generation)
+			i++;
+
+		if (i == m_nestedCompounds.size())
+			return;
+	}
+
+	m_leaves.resizeNoInitialize(0);
+	m_nestedCompounds.resizeNoInitialize(0);
+
+	btTransform identity;
+	identity.setIdentity();
+	addLeaves(this, identity, -1);
+
+	m_leavesGeneration = m_childrenGeneration;
+}
+
+void btCompoundShape::addLeaves(const btCompoundShape* compound, const btTransform& parentTransform, int childIndex)
+{
+	for (int i = 0; i < compound->m_children.size(); i++)
+	{
+		const btCompoundShapeChild& child = compound->m_children[i];
+		const btTransform trans = parentTransform * child.m_transform;
+		const int topIndex = childIndex < 0 ? i : childIndex;
+
+		if (child.m_childShape->getShapeType() == COMPOUND_SHAPE_PROXYTYPE)
+		{
+			const btCompoundShape* nested = static_cast<const btCompoundShape*>(child.m_childShape);
+			NestedCompound nc;
+			nc.m_shape = nested;
+			nc.m_generation = nested->m_childrenGeneration;
+			m_nestedCompounds.push_back(nc);
+
+			addLeaves(nested, trans, topIndex);
+			continue;
+		}
+
+		btCompoundShapeLeaf leaf;
+		leaf.m_transform = trans;
+		leaf.m_shape = child.m_childShape;
+		leaf.m_childIndex = topIndex;
+		m_leaves.push_back(leaf);
+	}
+}
+
 ///getAabb's default implementation is brute force, expected derived classes to implement a fast dedicated version
 void btCompoundShape::getAabb(const btTransform& trans,btVector3& aabbMin,btVector3& aabbMax) const
 {
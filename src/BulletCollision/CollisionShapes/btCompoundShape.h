@@ -38,6 +38,21 @@ ATTRIBUTE_ALIGNED16(struct) btCompoundShapeChild
 	struct btDbvtNode*	m_node;
 };
 
+///leaf shape of a compound hierarchy, nested compounds are expanded into their leaves
+ATTRIBUTE_ALIGNED16(struct) btCompoundShapeLeaf
+{
+	BT_DECLARE_ALIGNED_ALLOCATOR();
+
+	btCompoundShapeLeaf()
+		: m_transform(btTransform::getIdentity()), m_shape(0), m_childIndex(-1)
+	{
+	}
+
+	btTransform			m_transform;	///relative to the top compound
+	btCollisionShape*	m_shape;
+	int					m_childIndex;	///direct child of the top compound the leaf belongs to
+};
+
 SIMD_FORCE_INLINE bool operator==(const btCompoundShapeChild& c1, const btCompoundShapeChild& c2)
 {
 	return  ( c1.m_transform      == c2.m_transform &&
@@ -67,6 +82,21 @@ protected:
 
 	btVector3	m_localScaling;
 
+	///incremented on every change of the children or their transforms, m_leaves are valid while m_leavesGeneration matches
+	int								m_childrenGeneration;
+	int								m_leavesGeneration;
+
+	struct NestedCompound
+	{
+		const btCompoundShape*	m_shape;
+		int						m_generation;
+	};
+
+	btAlignedObjectArray<btCompoundShapeLeaf>	m_leaves;
+	btAlignedObjectArray<NestedCompound>		m_nestedCompounds;
+
+	void	addLeaves(const btCompoundShape* compound, const btTransform& parentTransform, int childIndex);
+
 public:
 	BT_DECLARE_ALIGNED_ALLOCATOR();
 
@@ -171,6 +201,28 @@ public:
 		return m_updateRevision;
 	}
 
+	///changes with the children and their transforms, unlike the update revision also on updateChildTransform
+	int	getChildrenGeneration() const
+	{
+		return m_childrenGeneration;
+	}
+
+	///rebuild the flattened leaf list if the children of this or of a nested compound changed since the last call
+	///not thread safe, the leaves can be read concurrently once updated
+	void	updateLeaves();
+
+	///leaves as of the last updateLeaves
+	const btAlignedObjectArray<btCompoundShapeLeaf>&	getLeaves() const
+	{
+		return m_leaves;
+	}
+
+	///call after modifying the children through getChildList or getChildTransform, also done by recalculateLocalAabb
+	void	invalidateLeaves()
+	{
+		m_childrenGeneration++;
+	}
+
 	virtual	int	calculateSerializeBufferSize() const;
 
 	///fills the dataBuffer and returns the struct name (and 0 on failure)
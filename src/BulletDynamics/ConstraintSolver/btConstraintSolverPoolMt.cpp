@@ -0,0 +1,94 @@
+/*
+Bullet Continuous Collision Detection and Physics Library
+Copyright (c) 2003-2006 Erwin Coumans  http://continuousphysics.com/Bullet/
+
+This software is provided 'as-is', without any express or implied warranty.
+In no event will the authors be held liable for any damages arising from the use of this software.
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it freely,
+subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must not claim that you wrote the original software. If you use this software in a product, an acknowledgment in the product documentation would be appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "btConstraintSolverPoolMt.h"
+#include "btSequentialImpulseConstraintSolver.h"
+#include "LinearMath/btAlignedAllocator.h"
+
+#include <new>
+
+///solver taken by the last solveGroup call of the thread, tried first by the next one
+static thread_local int tSolverHint = 0;
+
+
+btConstraintSolverPoolMt::btConstraintSolverPoolMt(int numSolvers)
+	:m_numSolvers(numSolvers > 0 ? numSolvers : 1)
+{
+	m_solvers = (ThreadSolver*)btAlignedAlloc(sizeof(ThreadSolver) * m_numSolvers, 16);
+	for (int i = 0; i < m_numSolvers; i++)
+	{
+		ThreadSolver* ts = new (&m_solvers[i]) ThreadSolver;
+
+		void* mem = btAlignedAlloc(sizeof(btSequentialImpulseConstraintSolver), 16);
+		btSequentialImpulseConstraintSolver* solver = new (mem) btSequentialImpulseConstraintSolver;
+		solver->setSharedKinematicBodies(true);
+		ts->m_solver = solver;
+	}
+}
+
+btConstraintSolverPoolMt::~btConstraintSolverPoolMt()
+{
+	for (int i = 0; i < m_numSolvers; i++)
+	{
+		m_solvers[i].m_solver->~btConstraintSolver();
+		btAlignedFree(m_solvers[i].m_solver);
+		m_solvers[i].~ThreadSolver();
+	}
+	btAlignedFree(m_solvers);
+}
+
+btConstraintSolverPoolMt::ThreadSolver* btConstraintSolverPoolMt::lockSolver()
+{
+	const int hint = tSolverHint < m_numSolvers ? tSolverHint : 0;
+	for (int i = 0; i < m_numSolvers; i++)
+	{
+		const int index = (hint + i) % m_numSolvers;
+		if (m_solvers[index].m_mutex.try_lock())
+		{
+			tSolverHint = index;
+			return &m_solvers[index];
+		}
+	}
+
+	//more callers than solvers
+	m_solvers[hint].m_mutex.lock();
+	return &m_solvers[hint];
+}
+
+void btConstraintSolverPoolMt::prepareSolve(int numBodies, int numManifolds)
+{
+	for (int i = 0; i < m_numSolvers; i++)
+		m_solvers[i].m_solver->prepareSolve(numBodies, numManifolds);
+}
+
+btScalar btConstraintSolverPoolMt::solveGroup(btCollisionObject** bodies,int numBodies,btPersistentManifold** manifold,int numManifolds,btTypedConstraint** constraints,int numConstraints, const btContactSolverInfo& info,btIDebugDraw* debugDrawer,btDispatcher* dispatcher)
+{
+	ThreadSolver* ts = lockSolver();
+	const btScalar result = ts->m_solver->solveGroup(bodies, numBodies, manifold, numManifolds, constraints, numConstraints, info, debugDrawer, dispatcher);
+	ts->m_mutex.unlock();
+	return result;
+}
+
+void btConstraintSolverPoolMt::allSolved(const btContactSolverInfo& info,btIDebugDraw* debugDrawer)
+{
+	for (int i = 0; i < m_numSolvers; i++)
+		m_solvers[i].m_solver->allSolved(info, debugDrawer);
+}
+
+void btConstraintSolverPoolMt::reset()
+{
+	for (int i = 0; i < m_numSolvers; i++)
+		m_solvers[i].m_solver->reset();
+}
@@ -0,0 +1,73 @@
+/*
+Bullet Continuous Collision Detection and Physics Library
+Copyright (c) 2003-2006 Erwin Coumans  http://continuousphysics.com/Bullet/
+
+This software is provided 'as-is', without any express or implied warranty.
+In no event will the authors be held liable for any damages arising from the use of this software.
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it freely,
+subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must not claim that you wrote the original software. If you use this software in a product, an acknowledgment in the product documentation would be appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef BT_CONSTRAINT_SOLVER_POOL_MT_H
+#define BT_CONSTRAINT_SOLVER_POOL_MT_H
+
+#include "btConstraintSolver.h"
+
+#include <mutex>
+
+///btConstraintSolverPoolMt lets several threads call solveGroup at the same time, for groups that share no dynamic bodies.
+///Each call locks one of the solvers of the pool for its duration, preferably the one the calling thread used last.
+///With more concurrent callers than solvers the extra callers wait for a solver to become free.
+class btConstraintSolverPoolMt : public btConstraintSolver
+{
+public:
+
+	///creates numSolvers btSequentialImpulseConstraintSolver, with kinematic bodies shared between the groups
+	explicit btConstraintSolverPoolMt(int numSolvers);
+
+	virtual ~btConstraintSolverPoolMt();
+
+	int		getNumSolvers() const
+	{
+		return m_numSolvers;
+	}
+
+	btConstraintSolver*	getSolver(int index)
+	{
+		btAssert(index >= 0 && index < m_numSolvers);
+		return m_solvers[index].m_solver;
+	}
+
+	virtual void prepareSolve(int numBodies, int numManifolds);
+
+	virtual btScalar solveGroup(btCollisionObject** bodies,int numBodies,btPersistentManifold** manifold,int numManifolds,btTypedConstraint** constraints,int numConstraints, const btContactSolverInfo& info,class btIDebugDraw* debugDrawer,btDispatcher* dispatcher);
+
+	virtual void allSolved(const btContactSolverInfo& info,class btIDebugDraw* debugDrawer);
+
+	virtual	void	reset();
+
+	virtual btConstraintSolverType	getSolverType() const
+	{
+		return m_solvers[0].m_solver->getSolverType();
+	}
+
+private:
+
+	struct ThreadSolver
+	{
+		btConstraintSolver*	m_solver;
+		std::mutex			m_mutex;
+	};
+
+	ThreadSolver*	lockSolver();
+
+	ThreadSolver*	m_solvers;
+	int				m_numSolvers;
+};
+
+#endif //BT_CONSTRAINT_SOLVER_POOL_MT_H
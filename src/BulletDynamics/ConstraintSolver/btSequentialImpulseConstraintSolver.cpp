@@ -366,6 +366,7 @@ void	btSequentialImpulseConstraintSolver::resolveSplitPenetrationImpulseCacheFri
  btSequentialImpulseConstraintSolver::btSequentialImpulseConstraintSolver()
 	 : m_resolveSingleConstraintRowGeneric(gResolveSingleConstraintRowGeneric_scalar_reference),
 	 m_resolveSingleConstraintRowLowerLimit(gResolveSingleConstraintRowLowerLimit_scalar_reference),
+	 m_sharedKinematicBodies(false),
 	 m_btSeed2(0)
  {
 
@@ -719,7 +720,19 @@ int	btSequentialImpulseConstraintSolver::getOrInitSolverBody(btCollisionObject&
 
 	int solverBodyIdA = -1;
 
-	if (body.getCompanionId() >= 0)
+	if (m_sharedKinematicBodies && body.isKinematicObject())
+	{
+		//the companion id may be in use by another solver, kinematic objects are few per group
+		const int index = m_kinematicBodies.findLinearSearch(&body);
+		if (index < m_kinematicBodies.size())
+			return m_kinematicSolverBodyIds[index];
+
+		solverBodyIdA = m_tmpSolverBodyPool.size();
+		btSolverBody& solverBody = m_tmpSolverBodyPool.expand();
+		initSolverBody(&solverBody,&body,timeStep);
+		m_kinematicBodies.push_back(&body);
+		m_kinematicSolverBodyIds.push_back(solverBodyIdA);
+	} else if (body.getCompanionId() >= 0)
 	{
 		//body has already been converted
 		solverBodyIdA = body.getCompanionId();
@@ -1171,6 +1184,8 @@ void btSequentialImpulseConstraintSolver::convertContacts(btPersistentManifold**
 btScalar btSequentialImpulseConstraintSolver::solveGroupCacheFriendlySetup(btCollisionObject** bodies, int numBodies, btPersistentManifold** manifoldPtr, int numManifolds,btTypedConstraint** constraints,int numConstraints,const btContactSolverInfo& infoGlobal,btIDebugDraw* debugDrawer)
 {
 	m_fixedBodyId = -1;
+	m_kinematicBodies.resize(0);
+	m_kinematicSolverBodyIds.resize(0);
 	BT_PROFILE("solveGroupCacheFriendlySetup");
 	(void)debugDrawer;
 
@@ -1248,7 +1263,8 @@ btScalar btSequentialImpulseConstraintSolver::solveGroupCacheFriendlySetup(btCol
 
 	for (int i = 0; i < numBodies; i++)
 	{
-		bodies[i]->setCompanionId(-1);
+		if (!(m_sharedKinematicBodies && bodies[i]->isKinematicObject()))
+			bodies[i]->setCompanionId(-1);
 	}
 
 
@@ -1875,7 +1891,8 @@ btScalar btSequentialImpulseConstraintSolver::solveGroupCacheFriendlyFinish(btCo
 	{
 		btSolverBody& solverbody = m_tmpSolverBodyPool[i];
 		btRigidBody* body = solverbody.m_originalBody;
-		if (body)
+		//kinematic velocities are not changed by the solver
+		if (body && !(m_sharedKinematicBodies && body->isKinematicObject()))
 		{
 			if (infoGlobal.m_splitImpulse)
 				solverbody.writebackVelocityAndTransform(infoGlobal.m_timeStep, infoGlobal.m_splitImpulseTurnErp);
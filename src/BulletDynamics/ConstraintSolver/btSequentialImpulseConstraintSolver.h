@@ -49,6 +49,11 @@ protected:
 	btSingleConstraintRowSolver m_resolveSingleConstraintRowGeneric;
 	btSingleConstraintRowSolver m_resolveSingleConstraintRowLowerLimit;
 
+	///solver bodies of kinematic objects, when they are shared with groups solved concurrently by other solvers
+	bool						m_sharedKinematicBodies;
+	btAlignedObjectArray<btCollisionObject*>	m_kinematicBodies;
+	btAlignedObjectArray<int>	m_kinematicSolverBodyIds;
+
 	void setupFrictionConstraint(	btSolverConstraint& solverConstraint, const btVector3& normalAxis,int solverBodyIdA,int  solverBodyIdB,
 									btManifoldPoint& cp,const btVector3& rel_pos1,const btVector3& rel_pos2,
 									btCollisionObject* colObj0,btCollisionObject* colObj1, btScalar relaxation, 
@@ -135,6 +140,17 @@ public:
 		return m_btSeed2;
 	}
 
+	///when on, the solver does not use the companion id of kinematic objects nor write their velocities back,
+	///so that groups sharing kinematic objects can be solved concurrently by different solver instances
+	void	setSharedKinematicBodies(bool shared)
+	{
+		m_sharedKinematicBodies = shared;
+	}
+	bool	getSharedKinematicBodies() const
+	{
+		return m_sharedKinematicBodies;
+	}
+
 	
 	virtual btConstraintSolverType	getSolverType() const
 	{
@@ -0,0 +1,390 @@
+/*
+Bullet Continuous Collision Detection and Physics Library
+Copyright (c) 2003-2006 Erwin Coumans  http://continuousphysics.com/Bullet/
+
+This software is provided 'as-is', without any express or implied warranty.
+In no event will the authors be held liable for any damages arising from the use of this software.
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it freely,
+subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must not claim that you wrote the original software. If you use this software in a product, an acknowledgment in the product documentation would be appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "btSequentialImpulseConstraintSolverMt.h"
+#include "BulletDynamics/Dynamics/btRigidBody.h"
+#include "LinearMath/btThreads.h"
+#include "LinearMath/btQuickprof.h"
+#include "LinearMath/btStepProfiler.h"
+
+
+///the rows of one batch, solved in chunks of grainSize rows
+struct btSequentialImpulseConstraintSolverMt::BatchLoop : public btIParallelForBody
+{
+	btSequentialImpulseConstraintSolverMt*	m_solver;
+	const int*					m_rows;
+	int							m_numRows;
+	RowPass						m_pass;
+	int							m_iteration;
+	const btContactSolverInfo*	m_info;
+
+	BatchLoop(btSequentialImpulseConstraintSolverMt* solver, const int* rows, int numRows, RowPass pass, int iteration, const btContactSolverInfo& info)
+		:m_solver(solver),
+		m_rows(rows),
+		m_numRows(numRows),
+		m_pass(pass),
+		m_iteration(iteration),
+		m_info(&info)
+	{
+	}
+
+	void forLoop(int iBegin, int iEnd) const
+	{
+		const int grainSize = m_solver->m_grainSize;
+		for (int chunk = iBegin; chunk < iEnd; chunk++)
+		{
+			const int first = chunk * grainSize;
+			m_solver->solveRows(m_rows + first, btMin(grainSize, m_numRows - first), chunk, m_pass, m_iteration, *m_info);
+		}
+	}
+};
+
+
+///rows never change the velocity of bodies without inverse mass and inertia
+static bool btIsStaticSolverBody(const btSolverBody& solverBody)
+{
+	const btRigidBody* body = solverBody.m_originalBody;
+	if (!body)
+		return true;
+
+	const btMatrix3x3& invInertia = body->getInvInertiaTensorWorld();
+	return body->getInvMass() == btScalar(0) && invInertia[0].isZero() && invInertia[1].isZero() && invInertia[2].isZero();
+}
+
+
+btSequentialImpulseConstraintSolverMt::btSequentialImpulseConstraintSolverMt()
+	:m_taskScheduler(0),
+	m_minBatchedConstraints(256),
+	m_grainSize(64),
+	m_useBatches(false)
+{
+}
+
+btSequentialImpulseConstraintSolverMt::~btSequentialImpulseConstraintSolverMt()
+{
+}
+
+void btSequentialImpulseConstraintSolverMt::buildBatches(Batches& batches, const btConstraintArray& pool, const btAlignedObjectArray<int>* order)
+{
+	const int numRows = pool.size();
+	batches.m_rows.resizeNoInitialize(numRows);
+	for (int i = 0; i < numRows; i++)
+		batches.m_rows[i] = order ? (*order)[i] : i;
+	batches.m_batchStart.resize(0);
+
+	//one bit per solver body, cleared through the list of the bodies used by the batch
+	m_bodyUsed.resize(0);
+	m_bodyUsed.resize(m_tmpSolverBodyPool.size() / 32 + 1, 0);
+	m_usedBodies.resize(0);
+
+	//every sweep over the remaining rows takes the ones not touching a body of the batch, and moves them to the front
+	int numAssigned = 0;
+	while (numAssigned < numRows)
+	{
+		batches.m_batchStart.push_back(numAssigned);
+
+		for (int i = numAssigned; i < numRows; i++)
+		{
+			const btSolverConstraint& row = pool[batches.m_rows[i]];
+			const int bodyA = row.m_solverBodyIdA;
+			const int bodyB = row.m_solverBodyIdB;
+			const bool aIsStatic = m_staticBody[bodyA];
+			const bool bIsStatic = m_staticBody[bodyB];
+
+			const unsigned aUnavailable = aIsStatic ? 0 : m_bodyUsed[bodyA >> 5] & (1u << (bodyA & 31));
+			const unsigned bUnavailable = bIsStatic ? 0 : m_bodyUsed[bodyB >> 5] & (1u << (bodyB & 31));
+			if (aUnavailable || bUnavailable)
+				continue;
+
+			if (!aIsStatic)
+			{
+				m_bodyUsed[bodyA >> 5] |= 1u << (bodyA & 31);
+				m_usedBodies.push_back(bodyA);
+			}
+			if (!bIsStatic)
+			{
+				m_bodyUsed[bodyB >> 5] |= 1u << (bodyB & 31);
+				m_usedBodies.push_back(bodyB);
+			}
+
+			if (i != numAssigned)
+				btSwap(batches.m_rows[i], batches.m_rows[numAssigned]);
+			numAssigned++;
+		}
+
+		for (int i = 0; i < m_usedBodies.size(); i++)
+			m_bodyUsed[m_usedBodies[i] >> 5] = 0;
+		m_usedBodies.resize(0);
+	}
+	batches.m_batchStart.push_back(numRows);
+
+	const int numBatches = batches.getNumBatches();
+	batches.m_batchOrder.resizeNoInitialize(numBatches);
+	for (int i = 0; i < numBatches; i++)
+		batches.m_batchOrder[i] = i;
+}
+
+void btSequentialImpulseConstraintSolverMt::shuffleBatches(Batches& batches)
+{
+	for (int j = 0; j < batches.m_batchOrder.size(); ++j)
+	{
+		int tmp = batches.m_batchOrder[j];
+		int swapi = btRandInt2(j+1);
+		batches.m_batchOrder[j] = batches.m_batchOrder[swapi];
+		batches.m_batchOrder[swapi] = tmp;
+	}
+}
+
+void btSequentialImpulseConstraintSolverMt::solveBatches(const Batches& batches, RowPass pass, int iteration, const btContactSolverInfo& infoGlobal)
+{
+	const int numBatches = batches.getNumBatches();
+	for (int i = 0; i < numBatches; i++)
+	{
+		const int batch = batches.m_batchOrder[i];
+		const int first = batches.m_batchStart[batch];
+		const int numRows = batches.m_batchStart[batch+1] - first;
+		const int numChunks = (numRows + m_grainSize - 1) / m_grainSize;
+
+		if (numChunks > 1)
+		{
+			BatchLoop loop(this, &batches.m_rows[first], numRows, pass, iteration, infoGlobal);
+			m_taskScheduler->parallelFor(0, numChunks, 1, loop);
+		}
+		else
+		{
+			solveRows(&batches.m_rows[first], numRows, 0, pass, iteration, infoGlobal);
+		}
+	}
+}
+
+void btSequentialImpulseConstraintSolverMt::solveRows(const int* rows, int numRows, int chunk, RowPass pass, int iteration, const btContactSolverInfo& infoGlobal)
+{
+	const bool simd = (infoGlobal.m_solverMode & SOLVER_SIMD) != 0;
+
+	btConstraintArray* pool;
+	switch (pass)
+	{
+	case PASS_NON_CONTACT:
+		pool = &m_tmpSolverNonContactConstraintPool;
+		break;
+	case PASS_FRICTION:
+		pool = &m_tmpSolverContactFrictionConstraintPool;
+		break;
+	case PASS_ROLLING_FRICTION:
+		pool = &m_tmpSolverContactRollingFrictionConstraintPool;
+		break;
+	default:
+		pool = &m_tmpSolverContactConstraintPool;
+	}
+
+	//the chunk has its own copies of the static bodies, other chunks of the batch run concurrently
+	btSolverBody& staticBodyA = m_staticBodyCopies[chunk*2];
+	btSolverBody& staticBodyB = m_staticBodyCopies[chunk*2+1];
+
+	for (int i = 0; i < numRows; i++)
+	{
+		btSolverConstraint& row = (*pool)[rows[i]];
+		btSolverBody& bodyA = m_staticBody[row.m_solverBodyIdA] ? staticBodyA : m_tmpSolverBodyPool[row.m_solverBodyIdA];
+		btSolverBody& bodyB = m_staticBody[row.m_solverBodyIdB] ? staticBodyB : m_tmpSolverBodyPool[row.m_solverBodyIdB];
+
+		switch (pass)
+		{
+		case PASS_NON_CONTACT:
+			if (iteration < row.m_overrideNumSolverIterations)
+			{
+				if (simd)
+					resolveSingleConstraintRowGenericSIMD(bodyA, bodyB, row);
+				else
+					resolveSingleConstraintRowGeneric(bodyA, bodyB, row);
+			}
+			break;
+
+		case PASS_CONTACT:
+			if (simd)
+				resolveSingleConstraintRowLowerLimitSIMD(bodyA, bodyB, row);
+			else
+				resolveSingleConstraintRowLowerLimit(bodyA, bodyB, row);
+			break;
+
+		case PASS_CONTACT_AND_FRICTION:
+			{
+				//the friction rows of a contact act on the same bodies
+				resolveSingleConstraintRowLowerLimitSIMD(bodyA, bodyB, row);
+				const btScalar totalImpulse = row.m_appliedImpulse;
+				if (totalImpulse > btScalar(0))
+				{
+					const int numFriction = (infoGlobal.m_solverMode & SOLVER_USE_2_FRICTION_DIRECTIONS) ? 2 : 1;
+					for (int f = 0; f < numFriction; f++)
+					{
+						btSolverConstraint& friction = m_tmpSolverContactFrictionConstraintPool[row.m_frictionIndex + f];
+						friction.m_lowerLimit = -(friction.m_friction*totalImpulse);
+						friction.m_upperLimit = friction.m_friction*totalImpulse;
+						resolveSingleConstraintRowGenericSIMD(bodyA, bodyB, friction);
+					}
+				}
+			}
+			break;
+
+		case PASS_FRICTION:
+			{
+				const btScalar totalImpulse = m_tmpSolverContactConstraintPool[row.m_frictionIndex].m_appliedImpulse;
+				if (totalImpulse > btScalar(0))
+				{
+					row.m_lowerLimit = -(row.m_friction*totalImpulse);
+					row.m_upperLimit = row.m_friction*totalImpulse;
+
+					if (simd)
+						resolveSingleConstraintRowGenericSIMD(bodyA, bodyB, row);
+					else
+						resolveSingleConstraintRowGeneric(bodyA, bodyB, row);
+				}
+			}
+			break;
+
+		case PASS_ROLLING_FRICTION:
+			{
+				const btScalar totalImpulse = m_tmpSolverContactConstraintPool[row.m_frictionIndex].m_appliedImpulse;
+				if (totalImpulse > btScalar(0))
+				{
+					btScalar rollingFrictionMagnitude = row.m_friction*totalImpulse;
+					if (rollingFrictionMagnitude > row.m_friction)
+						rollingFrictionMagnitude = row.m_friction;
+
+					row.m_lowerLimit = -rollingFrictionMagnitude;
+					row.m_upperLimit = rollingFrictionMagnitude;
+
+					if (simd)
+						resolveSingleConstraintRowGenericSIMD(bodyA, bodyB, row);
+					else
+						resolveSingleConstraintRowGeneric(bodyA, bodyB, row);
+				}
+			}
+			break;
+
+		case PASS_SPLIT_PENETRATION:
+			if (simd)
+				resolveSplitPenetrationSIMD(bodyA, bodyB, row);
+			else
+				resolveSplitPenetrationImpulseCacheFriendly(bodyA, bodyB, row);
+			break;
+		}
+	}
+}
+
+btScalar btSequentialImpulseConstraintSolverMt::solveGroupCacheFriendlyIterations(btCollisionObject** bodies,int numBodies,btPersistentManifold** manifoldPtr, int numManifolds,btTypedConstraint** constraints,int numConstraints,const btContactSolverInfo& infoGlobal,btIDebugDraw* debugDrawer)
+{
+	const int numRows = m_tmpSolverNonContactConstraintPool.size() + m_tmpSolverContactConstraintPool.size() + m_tmpSolverContactFrictionConstraintPool.size();
+	m_useBatches = m_taskScheduler && numRows && numRows >= m_minBatchedConstraints;
+
+	if (m_useBatches)
+	{
+		BT_PROFILE("buildConstraintBatches");
+
+		const int numSolverBodies = m_tmpSolverBodyPool.size();
+		m_staticBody.resize(numSolverBodies);
+		for (int i = 0; i < numSolverBodies; i++)
+			m_staticBody[i] = btIsStaticSolverBody(m_tmpSolverBodyPool[i]);
+
+		buildBatches(m_nonContactBatches, m_tmpSolverNonContactConstraintPool, &m_orderNonContactConstraintPool);
+		buildBatches(m_contactBatches, m_tmpSolverContactConstraintPool, &m_orderTmpConstraintPool);
+		buildBatches(m_frictionBatches, m_tmpSolverContactFrictionConstraintPool, &m_orderFrictionConstraintPool);
+		buildBatches(m_rollingFrictionBatches, m_tmpSolverContactRollingFrictionConstraintPool, 0);
+
+		//two static body copies for every chunk of the biggest batch
+		const Batches* allBatches[] = { &m_nonContactBatches, &m_contactBatches, &m_frictionBatches, &m_rollingFrictionBatches };
+		int maxBatchRows = 0;
+		for (int p = 0; p < 4; p++)
+		{
+			const Batches& batches = *allBatches[p];
+			for (int b = 0; b < batches.getNumBatches(); b++)
+				maxBatchRows = btMax(maxBatchRows, batches.m_batchStart[b+1] - batches.m_batchStart[b]);
+		}
+
+		const int numCopies = 2 * btMax(1, (maxBatchRows + m_grainSize - 1) / m_grainSize);
+		m_staticBodyCopies.resize(numCopies);
+		for (int i = 0; i < numCopies; i++)
+			initSolverBody(&m_staticBodyCopies[i], 0, infoGlobal.m_timeStep);
+
+		BT_STEP_PROFILE_COUNTER("contact batches", m_contactBatches.getNumBatches());
+		BT_STEP_PROFILE_COUNTER("joint row batches", m_nonContactBatches.getNumBatches());
+	}
+
+	const btScalar result = btSequentialImpulseConstraintSolver::solveGroupCacheFriendlyIterations(bodies, numBodies, manifoldPtr, numManifolds, constraints, numConstraints, infoGlobal, debugDrawer);
+	m_useBatches = false;
+	return result;
+}
+
+void btSequentialImpulseConstraintSolverMt::solveGroupCacheFriendlySplitImpulseIterations(btCollisionObject** bodies,int numBodies,btPersistentManifold** manifoldPtr, int numManifolds,btTypedConstraint** constraints,int numConstraints,const btContactSolverInfo& infoGlobal,btIDebugDraw* debugDrawer)
+{
+	if (!m_useBatches)
+	{
+		btSequentialImpulseConstraintSolver::solveGroupCacheFriendlySplitImpulseIterations(bodies, numBodies, manifoldPtr, numManifolds, constraints, numConstraints, infoGlobal, debugDrawer);
+		return;
+	}
+
+	if (infoGlobal.m_splitImpulse)
+	{
+		for (int iteration = 0; iteration < infoGlobal.m_numIterations; iteration++)
+			solveBatches(m_contactBatches, PASS_SPLIT_PENETRATION, iteration, infoGlobal);
+	}
+}
+
+btScalar btSequentialImpulseConstraintSolverMt::solveSingleIteration(int iteration, btCollisionObject** bodies ,int numBodies,btPersistentManifold** manifoldPtr, int numManifolds,btTypedConstraint** constraints,int numConstraints,const btContactSolverInfo& infoGlobal,btIDebugDraw* debugDrawer)
+{
+	if (!m_useBatches)
+		return btSequentialImpulseConstraintSolver::solveSingleIteration(iteration, bodies, numBodies, manifoldPtr, numManifolds, constraints, numConstraints, infoGlobal, debugDrawer);
+
+	//the rows of a batch are independent, only the order of the batches matters
+	if (infoGlobal.m_solverMode & SOLVER_RANDMIZE_ORDER)
+	{
+		shuffleBatches(m_nonContactBatches);
+
+		if (iteration < infoGlobal.m_numIterations)
+		{
+			shuffleBatches(m_contactBatches);
+			shuffleBatches(m_frictionBatches);
+		}
+	}
+
+	solveBatches(m_nonContactBatches, PASS_NON_CONTACT, iteration, infoGlobal);
+
+	if (iteration < infoGlobal.m_numIterations)
+	{
+		for (int j=0;j<numConstraints;j++)
+		{
+			if (constraints[j]->isEnabled())
+			{
+				int bodyAid = getOrInitSolverBody(constraints[j]->getRigidBodyA(),infoGlobal.m_timeStep);
+				int bodyBid = getOrInitSolverBody(constraints[j]->getRigidBodyB(),infoGlobal.m_timeStep);
+				btSolverBody& bodyA = m_tmpSolverBodyPool[bodyAid];
+				btSolverBody& bodyB = m_tmpSolverBodyPool[bodyBid];
+				constraints[j]->solveConstraintObsolete(bodyA,bodyB,infoGlobal.m_timeStep);
+			}
+		}
+
+		if ((infoGlobal.m_solverMode & SOLVER_SIMD) && (infoGlobal.m_solverMode & SOLVER_INTERLEAVE_CONTACT_AND_FRICTION_CONSTRAINTS))
+		{
+			solveBatches(m_contactBatches, PASS_CONTACT_AND_FRICTION, iteration, infoGlobal);
+		}
+		else
+		{
+			solveBatches(m_contactBatches, PASS_CONTACT, iteration, infoGlobal);
+			solveBatches(m_frictionBatches, PASS_FRICTION, iteration, infoGlobal);
+			solveBatches(m_rollingFrictionBatches, PASS_ROLLING_FRICTION, iteration, infoGlobal);
+		}
+	}
+
+	return 0.f;
+}
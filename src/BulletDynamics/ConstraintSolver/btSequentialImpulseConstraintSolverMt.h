@@ -0,0 +1,140 @@
+/*
+Bullet Continuous Collision Detection and Physics Library
+Copyright (c) 2003-2006 Erwin Coumans  http://continuousphysics.com/Bullet/
+
+This software is provided 'as-is', without any express or implied warranty.
+In no event will the authors be held liable for any damages arising from the use of this software.
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it freely,
+subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must not claim that you wrote the original software. If you use this software in a product, an acknowledgment in the product documentation would be appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef BT_SEQUENTIAL_IMPULSE_CONSTRAINT_SOLVER_MT_H
+#define BT_SEQUENTIAL_IMPULSE_CONSTRAINT_SOLVER_MT_H
+
+#include "btSequentialImpulseConstraintSolver.h"
+
+class btITaskScheduler;
+
+///btSequentialImpulseConstraintSolverMt solves the constraint rows of large groups on a btITaskScheduler.
+///The rows of every pool are colored into batches that share no dynamic solver body, the same greedy batching as b3GpuPgsConstraintSolver.
+///The batches are solved one after another, the rows of a batch in parallel, so the result does not depend on the thread count,
+///but it differs from the Gauss-Seidel order of btSequentialImpulseConstraintSolver.
+///Static and kinematic bodies do not split batches, the rows see them through per chunk copies that are never written back.
+///Friction rows are solved in a pass of their own after the contacts, unless SOLVER_INTERLEAVE_CONTACT_AND_FRICTION_CONSTRAINTS is set
+///with SOLVER_SIMD, then a contact is solved together with its friction rows. SOLVER_RANDMIZE_ORDER shuffles the order of the batches.
+///Groups with fewer rows than the minimum, or without a scheduler, are solved by btSequentialImpulseConstraintSolver.
+ATTRIBUTE_ALIGNED16(class) btSequentialImpulseConstraintSolverMt : public btSequentialImpulseConstraintSolver
+{
+public:
+
+	BT_DECLARE_ALIGNED_ALLOCATOR();
+
+	btSequentialImpulseConstraintSolverMt();
+
+	virtual ~btSequentialImpulseConstraintSolverMt();
+
+	void	setTaskScheduler(btITaskScheduler* scheduler)
+	{
+		m_taskScheduler = scheduler;
+	}
+
+	btITaskScheduler*	getTaskScheduler() const
+	{
+		return m_taskScheduler;
+	}
+
+	///groups with fewer contact, friction and joint rows are solved serially
+	void	setMinBatchedConstraints(int minConstraints)
+	{
+		m_minBatchedConstraints = minConstraints;
+	}
+
+	int		getMinBatchedConstraints() const
+	{
+		return m_minBatchedConstraints;
+	}
+
+	///rows of a batch solved by one task, batches with no more rows are solved on the calling thread
+	void	setGrainSize(int grainSize)
+	{
+		m_grainSize = grainSize > 0 ? grainSize : 1;
+	}
+
+	int		getGrainSize() const
+	{
+		return m_grainSize;
+	}
+
+	///rows of a constraint pool, grouped by batch
+	struct Batches
+	{
+		btAlignedObjectArray<int>	m_rows;
+		///first row of every batch in m_rows, followed by the number of rows
+		btAlignedObjectArray<int>	m_batchStart;
+		///order in which the batches are solved
+		btAlignedObjectArray<int>	m_batchOrder;
+
+		int		getNumBatches() const
+		{
+			return m_batchStart.size() ? m_batchStart.size() - 1 : 0;
+		}
+	};
+
+	///batches of the last batched group, for statistics
+	const Batches&	getContactBatches() const
+	{
+		return m_contactBatches;
+	}
+
+	const Batches&	getNonContactBatches() const
+	{
+		return m_nonContactBatches;
+	}
+
+protected:
+
+	enum RowPass
+	{
+		PASS_NON_CONTACT,
+		PASS_CONTACT,
+		PASS_CONTACT_AND_FRICTION,
+		PASS_FRICTION,
+		PASS_ROLLING_FRICTION,
+		PASS_SPLIT_PENETRATION
+	};
+
+	struct BatchLoop;
+
+	virtual btScalar solveGroupCacheFriendlyIterations(btCollisionObject** bodies,int numBodies,btPersistentManifold** manifoldPtr, int numManifolds,btTypedConstraint** constraints,int numConstraints,const btContactSolverInfo& infoGlobal,btIDebugDraw* debugDrawer);
+	virtual void solveGroupCacheFriendlySplitImpulseIterations(btCollisionObject** bodies,int numBodies,btPersistentManifold** manifoldPtr, int numManifolds,btTypedConstraint** constraints,int numConstraints,const btContactSolverInfo& infoGlobal,btIDebugDraw* debugDrawer);
+	virtual btScalar solveSingleIteration(int iteration, btCollisionObject** bodies ,int numBodies,btPersistentManifold** manifoldPtr, int numManifolds,btTypedConstraint** constraints,int numConstraints,const btContactSolverInfo& infoGlobal,btIDebugDraw* debugDrawer);
+
+	void	buildBatches(Batches& batches, const btConstraintArray& pool, const btAlignedObjectArray<int>* order);
+	void	shuffleBatches(Batches& batches);
+	void	solveBatches(const Batches& batches, RowPass pass, int iteration, const btContactSolverInfo& infoGlobal);
+	void	solveRows(const int* rows, int numRows, int chunk, RowPass pass, int iteration, const btContactSolverInfo& infoGlobal);
+
+	Batches		m_nonContactBatches;
+	Batches		m_contactBatches;
+	Batches		m_frictionBatches;
+	Batches		m_rollingFrictionBatches;
+
+	///solver bodies that are never written by the rows, they do not split batches
+	btAlignedObjectArray<bool>			m_staticBody;
+	///per chunk copies of a static solver body, used by the rows instead of the static bodies
+	btAlignedObjectArray<btSolverBody>	m_staticBodyCopies;
+	btAlignedObjectArray<unsigned>		m_bodyUsed;
+	btAlignedObjectArray<int>			m_usedBodies;
+
+	btITaskScheduler*	m_taskScheduler;
+	int					m_minBatchedConstraints;
+	int					m_grainSize;
+	bool				m_useBatches;
+};
+
+#endif //BT_SEQUENTIAL_IMPULSE_CONSTRAINT_SOLVER_MT_H
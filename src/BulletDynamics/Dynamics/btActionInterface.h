@@ -20,6 +20,7 @@ class btIDebugDraw;
 class btCollisionWorld;
 
 #include "LinearMath/btScalar.h"
+#include "LinearMath/btAlignedObjectArray.h"
 #include "btRigidBody.h"
 
 ///Basic interface to allow actions such as vehicles and characters to be updated inside a btDynamicsWorld
@@ -40,6 +41,15 @@ public:
 
 	virtual void debugDraw(btIDebugDraw* debugDrawer) = 0;
 
+	///Rigid bodies the action modifies, used to update actions with disjoint bodies concurrently (see btActionSchedule)
+	///The action may only change these bodies and query the world, it must not move other objects
+	///Returns false when the action can't tell, it is then updated alone
+	virtual bool getActionBodies(btAlignedObjectArray<btRigidBody*>& bodies) const
+	{
+		(void)bodies;
+		return false;
+	}
+
 };
 
 #endif //_BT_ACTION_INTERFACE_H
@@ -0,0 +1,100 @@
+/*
+Bullet Continuous Collision Detection and Physics Library
+Copyright (c) 2003-2006 Erwin Coumans  http://continuousphysics.com/Bullet/
+
+This software is provided 'as-is', without any express or implied warranty.
+In no event will the authors be held liable for any damages arising from the use of this software.
+Permission is granted to anyone to use this software for any purpose, 
+including commercial applications, and to alter it and redistribute it freely, 
+subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must not claim that you wrote the original software. If you use this software in a product, an acknowledgment in the product documentation would be appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "btActionSchedule.h"
+#include "btActionInterface.h"
+
+void	btActionSchedule::build(btActionInterface* const* actions, int numActions)
+{
+	m_order.resize(0);
+	m_stages.resize(0);
+	m_batchOfAction.resize(numActions);
+	m_lastBatchOfBody.clear();
+
+	//batches are numbered across the whole schedule, those before a serial action are never waited on again
+	int firstAction = 0;
+	int firstBatch = 0;
+	int endBatch = 0;
+
+	for (int i = 0; i < numActions; i++)
+	{
+		m_bodies.resize(0);
+
+		if (!actions[i]->getActionBodies(m_bodies))
+		{
+			addBatches(firstAction, i, firstBatch, endBatch);
+
+			Stage& stage = m_stages.expandNonInitializing();
+			stage.m_begin = m_order.size();
+			stage.m_end = stage.m_begin + 1;
+			stage.m_serial = true;
+			m_order.push_back(i);
+
+			firstAction = i + 1;
+			firstBatch = endBatch;
+			continue;
+		}
+
+		//first batch after all earlier actions of its bodies
+		int batch = firstBatch;
+		for (int b = 0; b < m_bodies.size(); b++)
+		{
+			const int* last = m_lastBatchOfBody.find(btHashPtr(m_bodies[b]));
+			if (last && *last >= batch)
+				batch = *last + 1;
+		}
+
+		for (int b = 0; b < m_bodies.size(); b++)
+			m_lastBatchOfBody.insert(btHashPtr(m_bodies[b]), batch);
+
+		m_batchOfAction[i] = batch;
+		if (batch >= endBatch)
+			endBatch = batch + 1;
+	}
+
+	addBatches(firstAction, numActions, firstBatch, endBatch);
+}
+
+void	btActionSchedule::addBatches(int firstAction, int endAction, int firstBatch, int endBatch)
+{
+	const int numBatches = endBatch - firstBatch;
+	if (!numBatches)
+		return;
+
+	//counting sort by batch, stable so that a batch keeps the order of its actions
+	m_batchStart.resize(0);
+	m_batchStart.resize(numBatches + 1, 0);
+
+	for (int i = firstAction; i < endAction; i++)
+		m_batchStart[m_batchOfAction[i] - firstBatch + 1]++;
+
+	for (int b = 1; b <= numBatches; b++)
+		m_batchStart[b] += m_batchStart[b - 1];
+
+	const int base = m_order.size();
+	m_order.resize(base + endAction - firstAction);
+
+	for (int i = firstAction; i < endAction; i++)
+		m_order[base + m_batchStart[m_batchOfAction[i] - firstBatch]++] = i;
+
+	//the starts got shifted to the ends of their batches
+	for (int b = 0; b < numBatches; b++)
+	{
+		Stage& stage = m_stages.expandNonInitializing();
+		stage.m_begin = base + (b ? m_batchStart[b - 1] : 0);
+		stage.m_end = base + m_batchStart[b];
+		stage.m_serial = false;
+	}
+}
@@ -0,0 +1,56 @@
+/*
+Bullet Continuous Collision Detection and Physics Library
+Copyright (c) 2003-2006 Erwin Coumans  http://continuousphysics.com/Bullet/
+
+This software is provided 'as-is', without any express or implied warranty.
+In no event will the authors be held liable for any damages arising from the use of this software.
+Permission is granted to anyone to use this software for any purpose, 
+including commercial applications, and to alter it and redistribute it freely, 
+subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must not claim that you wrote the original software. If you use this software in a product, an acknowledgment in the product documentation would be appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef BT_ACTION_SCHEDULE_H
+#define BT_ACTION_SCHEDULE_H
+
+#include "LinearMath/btAlignedObjectArray.h"
+#include "LinearMath/btHashMap.h"
+
+class btActionInterface;
+class btRigidBody;
+
+///btActionSchedule orders the actions of a world into stages, run one after another.
+///The actions of a parallel stage modify disjoint bodies and can be updated by any number of threads with the same result,
+///each body sees its actions in their original order. An action without body hints (see btActionInterface::getActionBodies)
+///gets a serial stage of its own, after the actions added before it and before the ones added after it.
+class btActionSchedule
+{
+public:
+
+	struct Stage
+	{
+		int		m_begin;	///first entry in m_order
+		int		m_end;
+		bool	m_serial;
+	};
+
+	///action indices, grouped by stage
+	btAlignedObjectArray<int>	m_order;
+	btAlignedObjectArray<Stage>	m_stages;
+
+	void	build(btActionInterface* const* actions, int numActions);
+
+private:
+
+	btAlignedObjectArray<btRigidBody*>	m_bodies;
+	btAlignedObjectArray<int>			m_batchOfAction;
+	btAlignedObjectArray<int>			m_batchStart;
+	btHashMap<btHashPtr, int>			m_lastBatchOfBody;
+
+	void	addBatches(int firstAction, int endAction, int firstBatch, int endBatch);
+};
+
+#endif //BT_ACTION_SCHEDULE_H
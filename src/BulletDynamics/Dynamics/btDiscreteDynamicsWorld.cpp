@@ -28,6 +28,8 @@ subject to the following restrictions:
 //rigidbody & constraints
 #include "BulletDynamics/Dynamics/btRigidBody.h"
 #include "BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolver.h"
+#include "BulletDynamics/ConstraintSolver/btConstraintSolverPoolMt.h"
+#include "BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolverMt.h"
 #include "BulletDynamics/ConstraintSolver/btContactSolverInfo.h"
 #include "BulletDynamics/ConstraintSolver/btTypedConstraint.h"
 #include "BulletDynamics/ConstraintSolver/btPoint2PointConstraint.h"
@@ -48,6 +50,8 @@ subject to the following restrictions:
 #include "LinearMath/btMotionState.h"
 
 #include "LinearMath/btSerializer.h"
+#include "LinearMath/btThreads.h"
+#include "LinearMath/btStepProfiler.h"
 
 #if 0
 btAlignedObjectArray<btVector3> debugContacts;
@@ -200,10 +204,207 @@ struct InplaceSolverIslandCallback : public btSimulationIslandManager::IslandCal
 
 
 
+///solves the awake simulation islands in batches, concurrently on a task scheduler
+struct IslandBatchSolverMt : public btIParallelForBody
+{
+	struct Batch
+	{
+		int	m_firstBody;
+		int	m_numBodies;
+		int	m_firstManifold;
+		int	m_numManifolds;
+		int	m_firstConstraint;
+		int	m_numConstraints;
+		///contact points and constraints, the least number of rows the batch is solved with
+		int	m_minRows;
+	};
+
+	///island with its range of sorted constraints
+	struct IslandCost
+	{
+		int	m_island;
+		int	m_firstConstraint;
+		int	m_numConstraints;
+		int	m_cost;
+	};
+
+	///biggest islands first, ties in island order to keep the batches deterministic
+	struct IslandCostPredicate
+	{
+		bool operator() (const IslandCost& lhs, const IslandCost& rhs) const
+		{
+			if (lhs.m_cost != rhs.m_cost)
+				return lhs.m_cost > rhs.m_cost;
+			return lhs.m_island < rhs.m_island;
+		}
+	};
+
+	btITaskScheduler*			m_scheduler;
+	btConstraintSolverPoolMt	m_solverPool;
+	///solves the batches with at least its minimum of batched rows on the calling thread, with their rows split over the scheduler
+	btSequentialImpulseConstraintSolverMt*	m_largeBatchSolver;
+
+	btAlignedObjectArray<btSimulationIslandManager::Island>	m_islands;
+	btAlignedObjectArray<IslandCost>	m_islandCosts;
+	btAlignedObjectArray<Batch>	m_batches;
+	///batches solved by the solver pool
+	btAlignedObjectArray<int>	m_pooledBatches;
+
+	btAlignedObjectArray<btCollisionObject*>	m_bodies;
+	btAlignedObjectArray<btPersistentManifold*>	m_manifolds;
+	btAlignedObjectArray<btTypedConstraint*>	m_constraints;
+
+	btContactSolverInfo*	m_solverInfo;
+	btIDebugDraw*			m_debugDrawer;
+	btDispatcher*			m_dispatcher;
+
+	IslandBatchSolverMt(btITaskScheduler* scheduler, int numSolvers)
+		:m_scheduler(scheduler),
+		m_solverPool(numSolvers),
+		m_largeBatchSolver(NULL),
+		m_solverInfo(NULL),
+		m_debugDrawer(NULL),
+		m_dispatcher(NULL)
+	{
+	}
+
+	///gather the islands into batches, the constraints must be sorted by island id
+	void	buildBatches(btSimulationIslandManager* islandManager, btCollisionWorld* collisionWorld, btTypedConstraint** sortedConstraints, int numConstraints)
+	{
+		BT_PROFILE("buildIslandBatches");
+
+		islandManager->buildIslandList(collisionWorld->getDispatcher(), collisionWorld, m_islands);
+
+		btAlignedObjectArray<btCollisionObject*>& islandBodies = islandManager->getIslandBodyArray();
+		btAlignedObjectArray<btPersistentManifold*>& islandManifolds = islandManager->getIslandManifoldArray();
+
+		//both the islands and the constraints are in ascending island id order
+		m_islandCosts.resize(0);
+		int c = 0;
+		for (int i = 0; i < m_islands.size(); i++)
+		{
+			const btSimulationIslandManager::Island& island = m_islands[i];
+
+			while (c < numConstraints && btGetConstraintIslandId(sortedConstraints[c]) < island.m_id)
+				c++;
+			const int firstConstraint = c;
+			while (c < numConstraints && btGetConstraintIslandId(sortedConstraints[c]) == island.m_id)
+				c++;
+
+			const int numIslandConstraints = c - firstConstraint;
+
+			//static and kinematic objects form islands of their own, with nothing to solve
+			if (island.m_numBodies == 1 && !island.m_numManifolds && !numIslandConstraints
+				&& islandBodies[island.m_firstBody]->isStaticOrKinematicObject())
+				continue;
+
+			IslandCost& cost = m_islandCosts.expand();
+			cost.m_island = i;
+			cost.m_firstConstraint = firstConstraint;
+			cost.m_numConstraints = numIslandConstraints;
+			cost.m_cost = island.m_numManifolds + numIslandConstraints;
+		}
+
+		m_islandCosts.quickSort(IslandCostPredicate());
+
+		//big islands get a batch of their own, the small ones are merged up to the minimum batch size
+		m_batches.resize(0);
+		m_bodies.resize(0);
+		m_manifolds.resize(0);
+		m_constraints.resize(0);
+
+		Batch* batch = 0;
+		for (int i = 0; i < m_islandCosts.size(); i++)
+		{
+			const IslandCost& cost = m_islandCosts[i];
+			const btSimulationIslandManager::Island& island = m_islands[cost.m_island];
+
+			if (!batch)
+			{
+				batch = &m_batches.expand();
+				batch->m_firstBody = m_bodies.size();
+				batch->m_firstManifold = m_manifolds.size();
+				batch->m_firstConstraint = m_constraints.size();
+				batch->m_minRows = 0;
+			}
+
+			int j;
+			for (j = 0; j < island.m_numBodies; j++)
+				m_bodies.push_back(islandBodies[island.m_firstBody + j]);
+			for (j = 0; j < island.m_numManifolds; j++)
+			{
+				btPersistentManifold* manifold = islandManifolds[island.m_firstManifold + j];
+				m_manifolds.push_back(manifold);
+				batch->m_minRows += manifold->getNumContacts();
+			}
+			for (j = 0; j < cost.m_numConstraints; j++)
+				m_constraints.push_back(sortedConstraints[cost.m_firstConstraint + j]);
+
+			batch->m_numBodies = m_bodies.size() - batch->m_firstBody;
+			batch->m_numManifolds = m_manifolds.size() - batch->m_firstManifold;
+			batch->m_numConstraints = m_constraints.size() - batch->m_firstConstraint;
+			batch->m_minRows += cost.m_numConstraints;
+
+			if (batch->m_numManifolds + batch->m_numConstraints >= m_solverInfo->m_minimumSolverBatchSize)
+				batch = 0;
+		}
+
+		islandBodies.resize(0);
+	}
+
+	void	solveBatches(btSimulationIslandManager* islandManager, btCollisionWorld* collisionWorld, btTypedConstraint** sortedConstraints, int numConstraints)
+	{
+		buildBatches(islandManager, collisionWorld, sortedConstraints, numConstraints);
+
+		BT_STEP_PROFILE_COUNTER("island batches", m_batches.size());
+
+		//large batches are solved one after another, each using the whole scheduler for its rows,
+		//before the remaining batches are spread over the scheduler, so the two never nest
+		m_pooledBatches.resize(0);
+		for (int b = 0; b < m_batches.size(); b++)
+		{
+			if (m_largeBatchSolver && m_batches[b].m_minRows >= m_largeBatchSolver->getMinBatchedConstraints())
+			{
+				BT_PROFILE("solveLargeIslandBatch");
+				solveBatch(m_largeBatchSolver, m_batches[b]);
+			}
+			else
+				m_pooledBatches.push_back(b);
+		}
+
+		BT_PROFILE("solveIslandBatches");
+		m_scheduler->parallelFor(0, m_pooledBatches.size(), 1, *this);
+	}
+
+	void	solveBatch(btConstraintSolver* solver, const Batch& batch)
+	{
+		btCollisionObject** bodies = batch.m_numBodies ? &m_bodies[batch.m_firstBody] : 0;
+		btPersistentManifold** manifolds = batch.m_numManifolds ? &m_manifolds[batch.m_firstManifold] : 0;
+		btTypedConstraint** constraints = batch.m_numConstraints ? &m_constraints[batch.m_firstConstraint] : 0;
+
+		solver->solveGroup(bodies, batch.m_numBodies, manifolds, batch.m_numManifolds, constraints, batch.m_numConstraints, *m_solverInfo, m_debugDrawer, m_dispatcher);
+	}
+
+	virtual void forLoop(int iBegin, int iEnd) const
+	{
+		IslandBatchSolverMt* self = const_cast<IslandBatchSolverMt*>(this);
+
+		for (int i = iBegin; i < iEnd; i++)
+		{
+			BT_PROFILE("solveIslandBatch");
+			self->solveBatch(&self->m_solverPool, m_batches[m_pooledBatches[i]]);
+		}
+	}
+};
+
+
+
 btDiscreteDynamicsWorld::btDiscreteDynamicsWorld(btDispatcher* dispatcher,btBroadphaseInterface* pairCache,btConstraintSolver* constraintSolver, btCollisionConfiguration* collisionConfiguration)
 :btDynamicsWorld(dispatcher,pairCache,collisionConfiguration),
 m_sortedConstraints	(),
 m_solverIslandCallback ( NULL ),
+m_islandBatchSolverMt ( NULL ),
+m_largeIslandSolver ( NULL ),
 m_constraintSolver(constraintSolver),
 m_gravity(0,-10,0),
 m_localTime(0),
@@ -251,6 +452,7 @@ btDiscreteDynamicsWorld::~btDiscreteDynamicsWorld()
 		m_solverIslandCallback->~InplaceSolverIslandCallback();
 		btAlignedFree(m_solverIslandCallback);
 	}
+	setIslandTaskScheduler(0, 0);
 	if (m_ownsConstraintSolver)
 	{
 
@@ -734,6 +936,24 @@ void	btDiscreteDynamicsWorld::solveConstraints(btContactSolverInfo& solverInfo)
 
 	btTypedConstraint** constraintsPtr = getNumConstraints() ? &m_sortedConstraints[0] : 0;
 
+	if (m_islandBatchSolverMt && m_islandManager->getSplitIslands())
+	{
+		IslandBatchSolverMt* mt = m_islandBatchSolverMt;
+		mt->m_solverInfo = &solverInfo;
+		mt->m_debugDrawer = getDebugDrawer();
+		mt->m_dispatcher = getCollisionWorld()->getDispatcher();
+		mt->m_largeBatchSolver = m_largeIslandSolver;
+
+		mt->m_solverPool.prepareSolve(getCollisionWorld()->getNumCollisionObjects(), getCollisionWorld()->getDispatcher()->getNumManifolds());
+		if (m_largeIslandSolver)
+			m_largeIslandSolver->prepareSolve(getCollisionWorld()->getNumCollisionObjects(), getCollisionWorld()->getDispatcher()->getNumManifolds());
+		mt->solveBatches(m_islandManager, getCollisionWorld(), constraintsPtr, m_sortedConstraints.size());
+		if (m_largeIslandSolver)
+			m_largeIslandSolver->allSolved(solverInfo, m_debugDrawer);
+		mt->m_solverPool.allSolved(solverInfo, m_debugDrawer);
+		return;
+	}
+
 	m_solverIslandCallback->setup(&solverInfo,constraintsPtr,m_sortedConstraints.size(),getDebugDrawer());
 	m_constraintSolver->prepareSolve(getCollisionWorld()->getNumCollisionObjects(), getCollisionWorld()->getDispatcher()->getNumManifolds());
 
@@ -1414,6 +1634,43 @@ btConstraintSolver* btDiscreteDynamicsWorld::getConstraintSolver()
 	return m_constraintSolver;
 }
 
+void btDiscreteDynamicsWorld::setIslandTaskScheduler(btITaskScheduler* scheduler, int numSolvers)
+{
+	if (m_islandBatchSolverMt)
+	{
+		if (scheduler && m_islandBatchSolverMt->m_solverPool.getNumSolvers() == numSolvers)
+		{
+			m_islandBatchSolverMt->m_scheduler = scheduler;
+			return;
+		}
+
+		m_islandBatchSolverMt->~IslandBatchSolverMt();
+		btAlignedFree(m_islandBatchSolverMt);
+		m_islandBatchSolverMt = 0;
+	}
+
+	if (scheduler)
+	{
+		void* mem = btAlignedAlloc(sizeof(IslandBatchSolverMt),16);
+		m_islandBatchSolverMt = new (mem) IslandBatchSolverMt(scheduler, numSolvers);
+	}
+}
+
+btITaskScheduler* btDiscreteDynamicsWorld::getIslandTaskScheduler()
+{
+	return m_islandBatchSolverMt ? m_islandBatchSolverMt->m_scheduler : 0;
+}
+
+void btDiscreteDynamicsWorld::setLargeIslandSolver(btSequentialImpulseConstraintSolverMt* solver)
+{
+	m_largeIslandSolver = solver;
+}
+
+btSequentialImpulseConstraintSolverMt* btDiscreteDynamicsWorld::getLargeIslandSolver()
+{
+	return m_largeIslandSolver;
+}
+
 
 int		btDiscreteDynamicsWorld::getNumConstraints() const
 {
@@ -28,6 +28,9 @@ class btActionInterface;
 class btPersistentManifold;
 class btIDebugDraw;
 struct InplaceSolverIslandCallback;
+struct IslandBatchSolverMt;
+class btITaskScheduler;
+class btSequentialImpulseConstraintSolverMt;
 
 #include "LinearMath/btAlignedObjectArray.h"
 
@@ -40,6 +43,8 @@ protected:
 	
     btAlignedObjectArray<btTypedConstraint*>	m_sortedConstraints;
 	InplaceSolverIslandCallback* 	m_solverIslandCallback;
+	IslandBatchSolverMt*	m_islandBatchSolverMt;
+	btSequentialImpulseConstraintSolverMt*	m_largeIslandSolver;
 
 	btConstraintSolver*	m_constraintSolver;
 
@@ -158,6 +163,20 @@ public:
 	virtual void	setConstraintSolver(btConstraintSolver* solver);
 
 	virtual btConstraintSolver* getConstraintSolver();
+
+	///solve the simulation islands concurrently on the scheduler, with numSolvers btSequentialImpulseConstraintSolver instances
+	///owned by the world. Islands are batched up to m_minimumSolverBatchSize and the biggest batches are scheduled first.
+	///Only used with split islands, the constraint solver of the world is bypassed. Pass a null scheduler to solve serially again
+	void	setIslandTaskScheduler(btITaskScheduler* scheduler, int numSolvers);
+
+	btITaskScheduler*	getIslandTaskScheduler();
+
+	///island batches with at least getMinBatchedConstraints() contact points and constraints are solved by this solver
+	///on the stepping thread, before the other batches, with the rows of the batch spread over the scheduler of the solver.
+	///Only used together with the island task scheduler, the solver is not owned by the world
+	void	setLargeIslandSolver(btSequentialImpulseConstraintSolverMt* solver);
+
+	btSequentialImpulseConstraintSolverMt*	getLargeIslandSolver();
 	
 	virtual	int		getNumConstraints() const;
 
@@ -27,8 +27,8 @@
 
 btRigidBody& btActionInterface::getFixedBody()
 {
+	//a zero mass body has zero inverse mass and inertia, set up once as actions may run concurrently
 	static btRigidBody s_fixed(0, 0,0);
-	s_fixed.setMassProps(btScalar(0.),btVector3(btScalar(0.),btScalar(0.),btScalar(0.)));
 	return s_fixed;
 }
 
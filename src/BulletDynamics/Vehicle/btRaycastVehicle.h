@@ -85,6 +85,13 @@ public:
         (void) collisionWorld;
 		updateVehicle(step);
 	}
+
+	///btActionInterface interface, wheels only push the chassis, the ground is the fixed body
+	virtual bool getActionBodies(btAlignedObjectArray<btRigidBody*>& bodies) const
+	{
+		bodies.push_back(m_chassisBody);
+		return true;
+	}
 	
 
 	///btActionInterface interface
@@ -200,7 +200,10 @@ public:
 
 #else
 
-#define	BT_PROFILE( name )
+#include "btStepProfiler.h"
+
+///without the hierarchical profiler the zones go to the step profiler, a flag test when it is disabled
+#define	BT_PROFILE( name )			BT_STEP_PROFILE( name )
 
 #endif //#ifndef BT_NO_PROFILE
 
@@ -0,0 +1,228 @@
+/*
+Bullet Continuous Collision Detection and Physics Library
+Copyright (c) 2003-2006 Erwin Coumans  http://continuousphysics.com/Bullet/
+
+This software is provided 'as-is', without any express or implied warranty.
+In no event will the authors be held liable for any damages arising from the use of this software.
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it freely,
+subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must not claim that you wrote the original software. If you use this software in a product, an acknowledgment in the product documentation would be appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "btStepProfiler.h"
+#include "btAlignedAllocator.h"
+#include "btAlignedObjectArray.h"
+
+#include <chrono>
+#include <mutex>
+#include <new>
+
+static_assert((BT_STEP_PROFILER_RING_SIZE & (BT_STEP_PROFILER_RING_SIZE - 1)) == 0, "BT_STEP_PROFILER_RING_SIZE must be a power of two");
+
+struct btStepProfileRing
+{
+	btStepProfileEvent	m_events[BT_STEP_PROFILER_RING_SIZE];
+	unsigned long long	m_head;		///total number of events written since reset
+	int					m_thread;
+};
+
+bool btStepProfiler::s_enabled = false;
+
+static std::mutex gStepProfilerMutex;
+static btAlignedObjectArray<btStepProfileRing*> gStepProfilerRings;
+static std::chrono::steady_clock::time_point gStepProfilerBase = std::chrono::steady_clock::now();
+static thread_local btStepProfileRing* tStepProfilerRing = 0;
+
+///rings are kept for the lifetime of the process, threads do not unregister
+struct btStepProfileRingRelease
+{
+	~btStepProfileRingRelease()
+	{
+		for (int i = 0; i < gStepProfilerRings.size(); i++)
+		{
+			gStepProfilerRings[i]->~btStepProfileRing();
+			btAlignedFree(gStepProfilerRings[i]);
+		}
+		gStepProfilerRings.clear();
+	}
+};
+
+static btStepProfileRingRelease gStepProfileRingRelease;
+
+static btStepProfileRing* getThreadRing()
+{
+	btStepProfileRing* ring = tStepProfilerRing;
+	if (!ring)
+	{
+		void* mem = btAlignedAlloc(sizeof(btStepProfileRing), 16);
+		ring = new (mem) btStepProfileRing;
+		ring->m_head = 0;
+
+		std::lock_guard<std::mutex> lock(gStepProfilerMutex);
+		ring->m_thread = gStepProfilerRings.size();
+		gStepProfilerRings.push_back(ring);
+		tStepProfilerRing = ring;
+	}
+	return ring;
+}
+
+void btStepProfiler::setEnabled(bool enabled)
+{
+	if (enabled && !s_enabled)
+	{
+		std::lock_guard<std::mutex> lock(gStepProfilerMutex);
+		bool empty = true;
+		for (int i = 0; i < gStepProfilerRings.size(); i++)
+			empty = empty && gStepProfilerRings[i]->m_head == 0;
+
+		if (empty)
+			gStepProfilerBase = std::chrono::steady_clock::now();
+	}
+	s_enabled = enabled;
+}
+
+void btStepProfiler::reset()
+{
+	std::lock_guard<std::mutex> lock(gStepProfilerMutex);
+	for (int i = 0; i < gStepProfilerRings.size(); i++)
+		gStepProfilerRings[i]->m_head = 0;
+	gStepProfilerBase = std::chrono::steady_clock::now();
+}
+
+unsigned long long btStepProfiler::getTime()
+{
+	return (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - gStepProfilerBase).count();
+}
+
+void btStepProfiler::recordZone(const char* name, const char* detail0, const char* detail1, unsigned long long start, unsigned long long end)
+{
+	btStepProfileRing* ring = getThreadRing();
+	btStepProfileEvent& ev = ring->m_events[ring->m_head & (BT_STEP_PROFILER_RING_SIZE - 1)];
+	ev.m_name = name;
+	ev.m_detail0 = detail0;
+	ev.m_detail1 = detail1;
+	ev.m_start = start;
+	ev.m_value = end > start ? end - start : 0;
+	ev.m_type = btStepProfileEvent::ZONE;
+	ring->m_head++;
+}
+
+void btStepProfiler::recordCounter(const char* name, unsigned long long value)
+{
+	btStepProfileRing* ring = getThreadRing();
+	btStepProfileEvent& ev = ring->m_events[ring->m_head & (BT_STEP_PROFILER_RING_SIZE - 1)];
+	ev.m_name = name;
+	ev.m_detail0 = 0;
+	ev.m_detail1 = 0;
+	ev.m_start = getTime();
+	ev.m_value = value;
+	ev.m_type = btStepProfileEvent::COUNTER;
+	ring->m_head++;
+}
+
+int btStepProfiler::getNumThreads()
+{
+	std::lock_guard<std::mutex> lock(gStepProfilerMutex);
+	return gStepProfilerRings.size();
+}
+
+int btStepProfiler::getEvents(int thread, btStepProfileEvent* events, int maxEvents)
+{
+	btStepProfileRing* ring = 0;
+	{
+		std::lock_guard<std::mutex> lock(gStepProfilerMutex);
+		if (thread < 0 || thread >= gStepProfilerRings.size())
+			return 0;
+		ring = gStepProfilerRings[thread];
+	}
+
+	const unsigned long long head = ring->m_head;
+	unsigned long long count = head < BT_STEP_PROFILER_RING_SIZE ? head : BT_STEP_PROFILER_RING_SIZE;
+	if (count > (unsigned long long)maxEvents)
+		count = maxEvents;
+
+	//the newest events are kept when the output is too small
+	for (unsigned long long i = 0; i < count; i++)
+		events[i] = ring->m_events[(head - count + i) & (BT_STEP_PROFILER_RING_SIZE - 1)];
+
+	return int(count);
+}
+
+static void writeJsonString(FILE* file, const char* str)
+{
+	for (; *str; ++str)
+	{
+		const char c = *str;
+		if (c == '"' || c == '\\')
+			fprintf(file, "\\%c", c);
+		else if ((unsigned char)c < 0x20)
+			fprintf(file, "\\u%04x", (unsigned)c);
+		else
+			fputc(c, file);
+	}
+}
+
+void btStepProfiler::exportChromeTrace(FILE* file)
+{
+	btAlignedObjectArray<btStepProfileEvent> events;
+	events.resize(BT_STEP_PROFILER_RING_SIZE);
+
+	fprintf(file, "{\"traceEvents\":[");
+	bool first = true;
+
+	const int numThreads = getNumThreads();
+	for (int t = 0; t < numThreads; t++)
+	{
+		const int count = getEvents(t, &events[0], events.size());
+		if (!count)
+			continue;
+
+		fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"bullet %d\"}}", first ? "" : ",", t, t);
+		first = false;
+
+		for (int i = 0; i < count; i++)
+		{
+			const btStepProfileEvent& ev = events[i];
+			fprintf(file, ",\n{\"name\":\"");
+			writeJsonString(file, ev.m_name);
+
+			if (ev.m_type == btStepProfileEvent::ZONE)
+			{
+				if (ev.m_detail0)
+				{
+					fputc(' ', file);
+					writeJsonString(file, ev.m_detail0);
+				}
+				if (ev.m_detail1)
+				{
+					fputc('/', file);
+					writeJsonString(file, ev.m_detail1);
+				}
+				fprintf(file, "\",\"cat\":\"bullet\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+					t, ev.m_start * 1e-3, ev.m_value * 1e-3);
+			}
+			else
+			{
+				fprintf(file, "\",\"cat\":\"bullet\",\"ph\":\"C\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"args\":{\"value\":%llu}}",
+					t, ev.m_start * 1e-3, ev.m_value);
+			}
+		}
+	}
+
+	fprintf(file, "\n],\"displayTimeUnit\":\"ns\"}\n");
+}
+
+bool btStepProfiler::exportChromeTrace(const char* fileName)
+{
+	FILE* file = fopen(fileName, "w");
+	if (!file)
+		return false;
+
+	exportChromeTrace(file);
+	fclose(file);
+	return true;
+}
@@ -0,0 +1,143 @@
+/*
+Bullet Continuous Collision Detection and Physics Library
+Copyright (c) 2003-2006 Erwin Coumans  http://continuousphysics.com/Bullet/
+
+This software is provided 'as-is', without any express or implied warranty.
+In no event will the authors be held liable for any damages arising from the use of this software.
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it freely,
+subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must not claim that you wrote the original software. If you use this software in a product, an acknowledgment in the product documentation would be appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef BT_STEP_PROFILER_H
+#define BT_STEP_PROFILER_H
+
+#include "btScalar.h"
+#include <stdio.h>
+
+///number of events kept per thread, older events are overwritten. Must be a power of two
+#ifndef BT_STEP_PROFILER_RING_SIZE
+#define BT_STEP_PROFILER_RING_SIZE 16384
+#endif
+
+///A zone or counter sample, names are static strings and are not copied
+struct btStepProfileEvent
+{
+	enum Type
+	{
+		ZONE,
+		COUNTER
+	};
+
+	const char*	m_name;
+	const char*	m_detail0;			///optional qualifiers of a zone name, e.g. the shape types of a near callback
+	const char*	m_detail1;
+	unsigned long long	m_start;	///ns since btStepProfiler::reset
+	unsigned long long	m_value;	///zone duration in ns, or the counter value
+	int			m_type;
+};
+
+///btStepProfiler records timed zones and counters into a ring buffer per thread, to be exported as a Chrome trace (chrome://tracing).
+///When disabled a zone costs a single flag test. The BT_PROFILE macro records into it when the hierarchical CProfileManager is compiled out.
+///Recording is lock free, each thread writes only its own ring. Reading (exportChromeTrace, getEvents) and reset must not run concurrently with a simulation step.
+class btStepProfiler
+{
+public:
+
+	static bool isEnabled()
+	{
+		return s_enabled;
+	}
+
+	///enabling also resets the time base on first use
+	static void setEnabled(bool enabled);
+
+	///discard all recorded events and restart the time base
+	static void reset();
+
+	///ns since the last reset
+	static unsigned long long getTime();
+
+	static void recordZone(const char* name, const char* detail0, const char* detail1, unsigned long long start, unsigned long long end);
+
+	static void recordCounter(const char* name, unsigned long long value);
+
+	///number of threads that recorded anything since startup
+	static int getNumThreads();
+
+	///copy the recorded events of a thread in chronological order of their completion, returns the number of events copied
+	static int getEvents(int thread, btStepProfileEvent* events, int maxEvents);
+
+	///write all recorded events as a Chrome trace event JSON object
+	static void exportChromeTrace(FILE* file);
+
+	///@return false if the file could not be created
+	static bool exportChromeTrace(const char* fileName);
+
+private:
+
+	static bool s_enabled;
+};
+
+///Times its scope with the step profiler
+class btStepProfileZone
+{
+public:
+
+	btStepProfileZone(const char* name)
+		: m_name(name)
+		, m_detail0(0)
+		, m_detail1(0)
+		, m_start(0)
+		, m_active(btStepProfiler::isEnabled())
+	{
+		if (m_active)
+			m_start = btStepProfiler::getTime();
+	}
+
+	bool isActive() const
+	{
+		return m_active;
+	}
+
+	void setDetail(const char* detail0, const char* detail1)
+	{
+		m_detail0 = detail0;
+		m_detail1 = detail1;
+	}
+
+	~btStepProfileZone()
+	{
+		if (m_active)
+			btStepProfiler::recordZone(m_name, m_detail0, m_detail1, m_start, btStepProfiler::getTime());
+	}
+
+private:
+
+	const char*	m_name;
+	const char*	m_detail0;
+	const char*	m_detail1;
+	unsigned long long	m_start;
+	bool		m_active;
+};
+
+#ifndef BT_NO_STEP_PROFILE
+
+#define BT_STEP_PROFILE( name )									btStepProfileZone __stepProfile( name )
+///the details are evaluated only when the profiler is enabled
+#define BT_STEP_PROFILE_DETAIL( name, detail0, detail1 )		btStepProfileZone __stepProfile( name ); if (__stepProfile.isActive()) __stepProfile.setDetail( detail0, detail1 )
+#define BT_STEP_PROFILE_COUNTER( name, value )					do { if (btStepProfiler::isEnabled()) btStepProfiler::recordCounter( name, (unsigned long long)(value) ); } while (0)
+
+#else
+
+#define BT_STEP_PROFILE( name )
+#define BT_STEP_PROFILE_DETAIL( name, detail0, detail1 )
+#define BT_STEP_PROFILE_COUNTER( name, value )
+
+#endif //BT_NO_STEP_PROFILE
+
+#endif //BT_STEP_PROFILER_H
@@ -0,0 +1,328 @@
+/*
+Bullet Continuous Collision Detection and Physics Library
+Copyright (c) 2003-2006 Erwin Coumans  http://continuousphysics.com/Bullet/
+
+This software is provided 'as-is', without any express or implied warranty.
+In no event will the authors be held liable for any damages arising from the use of this software.
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it freely,
+subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must not claim that you wrote the original software. If you use this software in a product, an acknowledgment in the product documentation would be appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "btThreadSafePoolAllocator.h"
+#include "btAlignedAllocator.h"
+#include "btMinMax.h"
+
+///end of an element list
+static const unsigned BT_POOL_NIL = 0xffffffffu;
+
+static std::mutex gPoolRegistryMutex;
+static btThreadSafePoolAllocator* gPoolRegistry[BT_THREAD_SAFE_POOL_MAX_CACHED];
+static std::atomic<unsigned long long> gPoolSerial(0);
+
+///the caches of a thread, indexed by the cache slot of the pool. A cache is reset when its serial does not match the pool,
+///so caches left behind by a destroyed pool are never used
+struct btThreadSafePoolCaches
+{
+	btThreadSafePoolCache	m_caches[BT_THREAD_SAFE_POOL_MAX_CACHED];
+
+	btThreadSafePoolCaches()
+	{
+		for (int i = 0; i < BT_THREAD_SAFE_POOL_MAX_CACHED; i++)
+		{
+			m_caches[i].m_serial = 0;
+			m_caches[i].m_head = BT_POOL_NIL;
+			m_caches[i].m_count = 0;
+		}
+	}
+
+	///return the cached elements to the pools that are still alive
+	~btThreadSafePoolCaches()
+	{
+		std::lock_guard<std::mutex> lock(gPoolRegistryMutex);
+		for (int i = 0; i < BT_THREAD_SAFE_POOL_MAX_CACHED; i++)
+		{
+			const btThreadSafePoolCache& cache = m_caches[i];
+			btThreadSafePoolAllocator* pool = gPoolRegistry[i];
+			if (cache.m_count && pool && pool->m_serial == cache.m_serial)
+				pool->pushBatch(cache.m_head, cache.m_count);
+		}
+	}
+};
+
+static thread_local btThreadSafePoolCaches tPoolCaches;
+
+
+btThreadSafePoolAllocator::btThreadSafePoolAllocator(int elemSize, int elementsPerChunk, int maxChunks)
+	:m_elemSize((btMax(elemSize, 16) + 15) & ~15),
+	m_elementsPerChunk(btMax(elementsPerChunk, 1)),
+	m_maxChunks(btMax(maxChunks, 1)),
+	m_numChunks(0),
+	m_freeBatches(BT_POOL_NIL),
+	m_usedCount(0),
+	m_highWaterMark(0),
+	m_fallbackCount(0),
+	m_cacheSlot(-1)
+{
+	btAssert((unsigned long long)m_maxChunks * m_elementsPerChunk < BT_POOL_NIL);
+
+	m_chunks = (unsigned char**)btAlignedAlloc(sizeof(unsigned char*) * m_maxChunks, 16);
+
+	m_serial = ++gPoolSerial;
+	m_sharedCache.m_serial = m_serial;
+	m_sharedCache.m_head = BT_POOL_NIL;
+	m_sharedCache.m_count = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(gPoolRegistryMutex);
+		for (int i = 0; i < BT_THREAD_SAFE_POOL_MAX_CACHED; i++)
+		{
+			if (!gPoolRegistry[i])
+			{
+				gPoolRegistry[i] = this;
+				m_cacheSlot = i;
+				break;
+			}
+		}
+	}
+
+	//the first chunk is allocated upfront, like btPoolAllocator
+	grow();
+}
+
+btThreadSafePoolAllocator::~btThreadSafePoolAllocator()
+{
+	if (m_cacheSlot >= 0)
+	{
+		std::lock_guard<std::mutex> lock(gPoolRegistryMutex);
+		gPoolRegistry[m_cacheSlot] = 0;
+	}
+
+	const int numChunks = getNumChunks();
+	for (int i = 0; i < numChunks; i++)
+		btAlignedFree(m_chunks[i]);
+	btAlignedFree(m_chunks);
+}
+
+void* btThreadSafePoolAllocator::allocate(int size, bool allowFallback)
+{
+	if (size > m_elemSize)
+		return allocateFallback(size, allowFallback);
+
+	void* mem;
+	if (m_cacheSlot >= 0)
+	{
+		mem = allocateFromCache(getCache());
+	}
+	else
+	{
+		std::lock_guard<std::mutex> lock(m_sharedCacheMutex);
+		mem = allocateFromCache(m_sharedCache);
+	}
+
+	if (!mem)
+		return allocateFallback(size, allowFallback);
+
+	const int used = m_usedCount.fetch_add(1, std::memory_order_relaxed) + 1;
+	int highWaterMark = m_highWaterMark.load(std::memory_order_relaxed);
+	while (used > highWaterMark && !m_highWaterMark.compare_exchange_weak(highWaterMark, used, std::memory_order_relaxed))
+	{
+	}
+
+	return mem;
+}
+
+void btThreadSafePoolAllocator::freeMemory(void* ptr)
+{
+	if (!ptr)
+		return;
+
+	const unsigned index = findIndex(ptr);
+	if (index == BT_POOL_NIL)
+	{
+		btAlignedFree(ptr);
+		return;
+	}
+
+	m_usedCount.fetch_sub(1, std::memory_order_relaxed);
+
+	if (m_cacheSlot >= 0)
+	{
+		freeToCache(getCache(), index);
+	}
+	else
+	{
+		std::lock_guard<std::mutex> lock(m_sharedCacheMutex);
+		freeToCache(m_sharedCache, index);
+	}
+}
+
+bool btThreadSafePoolAllocator::validPtr(const void* ptr) const
+{
+	return ptr && findIndex(ptr) != BT_POOL_NIL;
+}
+
+void btThreadSafePoolAllocator::flushThreadCache()
+{
+	std::unique_lock<std::mutex> lock(m_sharedCacheMutex, std::defer_lock);
+	if (m_cacheSlot < 0)
+		lock.lock();
+
+	btThreadSafePoolCache& cache = m_cacheSlot >= 0 ? getCache() : m_sharedCache;
+	if (cache.m_count)
+		pushBatch(cache.m_head, cache.m_count);
+
+	cache.m_head = BT_POOL_NIL;
+	cache.m_count = 0;
+}
+
+unsigned btThreadSafePoolAllocator::findIndex(const void* ptr) const
+{
+	const unsigned char* p = static_cast<const unsigned char*>(ptr);
+	const size_t chunkBytes = size_t(m_elemSize) * m_elementsPerChunk;
+
+	const int numChunks = getNumChunks();
+	for (int i = 0; i < numChunks; i++)
+	{
+		const unsigned char* chunk = m_chunks[i];
+		if (p >= chunk && p < chunk + chunkBytes)
+		{
+			const size_t offset = size_t(p - chunk);
+			btAssert(offset % m_elemSize == 0);
+			return unsigned(i) * m_elementsPerChunk + unsigned(offset / m_elemSize);
+		}
+	}
+	return BT_POOL_NIL;
+}
+
+unsigned btThreadSafePoolAllocator::popBatch()
+{
+	unsigned long long head = m_freeBatches.load(std::memory_order_acquire);
+	for (;;)
+	{
+		const unsigned index = unsigned(head);
+		if (index == BT_POOL_NIL)
+			return BT_POOL_NIL;
+
+		//the element may already be taken and reused by another thread, in which case the tag changed and the exchange fails.
+		//chunks are only freed with the pool, so the read itself is always safe
+		const unsigned next = getLinks(index)[1];
+		const unsigned long long desired = (((head >> 32) + 1) << 32) | next;
+		if (m_freeBatches.compare_exchange_weak(head, desired, std::memory_order_acquire, std::memory_order_acquire))
+			return index;
+	}
+}
+
+void btThreadSafePoolAllocator::pushBatch(unsigned head, int count)
+{
+	unsigned* links = getLinks(head);
+	links[2] = unsigned(count);
+
+	unsigned long long top = m_freeBatches.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		links[1] = unsigned(top);
+		const unsigned long long desired = (((top >> 32) + 1) << 32) | head;
+		if (m_freeBatches.compare_exchange_weak(top, desired, std::memory_order_release, std::memory_order_relaxed))
+			return;
+	}
+}
+
+bool btThreadSafePoolAllocator::grow()
+{
+	std::lock_guard<std::mutex> lock(m_growMutex);
+
+	//another thread may have grown the pool or returned a batch meanwhile
+	if (unsigned(m_freeBatches.load(std::memory_order_acquire)) != BT_POOL_NIL)
+		return true;
+
+	const int chunk = m_numChunks.load(std::memory_order_relaxed);
+	if (chunk >= m_maxChunks)
+		return false;
+
+	unsigned char* mem = (unsigned char*)btAlignedAlloc(size_t(m_elemSize) * m_elementsPerChunk, 16);
+	if (!mem)
+		return false;
+
+	m_chunks[chunk] = mem;
+	m_numChunks.store(chunk + 1, std::memory_order_release);
+
+	//batches are pushed from the end of the chunk, so that its start is handed out first
+	const unsigned first = unsigned(chunk) * m_elementsPerChunk;
+	for (int b = ((m_elementsPerChunk - 1) / BATCH_SIZE) * BATCH_SIZE; b >= 0; b -= BATCH_SIZE)
+	{
+		const int count = btMin(int(BATCH_SIZE), m_elementsPerChunk - b);
+		for (int i = 0; i < count; i++)
+			getLinks(first + b + i)[0] = i + 1 < count ? first + b + i + 1 : BT_POOL_NIL;
+
+		pushBatch(first + b, count);
+	}
+
+	return true;
+}
+
+void* btThreadSafePoolAllocator::allocateFallback(int size, bool allowFallback)
+{
+	if (!allowFallback)
+		return 0;
+
+	m_fallbackCount.fetch_add(1, std::memory_order_relaxed);
+	return btAlignedAlloc(static_cast<size_t>(size), 16);
+}
+
+void* btThreadSafePoolAllocator::allocateFromCache(btThreadSafePoolCache& cache)
+{
+	if (!cache.m_count)
+	{
+		unsigned head;
+		while ((head = popBatch()) == BT_POOL_NIL)
+		{
+			if (!grow())
+				return 0;
+		}
+
+		cache.m_head = head;
+		cache.m_count = int(getLinks(head)[2]);
+	}
+
+	const unsigned index = cache.m_head;
+	cache.m_head = getLinks(index)[0];
+	cache.m_count--;
+	return getElement(index);
+}
+
+void btThreadSafePoolAllocator::freeToCache(btThreadSafePoolCache& cache, unsigned index)
+{
+	//keep the most recently freed elements, the rest of the list goes to the global free list
+	if (cache.m_count >= 2 * BATCH_SIZE)
+	{
+		unsigned last = cache.m_head;
+		for (int i = 1; i < BATCH_SIZE; i++)
+			last = getLinks(last)[0];
+
+		const unsigned rest = getLinks(last)[0];
+		getLinks(last)[0] = BT_POOL_NIL;
+		pushBatch(rest, cache.m_count - BATCH_SIZE);
+		cache.m_count = BATCH_SIZE;
+	}
+
+	getLinks(index)[0] = cache.m_head;
+	cache.m_head = index;
+	cache.m_count++;
+}
+
+btThreadSafePoolCache& btThreadSafePoolAllocator::getCache()
+{
+	btThreadSafePoolCache& cache = tPoolCaches.m_caches[m_cacheSlot];
+	if (cache.m_serial != m_serial)
+	{
+		cache.m_serial = m_serial;
+		cache.m_head = BT_POOL_NIL;
+		cache.m_count = 0;
+	}
+	return cache;
+}
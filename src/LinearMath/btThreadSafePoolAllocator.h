@@ -0,0 +1,169 @@
+/*
+Bullet Continuous Collision Detection and Physics Library
+Copyright (c) 2003-2006 Erwin Coumans  http://continuousphysics.com/Bullet/
+
+This software is provided 'as-is', without any express or implied warranty.
+In no event will the authors be held liable for any damages arising from the use of this software.
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it freely,
+subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must not claim that you wrote the original software. If you use this software in a product, an acknowledgment in the product documentation would be appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef BT_THREAD_SAFE_POOL_ALLOCATOR_H
+#define BT_THREAD_SAFE_POOL_ALLOCATOR_H
+
+#include "btScalar.h"
+
+#include <atomic>
+#include <mutex>
+
+///maximum number of chunks a pool grows to before falling back to the heap
+#ifndef BT_THREAD_SAFE_POOL_MAX_CHUNKS
+#define BT_THREAD_SAFE_POOL_MAX_CHUNKS 64
+#endif
+
+///number of pools that can use per thread caches at the same time, further pools share one locked cache
+#ifndef BT_THREAD_SAFE_POOL_MAX_CACHED
+#define BT_THREAD_SAFE_POOL_MAX_CACHED 16
+#endif
+
+///per thread list of free elements of one pool
+struct btThreadSafePoolCache
+{
+	unsigned long long	m_serial;	///pool the elements belong to, 0 if empty
+	unsigned	m_head;
+	int			m_count;
+};
+
+///btThreadSafePoolAllocator is a pool of fixed size elements that can be used from several threads without a lock.
+///Each thread allocates from and frees into its own cache. The caches exchange batches of elements with a global lock free
+///free list, and the pool grows by chunks of elementsPerChunk when the list is empty. Requests larger than the element size
+///and requests made after the last chunk was added are served from the heap and counted, see getFallbackCount.
+///Free elements cached by a thread go back to the global list when the thread exits.
+class btThreadSafePoolAllocator
+{
+public:
+
+	///the element size is rounded up to a multiple of 16 bytes
+	btThreadSafePoolAllocator(int elemSize, int elementsPerChunk, int maxChunks = BT_THREAD_SAFE_POOL_MAX_CHUNKS);
+
+	~btThreadSafePoolAllocator();
+
+	///@param allowFallback if false, returns 0 instead of heap memory when the pool cannot serve the request
+	void*	allocate(int size, bool allowFallback = true);
+
+	///frees memory returned by allocate, including the heap fallbacks
+	void	freeMemory(void* ptr);
+
+	///true if ptr is an element of the pool
+	bool	validPtr(const void* ptr) const;
+
+	int		getElementSize() const
+	{
+		return m_elemSize;
+	}
+
+	int		getElementsPerChunk() const
+	{
+		return m_elementsPerChunk;
+	}
+
+	int		getNumChunks() const
+	{
+		return m_numChunks.load(std::memory_order_acquire);
+	}
+
+	///number of elements in the allocated chunks
+	int		getCapacity() const
+	{
+		return getNumChunks() * m_elementsPerChunk;
+	}
+
+	///number of elements currently allocated
+	int		getUsedCount() const
+	{
+		return m_usedCount.load(std::memory_order_relaxed);
+	}
+
+	///highest number of elements allocated at once since construction or resetStatistics
+	int		getHighWaterMark() const
+	{
+		return m_highWaterMark.load(std::memory_order_relaxed);
+	}
+
+	///number of requests served from the heap since construction or resetStatistics
+	int		getFallbackCount() const
+	{
+		return m_fallbackCount.load(std::memory_order_relaxed);
+	}
+
+	void	resetStatistics()
+	{
+		m_highWaterMark.store(getUsedCount(), std::memory_order_relaxed);
+		m_fallbackCount.store(0, std::memory_order_relaxed);
+	}
+
+	///return the elements cached by the calling thread to the global free list
+	void	flushThreadCache();
+
+private:
+
+	///number of elements moved between a thread cache and the global free list at once
+	enum { BATCH_SIZE = 32 };
+
+	unsigned char*	getElement(unsigned index) const
+	{
+		return m_chunks[index / m_elementsPerChunk] + size_t(index % m_elementsPerChunk) * m_elemSize;
+	}
+
+	///free element words: [0] next element, in a batch head also [1] next batch and [2] number of elements in the batch
+	unsigned*	getLinks(unsigned index) const
+	{
+		return reinterpret_cast<unsigned*>(getElement(index));
+	}
+
+	unsigned	findIndex(const void* ptr) const;
+
+	unsigned	popBatch();
+
+	void		pushBatch(unsigned head, int count);
+
+	bool		grow();
+
+	void*		allocateFallback(int size, bool allowFallback);
+
+	void*		allocateFromCache(btThreadSafePoolCache& cache);
+
+	void		freeToCache(btThreadSafePoolCache& cache, unsigned index);
+
+	btThreadSafePoolCache&	getCache();
+
+	int				m_elemSize;
+	int				m_elementsPerChunk;
+	int				m_maxChunks;
+	unsigned char**	m_chunks;
+	std::atomic<int>	m_numChunks;
+
+	///lock free stack of batches, the low word is the head element and the high word a tag against ABA
+	std::atomic<unsigned long long>	m_freeBatches;
+
+	std::atomic<int>	m_usedCount;
+	std::atomic<int>	m_highWaterMark;
+	std::atomic<int>	m_fallbackCount;
+
+	std::mutex		m_growMutex;
+
+	///index of the per thread caches of the pool, -1 when the pool uses m_sharedCache
+	int				m_cacheSlot;
+	unsigned long long	m_serial;
+	btThreadSafePoolCache	m_sharedCache;
+	std::mutex		m_sharedCacheMutex;
+
+	friend struct btThreadSafePoolCaches;
+};
+
+#endif //BT_THREAD_SAFE_POOL_ALLOCATOR_H
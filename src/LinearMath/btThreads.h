@@ -0,0 +1,52 @@
+/*
+Bullet Continuous Collision Detection and Physics Library
+Copyright (c) 2003-2006 Erwin Coumans  http://continuousphysics.com/Bullet/
+
+This software is provided 'as-is', without any express or implied warranty.
+In no event will the authors be held liable for any damages arising from the use of this software.
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it freely,
+subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must not claim that you wrote the original software. If you use this software in a product, an acknowledgment in the product documentation would be appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef BT_THREADS_H
+#define BT_THREADS_H
+
+#include "btScalar.h"
+
+///Body of a parallel loop, forLoop may be called concurrently for disjoint ranges
+class btIParallelForBody
+{
+public:
+	virtual ~btIParallelForBody() {}
+
+	virtual void forLoop(int iBegin, int iEnd) const = 0;
+};
+
+///btITaskScheduler lets the multithreaded parts of Bullet run on the task system of the application.
+///parallelFor splits [iBegin, iEnd) into ranges of about grainSize and returns when all of them are done.
+class btITaskScheduler
+{
+public:
+	virtual ~btITaskScheduler() {}
+
+	virtual void parallelFor(int iBegin, int iEnd, int grainSize, const btIParallelForBody& body) = 0;
+};
+
+///Runs the loops on the calling thread
+class btSequentialTaskScheduler : public btITaskScheduler
+{
+public:
+	virtual void parallelFor(int iBegin, int iEnd, int grainSize, const btIParallelForBody& body)
+	{
+		(void)grainSize;
+		if (iBegin < iEnd)
+			body.forLoop(iBegin, iEnd);
+	}
+};
+
+#endif //BT_THREADS_H
@@ -0,0 +1,419 @@
+#include "dbvt_query.h"
+#include "physics_cfg.h"
+
+#include <BulletCollision/CollisionDispatch/btCollisionObject.h>
+#include <BulletCollision/CollisionShapes/btCollisionShape.h>
+#include <BulletCollision/CollisionShapes/btCompoundShape.h>
+
+#include <comm/singleton.h>
+
+#include <emmintrin.h>
+#include <cfloat>
+#include <cmath>
+
+namespace bt {
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+dbvt_thread_query_stacks::dbvt_thread_query_stacks()
+    : depth(0)
+{
+    for (uint i = 0; i < MAX_NESTING; i++) {
+        stacks[i].reserve(256, false);
+        local_stacks[i].reserve(128, false);
+    }
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+dbvt_thread_query_stacks& dbvt_thread_query_stacks::get()
+{
+    THREAD_LOCAL_SINGLETON_DEF(dbvt_thread_query_stacks) stacks;
+    return *stacks;
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void dbvt_sphere_batch::build(const double3* centers, const float* radii, uint n)
+{
+    DASSERT(n > 0 && n <= MAX_QUERIES);
+
+    count = n;
+    origin = centers[0];
+
+    for (uint i = 0; i < MAX_QUERIES; i++) {
+        if (i < n) {
+            const float3 c(centers[i] - origin);
+            x[i] = c.x;
+            y[i] = c.y;
+            z[i] = c.z;
+            rad_sq[i] = radii[i] * radii[i];
+        }
+        else {
+            // negative radius never overlaps, the lanes are masked out anyway
+            x[i] = y[i] = z[i] = 0;
+            rad_sq[i] = -1;
+        }
+    }
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+static inline __m128 abs_ps(__m128 v)
+{
+    return _mm_andnot_ps(_mm_set1_ps(-0.f), v);
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+uint64 dbvt_sphere_batch::overlap(const float3& cen, const float3& half, uint64 mask) const
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 cx = _mm_set1_ps(cen.x);
+    const __m128 cy = _mm_set1_ps(cen.y);
+    const __m128 cz = _mm_set1_ps(cen.z);
+    const __m128 hx = _mm_set1_ps(half.x);
+    const __m128 hy = _mm_set1_ps(half.y);
+    const __m128 hz = _mm_set1_ps(half.z);
+
+    uint64 hits = 0;
+
+    for (uint i = 0; i < count; i += 4) {
+        if (((mask >> i) & 0xf) == 0)
+            continue;
+
+        const __m128 dx = _mm_max_ps(_mm_sub_ps(abs_ps(_mm_sub_ps(_mm_load_ps(x + i), cx)), hx), zero);
+        const __m128 dy = _mm_max_ps(_mm_sub_ps(abs_ps(_mm_sub_ps(_mm_load_ps(y + i), cy)), hy), zero);
+        const __m128 dz = _mm_max_ps(_mm_sub_ps(abs_ps(_mm_sub_ps(_mm_load_ps(z + i), cz)), hz), zero);
+        const __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+        hits |= uint64(_mm_movemask_ps(_mm_cmple_ps(d2, _mm_load_ps(rad_sq + i)))) << i;
+    }
+
+    return hits & mask;
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void dbvt_frustum_batch::build(const frustum_query* frusta, uint n)
+{
+    DASSERT(n > 0 && n <= MAX_QUERIES);
+
+    queries = frusta;
+    count = n;
+
+    for (uint q = 0; q < n; q++) {
+        const frustum_query& f = frusta[q];
+        DASSERT(f.nplanes <= MAX_PLANES);
+
+        ngroups[q] = uint8((f.nplanes + 3) / 4);
+
+        for (uint p = 0; p < uint(ngroups[q]) * 4; p++) {
+            plane_group& g = groups[q][p / 4];
+            if (p < f.nplanes) {
+                g.nx[p % 4] = f.planes[p].x;
+                g.ny[p % 4] = f.planes[p].y;
+                g.nz[p % 4] = f.planes[p].z;
+                g.w[p % 4] = f.planes[p].w;
+            }
+            else {
+                // padding plane every point is in front of
+                g.nx[p % 4] = g.ny[p % 4] = g.nz[p % 4] = 0;
+                g.w[p % 4] = 1;
+            }
+        }
+    }
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+uint64 dbvt_frustum_batch::overlap(const btDbvtNode* node, uint64 mask) const
+{
+    const btVector3 c = node->volume.Center();
+    const btVector3 h = node->volume.Extents();
+    const __m128 hx = _mm_set1_ps(float(h[0]));
+    const __m128 hy = _mm_set1_ps(float(h[1]));
+    const __m128 hz = _mm_set1_ps(float(h[2]));
+    const __m128 zero = _mm_setzero_ps();
+
+    uint64 hits = 0;
+
+    for (uint64 m = mask; m; m &= m - 1) {
+        const uint q = bit_index(m);
+        const double3& pos = queries[q].pos;
+
+        // aabb outside of any plane when even its most positive corner is behind it
+        const __m128 cx = _mm_set1_ps(float(c[0] - pos.x));
+        const __m128 cy = _mm_set1_ps(float(c[1] - pos.y));
+        const __m128 cz = _mm_set1_ps(float(c[2] - pos.z));
+
+        int outside = 0;
+        for (uint g = 0; g < ngroups[q] && !outside; g++) {
+            const plane_group& pg = groups[q][g];
+            const __m128 nx = _mm_load_ps(pg.nx);
+            const __m128 ny = _mm_load_ps(pg.ny);
+            const __m128 nz = _mm_load_ps(pg.nz);
+
+            const __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)), _mm_add_ps(_mm_mul_ps(nz, cz), _mm_load_ps(pg.w)));
+            const __m128 extent = _mm_add_ps(_mm_add_ps(_mm_mul_ps(abs_ps(nx), hx), _mm_mul_ps(abs_ps(ny), hy)), _mm_mul_ps(abs_ps(nz), hz));
+
+            outside = _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(dist, extent), zero));
+        }
+
+        if (!outside)
+            hits |= uint64(1) << q;
+    }
+
+    return hits;
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// the children of a compound can change without a change of the shape pointer or its scaling
+static inline int local_box_generation(const btCollisionShape* shape)
+{
+    return shape->isCompound() ? static_cast<const btCompoundShape*>(shape)->getChildrenGeneration() : 0;
+}
+
+static inline bool local_box_valid(const btCollisionObject* obj, const btCollisionShape* shape)
+{
+    return obj->m_otLocalBoxShape == shape
+        && obj->m_otLocalBoxScaling == shape->getLocalScaling()
+        && obj->m_otLocalBoxGeneration == local_box_generation(shape);
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+bool dbvt_frustum_batch::object_test(const btCollisionObject* obj, uint q, bool include_partial) const
+{
+    const btCollisionShape* shape = obj->getCollisionShape();
+    if (!local_box_valid(obj, shape))
+        return frustum_object_test(obj, queries[q], include_partial);
+
+    const btTransform& tr = obj->getWorldTransform();
+    const btMatrix3x3& basis = tr.getBasis();
+    const btVector3 cen = tr(obj->m_otLocalBoxCenter);
+    const btVector3& half = obj->m_otLocalBoxHalfExtents;
+    const double3& pos = queries[q].pos;
+
+    const __m128 cx = _mm_set1_ps(float(cen[0] - pos.x));
+    const __m128 cy = _mm_set1_ps(float(cen[1] - pos.y));
+    const __m128 cz = _mm_set1_ps(float(cen[2] - pos.z));
+
+    // box axes scaled by the half extents, rows of the basis are the world components
+    __m128 ax[3][3];
+    for (int a = 0; a < 3; a++) {
+        for (int k = 0; k < 3; k++) {
+            ax[a][k] = _mm_set1_ps(float(basis[k][a] * half[a]));
+        }
+    }
+
+    const __m128 zero = _mm_setzero_ps();
+
+    for (uint g = 0; g < ngroups[q]; g++) {
+        const plane_group& pg = groups[q][g];
+        const __m128 nx = _mm_load_ps(pg.nx);
+        const __m128 ny = _mm_load_ps(pg.ny);
+        const __m128 nz = _mm_load_ps(pg.nz);
+
+        const __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)), _mm_add_ps(_mm_mul_ps(nz, cz), _mm_load_ps(pg.w)));
+
+        __m128 extent = zero;
+        for (int a = 0; a < 3; a++) {
+            const __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, ax[a][0]), _mm_mul_ps(ny, ax[a][1])), _mm_mul_ps(nz, ax[a][2]));
+            extent = _mm_add_ps(extent, abs_ps(d));
+        }
+
+        if (include_partial) {
+            // box entirely behind a plane, the shape is too
+            if (_mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(dist, extent), zero)))
+                return false;
+        }
+        else if (_mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(dist, extent), zero))) {
+            // box not fully inside, the shape still can be
+            return frustum_object_test(obj, queries[q], include_partial);
+        }
+    }
+
+    return true;
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void refresh_local_box(btCollisionObject* obj)
+{
+    const btCollisionShape* shape = obj->getCollisionShape();
+    if (!shape)
+        return;
+
+    if (local_box_valid(obj, shape))
+        return;
+
+    btVector3 min, max;
+    shape->getAabb(btTransform::getIdentity(), min, max);
+
+    obj->m_otLocalBoxCenter = (min + max) * btScalar(0.5);
+    obj->m_otLocalBoxHalfExtents = (max - min) * btScalar(0.5);
+    obj->m_otLocalBoxScaling = shape->getLocalScaling();
+    obj->m_otLocalBoxGeneration = local_box_generation(shape);
+    obj->m_otLocalBoxShape = shape;
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// rounding outwards keeps the float boxes conservative
+static inline float float_down(double v)
+{
+    const float f = float(v);
+    return double(f) > v ? std::nextafter(f, -FLT_MAX) : f;
+}
+
+static inline float float_up(double v)
+{
+    const float f = float(v);
+    return double(f) < v ? std::nextafter(f, FLT_MAX) : f;
+}
+
+/// tree node waiting to be filled, its lanes are the children of the source nodes
+struct local_tree_pending
+{
+    uint idx;
+    uint nsrc;
+    const btDbvtNode* src[2];
+};
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void dbvt_local_tree::build(bt32BitAxisSweep3* broadphase, const void* tree_owner)
+{
+    THREAD_LOCAL_SINGLETON_DEF(coid::dynarray<local_tree_pending>) pending;
+    pending->reset();
+
+    btVector3 wmin, wmax;
+    broadphase->getBroadphaseAabb(wmin, wmax);
+    const btVector3 wcen = (wmin + wmax) * btScalar(0.5);
+
+    origin = double3(wcen[0], wcen[1], wcen[2]);
+    owner = tree_owner;
+    nodes.reset();
+    proxies.reset();
+    valid = true;
+
+    // the root spans both sets of the accelerator
+    local_tree_pending root;
+    root.idx = 0;
+    root.nsrc = 0;
+
+    const btDbvtBroadphase* raycast_acc = broadphase->getRaycastAccelerator();
+    DASSERT(raycast_acc);
+
+    for (int i = 0; i < 2; i++) {
+        if (raycast_acc->m_sets[i].m_root)
+            root.src[root.nsrc++] = raycast_acc->m_sets[i].m_root;
+    }
+
+    if (!root.nsrc)
+        return;
+
+    nodes.add();
+    *pending->add() = root;
+
+    local_tree_pending cur;
+
+    while (pending->pop(cur)) {
+        // inner sources are opened, two levels of the binary tree fill the 4 lanes
+        const btDbvtNode* lanes[4];
+        uint nlanes = 0;
+
+        for (uint s = 0; s < cur.nsrc; s++) {
+            const btDbvtNode* src = cur.src[s];
+            if (src->isinternal()) {
+                lanes[nlanes++] = src->childs[0];
+                lanes[nlanes++] = src->childs[1];
+            }
+            else {
+                lanes[nlanes++] = src;
+            }
+        }
+
+        node n;
+
+        for (uint l = 0; l < 4; l++) {
+            const btDbvtNode* lane = l < nlanes ? lanes[l] : 0;
+            btCollisionObject* obj = lane && lane->isleaf() && lane->data
+                ? reinterpret_cast<btCollisionObject*>(reinterpret_cast<btDbvtProxy*>(lane->data)->m_clientObject)
+                : 0;
+
+            if (!lane || (lane->isleaf() && (!obj || !obj->getBroadphaseHandle()))) {
+                n.min_x[l] = n.min_y[l] = n.min_z[l] = FLT_MAX;
+                n.max_x[l] = n.max_y[l] = n.max_z[l] = -FLT_MAX;
+                n.child[l] = 0;
+                continue;
+            }
+
+            const btVector3& mn = lane->volume.Mins();
+            const btVector3& mx = lane->volume.Maxs();
+            n.min_x[l] = float_down(mn[0] - origin.x);
+            n.min_y[l] = float_down(mn[1] - origin.y);
+            n.min_z[l] = float_down(mn[2] - origin.z);
+            n.max_x[l] = float_up(mx[0] - origin.x);
+            n.max_y[l] = float_up(mx[1] - origin.y);
+            n.max_z[l] = float_up(mx[2] - origin.z);
+
+            if (obj) {
+                n.child[l] = ~int(proxies.size());
+                *proxies.add() = obj->getBroadphaseHandle();
+            }
+            else {
+                local_tree_pending* child = pending->add();
+                child->idx = uint(nodes.size());
+                child->nsrc = 2;
+                child->src[0] = lane->childs[0];
+                child->src[1] = lane->childs[1];
+
+                n.child[l] = int(child->idx);
+                nodes.add();
+            }
+        }
+
+        nodes[cur.idx] = n;
+    }
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+uint dbvt_local_tree::overlap_aabb(const node& n, const float3& qmin, const float3& qmax)
+{
+    const __m128 ox = _mm_and_ps(_mm_cmple_ps(_mm_load_ps(n.min_x), _mm_set1_ps(qmax.x)), _mm_cmpge_ps(_mm_load_ps(n.max_x), _mm_set1_ps(qmin.x)));
+    const __m128 oy = _mm_and_ps(_mm_cmple_ps(_mm_load_ps(n.min_y), _mm_set1_ps(qmax.y)), _mm_cmpge_ps(_mm_load_ps(n.max_y), _mm_set1_ps(qmin.y)));
+    const __m128 oz = _mm_and_ps(_mm_cmple_ps(_mm_load_ps(n.min_z), _mm_set1_ps(qmax.z)), _mm_cmpge_ps(_mm_load_ps(n.max_z), _mm_set1_ps(qmin.z)));
+
+    return uint(_mm_movemask_ps(_mm_and_ps(_mm_and_ps(ox, oy), oz)));
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+uint dbvt_local_tree::overlap_sphere(const node& n, const float3& cen, float rad_sq)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 cx = _mm_set1_ps(cen.x);
+    const __m128 cy = _mm_set1_ps(cen.y);
+    const __m128 cz = _mm_set1_ps(cen.z);
+
+    // distance of the center outside the box along each axis
+    const __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_load_ps(n.min_x), cx), _mm_sub_ps(cx, _mm_load_ps(n.max_x))), zero);
+    const __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_load_ps(n.min_y), cy), _mm_sub_ps(cy, _mm_load_ps(n.max_y))), zero);
+    const __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_load_ps(n.min_z), cz), _mm_sub_ps(cz, _mm_load_ps(n.max_z))), zero);
+    const __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+    return uint(_mm_movemask_ps(_mm_cmple_ps(d2, _mm_set1_ps(rad_sq))));
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+bool frustum_object_test(const btCollisionObject* obj, const frustum_query& frustum, bool include_partial)
+{
+    const btVector3& cen = obj->getWorldTransform().getOrigin();
+    const float3 aabb_pos(float(cen[0] - frustum.pos.x), float(cen[1] - frustum.pos.y), float(cen[2] - frustum.pos.z));
+
+    for (uint8 p = 0; p < frustum.nplanes; p++) {
+        float3 n(frustum.planes[p]);
+        btVector3 min, max;
+        btTransform t(btMatrix3x3(n.x, n.y, n.z, 0., 0., 0., 0., 0., 0.));
+        obj->getCollisionShape()->getAabb(t, min, max);
+        const float np = float(max[0] - min[0]) * 0.5f;
+        const float mp = glm::dot(n, aabb_pos) + frustum.planes[p].w;
+        if ((include_partial ? mp + np : mp - np) < 0.0f) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+} //namespace bt
@@ -0,0 +1,274 @@
+#pragma once
+
+#include <comm/commtypes.h>
+#include <comm/dynarray.h>
+#include <ot/glm/glm_types.h>
+
+#include <BulletCollision/BroadphaseCollision/btAxisSweep3.h>
+#include <BulletCollision/BroadphaseCollision/btDbvtBroadphase.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+class btCollisionObject;
+
+namespace bt {
+
+struct frustum_query;
+
+/// broadphase tree traversal stack entry, mask holds the batched queries still overlapping the node
+struct dbvt_query_node
+{
+    const btDbvtNode* node;
+    uint64 mask;
+};
+
+/// traversal stack of the query_volume_* functions, can be owned by the caller to keep the queries allocation free
+typedef coid::dynarray<dbvt_query_node> dbvt_query_stack;
+
+/// traversal stack of the dbvt_local_tree queries, node indices
+typedef coid::dynarray<uint> dbvt_local_stack;
+
+/// traversal stacks of one thread, one per nesting level so that query callbacks may issue nested queries
+struct dbvt_thread_query_stacks
+{
+    static const uint MAX_NESTING = 8;
+
+    dbvt_query_stack stacks[MAX_NESTING];
+    dbvt_local_stack local_stacks[MAX_NESTING];
+    uint depth;
+
+    dbvt_thread_query_stacks();
+
+    static dbvt_thread_query_stacks& get();
+};
+
+/// borrows the traversal stacks of the calling thread for the lifetime of the scope
+struct query_stack_scope
+{
+    dbvt_query_stack& stack;
+    dbvt_local_stack& local_stack;
+
+    query_stack_scope()
+        : query_stack_scope(acquire())
+    {}
+
+    ~query_stack_scope() {
+        --dbvt_thread_query_stacks::get().depth;
+    }
+
+private:
+    explicit query_stack_scope(uint level)
+        : stack(dbvt_thread_query_stacks::get().stacks[level])
+        , local_stack(dbvt_thread_query_stacks::get().local_stacks[level])
+    {}
+
+    static uint acquire() {
+        dbvt_thread_query_stacks& ts = dbvt_thread_query_stacks::get();
+        DASSERT(ts.depth < dbvt_thread_query_stacks::MAX_NESTING);
+        return ts.depth++;
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+inline void push_dbvt_children(dbvt_query_stack& stack, const btDbvtNode* node, uint64 mask)
+{
+    dbvt_query_node* children = stack.add(2);
+    children[0].node = node->childs[0];
+    children[0].mask = mask;
+    children[1].node = node->childs[1];
+    children[1].mask = mask;
+}
+
+inline void push_dbvt_roots(dbvt_query_stack& stack, bt32BitAxisSweep3* broadphase, uint64 mask)
+{
+    const btDbvtBroadphase* raycast_acc = broadphase->getRaycastAccelerator();
+    DASSERT(raycast_acc);
+
+    for (int i = 0; i < 2; i++) {
+        if (raycast_acc->m_sets[i].m_root) {
+            dbvt_query_node* root = stack.add();
+            root->node = raycast_acc->m_sets[i].m_root;
+            root->mask = mask;
+        }
+    }
+}
+
+/// node aabb relative to the query origin, the tests then run in floats
+inline void node_aabb_local(const btDbvtNode* node, const double3& origin, float3& cen, float3& half)
+{
+    const btVector3 c = node->volume.Center();
+    const btVector3 h = node->volume.Extents();
+    cen = float3(float(c[0] - origin.x), float(c[1] - origin.y), float(c[2] - origin.z));
+    half = float3(float(h[0]), float(h[1]), float(h[2]));
+}
+
+/// sphere at the local origin vs aabb
+inline bool dbvt_sphere_overlap(const float3& cen, const float3& half, float rad_sq)
+{
+    const float dx = glm::max(glm::abs(cen.x) - half.x, 0.f);
+    const float dy = glm::max(glm::abs(cen.y) - half.y, 0.f);
+    const float dz = glm::max(glm::abs(cen.z) - half.z, 0.f);
+    return dx * dx + dy * dy + dz * dz <= rad_sq;
+}
+
+inline uint bit_index(uint64 m)
+{
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanForward64(&idx, m);
+    return uint(idx);
+#else
+    return uint(__builtin_ctzll(m));
+#endif
+}
+
+/// up to 64 spheres in SoA form, relative to the first sphere
+struct dbvt_sphere_batch
+{
+    static const uint MAX_QUERIES = 64;
+
+    double3 origin;
+    uint count;
+
+    alignas(16) float x[MAX_QUERIES];
+    alignas(16) float y[MAX_QUERIES];
+    alignas(16) float z[MAX_QUERIES];
+    alignas(16) float rad_sq[MAX_QUERIES];
+
+    void build(const double3* centers, const float* radii, uint n);
+
+    /// @return subset of mask with the spheres overlapping the aabb given relative to origin
+    uint64 overlap(const float3& cen, const float3& half, uint64 mask) const;
+};
+
+/// up to 64 frusta with the planes in SoA form, 4 planes per simd test
+struct dbvt_frustum_batch
+{
+    static const uint MAX_QUERIES = 64;
+    static const uint MAX_PLANES = 8;
+    static const uint PLANE_GROUPS = MAX_PLANES / 4;
+
+    struct plane_group
+    {
+        alignas(16) float nx[4];
+        alignas(16) float ny[4];
+        alignas(16) float nz[4];
+        alignas(16) float w[4];
+    };
+
+    const frustum_query* queries;
+    uint count;
+
+    uint8 ngroups[MAX_QUERIES];
+    plane_group groups[MAX_QUERIES][PLANE_GROUPS];
+
+    void build(const frustum_query* frusta, uint n);
+
+    /// @return subset of mask with the frusta overlapping the node aabb
+    uint64 overlap(const btDbvtNode* node, uint64 mask) const;
+
+    /// @brief Test object against all planes of frustum q at once, using the cached local box of the object
+    /// @note the box bounds the shape so partial hits are conservative, falls back to frustum_object_test when the
+    ///       local box is stale or when the box is not fully inside with include_partial false
+    bool object_test(const btCollisionObject* obj, uint q, bool include_partial) const;
+};
+
+/// @brief Broadphase tree of an external broadphase flattened into 4 wide float nodes relative to the tile origin
+/// @note built from the raycast accelerator of the sweep once the tile proxies change, queries subtract the origin once
+///       and test the 4 child boxes of a node in one simd op; leaves of proxies destroyed since the build are skipped
+struct dbvt_local_tree
+{
+    /// child boxes in SoA form, empty lanes have an inverted box
+    struct node
+    {
+        alignas(16) float min_x[4];
+        alignas(16) float min_y[4];
+        alignas(16) float min_z[4];
+        alignas(16) float max_x[4];
+        alignas(16) float max_y[4];
+        alignas(16) float max_z[4];
+
+        /// >= 0 inner node index, < 0 complement of the leaf proxy index
+        int child[4];
+    };
+
+    double3 origin;
+    const void* owner = 0;
+    coid::dynarray<node> nodes;
+    coid::dynarray<btBroadphaseProxy*> proxies;
+    bool valid = false;
+
+    /// @brief Rebuild from the current state of the broadphase
+    /// @param tree_owner m_ot_owner of the proxies, leaves with a different owner are no longer in the broadphase
+    void build(bt32BitAxisSweep3* broadphase, const void* tree_owner);
+
+    void invalidate() {
+        valid = false;
+    }
+
+    /// @brief Proxies whose aabb overlaps the box given relative to origin, stops when process_fn returns true
+    template<class fn> // bool (*fn)(btBroadphaseProxy * proxy)
+    void query_aabb(dbvt_local_stack& stack, const float3& cen, const float3& half, fn process_fn) const
+    {
+        const float3 qmin = cen - half;
+        const float3 qmax = cen + half;
+
+        traverse(stack, [&](const node& n) { return overlap_aabb(n, qmin, qmax); }, process_fn);
+    }
+
+    /// @brief Proxies whose aabb intersects the sphere given relative to origin, stops when process_fn returns true
+    template<class fn> // bool (*fn)(btBroadphaseProxy * proxy)
+    void query_sphere(dbvt_local_stack& stack, const float3& cen, float rad, fn process_fn) const
+    {
+        const float rad_sq = rad * rad;
+
+        traverse(stack, [&](const node& n) { return overlap_sphere(n, cen, rad_sq); }, process_fn);
+    }
+
+    /// @return mask of the node lanes overlapping the box
+    static uint overlap_aabb(const node& n, const float3& qmin, const float3& qmax);
+
+    /// @return mask of the node lanes intersecting the sphere
+    static uint overlap_sphere(const node& n, const float3& cen, float rad_sq);
+
+private:
+    template<class test_fn, class fn>
+    void traverse(dbvt_local_stack& stack, test_fn test, fn process_fn) const
+    {
+        DASSERT(valid);
+        if (nodes.size() == 0)
+            return;
+
+        stack.reset();
+        *stack.add() = 0;
+
+        uint idx;
+        while (stack.pop(idx)) {
+            const node& n = nodes[idx];
+
+            for (uint64 m = test(n); m; m &= m - 1) {
+                const int child = n.child[bit_index(m)];
+                if (child >= 0) {
+                    *stack.add() = uint(child);
+                    continue;
+                }
+
+                btBroadphaseProxy* proxy = proxies[~child];
+                if (proxy->m_ot_owner == owner && process_fn(proxy))
+                    return;
+            }
+        }
+    }
+};
+
+/// exact per object frustum test on the shape extents along the plane normals
+bool frustum_object_test(const btCollisionObject* obj, const frustum_query& frustum, bool include_partial);
+
+/// @brief Update the cached local box of the collision shape if the shape, its scaling or the children of a compound changed
+/// @note not thread safe, called from the simulation when the object aabb is updated
+void refresh_local_box(btCollisionObject* obj);
+
+} //namespace bt
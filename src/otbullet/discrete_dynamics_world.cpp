@@ -13,6 +13,7 @@
 #include <BulletCollision/CollisionShapes/btStaticPlaneShape.h>
 #include <BulletCollision/BroadphaseCollision/btCollisionAlgorithm.h>
 #include <BulletCollision/CollisionDispatch/btGhostObject.h>
+#include <BulletCollision/NarrowPhaseCollision/btRaycastCallback.h>
 
 #include <BulletDynamics/Dynamics/btActionInterface.h>
 
@@ -21,6 +22,7 @@
 #include <LinearMath/btIDebugDraw.h>
 #include <LinearMath/btAabbUtil2.h>
 #include <LinearMath/btQuickprof.h>
+#include <LinearMath/btStepProfiler.h>
 
 #include "ot_terrain_contact_common.h"
 
@@ -33,6 +35,8 @@
 #include <ot/glm/glm_bt.h>
 #include <ot/sys/object_cfg.h>
 
+#include <algorithm>
+
 extern unsigned int gOuterraSimulationFrame;
 
 /// tmp ////
@@ -43,6 +47,21 @@ extern unsigned int gOuterraSimulationFrame;
 
 const float g_sigma_coef = 1.f;
 
+/// upper limit of worker contexts (chunks) of the parallel terrain pass
+static const uint TERRAIN_PASS_MAX_CONTEXTS = 32;
+/// minimal number of objects processed by one terrain pass chunk
+static const uint TERRAIN_PASS_MIN_JOBS_PER_CONTEXT = 4;
+/// marks the ids of tree batches staged by a terrain worker until they are moved to the shared cache
+static const uint TREE_BATCH_STAGED_BIT = 0x80000000u;
+/// distance an object can move in any direction before its cached terrain triangles are refetched
+static const float TERRAIN_CACHE_MARGIN = 0.25f;
+/// number of terrain passes after which cached triangles are refetched anyway (terrain lod changes)
+static const uint TERRAIN_CACHE_MAX_AGE = 64;
+/// compounds with at least this many leaves query the terrain once for the whole shape first
+static const uint TERRAIN_COMPOUND_BROAD_MIN_LEAVES = 2;
+/// distance from a terrain triangle within which a compound child is still queried
+static const float TERRAIN_COMPOUND_BROAD_MARGIN = 0.1f;
+
 #ifdef _DEBUG
 
 #include <fstream>
@@ -54,7 +73,8 @@ void ot::discrete_dynamics_world::dump_triangle_list_to_obj(const char* fname, f
     q = glm::inverse(q);
 
 
-    _triangles.for_each([&](const bt::triangle& t) {
+    _terrain_contexts.for_each([&](const terrain_worker_context& ctx) {
+    ctx._triangles.for_each([&](const bt::triangle& t) {
         float4 off(t.parent_offset_p->x - off_x, t.parent_offset_p->y - off_y, t.parent_offset_p->z - off_z, 0);
 
         float4 p = q * (float4(t.a, 1) + off);
@@ -69,6 +89,7 @@ void ot::discrete_dynamics_world::dump_triangle_list_to_obj(const char* fname, f
         vtx_count += 3;
         buf << "f " << vtx_count - 2 << " " << vtx_count - 1 << " " << vtx_count << "\n";
     });
+    });
 
     std::ofstream ofs;
     ofs.open(fname);
@@ -92,6 +113,7 @@ void discrete_dynamics_world::updateAabbs()
         if (m_forceUpdateAllAabbs || colObj->isActive() || (colObj->m_otFlags & bt::OTF_TRANSFORMATION_CHANGED))
         {
             updateSingleAabb(colObj);
+            bt::refresh_local_box(colObj);
             colObj->m_otFlags &= ~bt::OTF_TRANSFORMATION_CHANGED;
         }
     }
@@ -112,10 +134,14 @@ bt::external_broadphase* discrete_dynamics_world::create_external_broadphase(con
         result->_revision = 0;
         result->_entries.clear();
         result->_procedural_objects.clear();
+        result->_local_tree.invalidate();
         delete result->_broadphase;
-        result->_broadphase = new bt32BitAxisSweep3(btVector3(min.x, min.y, min.z), btVector3(max.x, max.y, max.z), 5000);
+        result->_broadphase = new bt32BitAxisSweep3(btVector3(min.x, min.y, min.z), btVector3(max.x, max.y, max.z), bt::external_broadphase::INITIAL_CAPACITY);
     }
 
+    // cached terrain queries hold the lists of nearby broadphases
+    invalidate_terrain_cache();
+
     return result;
 }
 
@@ -133,6 +159,8 @@ void discrete_dynamics_world::delete_external_broadphase(bt::external_broadphase
         delete (proc_obj);
     });
 
+    invalidate_terrain_cache();
+
     _external_broadphase_pool.del_item_by_ptr(bp);
 }
 
@@ -140,10 +168,8 @@ void discrete_dynamics_world::delete_external_broadphase(bt::external_broadphase
 
 void discrete_dynamics_world::clean_external_broadphase_proxy_from_pairs(btBroadphaseProxy* proxy_ptr)
 {
-    _terrain_mesh_broadphase_pairs.for_each([&](btBroadphasePair& bp) {
-        btCollisionObject* obj0 = reinterpret_cast<btCollisionObject*>(bp.m_pProxy0->m_clientObject);
-        btCollisionObject* obj1 = reinterpret_cast<btCollisionObject*>(bp.m_pProxy1->m_clientObject);
-        if (proxy_ptr->m_clientObject == bp.m_pProxy0->m_clientObject || proxy_ptr->m_clientObject == bp.m_pProxy1->m_clientObject)
+    _terrain_mesh_broadphase_pairs.for_each([&](terrain_mesh_pair& bp) {
+        if (proxy_ptr->m_clientObject == bp.obj0 || proxy_ptr->m_clientObject == bp.obj1)
         {
             remove_terrain_broadphase_collision_pair(bp);
         }
@@ -153,6 +179,8 @@ void discrete_dynamics_world::clean_external_broadphase_proxy_from_pairs(btBroad
 //-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 void discrete_dynamics_world::internalSingleStepSimulation(btScalar timeStep)
 {
+    BT_PROFILE("internalSingleStepSimulation");
+
 #ifdef _PROFILING_ENABLED
     static coid::nsec_timer timer;
     static coid::nsec_timer timer1;
@@ -178,6 +206,10 @@ void discrete_dynamics_world::internalSingleStepSimulation(btScalar timeStep)
 
     createPredictiveContacts(timeStep);
 
+    if (_terrain_ccd) {
+        create_terrain_predictive_contacts(timeStep);
+    }
+
     COID_TIME_POINT(outerra_collision);
 
 #ifdef _PROFILING_ENABLED
@@ -239,7 +271,7 @@ void discrete_dynamics_world::internalSingleStepSimulation(btScalar timeStep)
 }
 
 //-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
-void discrete_dynamics_world::process_terrain_broadphases(const coid::dynarray<bt::external_broadphase*>& broadphase, btCollisionObject* col_obj)
+void discrete_dynamics_world::process_terrain_broadphases(bt::external_broadphase* const* bp_begin, bt::external_broadphase* const* bp_end, btCollisionObject* col_obj)
 {
     CPU_PROFILE_FUNCTION();
     btVector3 min, max;
@@ -254,12 +286,16 @@ void discrete_dynamics_world::process_terrain_broadphases(const coid::dynarray<b
     const uint col_obj_mask = col_obj->getBroadphaseHandle()->m_collisionFilterMask;
 
 
-    broadphase.for_each([&](bt::external_broadphase* bp) {
+    for (bt::external_broadphase* const* bp_ptr = bp_begin; bp_ptr < bp_end; ++bp_ptr) {
+        bt::external_broadphase* bp = *bp_ptr;
         if (bp->_dirty) {
             update_terrain_mesh_broadphase(bp);
         }
+        else if (!bp->_local_tree.valid) {
+            bp->_local_tree.build(bp->_broadphase, bp);
+        }
 
-        query_volume_aabb(bp->_broadphase,
+        query_volume_aabb(bp,
             double3(cen[0], cen[1], cen[2]),
             double3(half[0], half[1], half[2]),
             [&](btBroadphaseProxy* proxy) 
@@ -275,9 +311,10 @@ void discrete_dynamics_world::process_terrain_broadphases(const coid::dynarray<b
                     }
                 }
                 else {
-                    DASSERT(bp->_broadphase->ownsProxy(proxy));
+                    DASSERT(proxy->m_ot_owner == bp);
                     bp->_broadphase->destroyProxy(proxy, getDispatcher());
                     proxy->m_ot_revision = 0xffffffff; // invalidate proxy
+                    proxy->m_ot_owner = nullptr;
                     btCollisionObject* client_object = static_cast<btCollisionObject*>(proxy->m_clientObject);
 
                     if (client_object && client_object->getBroadphaseHandle() == proxy) { // client object has still same proxy that is invalid so clear it (it happens when object is set not visible)
@@ -287,42 +324,100 @@ void discrete_dynamics_world::process_terrain_broadphases(const coid::dynarray<b
                 return false;
             }
         );
-    });
+    }
 }
 
 //-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 void discrete_dynamics_world::update_terrain_mesh_broadphase(bt::external_broadphase* bp)
 {
-    bool procedural_objects_cleared = false;
+    THREAD_LOCAL_SINGLETON_DEF(coid::dynarray32<uint>) new_entries;
+    new_entries->reset();
 
-    bp->_entries.for_each([&](bt::external_broadphase::broadphase_entry& entry) {
-        btBroadphaseProxy* proxy = entry._collision_object->getBroadphaseHandle();
+    btVector3 contactThreshold(gContactBreakingThreshold, gContactBreakingThreshold, gContactBreakingThreshold);
+    bool has_procedural = false;
 
-        btVector3 min, max;
-        entry._collision_object->getCollisionShape()->getAabb(entry._collision_object->getWorldTransform(), min, max);
-        btVector3 contactThreshold(gContactBreakingThreshold, gContactBreakingThreshold, gContactBreakingThreshold);
-        min -= contactThreshold;
-        max += contactThreshold;
+    // existing proxies are moved in place and stale ones released, the sweep must be sorted for both
+    for (uint i = 0; i < bp->_entries.size(); i++) {
+        bt::external_broadphase::broadphase_entry& entry = bp->_entries[i];
+        btBroadphaseProxy* proxy = entry._collision_object->getBroadphaseHandle();
 
-        if (bp->_broadphase->ownsProxy(proxy) && proxy->m_ot_revision != 0xffffffff) 
+        if (bp->_broadphase->ownsProxy(proxy) && proxy->m_ot_revision != 0xffffffff)
         {
+            btVector3 min, max;
+            entry._collision_object->getCollisionShape()->getAabb(entry._collision_object->getWorldTransform(), min, max);
+            bt::refresh_local_box(entry._collision_object);
+            min -= contactThreshold;
+            max += contactThreshold;
+
             bp->_broadphase->setAabb(proxy, min, max, getDispatcher());
+            proxy->m_ot_revision = gOuterraSimulationFrame;
+            continue;
         }
-        else 
+
+        if (proxy)
         {
-            if (proxy) 
-            {
-                bt::external_broadphase* proxy_owner = _external_broadphase_pool.find_if([&](bt::external_broadphase& ebp) {
-                    return ebp._broadphase->ownsProxy(proxy);
-                });
-
-                DASSERT(proxy_owner);
-                if (proxy_owner)
-                    proxy_owner->_broadphase->destroyProxy(proxy, getDispatcher());
-                proxy->m_ot_revision = 0xffffffff; /// INVALIDATE HANDLE
+            bt::external_broadphase* proxy_owner = static_cast<bt::external_broadphase*>(proxy->m_ot_owner);
+
+            DASSERT(proxy_owner);
+            if (proxy_owner && proxy_owner->_broadphase->ownsProxy(proxy))
+                proxy_owner->_broadphase->destroyProxy(proxy, getDispatcher());
+            proxy->m_ot_revision = 0xffffffff; /// INVALIDATE HANDLE
+            proxy->m_ot_owner = nullptr;
+            entry._collision_object->setBroadphaseHandle(nullptr);
+        }
+
+        new_entries->push(i);
+        has_procedural |= entry._procedural;
+    }
+
+    // new procedural objects replace the previous ones, released before the bulk insert as that can't remove proxies
+    if (has_procedural) {
+        bp->_procedural_objects.for_each([&](btCollisionObject*& proc_obj)
+        {
+            btGhostObject* ghost = btGhostObject::upcast(proc_obj);
+            if (ghost) {
+                remove_terrain_occluder(ghost);
             }
+            removeCollisionObject_external(proc_obj);
+            delete (proc_obj);
+        });
+
+        bp->_procedural_objects.clear();
+    }
+
+    const uint nnew = new_entries->size();
+    if (nnew) {
+        const uint needed = bp->_broadphase->getNumHandles() + nnew;
+        if (needed > bp->_broadphase->getMaxHandles()) {
+            grow_external_broadphase(bp, glm::max(needed, bp->_broadphase->getMaxHandles() * 2));
+        }
+    }
+
+    // a tile streaming in is inserted in bulk, the endpoints get sorted once
+    const bool bulk = nnew > bt::external_broadphase::BULK_INSERT_MIN;
+    bool static_only = true;
+
+    new_entries->for_each([&](uint idx) {
+        bt::external_broadphase::broadphase_entry& entry = bp->_entries[idx];
+
+        btVector3 min, max;
+        entry._collision_object->getCollisionShape()->getAabb(entry._collision_object->getWorldTransform(), min, max);
+        bt::refresh_local_box(entry._collision_object);
+        min -= contactThreshold;
+        max += contactThreshold;
 
-            proxy = bp->_broadphase->createProxy(
+        static_only &= entry._collision_object->isStaticObject();
+
+        btBroadphaseProxy* proxy = bulk
+            ? bp->_broadphase->createProxyDeferred(
+                min,
+                max,
+                entry._collision_object->getCollisionShape()->getShapeType(),
+                entry._collision_object,
+                entry._collision_group,
+                entry._collision_mask,
+                getDispatcher(), 0)
+            : bp->_broadphase->createProxy(
                 min,
                 max,
                 entry._collision_object->getCollisionShape()->getShapeType(),
@@ -331,60 +426,107 @@ void discrete_dynamics_world::update_terrain_mesh_broadphase(bt::external_broadp
                 entry._collision_mask,
                 0, 0
             );
-            entry._collision_object->setBroadphaseHandle(proxy);
-
-            btGhostObject* ghost = btGhostObject::upcast(entry._collision_object);
-            if (ghost) {
-                entry._collision_object->setCollisionFlags(entry._collision_object->getCollisionFlags() |
-                    btCollisionObject::CollisionFlags::CF_NO_CONTACT_RESPONSE/* |
-                    btCollisionObject::CollisionFlags::CF_DISABLE_VISUALIZE_OBJECT*/);
-                add_terrain_occluder(ghost);
-            }
-
-            if (entry._procedural) {
-                if (!procedural_objects_cleared) {
-                    procedural_objects_cleared = true;
-                    bp->_procedural_objects.for_each([&](btCollisionObject*& proc_obj)
-                    {
-                        btGhostObject* ghost = btGhostObject::upcast(proc_obj);
-                        if (ghost) {
-                            remove_terrain_occluder(ghost);
-                        }
-                        removeCollisionObject_external(proc_obj);
-                        delete (proc_obj);
-                    });
+        proxy->m_ot_owner = bp;
+        entry._collision_object->setBroadphaseHandle(proxy);
 
-                    bp->_procedural_objects.clear();
-                }
+        btGhostObject* ghost = btGhostObject::upcast(entry._collision_object);
+        if (ghost) {
+            entry._collision_object->setCollisionFlags(entry._collision_object->getCollisionFlags() |
+                btCollisionObject::CollisionFlags::CF_NO_CONTACT_RESPONSE/* |
+                btCollisionObject::CollisionFlags::CF_DISABLE_VISUALIZE_OBJECT*/);
+            add_terrain_occluder(ghost);
+        }
 
-                bp->_procedural_objects.push(entry._collision_object);
-            }
+        if (entry._procedural) {
+            bp->_procedural_objects.push(entry._collision_object);
         }
 
         proxy->m_ot_revision = gOuterraSimulationFrame;
     });
 
+    if (bulk) {
+        // static tiles need no overlapping pairs, the terrain pass finds its pairs by querying the broadphase
+        bp->_broadphase->endDeferredProxies(getDispatcher(), !static_only);
+    }
+
+    bp->_local_tree.build(bp->_broadphase, bp);
+
     bp->_revision = gOuterraSimulationFrame;
     bp->_entries.clear();
     bp->_dirty = false;
 }
 
 //-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
-void discrete_dynamics_world::add_terrain_broadphase_collision_pair(btCollisionObject* obj1, btCollisionObject* obj2)
+void discrete_dynamics_world::grow_external_broadphase(bt::external_broadphase* bp, uint capacity)
 {
-    btBroadphasePair* pair = _terrain_mesh_broadphase_pairs.find_if([&](const btBroadphasePair& bp) {
-        if (bp.m_pProxy0->m_clientObject == obj1 && bp.m_pProxy1->m_clientObject == obj2) {
-            return true;
+    // the proxies live in the handle array of the sweep, all of them move to the new one
+    THREAD_LOCAL_SINGLETON_DEF(coid::dynarray32<btCollisionObject*>) objects;
+    objects->reset();
+
+    for_each_object_in_broadphase(bp->_broadphase, 0xffffffff, [&](btCollisionObject* obj) {
+        if (obj->getBroadphaseHandle()->m_ot_owner == bp)
+            objects->push(obj);
+    });
+
+    _terrain_mesh_broadphase_pairs.for_each([&](terrain_mesh_pair& tmp) {
+        if (tmp.m_pProxy0->m_ot_owner == bp || tmp.m_pProxy1->m_ot_owner == bp) {
+            remove_terrain_broadphase_collision_pair(tmp);
         }
+    });
 
-        return false;
+    // pairs of the dynamic proxies, released through the dispatcher so their manifolds don't outlive the old sweep
+    btOverlappingPairCache* old_pairs = bp->_broadphase->getOverlappingPairCache();
+    const bool had_pairs = old_pairs->getNumOverlappingPairs() > 0;
+
+    while (old_pairs->getNumOverlappingPairs() > 0) {
+        const btBroadphasePair& pair = old_pairs->getOverlappingPairArrayPtr()[old_pairs->getNumOverlappingPairs() - 1];
+        btBroadphaseProxy* proxy0 = pair.m_pProxy0;
+        btBroadphaseProxy* proxy1 = pair.m_pProxy1;
+        old_pairs->removeOverlappingPair(proxy0, proxy1, getDispatcher());
+    }
+
+    btVector3 min, max;
+    bp->_broadphase->getBroadphaseAabb(min, max);
+
+    bt32BitAxisSweep3* broadphase = new bt32BitAxisSweep3(min, max, capacity);
+
+    objects->for_each([&](btCollisionObject* obj) {
+        btBroadphaseProxy* old_proxy = obj->getBroadphaseHandle();
+
+        btBroadphaseProxy* proxy = broadphase->createProxyDeferred(
+            old_proxy->m_aabbMin,
+            old_proxy->m_aabbMax,
+            obj->getCollisionShape()->getShapeType(),
+            obj,
+            old_proxy->m_collisionFilterGroup,
+            old_proxy->m_collisionFilterMask,
+            getDispatcher(), 0);
+        proxy->m_ot_revision = old_proxy->m_ot_revision;
+        proxy->m_ot_owner = bp;
+        obj->setBroadphaseHandle(proxy);
     });
 
-    if (!pair) {
-        pair = _terrain_mesh_broadphase_pairs.add();
-        new(pair)btBroadphasePair();
-        pair->m_pProxy0 = obj1->getBroadphaseHandle();
-        pair->m_pProxy1 = obj2->getBroadphaseHandle();
+    // the pairs are found again in the new sweep, tiles of static proxies only had none
+    broadphase->endDeferredProxies(getDispatcher(), had_pairs);
+
+    // the tree leaves point to the handles of the old sweep
+    bp->_local_tree.invalidate();
+
+    delete bp->_broadphase;
+    bp->_broadphase = broadphase;
+
+    invalidate_terrain_cache();
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void discrete_dynamics_world::add_terrain_broadphase_collision_pair(btCollisionObject* obj1, btCollisionObject* obj2)
+{
+    bool is_new = false;
+    terrain_mesh_pair* pair = _terrain_mesh_broadphase_pairs.find_or_insert_value_slot(
+        terrain_mesh_pair_key(obj1, obj2), &is_new);
+
+    if (is_new) {
+        new(pair) terrain_mesh_pair(obj1, obj2);
 
         if (obj1->isGhostObject()) 
         {
@@ -400,19 +542,27 @@ void discrete_dynamics_world::add_terrain_broadphase_collision_pair(btCollisionO
 
         obj2->m_otFlags |= bt::OTF_POTENTIAL_TERRAIN_OBJECT_COLLISION;
     }
+    else {
+        // external proxy may have been recreated since, the near callback reads the objects through the proxies
+        pair->m_pProxy0 = obj1->getBroadphaseHandle();
+        pair->m_pProxy1 = obj2->getBroadphaseHandle();
+    }
 }
 
 //-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
-void discrete_dynamics_world::remove_terrain_broadphase_collision_pair(btBroadphasePair& pair)
+void discrete_dynamics_world::remove_terrain_broadphase_collision_pair(terrain_mesh_pair& pair)
 {
     if (pair.m_algorithm) {
         pair.m_algorithm->~btCollisionAlgorithm();
         getDispatcher()->freeCollisionAlgorithm(pair.m_algorithm);
         pair.m_algorithm = 0;
+#ifdef _PROFILING_ENABLED
+        _stats.collision_algorithms_released++;
+#endif // _PROFILING_ENABLED
     }
 
-    btCollisionObject* col_obj_0 = static_cast<btCollisionObject*>(pair.m_pProxy0->m_clientObject);
-    btCollisionObject* col_obj_1 = static_cast<btCollisionObject*>(pair.m_pProxy1->m_clientObject);
+    btCollisionObject* col_obj_0 = pair.obj0;
+    btCollisionObject* col_obj_1 = pair.obj1;
 
     if (col_obj_0->isGhostObject()) 
     {
@@ -426,7 +576,7 @@ void discrete_dynamics_world::remove_terrain_broadphase_collision_pair(btBroadph
         ghost->removeOverlappingObjectInternal(pair.m_pProxy0, getDispatcher());
     }
 
-    _terrain_mesh_broadphase_pairs.del_item_by_ptr(&pair);
+    _terrain_mesh_broadphase_pairs.erase(terrain_mesh_pair_key(col_obj_0, col_obj_1));
 }
 
 //-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
@@ -435,16 +585,25 @@ void discrete_dynamics_world::process_terrain_broadphase_collision_pairs()
     btDispatcherInfo& dispatchInfo = getDispatchInfo();
     btCollisionDispatcher* dispatcher = static_cast<btCollisionDispatcher*>(getDispatcher());
 
-    _terrain_mesh_broadphase_pairs.for_each([&](btBroadphasePair& bp) {
-        btCollisionObject* obj0 = reinterpret_cast<btCollisionObject*>(bp.m_pProxy0->m_clientObject);
-        btCollisionObject* obj1 = reinterpret_cast<btCollisionObject*>(bp.m_pProxy1->m_clientObject);
+    _terrain_mesh_broadphase_pairs.for_each([&](terrain_mesh_pair& bp) {
+        btCollisionObject* obj0 = bp.obj0;
+        btCollisionObject* obj1 = bp.obj1;
 
         btVector3 min0, max0, min1, max1;
         obj0->getCollisionShape()->getAabb(obj0->getWorldTransform(), min0, max0);
         obj1->getCollisionShape()->getAabb(obj1->getWorldTransform(), min1, max1);
 
         if (TestAabbAgainstAabb2(min0, max0, min1, max1)) {
+            // the near callback creates the algorithm once, it stays in the pair until the pair is removed
+#ifdef _PROFILING_ENABLED
+            const bool had_algorithm = bp.m_algorithm != 0;
+#endif // _PROFILING_ENABLED
             (*dispatcher->getNearCallback())(bp, *dispatcher, m_dispatchInfo);
+#ifdef _PROFILING_ENABLED
+            if (!had_algorithm && bp.m_algorithm) {
+                _stats.collision_algorithms_created++;
+            }
+#endif // _PROFILING_ENABLED
         }
         else {
             remove_terrain_broadphase_collision_pair(bp);
@@ -595,6 +754,83 @@ void discrete_dynamics_world::convexSweepTest(const btConvexShape* castShape, co
     }
 }
 
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void discrete_dynamics_world::gather_sweep_candidates(const btVector3& aabb_min, const btVector3& aabb_max, coid::dynarray<btCollisionObject*>& result) const
+{
+    struct candidate_callback : btBroadphaseAabbCallback
+    {
+        coid::dynarray<btCollisionObject*>& _result;
+
+        candidate_callback(coid::dynarray<btCollisionObject*>& result) : _result(result) {}
+
+        bool process(const btBroadphaseProxy* proxy) override {
+            *_result.add() = static_cast<btCollisionObject*>(proxy->m_clientObject);
+            return true;
+        }
+    } cb(result);
+
+    m_broadphasePairCache->aabbTest(aabb_min, aabb_max, cb);
+
+    THREAD_LOCAL_SINGLETON_DEF(coid::dynarray32<bt::external_broadphase*>) bps;
+    bps->clear();
+
+    const double3 center = bt::todouble3((aabb_min + aabb_max) * btScalar(0.5));
+    const btVector3 half = (aabb_max - aabb_min) * btScalar(0.5);
+    float3x3 basis;
+    basis[0][0] = float(half.x());
+    basis[1][1] = float(half.y());
+    basis[2][2] = float(half.z());
+
+    _obb_intersect_broadphase(m_context, center, basis, *bps);
+
+    for (bt::external_broadphase* ebp_ptr : *bps) {
+        ebp_ptr->_broadphase->aabbTest(aabb_min, aabb_max, cb);
+    }
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void discrete_dynamics_world::convex_sweep_candidates(const btConvexShape* cast_shape, const btTransform& from, const btTransform& to,
+    btCollisionObject* const* begin, btCollisionObject* const* end, ConvexResultCallback& result_callback, btScalar allowed_ccd_penetration) const
+{
+    btVector3 min0, max0, min1, max1;
+    cast_shape->getAabb(from, min0, max0);
+    cast_shape->getAabb(to, min1, max1);
+    min0.setMin(min1);
+    max0.setMax(max1);
+
+    // same per object test as btSingleSweepCallback, on the swept box instead of the broadphase ray
+    for (btCollisionObject* const* it = begin; it != end; ++it)
+    {
+        if (result_callback.m_closestHitFraction == btScalar(0.f)) {
+            break;
+        }
+
+        btCollisionObject* obj = *it;
+        btBroadphaseProxy* proxy = obj->getBroadphaseHandle();
+        if (!proxy || !result_callback.needsCollision(proxy)) {
+            continue;
+        }
+
+        if (!TestAabbAgainstAabb2(min0, max0, proxy->m_aabbMin, proxy->m_aabbMax)) {
+            continue;
+        }
+
+        objectQuerySingle(cast_shape, from, to, obj, obj->getCollisionShape(), obj->getWorldTransform(),
+            result_callback, allowed_ccd_penetration);
+    }
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+bool discrete_dynamics_world::addCollisionObject(btCollisionObject* collisionObject, short int collisionFilterGroup, short int collisionFilterMask)
+{
+    if (!btDiscreteDynamicsWorld::addCollisionObject(collisionObject, collisionFilterGroup, collisionFilterMask)) {
+        return false;
+    }
+
+    update_terrain_collider(collisionObject);
+    return true;
+}
+
 //-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 void discrete_dynamics_world::removeRigidBody(btRigidBody* body)
 {
@@ -607,44 +843,130 @@ void discrete_dynamics_world::removeRigidBody(btRigidBody* body)
 
     body->setTerrainManifoldHandle(0xffffffff);
 
-    _terrain_mesh_broadphase_pairs.for_each([&](btBroadphasePair& bp, uints idx) {
-        if (bp.m_pProxy0->m_clientObject == body || bp.m_pProxy1->m_clientObject == body) {
+    _terrain_caches.erase((uints)body);
+
+    _tree_collision_pairs.for_each([&](tree_collision_pair& tcp) {
+        if (tcp.obj == body) {
+            release_tree_collision_pair(tcp);
+        }
+    });
+
+    _terrain_mesh_broadphase_pairs.for_each([&](terrain_mesh_pair& bp) {
+        if (bp.obj0 == body || bp.obj1 == body) {
             remove_terrain_broadphase_collision_pair(bp);
         }
     });
 
     btDiscreteDynamicsWorld::removeRigidBody(body);
+    update_terrain_collider(body);
 }
 
 //-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 void discrete_dynamics_world::removeCollisionObject(btCollisionObject* collisionObject)
 {
+    _terrain_caches.erase((uints)collisionObject);
     btDiscreteDynamicsWorld::removeCollisionObject(collisionObject);
+    update_terrain_collider(collisionObject);
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+bool discrete_dynamics_world::is_terrain_collider(const btCollisionObject* obj)
+{
+    // removed objects have no proxy, objects of external broadphases have an owner
+    const btBroadphaseProxy* proxy = obj->getBroadphaseHandle();
+    if (!proxy || proxy->m_ot_owner) {
+        return false;
+    }
+
+    if (!obj->isRigidBody() && !obj->isKinematicObject()) {
+        return false;
+    }
+
+    const btCollisionShape* shape = obj->getCollisionShape();
+    const int shape_type = shape->getShapeType();
+    if (shape_type != SPHERE_SHAPE_PROXYTYPE
+        && shape_type != CAPSULE_SHAPE_PROXYTYPE
+        && !shape->isConvex()
+        && shape_type != COMPOUND_SHAPE_PROXYTYPE) {
+        return false;
+    }
+
+    return (proxy->m_collisionFilterMask & ot::collision::cg_terrain) != 0
+        && (obj->m_otFlags & bt::EOtFlags::OTF_DISABLE_OT_WORLD_COLLISIONS) == 0
+        && obj->getActivationState() != ISLAND_SLEEPING;
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void discrete_dynamics_world::update_terrain_collider(btCollisionObject* obj)
+{
+    // activation changes come also from the parallel stages of the step
+    std::lock_guard<std::mutex> lock(_terrain_colliders_mutex);
+
+    const int idx = obj->m_otTerrainColliderIndex;
+    const bool listed = idx >= 0;
+    if (listed == is_terrain_collider(obj)) {
+        return;
+    }
+
+    if (!listed) {
+        obj->m_otTerrainColliderIndex = int(_terrain_colliders.size());
+        *_terrain_colliders.add() = obj;
+        return;
+    }
+
+    DASSERT(_terrain_colliders[idx] == obj);
+
+    btCollisionObject* last = nullptr;
+    _terrain_colliders.pop(last);
+    if (last != obj) {
+        _terrain_colliders[idx] = last;
+        last->m_otTerrainColliderIndex = idx;
+    }
+
+    obj->m_otTerrainColliderIndex = -1;
 }
 
 //-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 void discrete_dynamics_world::removeCollisionObject_external(btCollisionObject* collisionObject)
 {
-    _terrain_mesh_broadphase_pairs.for_each([&](btBroadphasePair& bp, uints idx) {
-        if (bp.m_pProxy0->m_clientObject == collisionObject || bp.m_pProxy1->m_clientObject == collisionObject) {
+    _terrain_mesh_broadphase_pairs.for_each([&](terrain_mesh_pair& bp) {
+        if (bp.obj0 == collisionObject || bp.obj1 == collisionObject) {
             remove_terrain_broadphase_collision_pair(bp);
         }
     });
 
-    bt::external_broadphase* broadphase = _external_broadphase_pool.find_if([&](bt::external_broadphase& bp) {
-        return bp._broadphase->ownsProxy(collisionObject->getBroadphaseHandle());
-    });
+    btBroadphaseProxy* proxy = collisionObject->getBroadphaseHandle();
+    bt::external_broadphase* broadphase = proxy ? static_cast<bt::external_broadphase*>(proxy->m_ot_owner) : nullptr;
 
-    if (broadphase) {
-        broadphase->_broadphase->destroyProxy(collisionObject->getBroadphaseHandle(), getDispatcher());
+    if (broadphase && broadphase->_broadphase->ownsProxy(proxy)) {
+        broadphase->_broadphase->destroyProxy(proxy, getDispatcher());
+        proxy->m_ot_owner = nullptr;
     }
 
     collisionObject->setBroadphaseHandle(nullptr);
 }
 
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+template<class fn> // void (*fn)(uint chunk, uint job_begin, uint job_end)
+static void run_terrain_chunks(coid::taskmaster* tm, uint njobs, uint nchunks, fn process_fn)
+{
+    if (tm && nchunks > 1) {
+        tm->parallel_for(0, int(nchunks), [&](int chunk) {
+            process_fn(uint(chunk), uint(uint64(chunk) * njobs / nchunks), uint(uint64(chunk + 1) * njobs / nchunks));
+        });
+    }
+    else {
+        for (uint chunk = 0; chunk < nchunks; chunk++) {
+            process_fn(chunk, uint(uint64(chunk) * njobs / nchunks), uint(uint64(chunk + 1) * njobs / nchunks));
+        }
+    }
+}
+
 //-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 void discrete_dynamics_world::ot_terrain_collision_step()
 {
+    BT_PROFILE("ot_terrain_collision_step");
+
 #ifdef _PROFILING_ENABLED
     static coid::nsec_timer timer;
 #endif // _PROFILING_ENABLED
@@ -658,33 +980,19 @@ void discrete_dynamics_world::ot_terrain_collision_step()
         _debug_trees.reset();
     }
 
-    //LOCAL_SINGLETON(ot_terrain_contact_common) common_data = new ot_terrain_contact_common(0.00f,this,_pb_wrap);
-    if (!_common_data)
-        _common_data = new ot_terrain_contact_common(0.00f, this, _pb_wrap);
+    _terrain_jobs.reset();
 
-    for (int i = 0; i < m_collisionObjects.size(); i++)
+    // tree pairs not found in this pass are retired in process_tree_collisions
+    ++_terrain_pass_gen;
+    _tree_batch_queries.reset();
+
+    // only the awake terrain colliders, the set follows activation and flag changes
+    for (uints i = 0; i < _terrain_colliders.size(); i++)
     {
-        _cow_internal.clear();
-        _compound_processing_stack.clear();
-        btCollisionObject* obj = m_collisionObjects[i];
+        btCollisionObject* obj = _terrain_colliders[i];
         const bool is_rigid_body = obj->isRigidBody();
-        const bool is_kinematic = obj->isKinematicObject();
-
-        if ((!is_rigid_body && !is_kinematic) ||
-            (obj->getCollisionShape()->getShapeType() != SPHERE_SHAPE_PROXYTYPE &&
-                obj->getCollisionShape()->getShapeType() != CAPSULE_SHAPE_PROXYTYPE &&
-                !obj->getCollisionShape()->isConvex() &&
-                obj->getCollisionShape()->getShapeType() != COMPOUND_SHAPE_PROXYTYPE) ||
-            (obj->getBroadphaseHandle()->m_collisionFilterMask & ot::collision::cg_terrain) == 0
-            || (obj->m_otFlags & bt::EOtFlags::OTF_DISABLE_OT_WORLD_COLLISIONS) != 0)
-
-        {
-            continue;
-        }
 
-        if (obj->getActivationState() == ISLAND_SLEEPING) {
-            continue;
-        }
+        DASSERT(is_terrain_collider(obj));
 
         obj->m_otFlags &= ~(bt::OTF_POTENTIAL_OBJECT_COLLISION | bt::OTF_POTENTIAL_TERRAIN_OBJECT_COLLISION);
 
@@ -704,235 +1012,875 @@ void discrete_dynamics_world::ot_terrain_collision_step()
             }
         }
 
-        btCollisionObjectWrapper planet_wrapper(0, _planet_body->getCollisionShape(), _planet_body, btTransform::getIdentity(), -1, -1);
-        btCollisionObjectWrapper collider_wrapper(0, obj->getCollisionShape(), obj, obj->getWorldTransform(), -1, -1);
-        btManifoldResult res(&collider_wrapper, &planet_wrapper);
-
-        if (obj->getCollisionShape()->getShapeType() == COMPOUND_SHAPE_PROXYTYPE) {
-            btCompoundShape* cs = reinterpret_cast<btCompoundShape*>(obj->getCollisionShape());
-            new (_compound_processing_stack.add_uninit(1)) compound_processing_entry(cs, obj->getWorldTransform());
-            compound_processing_entry curr;
-            while (_compound_processing_stack.pop(curr)) {
-                if (curr._shape->getShapeType() == COMPOUND_SHAPE_PROXYTYPE) {
-                    btCompoundShape* curr_cs = reinterpret_cast<btCompoundShape*>(curr._shape);
-                    for (int j = 0; j < curr_cs->getNumChildShapes(); j++) {
-                        new (_compound_processing_stack.add_uninit(1)) compound_processing_entry(curr_cs->getChildShape(j), curr._world_trans * curr_cs->getChildTransform(j));
-                    }
-                }
-                else {
-                    new (_cow_internal.add_uninit(1)) btCollisionObjectWrapperCtorArgs(&collider_wrapper, curr._shape, obj, curr._world_trans, -1, -1);
-                }
-            }
+        // shared shapes, flatten before the parallel part
+        btCollisionShape* shape = obj->getCollisionShape();
+        if (shape->getShapeType() == COMPOUND_SHAPE_PROXYTYPE) {
+            static_cast<btCompoundShape*>(shape)->updateLeaves();
         }
-        else {
-            new (_cow_internal.add_uninit(1)) btCollisionObjectWrapperCtorArgs(0, obj->getCollisionShape(), obj, obj->getWorldTransform(), -1, -1);
 
-        }
+        terrain_object_job* job = _terrain_jobs.add();
+        job->_obj = obj;
+        job->_manifold = manifold;
+        job->_cache = nullptr;
+        job->_ctx = 0;
+        job->_child_begin = job->_child_end = 0;
+        job->_potentially_inside_tunnel = false;
+    }
 
-        res.setPersistentManifold(manifold);
+    if (_terrain_cache_enabled) {
+        // inserting may relocate the entries, take the pointers after all objects have one
+        _terrain_jobs.for_each([&](terrain_object_job& job) {
+            bool is_new = false;
+            terrain_object_cache* cache = _terrain_caches.find_or_insert_value_slot((uints)job._obj, &is_new);
+            if (is_new) {
+                cache->_obj = job._obj;
+            }
+        });
 
-        uint tri_count = 0;
+        _terrain_jobs.for_each([&](terrain_object_job& job) {
+            bool is_new = false;
+            job._cache = _terrain_caches.find_or_insert_value_slot((uints)job._obj, &is_new);
+        });
+    }
 
-        THREAD_LOCAL_SINGLETON_DEF(coid::dynarray<bt::external_broadphase*>) broadphase_tls;
-        coid::dynarray<bt::external_broadphase*>& broadphases = *broadphase_tls;
-        broadphases.reset();
+    const uint njobs = uint(_terrain_jobs.size());
+    const bool parallel = _parallel_terrain_step && _task_master != nullptr;
+    const uint nchunks = parallel
+        ? glm::clamp((njobs + TERRAIN_PASS_MIN_JOBS_PER_CONTEXT - 1) / TERRAIN_PASS_MIN_JOBS_PER_CONTEXT, 1u, TERRAIN_PASS_MAX_CONTEXTS)
+        : 1u;
 
-        for (uints j = 0; j < _cow_internal.size(); j++) {
-            if (_cow_internal[j]._shape->getUserIndex() & 1) { // do not collide with terrain
-                continue;
-            }
-            btCollisionObjectWrapper internal_obj_wrapper(_cow_internal[j]._parent,
-                _cow_internal[j]._shape,
-                obj,
-                _cow_internal[j]._worldTransform,
-                _cow_internal[j]._partId,
-                _cow_internal[j]._index);
-
-
-            _common_data->set_internal_obj_wrapper(&internal_obj_wrapper);
-
-            btVector3 sc = internal_obj_wrapper.getWorldTransform().getOrigin();
-            //int face = ot::xyz_to_cubeface(&sc.m_floats[0]);
-            //int levs = 0;
-            //float dist;
-            //terrain_mesh::auxdata & aux = terrain_mesh::aux();
-            _from = double3(sc.x(), sc.y(), sc.z());
-            //_col_shape = bt::csSphere;
-
-            if (internal_obj_wrapper.getCollisionShape()->getShapeType() == SPHERE_SHAPE_PROXYTYPE) {
-                const btSphereShape* sph = reinterpret_cast<const btSphereShape*>(internal_obj_wrapper.getCollisionShape());
-                _rad = float(sph->getRadius() + 0.02);
-                _lod_dim = _rad;
-                _common_data->prepare_sphere_collision(&res, _from, float(sph->getRadius()), 0.02f);
-                gContactAddedCallback = friction_combiner_cbk;
-            }
-            else if (internal_obj_wrapper.getCollisionShape()->getShapeType() == CAPSULE_SHAPE_PROXYTYPE) {
-                const btCapsuleShape* caps = reinterpret_cast<const btCapsuleShape*>(internal_obj_wrapper.getCollisionShape());
-                float cap_rad = float(caps->getRadius());
-                float cap_hheight = float(caps->getHalfHeight());
-                _rad = cap_rad + cap_hheight + 0.04f;
-                _lod_dim = cap_rad;
-
-                btVector3 main_axis = internal_obj_wrapper.getWorldTransform().getBasis().getColumn(caps->getUpAxis());
-                btVector3 p0 = sc + (main_axis * cap_hheight);
-                btVector3 p1 = sc - (main_axis * cap_hheight);
-
-                _common_data->prepare_capsule_collision(&res, glm::dvec3(p0.x(), p0.y(), p0.z()), glm::dvec3(p1.x(), p1.y(), p1.z()), cap_rad, float(caps->getMargin()));
-                gContactAddedCallback = friction_combiner_cbk;
-            }
-            else if (internal_obj_wrapper.getCollisionShape()->isConvex()) {
-                btTransform t = internal_obj_wrapper.getWorldTransform();
-                btQuaternion q = t.getRotation();
-                btVector3 p = t.getOrigin();
-                btVector3 min;
-                btVector3 max;
-                btScalar rad;
-                internal_obj_wrapper.getCollisionShape()->getBoundingSphere(min, rad);
-                internal_obj_wrapper.getCollisionShape()->getAabb(t, min, max);
-
-                _rad = (float)rad;
-
-                min = (max - min) * 0.5;
-                _lod_dim = (float)min[min.minAxis()];
-                _common_data->prepare_bt_convex_collision(&res, &internal_obj_wrapper, getDispatcher());
-                gContactAddedCallback = GJK_contact_added;
-            }
-            else {
-                continue;
-            }
+    while (_terrain_contexts.size() < nchunks) {
+        terrain_worker_context* ctx = _terrain_contexts.add();
+        ctx->_common_data = new ot_terrain_contact_common(0.00f, this, _pb_wrap);
+    }
 
-            _common_data->set_bounding_sphere_rad(_rad);
+    coid::taskmaster* tm = parallel ? _task_master : nullptr;
 
-            _triangles.clear();
-            _tree_batches.clear();
+    // concurrent terrain callbacks add tree batches to the arrays of their workers
+    const bool stage_tree_batches = tm != nullptr && nchunks > 1;
 
-            get_obb(internal_obj_wrapper.getCollisionShape(), internal_obj_wrapper.getWorldTransform(), _from, _basis);
+    for (uint c = 0; c < nchunks; c++) {
+        _terrain_contexts[c].reset();
+        _terrain_contexts[c]._stage_tree_batches = stage_tree_batches;
+    }
 
-            //_relocation_offset = _tb_cache.get_array().ptr();
+    // terrain queries, each chunk of objects works in its own context
+    run_terrain_chunks(tm, njobs, nchunks, [&](uint chunk, uint job_begin, uint job_end) {
+        BT_PROFILE("terrain queries");
+        terrain_worker_context& ctx = _terrain_contexts[chunk];
+        for (uint j = job_begin; j < job_end; j++) {
+            _terrain_jobs[j]._ctx = chunk;
+            terrain_query_object(ctx, _terrain_jobs[j]);
+        }
+    });
 
-            bool is_above_tm = false;
-            double3 under_terrain_contact;
-            float3 under_terrain_normal;
+    if (stage_tree_batches) {
+        merge_staged_tree_batches(nchunks);
+    }
 
-            int col_result = _aabb_intersect(m_context, _from, _basis, _lod_dim, _triangles,
-                _tree_batches, _tb_cache, gCurrentFrame,
-                is_above_tm, under_terrain_contact, under_terrain_normal, broadphases);
+    // external broadphases and occluders are shared, merge them in object order
+    for (uint j = 0; j < njobs; j++) {
+        terrain_object_job& job = _terrain_jobs[j];
+        const terrain_worker_context& ctx = _terrain_contexts[job._ctx];
+        btCollisionObject* obj = job._obj;
 
-            if (col_result == 0 && broadphases.size() == 0 && _tree_batches.size() == 0) {
-                continue;
-            }
+        if (job._child_begin == job._child_end) {
+            continue;
+        }
 
-            process_terrain_broadphases(broadphases, obj);
+        for (uint c = job._child_begin; c < job._child_end; c++) {
+            const terrain_child_query& child = ctx._children[c];
+            process_terrain_broadphases(ctx._broadphases.ptr() + child._bp_begin, ctx._broadphases.ptr() + child._bp_end, obj);
+        }
 
-            bool is_potentially_inside_tunnel = false;
-            // terrain ocluders
-            _terrain_occluders.for_each([&](const btGhostObject* go) {
-                int num_op = go->getNumOverlappingObjects();
-                for (int i = 0; i < num_op; i++) {
-                    const btCollisionObject* overlappig_obj = go->getOverlappingObject(i);
-                    if (overlappig_obj == obj) {
-                        is_potentially_inside_tunnel = true;
-                    }
+        bool is_potentially_inside_tunnel = false;
+        // terrain ocluders
+        _terrain_occluders.for_each([&](const btGhostObject* go) {
+            int num_op = go->getNumOverlappingObjects();
+            for (int i = 0; i < num_op; i++) {
+                const btCollisionObject* overlappig_obj = go->getOverlappingObject(i);
+                if (overlappig_obj == obj) {
+                    is_potentially_inside_tunnel = true;
                 }
-            });
-
-            obj->m_otFlags = (is_potentially_inside_tunnel)
-                ? obj->m_otFlags | (bt::EOtFlags::OTF_POTENTIAL_TUNNEL_COLLISION)
-                : obj->m_otFlags & ~bt::EOtFlags::OTF_POTENTIAL_TUNNEL_COLLISION;
+            }
+        });
 
-            if (is_rigid_body)
-            {
-                if (_triangles.size() > 0)
-                {
-                    tri_count += uint(_triangles.size());
+        job._potentially_inside_tunnel = is_potentially_inside_tunnel;
+        obj->m_otFlags = (is_potentially_inside_tunnel)
+            ? obj->m_otFlags | (bt::EOtFlags::OTF_POTENTIAL_TUNNEL_COLLISION)
+            : obj->m_otFlags & ~bt::EOtFlags::OTF_POTENTIAL_TUNNEL_COLLISION;
 
-                    if (m_debugDrawer && !(obj->getCollisionFlags() & btCollisionObject::CF_DISABLE_VISUALIZE_OBJECT)) {
-                        _triangles.for_each([&](const bt::triangle& t) {
-                            *_debug_terrain_triangles.push() = t;
-                        });
-                    }
+        if (m_debugDrawer && job._manifold && !(obj->getCollisionFlags() & btCollisionObject::CF_DISABLE_VISUALIZE_OBJECT)) {
+            for (uint c = job._child_begin; c < job._child_end; c++) {
+                const terrain_child_query& child = ctx._children[c];
+                for (uint t = child._tri_begin; t < child._tri_end; t++) {
+                    *_debug_terrain_triangles.push() = ctx._triangles[t];
+                }
+            }
+        }
+    }
 
 #ifdef _PROFILING_ENABLED
-                    timer.reset();
-
+    timer.reset();
 #endif // _PROFILING_ENABLED
 
-                    if (is_above_tm) {
-                        static coid::nsec_timer timer;
-                        timer.reset();
-                        {
-                            CPU_PROFILE_SCOPE(process_triangle_cache);
-                            _common_data->process_triangle_cache(_triangles);
-                        }
-                        //uint time_ms = timer.time_ns() * 0.000001f;
-                        //static bool ass = false;
-                        //DASSERT(ass || time_ms < 2.f);
-                    }
-                    else {
-                        gContactAddedCallback = plane_contact_added;
-                        _common_data->collide_object_plane(_elevation_above_terrain);
-                    }
+    // contact generation, every rigid body writes only into its own terrain manifold
+    run_terrain_chunks(tm, njobs, nchunks, [&](uint chunk, uint job_begin, uint job_end) {
+        BT_PROFILE("terrain contacts");
+        terrain_worker_context& ctx = _terrain_contexts[chunk];
+        for (uint j = job_begin; j < job_end; j++) {
+            if (_terrain_jobs[j]._manifold) {
+                terrain_collide_object(ctx, _terrain_jobs[j]);
+            }
+        }
+    });
 
 #ifdef _PROFILING_ENABLED
-                    _stats.triangles_processed_count += _triangles.size();
-                    _stats.triangle_processing_time_ms += timer.time_ns() * 0.000001f;
+    _stats.triangle_processing_time_ms += timer.time_ns() * 0.000001f;
+    for (uint c = 0; c < nchunks; c++) {
+        _stats.triangles_processed_count += _terrain_contexts[c]._triangles_processed;
+        _stats.terrain_cache_hits += _terrain_contexts[c]._cache_hits;
+        _stats.terrain_cache_misses += _terrain_contexts[c]._cache_misses;
+    }
 #endif // _PROFILING_ENABLED
 
-                }
-                else if (col_result == -1 && !is_potentially_inside_tunnel) {
-                    gContactAddedCallback = nullptr;
-                    res.addContactPoint(btVector3(under_terrain_normal.x, under_terrain_normal.y, under_terrain_normal.z),
-                        btVector3(_from.x, _from.y, _from.z),
-                        -glm::length(_from - under_terrain_contact));
-                }
+    if (btStepProfiler::isEnabled()) {
+        uint triangles = 0;
+        for (uint c = 0; c < nchunks; c++) {
+            triangles += _terrain_contexts[c]._triangles_processed;
+        }
+        BT_STEP_PROFILE_COUNTER("terrain colliders", njobs);
+        BT_STEP_PROFILE_COUNTER("terrain triangles", triangles);
+    }
 
-                if (_tree_batches.size() > 0)
-                {
-                    prepare_tree_collision_pairs(obj, _tree_batches, gCurrentFrame);
-                }
-            
-                _common_data->process_collision_points();
+    // tree pairs and manifold pools are shared, merge them in object order
+    for (uint j = 0; j < njobs; j++) {
+        terrain_object_job& job = _terrain_jobs[j];
+        const terrain_worker_context& ctx = _terrain_contexts[job._ctx];
+        btCollisionObject* obj = job._obj;
+        btPersistentManifold* manifold = job._manifold;
 
-                int before = res.getPersistentManifold()->getNumContacts();
+        if (!manifold) {
+            continue;
+        }
 
-                res.refreshContactPoints();
+        for (uint c = job._child_begin; c < job._child_end; c++) {
+            const terrain_child_query& child = ctx._children[c];
+            if (child._tree_begin < child._tree_end) {
+                prepare_tree_collision_pairs(obj, ctx._tree_batches.ptr() + child._tree_begin, ctx._tree_batches.ptr() + child._tree_end, child._from, child._rad, gCurrentFrame);
+            }
+        }
 
-                //
-                if (obj->m_otFlags & bt::EOtFlags::OTF_POTENTIAL_TUNNEL_COLLISION) {
-                    btPersistentManifold* man = res.getPersistentManifold();
-                    int num_contacts = man->getNumContacts();
-                    for (int j = 0; j < num_contacts; j++) {
-                        btManifoldPoint& pt = man->getContactPoint(j);
+        if (job._child_begin < job._child_end && (obj->m_otFlags & bt::EOtFlags::OTF_POTENTIAL_TUNNEL_COLLISION)) {
+            int num_contacts = manifold->getNumContacts();
+            for (int k = 0; k < num_contacts; k++) {
+                btManifoldPoint& pt = manifold->getContactPoint(k);
 
-                        if (is_point_inside_terrain_occluder(pt.getPositionWorldOnB())) {
-                            man->removeContactPoint(j);
-                            j--;
-                            num_contacts--;
-                        }
-                    }
+                if (is_point_inside_terrain_occluder(pt.getPositionWorldOnB())) {
+                    manifold->removeContactPoint(k);
+                    k--;
+                    num_contacts--;
                 }
             }
         }
 
-        if(manifold != nullptr && manifold->getNumContacts() == 0 ) 
+        if (manifold->getNumContacts() == 0)
         {
             getDispatcher()->releaseManifold(manifold);
-            _manifolds.get_item(obj->getTerrainManifoldHandle());
             _manifolds.del_item_by_ptr(_manifolds.get_item(obj->getTerrainManifoldHandle()));
             obj->setTerrainManifoldHandle(UMAX32);
         }
     }
 
     process_terrain_broadphase_collision_pairs();
-    gContactAddedCallback = nullptr;
 }
 
-//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
-void discrete_dynamics_world::prepare_tree_collision_pairs(btCollisionObject* cur_obj, const coid::dynarray<uint>& tree_batches_cache, uint32 frame)
+/// closest time of impact of a convex cast against terrain triangles, ignores hits the shape moves away from
+class terrain_ccd_callback : public btTriangleConvexcastCallback
 {
-    for (uints i = 0; i < tree_batches_cache.size(); i++) {
-        uint bid = tree_batches_cache[i];
-        bt::tree_batch* tb = _tb_cache.get_item(bid);
+public:
+    btVector3 _motion;
+    btVector3 _normal;
+
+    terrain_ccd_callback(const btConvexShape* shape, const btTransform& from, const btTransform& to, btScalar allowed_penetration)
+        : btTriangleConvexcastCallback(shape, from, to, btTransform::getIdentity(), 0)
+        , _motion(to.getOrigin() - from.getOrigin())
+        , _normal(0, 0, 0)
+    {
+        m_allowedPenetration = allowed_penetration;
+    }
+
+    btScalar reportHit(const btVector3& hit_normal, const btVector3& hit_point, btScalar hit_fraction, int part_id, int triangle_index) override
+    {
+        if (hit_normal.dot(_motion) >= -m_allowedPenetration) {
+            return m_hitFraction;
+        }
+
+        m_hitFraction = hit_fraction;
+        _normal = hit_normal;
+        return hit_fraction;
+    }
+};
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void discrete_dynamics_world::create_terrain_predictive_contacts(btScalar time_step)
+{
+    BT_PROFILE("create_terrain_predictive_contacts");
+
+    if (!getDispatchInfo().m_useContinuous) {
+        return;
+    }
+
+    btTransform predicted_trans;
+
+    for (uints i = 0; i < _terrain_colliders.size(); i++)
+    {
+        btRigidBody* body = btRigidBody::upcast(_terrain_colliders[i]);
+        if (!body || body->isStaticOrKinematicObject() || !body->isActive() || !body->getCcdSquareMotionThreshold()) {
+            continue;
+        }
+
+        body->predictIntegratedTransform(time_step, predicted_trans);
+
+        const btTransform& trans = body->getWorldTransform();
+        const btVector3 motion = predicted_trans.getOrigin() - trans.getOrigin();
+        if (motion.length2() <= body->getCcdSquareMotionThreshold()) {
+            continue;
+        }
+
+        // spheres, capsules and convex shapes are swept as they are, others by the ccd sphere
+        btSphereShape ccd_sphere(body->getCcdSweptSphereRadius());
+        const btConvexShape* cast_shape = body->getCollisionShape()->isConvex()
+            ? static_cast<const btConvexShape*>(body->getCollisionShape())
+            : &ccd_sphere;
+
+        // cast relative to the current position, rotation is kept as in createPredictiveContacts
+        btTransform from_trans = trans;
+        from_trans.setOrigin(btVector3(0, 0, 0));
+        btTransform to_trans = from_trans;
+        to_trans.setOrigin(motion);
+
+        btVector3 min0, max0, min1, max1;
+        cast_shape->getAabb(from_trans, min0, max0);
+        cast_shape->getAabb(to_trans, min1, max1);
+
+        const btVector3 extent = (max0 - min0) * btScalar(0.5);
+        min0.setMin(min1);
+        max0.setMax(max1);
+
+        const btVector3 cen = (min0 + max0) * btScalar(0.5) + trans.getOrigin();
+        const btVector3 half = (max0 - min0) * btScalar(0.5);
+
+        const double3 from(cen.x(), cen.y(), cen.z());
+        float3x3 basis;
+        basis[0] = float3(float(half.x()), 0, 0);
+        basis[1] = float3(0, float(half.y()), 0);
+        basis[2] = float3(0, 0, float(half.z()));
+
+        bool is_above_tm = false;
+        double3 under_contact;
+        float3 under_normal;
+
+        _ccd_triangles.reset();
+        _ccd_tree_batches.reset();
+        _ccd_broadphases.reset();
+
+        _aabb_intersect(m_context, from, basis, float(extent[extent.minAxis()]), _ccd_triangles,
+            _ccd_tree_batches, _tb_cache, gCurrentFrame,
+            is_above_tm, under_contact, under_normal, _ccd_broadphases);
+
+        if (_ccd_triangles.size() == 0) {
+            continue;
+        }
+
+        terrain_ccd_callback cb(cast_shape, from_trans, to_trans, getDispatchInfo().m_allowedCcdPenetration);
+
+        const double3 org(trans.getOrigin().x(), trans.getOrigin().y(), trans.getOrigin().z());
+        btVector3 verts[3];
+
+        _ccd_triangles.for_each([&](const bt::triangle& t) {
+            const double3 rel = *t.parent_offset_p - org;
+            verts[0] = btVector3(rel.x + t.a.x, rel.y + t.a.y, rel.z + t.a.z);
+            verts[1] = btVector3(rel.x + t.b.x, rel.y + t.b.y, rel.z + t.b.z);
+            verts[2] = btVector3(rel.x + t.c.x, rel.y + t.c.y, rel.z + t.c.z);
+            cb.processTriangle(verts, 0, int(t.tri_idx));
+        });
+
+        if (cb.m_hitFraction >= btScalar(1)) {
+            continue;
+        }
+
+        // same predictive contact as createPredictiveContacts makes, released with them in the next step
+        const btVector3 dist_vec = motion * cb.m_hitFraction;
+        const btScalar distance = dist_vec.dot(-cb._normal);
+
+        btPersistentManifold* manifold = m_dispatcher1->getNewManifold(body, _planet_body);
+        m_predictiveManifolds.push_back(manifold);
+
+        const btVector3 world_point_b = trans.getOrigin() + dist_vec;
+        const btVector3 local_point_b = _planet_body->getWorldTransform().inverse() * world_point_b;
+
+        btManifoldPoint new_point(btVector3(0, 0, 0), local_point_b, cb._normal, cb._normal, distance);
+
+        const int index = manifold->addManifoldPoint(new_point, true);
+        btManifoldPoint& pt = manifold->getContactPoint(index);
+        pt.m_combinedRestitution = 0;
+        pt.m_combinedFriction = btManifoldResult::calculateCombinedFriction(body, _planet_body);
+        pt.m_positionWorldOnA = trans.getOrigin();
+        pt.m_positionWorldOnB = world_point_b;
+    }
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void discrete_dynamics_world::terrain_query_object(terrain_worker_context& ctx, terrain_object_job& job)
+{
+    btCollisionObject* obj = job._obj;
+    const btCollisionShape* obj_shape = obj->getCollisionShape();
+    const btTransform& obj_trans = obj->getWorldTransform();
+
+    job._child_begin = job._child_end = uint(ctx._children.size());
+
+    if (obj_shape->getShapeType() != COMPOUND_SHAPE_PROXYTYPE) {
+        terrain_query_child(ctx, job, obj_shape, obj_trans, 0, false);
+        job._child_end = uint(ctx._children.size());
+        return;
+    }
+
+    // leaves were updated when the job was created
+    const btCompoundShape* cs = static_cast<const btCompoundShape*>(obj_shape);
+    const btAlignedObjectArray<btCompoundShapeLeaf>& leaves = cs->getLeaves();
+    const uint nleaves = uint(leaves.size());
+
+    if (job._cache) {
+        // one slot per leaf and one for the broad query
+        coid::dynarray<terrain_cached_child>& cached_children = job._cache->_children;
+        while (cached_children.size() < nleaves + 1) {
+            cached_children.add();
+        }
+    }
+
+    const bool broad = terrain_compound_broad_test(ctx, job, cs, nleaves);
+
+    for (uint i = 0; i < nleaves; i++) {
+        const btCompoundShapeLeaf& leaf = leaves[i];
+        if (broad && !ctx._compound_child_hits[leaf.m_childIndex]) {
+            continue;
+        }
+
+        terrain_query_child(ctx, job, leaf.m_shape, obj_trans * leaf.m_transform, i, broad);
+    }
+
+    job._child_end = uint(ctx._children.size());
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+bool discrete_dynamics_world::terrain_compound_broad_test(terrain_worker_context& ctx, terrain_object_job& job, const btCompoundShape* cs, uint nleaves)
+{
+    const btDbvt* tree = cs->getDynamicAabbTree();
+    if (!tree || !tree->m_root || nleaves < TERRAIN_COMPOUND_BROAD_MIN_LEAVES) {
+        return false;
+    }
+
+    const btTransform& obj_trans = job._obj->getWorldTransform();
+
+    // query as fine as the finest leaf, so the triangles match those the leaves would get
+    float lod_dim = FLT_MAX;
+    const btAlignedObjectArray<btCompoundShapeLeaf>& leaves = cs->getLeaves();
+    for (uint i = 0; i < nleaves; i++) {
+        btVector3 min, max;
+        leaves[i].m_shape->getAabb(leaves[i].m_transform, min, max);
+        const btVector3 half = (max - min) * btScalar(0.5);
+        lod_dim = glm::min(lod_dim, float(half[half.minAxis()]));
+    }
+
+    double3 from;
+    float3x3 basis;
+    get_obb(cs, obj_trans, from, basis);
+
+    terrain_query_result qr;
+    query_terrain_obb(ctx, job, nleaves, cs, from, basis, lod_dim, qr);
+
+    // under the terrain mesh or near a tunnel, every leaf needs its own answer
+    if (qr.col_result != 0 && !qr.is_above_tm) {
+        return false;
+    }
+
+    const uint nchildren = uint(cs->getNumChildShapes());
+    ctx._compound_child_hits.reset();
+    memset(ctx._compound_child_hits.add(nchildren), 0, nchildren);
+
+    // direct children whose local aabb touches a terrain triangle
+    const btTransform inv_trans = obj_trans.inverse();
+    const btVector3 margin(TERRAIN_COMPOUND_BROAD_MARGIN, TERRAIN_COMPOUND_BROAD_MARGIN, TERRAIN_COMPOUND_BROAD_MARGIN);
+
+    qr.triangles->for_each([&](const bt::triangle& t) {
+        const double3& offset = *t.parent_offset_p;
+        const btVector3 a = inv_trans(btVector3(offset.x + t.a.x, offset.y + t.a.y, offset.z + t.a.z));
+        const btVector3 b = inv_trans(btVector3(offset.x + t.b.x, offset.y + t.b.y, offset.z + t.b.z));
+        const btVector3 c = inv_trans(btVector3(offset.x + t.c.x, offset.y + t.c.y, offset.z + t.c.z));
+
+        btVector3 min = a, max = a;
+        min.setMin(b); min.setMin(c);
+        max.setMax(b); max.setMax(c);
+        const btDbvtVolume volume = btDbvtVolume::FromMM(min - margin, max + margin);
+
+        ctx._compound_tree_stack.reset();
+        *ctx._compound_tree_stack.add() = tree->m_root;
+
+        const btDbvtNode* node;
+        while (ctx._compound_tree_stack.pop(node)) {
+            if (!Intersect(node->volume, volume)) {
+                continue;
+            }
+
+            if (node->isleaf()) {
+                ctx._compound_child_hits[node->dataAsInt] = 1;
+            }
+            else {
+                const btDbvtNode** children = ctx._compound_tree_stack.add(2);
+                children[0] = node->childs[0];
+                children[1] = node->childs[1];
+            }
+        }
+    });
+
+    // trees and external broadphases go once for the whole compound
+    if (qr.tree_batches->size() > 0 || qr.broadphases->size() > 0) {
+        terrain_child_query* child = ctx._children.add();
+        child->_shape = cs;
+        child->_world_trans = obj_trans;
+        child->_compound_child = false;
+        child->_broad = true;
+        child->_from = from;
+        child->_basis = basis;
+        child->_rad = glm::length(basis[0] + basis[1] + basis[2]);
+        child->_lod_dim = lod_dim;
+        child->_col_result = qr.col_result;
+        child->_is_above_tm = qr.is_above_tm;
+        child->_under_contact = qr.under_contact;
+        child->_under_normal = qr.under_normal;
+
+        child->_tri_begin = child->_tri_end = uint(ctx._triangles.size());
+
+        child->_tree_begin = uint(ctx._tree_batches.size());
+        qr.tree_batches->for_each([&](uint bid) { ctx._tree_batches.push(bid); });
+        child->_tree_end = uint(ctx._tree_batches.size());
+
+        child->_bp_begin = uint(ctx._broadphases.size());
+        qr.broadphases->for_each([&](bt::external_broadphase* bp) { ctx._broadphases.push(bp); });
+        child->_bp_end = uint(ctx._broadphases.size());
+    }
+
+    return true;
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// cached triangles outlive the terrain meshes their parent offsets point into, they get copies kept with the cache
+static void copy_parent_offsets(coid::dynarray<bt::triangle>& triangles, coid::dynarray<const double3*>& sources,
+    coid::dynarray<double3>& offsets)
+{
+    sources.reset();
+    triangles.for_each([&](const bt::triangle& t) {
+        uints i = 0;
+        while (i < sources.size() && sources[i] != t.parent_offset_p)
+            ++i;
+        if (i == sources.size())
+            *sources.add() = t.parent_offset_p;
+    });
+
+    offsets.reset();
+    sources.for_each([&](const double3* p) {
+        *offsets.add() = *p;
+    });
+
+    triangles.for_each([&](bt::triangle& t) {
+        uints i = 0;
+        while (sources[i] != t.parent_offset_p)
+            ++i;
+        t.parent_offset_p = &offsets[i];
+    });
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void discrete_dynamics_world::query_terrain_obb(terrain_worker_context& ctx, terrain_object_job& job, uint slot,
+    const btCollisionShape* shape, const double3& from, const float3x3& basis, float lod_dim, terrain_query_result& qr)
+{
+    terrain_cached_child* cached = nullptr;
+    if (job._cache) {
+        coid::dynarray<terrain_cached_child>& cached_children = job._cache->_children;
+        cached = slot < cached_children.size() ? &cached_children[slot] : cached_children.add();
+    }
+
+    const bool cache_hit = cached
+        && cached->_valid
+        && cached->_shape == shape
+        && cached->_revision == _terrain_revision
+        && _terrain_pass_gen - cached->_fetch_gen < TERRAIN_CACHE_MAX_AGE
+        && is_obb_inside(from, basis, cached->_from, cached->_basis);
+
+    qr.triangles = &ctx._query_triangles;
+    qr.tree_batches = &ctx._query_tree_batches;
+    qr.broadphases = &ctx._query_broadphases;
+    qr.is_above_tm = false;
+
+    if (cache_hit) {
+        ++ctx._cache_hits;
+        qr.triangles = &cached->_triangles;
+        qr.tree_batches = &cached->_tree_batches;
+        qr.broadphases = &cached->_broadphases;
+        qr.col_result = cached->_col_result;
+        qr.is_above_tm = true;
+        return;
+    }
+
+    // the margin is only worth it while the results can be cached, i.e. the object stayed above the terrain mesh
+    bool expand = cached && cached->_valid;
+
+    float3x3 query_basis = basis;
+    if (cached) {
+        ++ctx._cache_misses;
+    }
+    if (expand) {
+        for (int a = 0; a < 3; a++) {
+            const float len = glm::length(basis[a]);
+            query_basis[a] = basis[a] * ((len + TERRAIN_CACHE_MARGIN) / glm::max(len, 1e-6f));
+        }
+    }
+
+    coid::slotalloc<bt::tree_batch>& tree_batches = ctx._stage_tree_batches ? ctx._tb_staging : _tb_cache;
+
+    for (;;) {
+        ctx._query_triangles.reset();
+        ctx._query_tree_batches.reset();
+        ctx._query_broadphases.reset();
+
+        qr.col_result = _aabb_intersect(m_context, from, query_basis, lod_dim, ctx._query_triangles,
+            ctx._query_tree_batches, tree_batches, gCurrentFrame,
+            qr.is_above_tm, qr.under_contact, qr.under_normal, ctx._query_broadphases);
+
+        // a result that is not cached is used as is, it must be the one of the exact obb
+        if (!expand || (qr.col_result > 0 && qr.is_above_tm))
+            break;
+
+        query_basis = basis;
+        expand = false;
+    }
+
+    if (ctx._stage_tree_batches) {
+        // replaced by the _tb_cache ids in merge_staged_tree_batches
+        ctx._query_tree_batches.for_each([](uint& bid) { bid |= TREE_BATCH_STAGED_BIT; });
+    }
+
+    if (cached) {
+        // only results above the terrain mesh do not depend on the exact position
+        cached->_valid = qr.col_result > 0 && qr.is_above_tm;
+        if (cached->_valid) {
+            cached->_shape = shape;
+            cached->_revision = _terrain_revision;
+            cached->_fetch_gen = _terrain_pass_gen;
+            cached->_from = from;
+            cached->_basis = query_basis;
+            cached->_col_result = qr.col_result;
+            cached->_triangles.swap(ctx._query_triangles);
+            copy_parent_offsets(cached->_triangles, ctx._offset_sources, cached->_offsets);
+            cached->_tree_batches.swap(ctx._query_tree_batches);
+            cached->_broadphases.swap(ctx._query_broadphases);
+
+            qr.triangles = &cached->_triangles;
+            qr.tree_batches = &cached->_tree_batches;
+            qr.broadphases = &cached->_broadphases;
+        }
+    }
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void discrete_dynamics_world::merge_staged_tree_batches(uint nchunks)
+{
+    // cached batches by terrain mesh cell, a cell already cached or added by an earlier worker keeps its batch id
+    _tb_cache_keys.reset();
+    _tb_cache.for_each([&](bt::tree_batch& tb) {
+        if (tb.tm) {
+            tree_batch_key* key = _tb_cache_keys.add();
+            key->tm = tb.tm;
+            key->tm_version = tb.tm_version;
+            key->idx_in_tm = tb.idx_in_tm;
+            key->bid = uint(_tb_cache.get_item_id(&tb));
+        }
+    });
+    std::sort(_tb_cache_keys.ptr(), _tb_cache_keys.ptre());
+    const uints nsorted = _tb_cache_keys.size();
+
+    for (uint c = 0; c < nchunks; c++) {
+        terrain_worker_context& ctx = _terrain_contexts[c];
+        ctx._tb_remap.reset();
+
+        ctx._tb_staging.for_each([&](bt::tree_batch& staged) {
+            const uint sid = uint(ctx._tb_staging.get_item_id(&staged));
+            uint bid = UMAX32;
+
+            tree_batch_key key;
+            key.tm = staged.tm;
+            key.tm_version = staged.tm_version;
+            key.idx_in_tm = staged.idx_in_tm;
+
+            if (key.tm) {
+                const tree_batch_key* found = std::lower_bound(_tb_cache_keys.ptr(), _tb_cache_keys.ptr() + nsorted, key);
+                if (found != _tb_cache_keys.ptr() + nsorted && found->same_cell(key)) {
+                    bid = found->bid;
+                }
+                for (uints k = nsorted; bid == UMAX32 && k < _tb_cache_keys.size(); k++) {
+                    if (_tb_cache_keys[k].same_cell(key)) {
+                        bid = _tb_cache_keys[k].bid;
+                    }
+                }
+            }
+
+            if (bid == UMAX32) {
+                bt::tree_batch* tb = _tb_cache.add();
+                *tb = staged;
+                // the collision info points into the batch, it's built again on first use
+                tb->last_frame_used = UMAX32;
+                bid = uint(_tb_cache.get_item_id(tb));
+
+                if (key.tm) {
+                    key.bid = bid;
+                    *_tb_cache_keys.add() = key;
+                }
+            }
+
+            while (ctx._tb_remap.size() <= sid) {
+                *ctx._tb_remap.add() = UMAX32;
+            }
+            ctx._tb_remap[sid] = bid;
+        });
+
+        ctx._tb_staging.reset();
+
+        ctx._tree_batches.for_each([&](uint& bid) {
+            if (bid & TREE_BATCH_STAGED_BIT) {
+                bid = ctx._tb_remap[bid & ~TREE_BATCH_STAGED_BIT];
+            }
+        });
+    }
+
+    // query results cached in this pass were fetched with the staged ids as well
+    _terrain_jobs.for_each([&](terrain_object_job& job) {
+        if (!job._cache) {
+            return;
+        }
+
+        const terrain_worker_context& ctx = _terrain_contexts[job._ctx];
+        job._cache->_children.for_each([&](terrain_cached_child& cached) {
+            cached._tree_batches.for_each([&](uint& bid) {
+                if (bid & TREE_BATCH_STAGED_BIT) {
+                    bid = ctx._tb_remap[bid & ~TREE_BATCH_STAGED_BIT];
+                }
+            });
+        });
+    });
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void discrete_dynamics_world::terrain_query_child(terrain_worker_context& ctx, terrain_object_job& job,
+    const btCollisionShape* shape, const btTransform& world_trans, uint slot, bool broad)
+{
+    if (shape->getUserIndex() & 1) { // do not collide with terrain
+        return;
+    }
+
+    float rad;
+    float lod_dim;
+
+    if (shape->getShapeType() == SPHERE_SHAPE_PROXYTYPE) {
+        const btSphereShape* sph = reinterpret_cast<const btSphereShape*>(shape);
+        rad = float(sph->getRadius() + 0.02);
+        lod_dim = rad;
+    }
+    else if (shape->getShapeType() == CAPSULE_SHAPE_PROXYTYPE) {
+        const btCapsuleShape* caps = reinterpret_cast<const btCapsuleShape*>(shape);
+        float cap_rad = float(caps->getRadius());
+        float cap_hheight = float(caps->getHalfHeight());
+        rad = cap_rad + cap_hheight + 0.04f;
+        lod_dim = cap_rad;
+    }
+    else if (shape->isConvex()) {
+        btVector3 min;
+        btVector3 max;
+        btScalar bs_rad;
+        shape->getBoundingSphere(min, bs_rad);
+        shape->getAabb(world_trans, min, max);
+
+        rad = (float)bs_rad;
+
+        min = (max - min) * 0.5;
+        lod_dim = (float)min[min.minAxis()];
+    }
+    else {
+        return;
+    }
+
+    double3 from;
+    float3x3 basis;
+    get_obb(shape, world_trans, from, basis);
+
+    terrain_query_result qr;
+    query_terrain_obb(ctx, job, slot, shape, from, basis, lod_dim, qr);
+
+    // trees and broadphases of pruned compounds come from the broad query
+    const uint ntrees = broad ? 0 : uint(qr.tree_batches->size());
+    const uint nbps = broad ? 0 : uint(qr.broadphases->size());
+
+    if (qr.col_result == 0 && nbps == 0 && ntrees == 0) {
+        return;
+    }
+
+    terrain_child_query* child = ctx._children.add();
+    child->_shape = shape;
+    child->_world_trans = world_trans;
+    child->_compound_child = shape != job._obj->getCollisionShape();
+    child->_broad = false;
+    child->_from = from;
+    child->_basis = basis;
+    child->_rad = rad;
+    child->_lod_dim = lod_dim;
+    child->_col_result = qr.col_result;
+    child->_is_above_tm = qr.is_above_tm;
+    child->_under_contact = qr.under_contact;
+    child->_under_normal = qr.under_normal;
+
+    child->_tri_begin = uint(ctx._triangles.size());
+    qr.triangles->for_each([&](const bt::triangle& t) { ctx._triangles.push(t); });
+    child->_tri_end = uint(ctx._triangles.size());
+
+    child->_tree_begin = uint(ctx._tree_batches.size());
+    if (ntrees) {
+        qr.tree_batches->for_each([&](uint bid) { ctx._tree_batches.push(bid); });
+    }
+    child->_tree_end = uint(ctx._tree_batches.size());
+
+    child->_bp_begin = uint(ctx._broadphases.size());
+    if (nbps) {
+        qr.broadphases->for_each([&](bt::external_broadphase* bp) { ctx._broadphases.push(bp); });
+    }
+    child->_bp_end = uint(ctx._broadphases.size());
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+bool discrete_dynamics_world::is_obb_inside(const double3& cen, const float3x3& basis, const double3& outer_cen, const float3x3& outer_basis)
+{
+    const float3 d(cen - outer_cen);
+
+    for (int i = 0; i < 3; i++) {
+        const float3& axis = outer_basis[i];
+        const float half2 = glm::dot(axis, axis);
+
+        // projections scaled by the outer half extent: |d.a| + sum|b_j.a| <= |a|^2
+        const float ext = glm::abs(glm::dot(d, axis))
+            + glm::abs(glm::dot(basis[0], axis))
+            + glm::abs(glm::dot(basis[1], axis))
+            + glm::abs(glm::dot(basis[2], axis));
+
+        if (ext > half2) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void discrete_dynamics_world::set_terrain_cache_enabled(bool enabled)
+{
+    if (!enabled) {
+        _terrain_caches.reset();
+    }
+
+    _terrain_cache_enabled = enabled;
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void discrete_dynamics_world::terrain_collide_object(terrain_worker_context& ctx, terrain_object_job& job)
+{
+    btCollisionObject* obj = job._obj;
+
+    btCollisionObjectWrapper planet_wrapper(0, _planet_body->getCollisionShape(), _planet_body, btTransform::getIdentity(), -1, -1);
+    btCollisionObjectWrapper collider_wrapper(0, obj->getCollisionShape(), obj, obj->getWorldTransform(), -1, -1);
+    btManifoldResult res(&collider_wrapper, &planet_wrapper);
+    res.setPersistentManifold(job._manifold);
+
+    for (uint c = job._child_begin; c < job._child_end; c++) {
+        const terrain_child_query& child = ctx._children[c];
+        if (child._broad) {
+            continue;
+        }
+
+        btCollisionObjectWrapper internal_obj_wrapper(child._compound_child ? &collider_wrapper : 0,
+            child._shape,
+            obj,
+            child._world_trans,
+            -1,
+            -1);
+
+        ctx._common_data->set_internal_obj_wrapper(&internal_obj_wrapper);
+
+        const btVector3 sc = child._world_trans.getOrigin();
+
+        if (child._shape->getShapeType() == SPHERE_SHAPE_PROXYTYPE) {
+            const btSphereShape* sph = reinterpret_cast<const btSphereShape*>(child._shape);
+            ctx._common_data->prepare_sphere_collision(&res, child._from, float(sph->getRadius()), 0.02f);
+        }
+        else if (child._shape->getShapeType() == CAPSULE_SHAPE_PROXYTYPE) {
+            const btCapsuleShape* caps = reinterpret_cast<const btCapsuleShape*>(child._shape);
+            float cap_rad = float(caps->getRadius());
+            float cap_hheight = float(caps->getHalfHeight());
+
+            btVector3 main_axis = child._world_trans.getBasis().getColumn(caps->getUpAxis());
+            btVector3 p0 = sc + (main_axis * cap_hheight);
+            btVector3 p1 = sc - (main_axis * cap_hheight);
+
+            ctx._common_data->prepare_capsule_collision(&res, glm::dvec3(p0.x(), p0.y(), p0.z()), glm::dvec3(p1.x(), p1.y(), p1.z()), cap_rad, float(caps->getMargin()));
+        }
+        else {
+            ctx._common_data->prepare_bt_convex_collision(&res, &internal_obj_wrapper, getDispatcher());
+        }
+
+        ctx._common_data->set_bounding_sphere_rad(child._rad);
+
+        const uint tri_count = child._tri_end - child._tri_begin;
+        if (tri_count > 0)
+        {
+            if (child._is_above_tm) {
+                CPU_PROFILE_SCOPE(process_triangle_cache);
+                ctx._common_data->process_triangle_cache(ctx._triangles.ptr() + child._tri_begin, ctx._triangles.ptr() + child._tri_end);
+            }
+            else {
+                ctx._common_data->collide_object_plane(_elevation_above_terrain);
+            }
+
+            ctx._triangles_processed += tri_count;
+        }
+        else if (child._col_result == -1 && !job._potentially_inside_tunnel) {
+            res.setContactAddedHook(nullptr, nullptr);
+            res.addContactPoint(btVector3(child._under_normal.x, child._under_normal.y, child._under_normal.z),
+                btVector3(child._from.x, child._from.y, child._from.z),
+                -glm::length(child._from - child._under_contact));
+        }
+
+        ctx._common_data->process_collision_points();
+
+        res.refreshContactPoints();
+    }
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void discrete_dynamics_world::prepare_tree_collision_pairs(btCollisionObject* cur_obj, const uint* tb_begin, const uint* tb_end, const double3& from, float rad, uint32 frame)
+{
+    const int shape_type = cur_obj->getCollisionShape()->getShapeType();
+    const bool batched = shape_type == SPHERE_SHAPE_PROXYTYPE || shape_type == CAPSULE_SHAPE_PROXYTYPE;
+
+    for (const uint* tb_ptr = tb_begin; tb_ptr < tb_end; ++tb_ptr) {
+        uint bid = *tb_ptr;
+        bt::tree_batch* tb = _tb_cache.get_item(bid);
 
         if (tb->last_frame_used == UMAX32) {
             build_tb_collision_info(tb);
@@ -940,6 +1888,8 @@ void discrete_dynamics_world::prepare_tree_collision_pairs(btCollisionObject* cu
 
         tb->last_frame_used = frame;
 
+        tree_batch_query* query = nullptr;
+
         for (uint8 j = 0; j < tb->tree_count; j++) {
             if (tb->trees[j].spring_force_uv[0] == -128 && tb->trees[j].spring_force_uv[1] != -128) // broken tree
                 continue;
@@ -951,20 +1901,30 @@ void discrete_dynamics_world::prepare_tree_collision_pairs(btCollisionObject* cu
             }
 
             float3 p = float3(glm::normalize(tb->trees[j].pos)) * tb->trees[j].height;
-            float3 cen_rel(_from - tb->trees[j].pos);
-            if (coal3d::distance_point_segment_sqr(cen_rel, float3(0, 0, 0), p) < glm::pow(tb->trees[j].radius + _rad, 2.f)) {
-                tree_collision_pair tcp(cur_obj, bid, j);
-                tree_collision_pair* cached_tcp = _tree_collision_pairs.find_if([&](const tree_collision_pair& _tcp) {
-                    return tcp == _tcp;
-                });
-
-                if (!cached_tcp) {
-                    cached_tcp = _tree_collision_pairs.add();
+            float3 cen_rel(from - tb->trees[j].pos);
+            if (coal3d::distance_point_segment_sqr(cen_rel, float3(0, 0, 0), p) < glm::pow(tb->trees[j].radius + rad, 2.f)) {
+                bool is_new = false;
+                tree_collision_pair* cached_tcp = _tree_collision_pairs.find_or_insert_value_slot(
+                    tree_collision_pair_key(cur_obj, bid << 4 | (j & 0xf)), &is_new);
+
+                if (is_new) {
                     cached_tcp->init_with(cur_obj, bid, j, tb->trees[j]);
                     cached_tcp->manifold = getDispatcher()->getNewManifold(cached_tcp->obj, &tb->info(j)->obj);
                 }
 
-                cached_tcp->reused = true;
+                cached_tcp->seen_gen = _terrain_pass_gen;
+
+                if (batched) {
+                    if (!query) {
+                        query = _tree_batch_queries.add();
+                        query->obj = cur_obj;
+                        query->bid = bid;
+                        query->mask = 0;
+                    }
+
+                    query->mask |= 1 << j;
+                    query->pair_ids[j] = _tree_collision_pairs.get_item_id(cached_tcp);
+                }
             }
         }
     }
@@ -987,19 +1947,80 @@ void discrete_dynamics_world::build_tb_collision_info(bt::tree_batch* tb)
         t_col->setCollisionShape(t_cap);
         t_col->setWorldTransform(t_trans);
     }
+
+    tb->soa.build(tb->trees, tb->tree_count);
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void discrete_dynamics_world::process_tree_batch_queries()
+{
+    _tree_batch_queries.for_each([&](const tree_batch_query& query) {
+        const bt::tree_batch* tb = _tb_cache.get_item(query.bid);
+        const bt::tree_batch_soa& soa = tb->soa;
+        btCollisionObject* obj = query.obj;
+        const btCollisionShape* shape = obj->getCollisionShape();
+        const btTransform& trans = obj->getWorldTransform();
+        const btVector3& o = trans.getOrigin();
+
+        // body segment relative to the batch origin
+        const double3 center(o.x() - soa.origin.x, o.y() - soa.origin.y, o.z() - soa.origin.z);
+        float3 p0(center), p1(center);
+        float radius;
+
+        if (shape->getShapeType() == CAPSULE_SHAPE_PROXYTYPE) {
+            const btCapsuleShape* caps = static_cast<const btCapsuleShape*>(shape);
+            const btVector3 axis = trans.getBasis().getColumn(caps->getUpAxis()) * caps->getHalfHeight();
+            p0 = float3(center + double3(axis.x(), axis.y(), axis.z()));
+            p1 = float3(center - double3(axis.x(), axis.y(), axis.z()));
+            radius = float(caps->getRadius());
+        }
+        else {
+            radius = float(static_cast<const btSphereShape*>(shape)->getRadius());
+        }
+
+        bt::tree_segment_contact contacts[bt::tree_batch_soa::LANES];
+        bt::collide_segment_tree_batch(soa, p0, p1, radius, contacts);
+
+        btCollisionObjectWrapper obj1_wrapper(0, shape, obj, trans, -1, -1);
+
+        for (uint j = 0; j < soa.count; j++) {
+            if (!(query.mask & (1 << j))) {
+                continue;
+            }
+
+            tree_collision_pair* tcp = _tree_collision_pairs.get_item(query.pair_ids[j]);
+            bt::tree_collision_info* tci = const_cast<bt::tree_batch*>(tb)->info(j);
+            btCollisionObjectWrapper obj2_wrapper(0, &tci->shape, &tci->obj, tci->obj.getWorldTransform(), -1, -1);
+
+            btManifoldResult res(&obj1_wrapper, &obj2_wrapper);
+            res.setPersistentManifold(tcp->manifold);
+
+            const bt::tree_segment_contact& tc = contacts[j];
+            if (tc.distance < tcp->manifold->getContactBreakingThreshold()) {
+                const double3 pt = soa.origin + double3(tc.point_on_tree);
+                res.addContactPoint(btVector3(tc.normal.x, tc.normal.y, tc.normal.z), btVector3(pt.x, pt.y, pt.z), tc.distance);
+            }
+
+            res.refreshContactPoints();
+            tcp->batched_gen = _terrain_pass_gen;
+        }
+    });
 }
 
 //-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 void discrete_dynamics_world::process_tree_collisions(btScalar time_step)
 {
+    BT_PROFILE("process_tree_collisions");
+
+    process_tree_batch_queries();
+
     _tree_collision_pairs.for_each([&](tree_collision_pair& tcp) {
         btDispatcher* dispatcher = getDispatcher();
         btPersistentManifold* manifold = tcp.manifold;
         DASSERT(manifold);
 
-        if (!tcp.reused) {
-            dispatcher->releaseManifold(manifold);
-            _tree_collision_pairs.del_item_by_ptr(&tcp);
+        if (tcp.seen_gen != _terrain_pass_gen) {
+            release_tree_collision_pair(tcp);
             return;
         }
 
@@ -1009,20 +2030,27 @@ void discrete_dynamics_world::process_tree_collisions(btScalar time_step)
         bt::tree* tree_inf = get_tree(tcp);
         btCollisionObjectWrapper obj2_wrapper(0, &tree_col_info->shape, &tree_col_info->obj, tree_col_info->obj.getWorldTransform(), -1, -1);
 
-        btManifoldResult res(&obj1_wrapper, &obj2_wrapper);
-        res.setPersistentManifold(manifold);
+        // sphere and capsule bodies were already handled by the batched tree collider
+        if (tcp.batched_gen != _terrain_pass_gen) {
+            btManifoldResult res(&obj1_wrapper, &obj2_wrapper);
+            res.setPersistentManifold(manifold);
+
+            if (!tcp.algorithm) {
+                tcp.algorithm = dispatcher->findAlgorithm(&obj1_wrapper, &obj2_wrapper, manifold);
+#ifdef _PROFILING_ENABLED
+                if (tcp.algorithm) {
+                    _stats.collision_algorithms_created++;
+                }
+#endif // _PROFILING_ENABLED
+            }
 
-        btCollisionAlgorithm* algo = dispatcher->findAlgorithm(&obj1_wrapper, &obj2_wrapper, manifold);
+            if (tcp.algorithm) {
+                tcp.algorithm->processCollision(&obj1_wrapper, &obj2_wrapper, getDispatchInfo(), &res);
+            }
 
-        if (algo) {
-            algo->processCollision(&obj1_wrapper, &obj2_wrapper, getDispatchInfo(), &res);
-            algo->~btCollisionAlgorithm();
-            dispatcher->freeCollisionAlgorithm(algo);
+            res.refreshContactPoints();
         }
 
-        tcp.reused = false;
-        res.refreshContactPoints();
-
         if (!tcp.tc_ctx.collision_started) {
             if (manifold->getNumContacts()) {
                 btManifoldPoint& min_cp = manifold->getContactPoint(0);
@@ -1072,6 +2100,24 @@ void discrete_dynamics_world::process_tree_collisions(btScalar time_step)
     });
 }
 
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void discrete_dynamics_world::release_tree_collision_pair(tree_collision_pair& tcp)
+{
+    btDispatcher* dispatcher = getDispatcher();
+
+    if (tcp.algorithm) {
+        tcp.algorithm->~btCollisionAlgorithm();
+        dispatcher->freeCollisionAlgorithm(tcp.algorithm);
+        tcp.algorithm = 0;
+#ifdef _PROFILING_ENABLED
+        _stats.collision_algorithms_released++;
+#endif // _PROFILING_ENABLED
+    }
+
+    dispatcher->releaseManifold(tcp.manifold);
+    _tree_collision_pairs.erase(tree_collision_pair_key(tcp.obj, tcp.tree_col_info));
+}
+
 //-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 void discrete_dynamics_world::get_obb(const btCollisionShape* cs, const btTransform& t, double3& cen, float3x3& basis)
 {
@@ -1079,7 +2125,7 @@ void discrete_dynamics_world::get_obb(const btCollisionShape* cs, const btTransf
     cs->getAabb(btTransform::getIdentity(), min, max);
     btVector3 bt_cen = (min + max) * btScalar(0.5);
     btVector3 half = max - bt_cen;
-    bt_cen += t.getOrigin();
+    bt_cen = t(bt_cen);
     btMatrix3x3 bt_basis;
     bt_basis[0] = t.getBasis() * btVector3(half[0], 0, 0);
     bt_basis[1] = t.getBasis() * btVector3(0, half[1], 0);
@@ -1271,7 +2317,6 @@ discrete_dynamics_world::discrete_dynamics_world(btDispatcher* dispatcher,
     , _debug_terrain_triangles(1024)
     , _debug_trees(1024)
     , _tb_cache(1024, coid::reserve_mode::memory)
-    , _terrain_mesh_broadphase_pairs(1024, coid::reserve_mode::memory)
     , _task_master(tm)
     //, _relocation_offset(0)
 {
@@ -1285,8 +2330,8 @@ discrete_dynamics_world::discrete_dynamics_world(btDispatcher* dispatcher,
     _planet_body->setRestitution(0.0f);
     _planet_body->setCollisionFlags(_planet_body->getCollisionFlags() | btCollisionObject::CF_CUSTOM_MATERIAL_CALLBACK);
 
-    _cow_internal.reserve(128, false);
-    _compound_processing_stack.reserve(128, false);
+    _terrain_jobs.reserve(128, false);
+    _terrain_contexts.reserve(TERRAIN_PASS_MAX_CONTEXTS, false);
 }
 
 //-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
@@ -1442,21 +2487,24 @@ void discrete_dynamics_world::add_debug_aabb(const btVector3& min, const btVecto
 }
 
 //-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
-void discrete_dynamics_world::add_sensor_trigger_data_internal(btPairCachingGhostObject* sensor_ptr, btCollisionObject* trigger_ptr, btBroadphasePair* pair_ptr)
+void discrete_dynamics_world::add_sensor_trigger_data_internal(btPairCachingGhostObject* sensor_ptr, btCollisionObject* trigger_ptr)
 {
-    DASSERTX(find_active_trigger_intenral(sensor_ptr, trigger_ptr) == nullptr, "sensor-trigger pair already added!");
+    bool is_new = false;
+    sensor_trigger_data* data = _active_sensors.find_or_insert_value_slot(sensor_trigger_key(sensor_ptr, trigger_ptr), &is_new);
+
+    DASSERTX(is_new, "sensor-trigger pair already added!");
 
-    _active_sensors.push({ sensor_ptr, trigger_ptr, pair_ptr, false });
+    if (is_new) {
+        new(data) sensor_trigger_data(sensor_ptr, trigger_ptr);
+    }
 }
 
 //-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 void discrete_dynamics_world::remove_sensor_trigger_data_internal(btPairCachingGhostObject* sensor_ptr, btCollisionObject* trigger_ptr)
 {
-    sensor_trigger_data* found = find_active_trigger_intenral(sensor_ptr, trigger_ptr);
-
-    DASSERT_RETX(found != nullptr, "sensor-trigger pair not found!");
+    const bool found = _active_sensors.erase(sensor_trigger_key(sensor_ptr, trigger_ptr));
 
-    _active_sensors.del_item_by_ptr(found);
+    DASSERT_RETX(found, "sensor-trigger pair not found!");
 
     _triggered_sensors.del_if([&](std::pair<btGhostObject*, btCollisionObject*>& data)
     {
@@ -1464,81 +2512,85 @@ void discrete_dynamics_world::remove_sensor_trigger_data_internal(btPairCachingG
     });
 }
 
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void discrete_dynamics_world::sensor_contact_event_internal(const btCollisionObject* sensor_ptr, const btCollisionObject* trigger_ptr, bool started)
+{
+    std::lock_guard<std::mutex> lock(_sensor_events_mutex);
+
+    sensor_contact_event* ev = _sensor_events.add();
+    ev->sensor = sensor_ptr;
+    ev->trigger = trigger_ptr;
+    ev->started = started;
+}
+
 //-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 
 void discrete_dynamics_world::update_sensors_internal()
 {
-    _active_sensors.for_each([this](sensor_trigger_data& data)
+    BT_PROFILE("update_sensors");
+
+    // only the pairs whose manifolds gained the first or lost the last contact point since the last step
+    _sensor_events.for_each([this](const sensor_contact_event& ev)
     {
-        THREAD_LOCAL_SINGLETON_DEF(btManifoldArray) manifolds;
-        manifolds->clear();
+        sensor_trigger_data* data = find_active_trigger_intenral(ev.sensor, ev.trigger);
 
-        int64 idx = data._pair_ptr - getBroadphase()->getOverlappingPairCache()->getOverlappingPairArrayPtr();
+        // pair already gone, its manifolds get cleared after the removal
+        if (!data)
+            return;
 
-        if (data._pair_ptr == nullptr || idx < 0 || idx > getBroadphase()->getOverlappingPairCache()->getNumOverlappingPairs())
-        {
-            btBroadphasePairArray& pairs = data._sensor_ptr->getOverlappingPairCache()->getOverlappingPairArray();
-            for (int i = 0; i < pairs.size(); ++i)
-            {
-                if ((pairs[i].m_pProxy0->m_clientObject == data._sensor_ptr && pairs[i].m_pProxy1->m_clientObject == data._trigger_ptr) ||
-                    (pairs[i].m_pProxy1->m_clientObject == data._sensor_ptr && pairs[i].m_pProxy0->m_clientObject == data._trigger_ptr))
-                {
-                    data._pair_ptr = &pairs[i];
-                    data._pair_ptr = getBroadphase()->getOverlappingPairCache()->findPair(data._pair_ptr->m_pProxy0, data._pair_ptr->m_pProxy1);
-                    break;
-                }
-            }
+        if (ev.started) {
+            if (data->_touching_manifolds++ == 0)
+                _triggered_sensors.push({data->_sensor_ptr, data->_trigger_ptr});
         }
-
-        if (data._pair_ptr->m_algorithm)
-            data._pair_ptr->m_algorithm->getAllContactManifolds(*manifolds);
-
-        const bool do_collide = manifolds->size() > 0;
-
-        if (data._triggered)
-        {
-            if (do_collide)
-            {
-                // still trigerred
-            }
-            else
-            {
-                // what to do when untrigerred?
-            }
+        else if (data->_touching_manifolds > 0) {
+            // a manifold of a removed pair may end after the pair was added again
+            --data->_touching_manifolds;
         }
-        else if (do_collide)
-        {
-            _triggered_sensors.push({data._sensor_ptr, data._trigger_ptr});
-        }
-
-        data._triggered = do_collide;
     });
+
+    _sensor_events.reset();
 }
 
 //-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 
-discrete_dynamics_world::sensor_trigger_data* discrete_dynamics_world::find_active_trigger_intenral(btPairCachingGhostObject* sensor_ptr, btCollisionObject* trigger_ptr)
+sensor_trigger_data* discrete_dynamics_world::find_active_trigger_intenral(const btCollisionObject* sensor_ptr, const btCollisionObject* trigger_ptr)
 {
-    return _active_sensors.find_if([&](sensor_trigger_data& data)
-    {
-        return data._sensor_ptr == sensor_ptr && data._trigger_ptr == trigger_ptr;
-    });
+    return const_cast<sensor_trigger_data*>(_active_sensors.find_value(sensor_trigger_key(sensor_ptr, trigger_ptr)));
 }
 
 //-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 void	discrete_dynamics_world::updateActions(btScalar timeStep)
 {
-    static bool use_parallel = true;
+    BT_PROFILE("updateActions");
 
-    if (use_parallel) {
-        _task_master->parallel_for(0, m_actions.size(), [&](int idx) {
-            m_actions[idx]->updateAction(this, timeStep);
-        });
-    }
-    else {
-        for (int i = 0; i < m_actions.size(); i++) {
+    const int nactions = m_actions.size();
+    if (nactions == 0)
+        return;
+
+    const bool parallel = _parallel_actions && _task_master != nullptr;
+    if (!parallel) {
+        for (int i = 0; i < nactions; i++) {
             m_actions[i]->updateAction(this, timeStep);
+        }
+        return;
+    }
+
+    _action_schedule.build(&m_actions[0], nactions);
+
+    const int* order = &_action_schedule.m_order[0];
 
+    for (int s = 0; s < _action_schedule.m_stages.size(); ++s) {
+        const btActionSchedule::Stage& stage = _action_schedule.m_stages[s];
+
+        if (stage.m_serial || stage.m_end - stage.m_begin == 1) {
+            for (int i = stage.m_begin; i < stage.m_end; i++) {
+                m_actions[order[i]]->updateAction(this, timeStep);
+            }
+        }
+        else {
+            _task_master->parallel_for(stage.m_begin, stage.m_end, [&](int idx) {
+                m_actions[order[idx]]->updateAction(this, timeStep);
+            });
         }
     }
 }
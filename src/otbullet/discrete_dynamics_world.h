@@ -2,9 +2,11 @@
 #define OT_DISCRETE_WORLD_DYNAMICS_H
 
 #include <BulletDynamics/Dynamics/btDiscreteDynamicsWorld.h>
+#include <BulletDynamics/Dynamics/btActionSchedule.h>
 #include <LinearMath/btAlignedObjectArray.h>
 
 #include "physics_cfg.h"
+#include "dbvt_query.h"
 
 #include <ot/glm/glm_types.h>
 #include <ot/glm/coal.h>
@@ -17,6 +19,8 @@
 
 #include <BulletCollision/BroadphaseCollision/btAxisSweep3.h>
 
+#include <mutex>
+
 //#include <ot/logger.h>
 //#include <ot/sketch.h>
 
@@ -49,13 +53,45 @@ struct tree_flex_inf {
 };
 
 ///
+/// key of tree_collision_pair in the pair hash
+struct tree_collision_pair_key
+{
+    const btCollisionObject* obj;
+    uint tree_col_info;
+
+    tree_collision_pair_key(const btCollisionObject* col_obj, uint tci)
+        : obj(col_obj)
+        , tree_col_info(tci)
+    {}
+
+    bool operator==(const tree_collision_pair_key& key) const {
+        return obj == key.obj && tree_col_info == key.tree_col_info;
+    }
+};
+
+struct tree_collision_pair_hasher
+{
+    typedef tree_collision_pair_key key_type;
+
+    uint operator()(const tree_collision_pair_key& key) const {
+        uint64 h = (uint64)(uints)key.obj * 0x9e3779b97f4a7c15ULL;
+        h ^= key.tree_col_info + 0x7f4a7c15U + (h << 6) + (h >> 2);
+        return uint(h ^ (h >> 32));
+    }
+};
+
 struct tree_collision_pair
 {
     btCollisionObject* obj;
     uint tree_col_info;
 
-    bool reused;
+    /// generation of the terrain pass in which the pair was last found, stale pairs get retired
+    uint seen_gen;
+    /// generation in which the contacts were generated by the batched tree collider
+    uint batched_gen;
     btPersistentManifold* manifold;
+    /// kept for the lifetime of the pair to preserve the algorithm caches (separating axis, GJK warm start)
+    btCollisionAlgorithm* algorithm;
 
     bt::tree_collision_contex tc_ctx;
 
@@ -67,8 +103,10 @@ struct tree_collision_pair
         : obj(0)
         , tree_col_info(-1)
 
-        , reused(false)
+        , seen_gen(0)
+        , batched_gen(0)
         , manifold(0)
+        , algorithm(0)
     {}
 
     tree_collision_pair(btCollisionObject* col_obj, uint bid, uint8 tid)
@@ -84,6 +122,143 @@ struct tree_collision_pair
     }
 };
 
+struct tree_collision_pair_extractor
+{
+    typedef tree_collision_pair_key ret_type;
+
+    ret_type operator()(const tree_collision_pair& tcp) const {
+        return tree_collision_pair_key(tcp.obj, tcp.tree_col_info);
+    }
+};
+
+///
+/// key of terrain_mesh_pair in the pair hash
+struct terrain_mesh_pair_key
+{
+    const btCollisionObject* obj0;
+    const btCollisionObject* obj1;
+
+    terrain_mesh_pair_key(const btCollisionObject* o0, const btCollisionObject* o1)
+        : obj0(o0)
+        , obj1(o1)
+    {}
+
+    bool operator==(const terrain_mesh_pair_key& key) const {
+        return obj0 == key.obj0 && obj1 == key.obj1;
+    }
+};
+
+struct terrain_mesh_pair_hasher
+{
+    typedef terrain_mesh_pair_key key_type;
+
+    uint operator()(const terrain_mesh_pair_key& key) const {
+        uint64 h = (uint64)(uints)key.obj0 * 0x9e3779b97f4a7c15ULL;
+        h ^= (uint64)(uints)key.obj1 + 0x7f4a7c15U + (h << 6) + (h >> 2);
+        return uint(h ^ (h >> 32));
+    }
+};
+
+/// pair of an object from an external broadphase and a world object
+/// keyed on the client objects, the external proxies get recreated when the broadphase is rebuilt
+struct terrain_mesh_pair : btBroadphasePair
+{
+    btCollisionObject* obj0;
+    btCollisionObject* obj1;
+
+    terrain_mesh_pair()
+        : obj0(0)
+        , obj1(0)
+    {}
+
+    terrain_mesh_pair(btCollisionObject* o0, btCollisionObject* o1)
+        : obj0(o0)
+        , obj1(o1)
+    {
+        m_pProxy0 = o0->getBroadphaseHandle();
+        m_pProxy1 = o1->getBroadphaseHandle();
+    }
+};
+
+struct terrain_mesh_pair_extractor
+{
+    typedef terrain_mesh_pair_key ret_type;
+
+    ret_type operator()(const terrain_mesh_pair& tmp) const {
+        return terrain_mesh_pair_key(tmp.obj0, tmp.obj1);
+    }
+};
+
+/// key of sensor_trigger_data in the sensor hash
+struct sensor_trigger_key
+{
+    const btCollisionObject* sensor;
+    const btCollisionObject* trigger;
+
+    sensor_trigger_key(const btCollisionObject* s, const btCollisionObject* t)
+        : sensor(s)
+        , trigger(t)
+    {}
+
+    bool operator==(const sensor_trigger_key& key) const {
+        return sensor == key.sensor && trigger == key.trigger;
+    }
+};
+
+struct sensor_trigger_hasher
+{
+    typedef sensor_trigger_key key_type;
+
+    uint operator()(const sensor_trigger_key& key) const {
+        uint64 h = (uint64)(uints)key.sensor * 0x9e3779b97f4a7c15ULL;
+        h ^= (uint64)(uints)key.trigger + 0x7f4a7c15U + (h << 6) + (h >> 2);
+        return uint(h ^ (h >> 32));
+    }
+};
+
+/// sensor overlapping a trigger object in the broadphase
+/// keyed on the objects, the pairs of the broadphase move when the pair array changes
+struct sensor_trigger_data
+{
+    btPairCachingGhostObject* _sensor_ptr = nullptr;
+    btCollisionObject* _trigger_ptr = nullptr;
+    /// manifolds of the pair with contact points
+    uint _touching_manifolds = 0;
+
+    sensor_trigger_data() {}
+
+    sensor_trigger_data(btPairCachingGhostObject* sensor, btCollisionObject* trigger)
+        : _sensor_ptr(sensor)
+        , _trigger_ptr(trigger)
+    {}
+};
+
+struct sensor_trigger_extractor
+{
+    typedef sensor_trigger_key ret_type;
+
+    ret_type operator()(const sensor_trigger_data& data) const {
+        return sensor_trigger_key(data._sensor_ptr, data._trigger_ptr);
+    }
+};
+
+/// contact count transition of a manifold between a sensor and a trigger object
+struct sensor_contact_event
+{
+    const btCollisionObject* sensor;
+    const btCollisionObject* trigger;
+    bool started;
+};
+
+/// trees of one batch touched by a sphere or capsule body, processed by the batched tree collider
+struct tree_batch_query
+{
+    btCollisionObject* obj;
+    uint bid;
+    uint16 mask;
+    uints pair_ids[16];
+};
+
 ///
 struct raw_collision_pair {
     btCollisionObject* _obj1;
@@ -94,18 +269,6 @@ struct raw_collision_pair {
         :_obj1(obj1), _obj2(obj2) {}
 };
 
-///
-struct compound_processing_entry {
-    btCollisionShape* _shape;
-    btTransform _world_trans;
-    compound_processing_entry(btCollisionShape* shape, const btTransform& world_trans)
-        :_shape(shape)
-        , _world_trans(world_trans)
-    {};
-    compound_processing_entry() {
-    }
-};
-
 struct p_treebatch_key_extractor {
     typedef uints ret_type;
     uints operator()(const bt::tree_batch* tb) const {
@@ -149,23 +312,142 @@ class discrete_dynamics_world : public btDiscreteDynamicsWorld
 {
     friend ot_gost_pair_callback;
 protected:
-    struct btCollisionObjectWrapperCtorArgs {
-        const btCollisionObjectWrapper* _parent;
+    /// terrain query result of a single (child) shape, filled by the terrain pass workers
+    struct terrain_child_query {
         const btCollisionShape* _shape;
-        const btCollisionObject* _collisionObject;
-        const btTransform _worldTransform;
-        int _partId;
-        int _index;
-        btCollisionObjectWrapperCtorArgs(const btCollisionObjectWrapper* parent, const btCollisionShape* shape, const btCollisionObject* collisionObject, const btTransform& worldTransform, int partId, int index)
-            :_parent(parent)
-            , _shape(shape)
-            , _collisionObject(collisionObject)
-            , _worldTransform(worldTransform)
-            , _partId(partId)
-            , _index(index)
-        {};
-    private:
-        btCollisionObjectWrapperCtorArgs();
+        btTransform _world_trans;
+        bool _compound_child;
+        bool _broad;                    //< whole compound entry of the broad query, only tree batches and broadphases
+
+        double3 _from;
+        float3x3 _basis;
+        float _rad;
+        float _lod_dim;
+
+        int _col_result;
+        bool _is_above_tm;
+        double3 _under_contact;
+        float3 _under_normal;
+
+        uint _tri_begin, _tri_end;
+        uint _tree_begin, _tree_end;
+        uint _bp_begin, _bp_end;
+    };
+
+    /// terrain query result of a child shape kept across frames, fetched with an expanded obb
+    struct terrain_cached_child {
+        const btCollisionShape* _shape = nullptr;
+        bool _valid = false;
+        uint _revision = 0;             //< _terrain_revision at fetch time
+        uint _fetch_gen = 0;            //< _terrain_pass_gen at fetch time
+
+        double3 _from;                  //< expanded obb used for the query
+        float3x3 _basis;
+        int _col_result = 0;
+
+        coid::dynarray<bt::triangle> _triangles;
+        coid::dynarray<double3> _offsets;   //< copies of the terrain mesh offsets the cached triangles point to
+        coid::dynarray<uint> _tree_batches;
+        coid::dynarray<bt::external_broadphase*> _broadphases;
+    };
+
+    /// terrain callback result, points either into the worker buffers or into the cache
+    struct terrain_query_result {
+        const coid::dynarray<bt::triangle>* triangles;
+        const coid::dynarray<uint>* tree_batches;
+        const coid::dynarray<bt::external_broadphase*>* broadphases;
+        int col_result;
+        bool is_above_tm;
+        double3 under_contact;
+        float3 under_normal;
+    };
+
+    /// per-object terrain triangle cache
+    struct terrain_object_cache {
+        const btCollisionObject* _obj = nullptr;
+        coid::dynarray<terrain_cached_child> _children;
+    };
+
+    struct terrain_object_cache_extractor {
+        typedef uints ret_type;
+        uints operator()(const terrain_object_cache& c) const {
+            return (uints)c._obj;
+        }
+    };
+
+    /// object processed by the terrain pass, children are stored in the context of the chunk
+    struct terrain_object_job {
+        btCollisionObject* _obj;
+        btPersistentManifold* _manifold;
+        terrain_object_cache* _cache;
+        uint _ctx;
+        uint _child_begin, _child_end;
+        bool _potentially_inside_tunnel;
+    };
+
+    /// terrain mesh cell of a tree batch in _tb_cache, finds the batch again when another worker added it in the same pass
+    struct tree_batch_key {
+        const bt::terrain_mesh* tm;
+        uint tm_version;
+        uint16 idx_in_tm;
+        uint bid;
+
+        bool operator<(const tree_batch_key& key) const {
+            if (tm != key.tm) return tm < key.tm;
+            if (tm_version != key.tm_version) return tm_version < key.tm_version;
+            return idx_in_tm < key.idx_in_tm;
+        }
+
+        bool same_cell(const tree_batch_key& key) const {
+            return tm == key.tm && tm_version == key.tm_version && idx_in_tm == key.idx_in_tm;
+        }
+    };
+
+    /// per-worker scratch data of the terrain pass
+    struct terrain_worker_context {
+        coid::dynarray<terrain_child_query> _children;
+
+        // compound broad test, direct children touching the terrain
+        coid::dynarray<uint8> _compound_child_hits;
+        coid::dynarray<const btDbvtNode*> _compound_tree_stack;
+
+        coid::dynarray<bt::triangle> _triangles;
+        coid::dynarray<uint> _tree_batches;
+        coid::dynarray<bt::external_broadphase*> _broadphases;
+
+        // buffers handed to the terrain callback, results are appended to the arrays above
+        coid::dynarray<bt::triangle> _query_triangles;
+        coid::dynarray<uint> _query_tree_batches;
+        coid::dynarray<bt::external_broadphase*> _query_broadphases;
+
+        // distinct parent offsets of the triangles being cached
+        coid::dynarray<const double3*> _offset_sources;
+
+        coid::local<ot_terrain_contact_common> _common_data;
+
+        // tree batches the terrain callback adds during a parallel pass, moved to _tb_cache after the queries,
+        // their ids in the query results are marked until then
+        coid::slotalloc<bt::tree_batch> _tb_staging;
+        coid::dynarray<uint> _tb_remap;
+        bool _stage_tree_batches = false;
+
+        uint _triangles_processed = 0;
+        uint _cache_hits = 0;
+        uint _cache_misses = 0;
+
+        terrain_worker_context()
+            : _tb_staging(1024, coid::reserve_mode::memory)
+        {}
+
+        void reset() {
+            _children.reset();
+            _triangles.reset();
+            _tree_batches.reset();
+            _broadphases.reset();
+            _triangles_processed = 0;
+            _cache_hits = 0;
+            _cache_misses = 0;
+        }
     };
 
     coid::taskmaster* _task_master;
@@ -173,41 +455,47 @@ protected:
     btRigidBody* _planet_body;
     btCollisionObjectWrapper* _pb_wrap;
     coid::slotalloc<btPersistentManifold*> _manifolds;
-    coid::slotalloc<tree_collision_pair> _tree_collision_pairs;
-    coid::dynarray<btCollisionObjectWrapperCtorArgs> _cow_internal;
-    coid::dynarray<compound_processing_entry> _compound_processing_stack;
+    coid::slothash<tree_collision_pair, tree_collision_pair_key, tree_collision_pair_extractor, tree_collision_pair_hasher> _tree_collision_pairs;
+    uint _terrain_pass_gen = 0;
+    coid::dynarray<tree_batch_query> _tree_batch_queries;
 
-    coid::dynarray<bt::triangle> _triangles;
     coid::slotalloc<bt::tree_batch> _tb_cache;
+    coid::dynarray<tree_batch_key> _tb_cache_keys;
     //void * _relocation_offset;
 
-    coid::dynarray<uint> _tree_batches;
+    coid::dynarray<terrain_object_job> _terrain_jobs;
+    coid::dynarray<terrain_worker_context> _terrain_contexts;
+    bool _parallel_terrain_step = false;
+    bool _parallel_actions = true;
+    bool _terrain_ccd = false;
+    // terrain query buffers of the ccd sweeps
+    coid::dynarray<bt::triangle> _ccd_triangles;
+    coid::dynarray<uint> _ccd_tree_batches;
+    coid::dynarray<bt::external_broadphase*> _ccd_broadphases;
+    btActionSchedule _action_schedule;
+    bool _terrain_cache_enabled = false;
+    uint _terrain_revision = 0;
+    coid::slothash<terrain_object_cache, uints, terrain_object_cache_extractor> _terrain_caches;
+    std::mutex _dispatcher_mutex;
 
     coid::dynarray<btGhostObject*> _terrain_occluders;
 
-    coid::slotalloc<btBroadphasePair> _terrain_mesh_broadphase_pairs;
+    /// objects the terrain pass works on: awake, with a terrain collidable shape and filter
+    coid::dynarray<btCollisionObject*> _terrain_colliders;
+    std::mutex _terrain_colliders_mutex;
 
-    struct sensor_trigger_data
-    {
-        btPairCachingGhostObject* _sensor_ptr = nullptr;
-        btCollisionObject* _trigger_ptr = nullptr;
-        btBroadphasePair* _pair_ptr = nullptr;
-        bool _triggered = false;
-    };
+    coid::slothash<terrain_mesh_pair, terrain_mesh_pair_key, terrain_mesh_pair_extractor, terrain_mesh_pair_hasher> _terrain_mesh_broadphase_pairs;
 
-    coid::slotalloc<sensor_trigger_data> _active_sensors;
+    coid::slothash<sensor_trigger_data, sensor_trigger_key, sensor_trigger_extractor, sensor_trigger_hasher> _active_sensors;
     coid::dynarray32<std::pair<btGhostObject*, btCollisionObject*>> _triggered_sensors;
+    /// contact transitions of sensor manifolds, queued from the narrowphase threads
+    coid::dynarray32<sensor_contact_event> _sensor_events;
+    std::mutex _sensor_events_mutex;
 
     //coid::dynarray<bt::external_broadphase*> _debug_external_broadphases;
 
     coid::slotalloc_pool<bt::external_broadphase> _external_broadphase_pool;
 
-    double3 _from;
-    float3 _ray;
-    float _rad;
-    float3x3 _basis;
-    float _lod_dim;
-
     bt::ot_world_physics_stats _stats;
 
     coid::dynarray<bt::triangle> _debug_terrain_triangles;
@@ -217,8 +505,6 @@ protected:
     */
     coid::dynarray<uint> _debug_trees;
 
-    coid::local<ot_terrain_contact_common> _common_data;
-
     bt::bullet_stats* _stats2;
     bool _simulation_running = true;
 
@@ -232,10 +518,12 @@ public:
 #ifdef _DEBUG
     void dump_triangle_list_to_obj(const char* fname, float off_x, float off_y, float off_z, float rx, float ry, float rz, float rw);
 #endif
-    void process_terrain_broadphases(const coid::dynarray<bt::external_broadphase*>& broadphase, btCollisionObject* col_obj);
+    void process_terrain_broadphases(bt::external_broadphase* const* bp_begin, bt::external_broadphase* const* bp_end, btCollisionObject* col_obj);
     void update_terrain_mesh_broadphase(bt::external_broadphase* bp);
+    /// @brief Move the proxies of the broadphase to a new sweep with the given capacity, the overlapping pairs are rebuilt there
+    void grow_external_broadphase(bt::external_broadphase* bp, uint capacity);
     void add_terrain_broadphase_collision_pair(btCollisionObject* obj1, btCollisionObject* obj2);
-    void remove_terrain_broadphase_collision_pair(btBroadphasePair& pair);
+    void remove_terrain_broadphase_collision_pair(terrain_mesh_pair& pair);
     void process_terrain_broadphase_collision_pairs();
 
     void rayTest(const btVector3& rayFromWorld, const btVector3& rayToWorld, RayResultCallback& resultCallback) const override;
@@ -243,17 +531,64 @@ public:
 
     void convexSweepTest(const btConvexShape* castShape, const btTransform& convexFromWorld, const btTransform& convexToWorld, ConvexResultCallback& resultCallback, btScalar allowedCcdPenetration = btScalar(0.)) const override;
 
+    /// @brief Collect the objects of the world and the overlapping external broadphases whose aabb intersects the box
+    /// @note one query shared by a group of nearby sweeps done with convex_sweep_candidates, reentrant
+    void gather_sweep_candidates(const btVector3& aabb_min, const btVector3& aabb_max, coid::dynarray<btCollisionObject*>& result) const;
+
+    /// @brief Convex sweep against previously gathered candidates only, reentrant
+    void convex_sweep_candidates(const btConvexShape* cast_shape, const btTransform& from, const btTransform& to,
+        btCollisionObject* const* begin, btCollisionObject* const* end, ConvexResultCallback& result_callback, btScalar allowed_ccd_penetration = btScalar(0.)) const;
 
+
+    virtual bool addCollisionObject(btCollisionObject* collisionObject, short int collisionFilterGroup = btBroadphaseProxy::StaticFilter, short int collisionFilterMask = btBroadphaseProxy::AllFilter ^ btBroadphaseProxy::StaticFilter) override;
     virtual void removeRigidBody(btRigidBody* body) override;
     virtual void removeCollisionObject(btCollisionObject* collisionObject) override;
     void removeCollisionObject_external(btCollisionObject* collisionObject);
 
+    /// @brief Add or remove the object from the terrain pass set after a change of its activation, collision flags, filter mask or ot flags
+    /// @note called from the sleeping state callback, may run on worker threads
+    void update_terrain_collider(btCollisionObject* obj);
+
     virtual void debugDrawWorld(btScalar extrapolation_step) override;
 
     void set_ot_stats(bt::bullet_stats* stats) { _stats2 = stats; };
 
     void pause_simulation(bool pause) { _simulation_running = !pause; };
 
+    /// @brief Run the per-object terrain query and contact generation on the taskmaster
+    /// @note _elevation_above_terrain and _aabb_intersect must be reentrant when enabled; the tree batch array passed to
+    ///       _aabb_intersect then belongs to the calling worker, its new batches are moved to the shared cache after the
+    ///       queries and a batch of a terrain mesh cell that is already cached is replaced by the cached one
+    void set_parallel_terrain_step(bool parallel) { _parallel_terrain_step = parallel; }
+    bool is_parallel_terrain_step() const { return _parallel_terrain_step; }
+
+    /// @brief Update the actions of the stages of body disjoint actions on the taskmaster
+    /// @note the result doesn't depend on the thread count; actions without body hints still run serially in order,
+    ///       hinted actions must be reentrant apart from their bodies, including the ray casts they issue
+    void set_parallel_actions(bool parallel) { _parallel_actions = parallel; }
+    bool is_parallel_actions() const { return _parallel_actions; }
+
+    /// @brief Keep terrain query results per object and reuse them while the object stays inside an expanded obb
+    /// @note the host must call invalidate_terrain_cache() whenever terrain meshes or tree batches are released or rebuilt
+    void set_terrain_cache_enabled(bool enabled);
+    bool is_terrain_cache_enabled() const { return _terrain_cache_enabled; }
+
+    /// drop all cached terrain query results, they are refetched on next use
+    void invalidate_terrain_cache() { ++_terrain_revision; }
+
+    /// @brief Sweep fast bodies against the terrain triangles along their predicted motion and add predictive contacts
+    /// @note only bodies moving more than their ccd motion threshold per step are swept, as with the predictive contacts of bullet
+    void set_terrain_ccd(bool enabled) { _terrain_ccd = enabled; }
+    bool is_terrain_ccd() const { return _terrain_ccd; }
+
+    coid::taskmaster* task_master() const { return _task_master; }
+
+    /// tree batches referenced by the terrain pass
+    const coid::slotalloc<bt::tree_batch>& tree_batches() const { return _tb_cache; }
+
+    /// dispatcher pools are not thread safe, terrain workers lock this around algorithm allocations
+    std::mutex& dispatcher_mutex() { return _dispatcher_mutex; }
+
     typedef bool (*fn_ext_collision)(
         const void* context,
         const double3& center,
@@ -330,160 +665,220 @@ public:
 
     void get_obb(const btCollisionShape* cs, const btTransform& t, double3& cen, float3x3& basis);
 
-    template<class fn> // void (*fn)(btCollisionObject * obj)
+    /// @brief Objects whose broadphase aabb intersects the sphere, stops when process_fn returns true
+    /// @note uses a traversal stack of the calling thread, safe to call from worker threads as long as the broadphase is not modified meanwhile
+    template<class fn> // bool (*fn)(btCollisionObject * obj)
     void query_volume_sphere(bt32BitAxisSweep3* broadphase, const double3& pos, float rad, fn process_fn)
     {
-        static coid::dynarray<const btDbvtNode*> _processing_stack(1024);
-        _processing_stack.reset();
+        bt::query_stack_scope scope;
+        query_volume_sphere(scope.stack, broadphase, pos, rad, process_fn);
+    }
 
-        const btDbvtBroadphase* raycast_acc = broadphase->getRaycastAccelerator();
-        DASSERT(raycast_acc);
+    template<class fn> // bool (*fn)(btCollisionObject * obj)
+    void query_volume_sphere(bt::dbvt_query_stack& stack, bt32BitAxisSweep3* broadphase, const double3& pos, float rad, fn process_fn)
+    {
+        stack.reset();
+        bt::push_dbvt_roots(stack, broadphase, 1);
 
-        const btDbvt* dyn_set = &raycast_acc->m_sets[0];
-        const btDbvt* stat_set = &raycast_acc->m_sets[1];
+        const float rad_sq = rad * rad;
+        bt::dbvt_query_node cur;
 
-        const btDbvtNode* cur_node = nullptr;
+        while (stack.pop(cur)) {
+            float3 cen, half;
+            bt::node_aabb_local(cur.node, pos, cen, half);
 
-        if (dyn_set && dyn_set->m_root) {
-            _processing_stack.push(dyn_set->m_root);
-        }
-
-        if (stat_set && stat_set->m_root) {
-            _processing_stack.push(stat_set->m_root);
-        }
-
-        while (_processing_stack.pop(cur_node)) {
-            const btVector3& bt_aabb_cen = cur_node->volume.Center();
-            const btVector3& bt_aabb_half = cur_node->volume.Extents();
-            double3 aabb_cen(bt_aabb_cen[0], bt_aabb_cen[1], bt_aabb_cen[2]);
-            double3 aabb_half(bt_aabb_half[0], bt_aabb_half[1], bt_aabb_half[2]);
-            if (coal3d::intersects_sphere_aabb(pos, (double)rad, aabb_cen, aabb_half, nullptr)) {
-                if (cur_node->isleaf()) {
-                    if (cur_node->data) {
-                        btDbvtProxy* dat = reinterpret_cast<btDbvtProxy*>(cur_node->data);
+            if (bt::dbvt_sphere_overlap(cen, half, rad_sq)) {
+                if (cur.node->isleaf()) {
+                    if (cur.node->data) {
+                        btDbvtProxy* dat = reinterpret_cast<btDbvtProxy*>(cur.node->data);
                         if (process_fn(reinterpret_cast<btCollisionObject*>(dat->m_clientObject)))
                             break;
                     }
                 }
                 else {
-                    _processing_stack.push(cur_node->childs[0]);
-                    _processing_stack.push(cur_node->childs[1]);
+                    bt::push_dbvt_children(stack, cur.node, 1);
                 }
             }
         }
     }
 
+    /// @brief query_volume_sphere on the tile local float tree of an external broadphase, the sweep is walked while the tree is stale
+    template<class fn> // bool (*fn)(btCollisionObject * obj)
+    void query_volume_sphere(const bt::external_broadphase* bp, const double3& pos, float rad, fn process_fn)
+    {
+        if (!bp->_local_tree.valid) {
+            query_volume_sphere(bp->_broadphase, pos, rad, process_fn);
+            return;
+        }
 
-    template<typename fn> //void(*fn)(btBroadphaseProxy * proxy);
-    void query_volume_aabb(bt32BitAxisSweep3* broadphase, const double3& aabb_cen, const double3& aabb_half, fn process_fn)
+        bt::query_stack_scope scope;
+        const float3 cen(pos - bp->_local_tree.origin);
+
+        bp->_local_tree.query_sphere(scope.local_stack, cen, rad, [&](btBroadphaseProxy* proxy) {
+            return process_fn(reinterpret_cast<btCollisionObject*>(proxy->m_clientObject));
+        });
+    }
+
+    /// @brief Batched query_volume_sphere, all spheres are tested in one walk of the broadphase tree
+    /// @note sphere centers are taken relative to the first one of each group of 64, keep the batch spatially coherent
+    template<class fn> // bool (*fn)(uint query, btCollisionObject * obj), returning true stops that query
+    void query_volume_spheres(bt::dbvt_query_stack& stack, bt32BitAxisSweep3* broadphase, const double3* centers, const float* radii, uint count, fn process_fn)
     {
-        static coid::dynarray<const btDbvtNode*> _processing_stack(1024);
-        _processing_stack.reset();
+        for (uint first = 0; first < count; first += bt::dbvt_sphere_batch::MAX_QUERIES) {
+            const uint n = glm::min(count - first, bt::dbvt_sphere_batch::MAX_QUERIES);
 
-        const btDbvtBroadphase* raycast_acc = broadphase->getRaycastAccelerator();
-        DASSERT(raycast_acc);
+            bt::dbvt_sphere_batch batch;
+            batch.build(centers + first, radii + first, n);
 
-        const btDbvt* dyn_set = &raycast_acc->m_sets[0];
-        const btDbvt* stat_set = &raycast_acc->m_sets[1];
+            uint64 active = n == 64 ? ~uint64(0) : (uint64(1) << n) - 1;
 
-        const btDbvtNode* cur_node = nullptr;
+            stack.reset();
+            bt::push_dbvt_roots(stack, broadphase, active);
 
-        if (dyn_set && dyn_set->m_root) {
-            _processing_stack.push(dyn_set->m_root);
-        }
+            bt::dbvt_query_node cur;
 
-        if (stat_set && stat_set->m_root) {
-            _processing_stack.push(stat_set->m_root);
-        }
+            while (active && stack.pop(cur)) {
+                const uint64 mask = cur.mask & active;
+                if (!mask)
+                    continue;
 
-        btCollisionObject p_obj;
+                float3 cen, half;
+                bt::node_aabb_local(cur.node, batch.origin, cen, half);
 
-        while (_processing_stack.pop(cur_node)) {
-            const btVector3& bt_node_aabb_cen = cur_node->volume.Center();
-            const btVector3& bt_node_aabb_half = cur_node->volume.Extents();
-            double3 node_aabb_cen(bt_node_aabb_cen[0], bt_node_aabb_cen[1], bt_node_aabb_cen[2]);
-            double3 node_aabb_half(bt_node_aabb_half[0], bt_node_aabb_half[1], bt_node_aabb_half[2]);
+                const uint64 hits = batch.overlap(cen, half, mask);
+                if (!hits)
+                    continue;
 
-            if (coal3d::intersects_aabb_aabb(node_aabb_cen, node_aabb_half, aabb_cen, aabb_half)) {
+                if (cur.node->isleaf()) {
+                    if (cur.node->data) {
+                        btDbvtProxy* dat = reinterpret_cast<btDbvtProxy*>(cur.node->data);
+                        btCollisionObject* obj = reinterpret_cast<btCollisionObject*>(dat->m_clientObject);
 
-                if (cur_node->isleaf()) {
-                    //add_debug_aabb(bt_node_aabb_cen - bt_node_aabb_half, bt_node_aabb_cen + bt_node_aabb_half, btVector3(1, 0, 0));
-                    if (cur_node->data) {
-                        btDbvtProxy* dat = reinterpret_cast<btDbvtProxy*>(cur_node->data);
+                        for (uint64 m = hits; m; m &= m - 1) {
+                            const uint q = first + bt::bit_index(m);
+                            if (process_fn(q, obj))
+                                active &= ~(uint64(1) << (q - first));
+                        }
+                    }
+                }
+                else {
+                    bt::push_dbvt_children(stack, cur.node, hits);
+                }
+            }
+        }
+    }
+
+    template<typename fn> //void(*fn)(btBroadphaseProxy * proxy);
+    void query_volume_aabb(bt32BitAxisSweep3* broadphase, const double3& aabb_cen, const double3& aabb_half, fn process_fn)
+    {
+        bt::query_stack_scope scope;
+        query_volume_aabb(scope.stack, broadphase, aabb_cen, aabb_half, process_fn);
+    }
+
+    template<typename fn> //void(*fn)(btBroadphaseProxy * proxy);
+    void query_volume_aabb(bt::dbvt_query_stack& stack, bt32BitAxisSweep3* broadphase, const double3& aabb_cen, const double3& aabb_half, fn process_fn)
+    {
+        stack.reset();
+        bt::push_dbvt_roots(stack, broadphase, 1);
+
+        const float3 query_half(aabb_half);
+        bt::dbvt_query_node cur;
+
+        while (stack.pop(cur)) {
+            float3 cen, half;
+            bt::node_aabb_local(cur.node, aabb_cen, cen, half);
+
+            if (glm::abs(cen.x) <= half.x + query_half.x
+                && glm::abs(cen.y) <= half.y + query_half.y
+                && glm::abs(cen.z) <= half.z + query_half.z)
+            {
+                if (cur.node->isleaf()) {
+                    if (cur.node->data) {
+                        btDbvtProxy* dat = reinterpret_cast<btDbvtProxy*>(cur.node->data);
                         process_fn(reinterpret_cast<btCollisionObject*>(dat->m_clientObject)->getBroadphaseHandle());
                     }
                 }
                 else {
-                    //add_debug_aabb(bt_node_aabb_cen - bt_node_aabb_half, bt_node_aabb_cen + bt_node_aabb_half, btVector3(1, 1, 1));
-                    _processing_stack.push(cur_node->childs[0]);
-                    _processing_stack.push(cur_node->childs[1]);
+                    bt::push_dbvt_children(stack, cur.node, 1);
                 }
             }
         }
     }
 
+    /// @brief query_volume_aabb on the tile local float tree of an external broadphase, the sweep is walked while the tree is stale
+    template<typename fn> //void(*fn)(btBroadphaseProxy * proxy);
+    void query_volume_aabb(const bt::external_broadphase* bp, const double3& aabb_cen, const double3& aabb_half, fn process_fn)
+    {
+        if (!bp->_local_tree.valid) {
+            query_volume_aabb(bp->_broadphase, aabb_cen, aabb_half, process_fn);
+            return;
+        }
+
+        bt::query_stack_scope scope;
+        const float3 cen(aabb_cen - bp->_local_tree.origin);
+
+        bp->_local_tree.query_aabb(scope.local_stack, cen, float3(aabb_half), [&](btBroadphaseProxy* proxy) {
+            process_fn(proxy);
+            return false;
+        });
+    }
 
+    /// @brief Objects inside the frustum, planes are relative to pos
+    /// @note uses a traversal stack of the calling thread, safe to call from worker threads as long as the broadphase is not modified meanwhile
     template<class fn> // void (*fn)(btCollisionObject * obj)
     void query_volume_frustum(bt32BitAxisSweep3* broadphase, const double3& pos, const float4* f_planes_norms, uint8 nplanes, bool include_partial, fn process_fn)
     {
+        bt::query_stack_scope scope;
+        query_volume_frustum(scope.stack, broadphase, pos, f_planes_norms, nplanes, include_partial, process_fn);
+    }
 
-        static coid::dynarray<const btDbvtNode*> _processing_stack(1024);
-        _processing_stack.reset();
-
-        const btDbvtBroadphase* raycast_acc = broadphase->getRaycastAccelerator();
-        DASSERT(raycast_acc);
-
-        const btDbvt* dyn_set = &raycast_acc->m_sets[0];
-        const btDbvt* stat_set = &raycast_acc->m_sets[1];
+    template<class fn> // void (*fn)(btCollisionObject * obj)
+    void query_volume_frustum(bt::dbvt_query_stack& stack, bt32BitAxisSweep3* broadphase, const double3& pos, const float4* f_planes_norms, uint8 nplanes, bool include_partial, fn process_fn)
+    {
+        bt::frustum_query query;
+        query.pos = pos;
+        query.planes = f_planes_norms;
+        query.nplanes = nplanes;
+
+        query_volume_frustums(stack, broadphase, &query, 1, include_partial, [&](uint, btCollisionObject* obj) {
+            process_fn(obj);
+        });
+    }
 
-        const btDbvtNode* cur_node = nullptr;
+    /// @brief Batched query_volume_frustum, all frusta are tested in one walk of the broadphase tree
+    template<class fn> // void (*fn)(uint query, btCollisionObject * obj)
+    void query_volume_frustums(bt::dbvt_query_stack& stack, bt32BitAxisSweep3* broadphase, const bt::frustum_query* frusta, uint count, bool include_partial, fn process_fn)
+    {
+        for (uint first = 0; first < count; first += bt::dbvt_frustum_batch::MAX_QUERIES) {
+            const uint n = glm::min(count - first, bt::dbvt_frustum_batch::MAX_QUERIES);
 
-        if (dyn_set && dyn_set->m_root) {
-            _processing_stack.push(dyn_set->m_root);
-        }
+            bt::dbvt_frustum_batch batch;
+            batch.build(frusta + first, n);
 
-        if (stat_set && stat_set->m_root) {
-            _processing_stack.push(stat_set->m_root);
-        }
+            stack.reset();
+            bt::push_dbvt_roots(stack, broadphase, n == 64 ? ~uint64(0) : (uint64(1) << n) - 1);
 
-        btCollisionObject p_obj;
+            bt::dbvt_query_node cur;
 
-        while (_processing_stack.pop(cur_node)) {
-            const btVector3& bt_aabb_cen = cur_node->volume.Center();
-            const btVector3& bt_aabb_half = cur_node->volume.Extents();
-            double3 aabb_cen(bt_aabb_cen[0], bt_aabb_cen[1], bt_aabb_cen[2]);
-            float3 aabb_half(bt_aabb_half[0], bt_aabb_half[1], bt_aabb_half[2]);
+            while (stack.pop(cur)) {
+                const uint64 hits = batch.overlap(cur.node, cur.mask);
+                if (!hits)
+                    continue;
 
-            if (coal3d::intersects_frustum_aabb(aabb_cen, aabb_half, pos, f_planes_norms, nplanes, true)) {
-                if (cur_node->isleaf()) {
-                    if (cur_node->data) {
-                        btDbvtProxy* dat = reinterpret_cast<btDbvtProxy*>(cur_node->data);
+                if (cur.node->isleaf()) {
+                    if (cur.node->data) {
+                        btDbvtProxy* dat = reinterpret_cast<btDbvtProxy*>(cur.node->data);
                         btCollisionObject* leaf_obj = reinterpret_cast<btCollisionObject*>(dat->m_clientObject);
 
-                        const btVector3& cen = leaf_obj->getWorldTransform().getOrigin();
-                        const float3 aabb_pos(float(cen[0] - pos.x), float(cen[1] - pos.y), float(cen[2] - pos.z));
-                        bool passes = true;
-                        for (uint8 p = 0; p < nplanes; p++) {
-                            float3 n(f_planes_norms[p]);
-                            btVector3 min, max;
-                            btTransform t(btMatrix3x3(n.x, n.y, n.z, 0., 0., 0., 0., 0., 0.));
-                            leaf_obj->getCollisionShape()->getAabb(t, min, max);
-                            const float np = float(max[0] - min[0]) * 0.5f;
-                            const float mp = glm::dot(n, aabb_pos) + f_planes_norms[p].w;
-                            if ((include_partial ? mp + np : mp - np) < 0.0f) {
-                                passes = false;
-                                break;
-                            }
-                        }
-
-                        if (passes) {
-                            process_fn(leaf_obj);
+                        for (uint64 m = hits; m; m &= m - 1) {
+                            const uint q = bt::bit_index(m);
+                            if (batch.object_test(leaf_obj, q, include_partial))
+                                process_fn(first + q, leaf_obj);
                         }
                     }
                 }
                 else {
-                    _processing_stack.push(cur_node->childs[0]);
-                    _processing_stack.push(cur_node->childs[1]);
+                    bt::push_dbvt_children(stack, cur.node, hits);
                 }
             }
         }
@@ -498,44 +893,28 @@ public:
 
     template<class fn> // void (*fn)(btCollisionObject * obj)
     void for_each_object_in_broadphase(bt32BitAxisSweep3* broadphase, uint revision, fn process_fn) {
-        static coid::dynarray<const btDbvtNode*> _processing_stack(1024);
-        _processing_stack.reset();
-
-        const btDbvtBroadphase* raycast_acc = broadphase->getRaycastAccelerator();
-        DASSERT(raycast_acc);
-
-        const btDbvt* dyn_set = &raycast_acc->m_sets[0];
-        const btDbvt* stat_set = &raycast_acc->m_sets[1];
-
-        const btDbvtNode* cur_node = nullptr;
-
-        if (dyn_set && dyn_set->m_root) {
-            _processing_stack.push(dyn_set->m_root);
-        }
-
-        if (stat_set && stat_set->m_root) {
-            _processing_stack.push(stat_set->m_root);
-        }
+        bt::query_stack_scope scope;
+        for_each_object_in_broadphase(scope.stack, broadphase, revision, process_fn);
+    }
 
-        btCollisionObject p_obj;
+    template<class fn> // void (*fn)(btCollisionObject * obj)
+    void for_each_object_in_broadphase(bt::dbvt_query_stack& stack, bt32BitAxisSweep3* broadphase, uint revision, fn process_fn) {
+        stack.reset();
+        bt::push_dbvt_roots(stack, broadphase, 1);
 
-        while (_processing_stack.pop(cur_node)) {
-            const btVector3& bt_node_aabb_cen = cur_node->volume.Center();
-            const btVector3& bt_node_aabb_half = cur_node->volume.Extents();
-            double3 node_aabb_cen(bt_node_aabb_cen[0], bt_node_aabb_cen[1], bt_node_aabb_cen[2]);
-            double3 node_aabb_half(bt_node_aabb_half[0], bt_node_aabb_half[1], bt_node_aabb_half[2]);
+        bt::dbvt_query_node cur;
 
-            if (cur_node->isleaf()) {
-                if (cur_node->data) {
-                    btDbvtProxy* dat = reinterpret_cast<btDbvtProxy*>(cur_node->data);
+        while (stack.pop(cur)) {
+            if (cur.node->isleaf()) {
+                if (cur.node->data) {
+                    btDbvtProxy* dat = reinterpret_cast<btDbvtProxy*>(cur.node->data);
                     btCollisionObject* co = reinterpret_cast<btCollisionObject*>(dat->m_clientObject);
                     if (co->getBroadphaseHandle() && broadphase->ownsProxy(co->getBroadphaseHandle()) && (co->getBroadphaseHandle()->m_ot_revision == revision || revision == 0xffffffff))
                         process_fn(co);
                 }
             }
             else {
-                _processing_stack.push(cur_node->childs[0]);
-                _processing_stack.push(cur_node->childs[1]);
+                bt::push_dbvt_children(stack, cur.node, 1);
             }
         }
     }
@@ -550,13 +929,36 @@ protected:
 
     void ot_terrain_collision_step();
 
-    void prepare_tree_collision_pairs(btCollisionObject* cur_obj, const coid::dynarray<uint>& trees_cache, uint32 frame);
+    /// predictive contacts of the bodies whose motion exceeds the ccd threshold, swept against the terrain triangles
+    void create_terrain_predictive_contacts(btScalar time_step);
+
+    /// object in this world that the terrain pass should process now
+    static bool is_terrain_collider(const btCollisionObject* obj);
+
+    void terrain_query_object(terrain_worker_context& ctx, terrain_object_job& job);
+    /// @brief Query the terrain for the whole compound and mark the direct children whose local aabb touches a returned triangle
+    /// @return false if the children can't be pruned and all have to be queried
+    bool terrain_compound_broad_test(terrain_worker_context& ctx, terrain_object_job& job, const btCompoundShape* cs, uint nleaves);
+    /// terrain query of a (child) shape, cache slot is the leaf index, the broad query of a compound uses the slot after the leaves
+    void query_terrain_obb(terrain_worker_context& ctx, terrain_object_job& job, uint slot,
+        const btCollisionShape* shape, const double3& from, const float3x3& basis, float lod_dim, terrain_query_result& qr);
+    void terrain_query_child(terrain_worker_context& ctx, terrain_object_job& job,
+        const btCollisionShape* shape, const btTransform& world_trans, uint slot, bool broad);
+    static bool is_obb_inside(const double3& cen, const float3x3& basis, const double3& outer_cen, const float3x3& outer_basis);
+    void terrain_collide_object(terrain_worker_context& ctx, terrain_object_job& job);
+    /// move the tree batches the workers added in a parallel pass to _tb_cache and replace their ids in the query results
+    void merge_staged_tree_batches(uint nchunks);
+
+    void prepare_tree_collision_pairs(btCollisionObject* cur_obj, const uint* tb_begin, const uint* tb_end, const double3& from, float rad, uint32 frame);
     void build_tb_collision_info(bt::tree_batch* tb);
 
     fn_ext_collision _sphere_intersect;
     fn_process_tree_collision _tree_collision;
 
     void process_tree_collisions(btScalar time_step);
+    void release_tree_collision_pair(tree_collision_pair& tcp);
+    /// contacts of sphere and capsule bodies with whole tree batches, without collision algorithms
+    void process_tree_batch_queries();
     void oob_to_aabb(const btVector3& src_cen,
         const btMatrix3x3& src_basis,
         const btVector3& dst_cen,
@@ -574,6 +976,10 @@ protected:
         _stats.trees_processed_count = 0;
         _stats.after_ot_phase_time_ms = 0;
         _stats.before_ot_phase_time_ms = 0;
+        _stats.collision_algorithms_created = 0;
+        _stats.collision_algorithms_released = 0;
+        _stats.terrain_cache_hits = 0;
+        _stats.terrain_cache_misses = 0;
     };
 
     void repair_tree_collision_pairs();
@@ -584,11 +990,13 @@ protected:
 
     void add_debug_aabb(const btVector3& min, const btVector3& max, const btVector3& color);
 
-    void add_sensor_trigger_data_internal(btPairCachingGhostObject* sensor_ptr, btCollisionObject* trigger_ptr, btBroadphasePair* pair_ptr);
+    void add_sensor_trigger_data_internal(btPairCachingGhostObject* sensor_ptr, btCollisionObject* trigger_ptr);
     void remove_sensor_trigger_data_internal(btPairCachingGhostObject* sensor_ptr, btCollisionObject* trigger_ptr);
+    /// @brief Queue the contact transition of a manifold, thread safe
+    void sensor_contact_event_internal(const btCollisionObject* sensor_ptr, const btCollisionObject* trigger_ptr, bool started);
     void update_sensors_internal();
 
-    sensor_trigger_data* find_active_trigger_intenral(btPairCachingGhostObject* sensor_ptr, btCollisionObject* trigger_ptr);
+    sensor_trigger_data* find_active_trigger_intenral(const btCollisionObject* sensor_ptr, const btCollisionObject* trigger_ptr);
 };
 
 } // namespace ot
@@ -1,5 +1,6 @@
 #include "multithread_default_collision_configuration.h"
 #include <comm/singleton.h>
+#include <comm/taskmaster.h>
 
 #include <BulletCollision/NarrowPhaseCollision/btGjkEpaPenetrationDepthSolver.h>
 #include <BulletCollision/NarrowPhaseCollision/btMinkowskiPenetrationDepthSolver.h>
@@ -22,4 +23,29 @@ btConvexPenetrationDepthSolver* multithread_default_collision_configuration::get
         THREAD_LOCAL_SINGLETON_DEF(btMinkowskiPenetrationDepthSolver)solver;
         return solver.get();
     }
-}
\ No newline at end of file
+}
+
+void taskmaster_task_scheduler::parallelFor(int begin, int end, int grain_size, const btIParallelForBody& body)
+{
+    if (begin >= end) {
+        return;
+    }
+
+    const int grain = grain_size > 0 ? grain_size : 1;
+    const int nchunks = (end - begin + grain - 1) / grain;
+
+    if (nchunks == 1 || !_task_master) {
+        body.forLoop(begin, end);
+        return;
+    }
+
+    _task_master->parallel_for(0, nchunks, [&](int chunk) {
+        const int chunk_begin = begin + chunk * grain;
+        body.forLoop(chunk_begin, btMin(chunk_begin + grain, end));
+    });
+}
+
+int taskmaster_task_scheduler::num_threads() const
+{
+    return _task_master ? int(_task_master->get_threads_count()) + 1 : 1;
+}
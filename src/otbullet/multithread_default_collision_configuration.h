@@ -3,6 +3,11 @@
 #define __multithread_default_collision_configuration_h__
 
 #include <BulletCollision/CollisionDispatch/btDefaultCollisionConfiguration.h>
+#include <LinearMath/btThreads.h>
+
+namespace coid {
+    class taskmaster;
+}
 
 class multithread_default_collision_configuration : public btDefaultCollisionConfiguration
 {
@@ -17,4 +22,22 @@ public:
 
 };
 
+/// runs the parallel loops of btCollisionDispatcherMt on the taskmaster, each grain is a task
+class taskmaster_task_scheduler : public btITaskScheduler
+{
+public:
+    explicit taskmaster_task_scheduler(coid::taskmaster* tm)
+        : _task_master(tm)
+    {
+    }
+
+    virtual void parallelFor(int begin, int end, int grain_size, const btIParallelForBody& body) override;
+
+    /// @return number of threads that can run the loop bodies concurrently, the workers of the taskmaster and the calling thread
+    int num_threads() const;
+
+private:
+    coid::taskmaster* _task_master;
+};
+
 #endif // __multithread_default_collision_configuration_h__
\ No newline at end of file
@@ -3,10 +3,22 @@
 #include <BulletCollision/CollisionDispatch/btGhostObject.h>
 #include <BulletCollision/CollisionShapes/btConvexShape.h>
 
+#include "discrete_dynamics_world.h"
+#include "physics_cfg.h"
+
 #include <ot/glm/glm_bt.h>
 
 #include <comm/commassert.h>
 #include <comm/log.h>
+#include <comm/singleton.h>
+#include <comm/taskmaster.h>
+
+#include <algorithm>
+
+/// size of the cells grouping the probes of a batch step around one broadphase query
+static const double NAVIGATION_PROBE_CELL_SIZE = 32.0;
+/// max probes sharing a query, crowded cells are split among more tasks
+static const uint NAVIGATION_PROBE_MAX_GROUP = 64;
 
 
 //-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
@@ -76,7 +88,8 @@ void bt::ot_navigation_probe::set_transform(const double3& pos, const quat& rot)
 
 //-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 
-void bt::ot_navigation_probe::sim_step(btCollisionWorld* world_ptr, const double3& target_position, const quat& target_rotation, float dt)
+template <class SweepFn>
+void bt::ot_navigation_probe::sim_step_internal(const double3& target_position, const quat& target_rotation, SweepFn sweep_fn)
 {
     btTransform current_transform = _ghost_object->getWorldTransform();
     btTransform target_transform(calculate_transform_internal(target_position, target_rotation));
@@ -107,7 +120,7 @@ void bt::ot_navigation_probe::sim_step(btCollisionWorld* world_ptr, const double
 
     if (sweepDirNegative.length2() > 0.0001)
     {
-        world_ptr->convexSweepTest(_collision_shape, start, end, callback, 0.0);
+        sweep_fn(start, end, callback);
     }
 
     if (callback.hasHit() && needs_collision_with_internal(callback.m_hitCollisionObject))
@@ -124,6 +137,131 @@ void bt::ot_navigation_probe::sim_step(btCollisionWorld* world_ptr, const double
 
 //-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 
+void bt::ot_navigation_probe::sim_step(btCollisionWorld* world_ptr, const double3& target_position, const quat& target_rotation, float dt)
+{
+    sim_step_internal(target_position, target_rotation, [&](const btTransform& start, const btTransform& end, btCollisionWorld::ConvexResultCallback& callback) {
+        world_ptr->convexSweepTest(_collision_shape, start, end, callback, 0.0);
+    });
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void bt::ot_navigation_probe::sim_step_batch(ot::discrete_dynamics_world* world_ptr, const navigation_probe_step* steps, uint count, float dt)
+{
+    struct cell_entry {
+        int64 cell[3];
+        uint step;
+
+        bool operator < (const cell_entry& e) const {
+            for (int k = 0; k < 3; k++) {
+                if (cell[k] != e.cell[k]) {
+                    return cell[k] < e.cell[k];
+                }
+            }
+            return step < e.step;
+        }
+        bool same_cell(const cell_entry& e) const {
+            return cell[0] == e.cell[0] && cell[1] == e.cell[1] && cell[2] == e.cell[2];
+        }
+    };
+
+    if (count == 0) {
+        return;
+    }
+
+    // group the probes by the cell of their current position
+    coid::dynarray<cell_entry> entries;
+    entries.reserve(count, false);
+
+    for (uint i = 0; i < count; i++) {
+        const btVector3& pos = steps[i].probe->_ghost_object->getWorldTransform().getOrigin();
+        cell_entry& e = *entries.add();
+        e.cell[0] = int64(glm::floor(pos.x() / NAVIGATION_PROBE_CELL_SIZE));
+        e.cell[1] = int64(glm::floor(pos.y() / NAVIGATION_PROBE_CELL_SIZE));
+        e.cell[2] = int64(glm::floor(pos.z() / NAVIGATION_PROBE_CELL_SIZE));
+        e.step = i;
+    }
+
+    std::sort(entries.ptr(), entries.ptre());
+
+    // group boundaries, crowded cells are split to keep the parallel work balanced
+    coid::dynarray<uint> groups;
+    *groups.add() = 0;
+    uint group_begin = 0;
+    for (uint i = 1; i < count; i++) {
+        if (!entries[i].same_cell(entries[i - 1]) || i - group_begin >= NAVIGATION_PROBE_MAX_GROUP) {
+            *groups.add() = group_begin = i;
+        }
+    }
+    *groups.add() = count;
+
+    auto step_group = [&](int g) {
+        const uint first = groups[g];
+        const uint last = groups[g + 1];
+
+        btVector3 aabb_min, aabb_max;
+        for (uint i = first; i < last; i++) {
+            const navigation_probe_step& st = steps[entries[i].step];
+            btVector3 min, max;
+            st.probe->get_sweep_aabb(st.target_position, st.target_rotation, min, max);
+            if (i == first) {
+                aabb_min = min;
+                aabb_max = max;
+            }
+            else {
+                aabb_min.setMin(min);
+                aabb_max.setMax(max);
+            }
+        }
+
+        THREAD_LOCAL_SINGLETON_DEF(coid::dynarray<btCollisionObject*>) candidates;
+        candidates->reset();
+        world_ptr->gather_sweep_candidates(aabb_min, aabb_max, *candidates);
+
+        // objects without contact response are ignored by the sweep callback, this also leaves out the probes moved concurrently
+        btCollisionObject** candidates_end = candidates->ptr();
+        for (uints c = 0; c < candidates->size(); c++) {
+            btCollisionObject* obj = (*candidates)[c];
+            if (obj->hasContactResponse()) {
+                *candidates_end++ = obj;
+            }
+        }
+
+        for (uint i = first; i < last; i++) {
+            const navigation_probe_step& st = steps[entries[i].step];
+            ot_navigation_probe* probe = st.probe;
+            probe->sim_step_internal(st.target_position, st.target_rotation, [&](const btTransform& start, const btTransform& end, btCollisionWorld::ConvexResultCallback& callback) {
+                world_ptr->convex_sweep_candidates(probe->_collision_shape, start, end, candidates->ptr(), candidates_end, callback, 0.0);
+            });
+        }
+    };
+
+    const int ngroups = int(groups.size() - 1);
+    coid::taskmaster* tm = world_ptr->task_master();
+
+    if (tm && ngroups > 1) {
+        tm->parallel_for(0, ngroups, step_group);
+    }
+    else {
+        for (int g = 0; g < ngroups; g++) {
+            step_group(g);
+        }
+    }
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void bt::ot_navigation_probe::get_sweep_aabb(const double3& target_position, const quat& target_rotation, btVector3& aabb_min, btVector3& aabb_max) const
+{
+    btVector3 min, max;
+    _collision_shape->getAabb(_ghost_object->getWorldTransform(), aabb_min, aabb_max);
+    _collision_shape->getAabb(calculate_transform_internal(target_position, target_rotation), min, max);
+    aabb_min.setMin(min);
+    aabb_max.setMax(max);
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
 double3 bt::ot_navigation_probe::get_pos() const
 {    
     double3 result = bt::todouble3(_ghost_object->getWorldTransform().getOrigin());
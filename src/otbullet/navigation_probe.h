@@ -5,11 +5,18 @@ class btPairCachingGhostObject;
 class btConvexShape;
 class btCollisionWorld;
 class btTransform;
+class btVector3;
 class btCollisionObject;
 
+namespace ot {
+    class discrete_dynamics_world;
+}
+
 namespace bt
 {
 
+struct navigation_probe_step;
+
 class ot_navigation_probe
 {
 public: // methods only
@@ -22,6 +29,10 @@ public: // methods only
 
     void sim_step(btCollisionWorld* world_ptr, const double3& target_position, const quat& target_rotation, float dt);
 
+    /// @brief Step a batch of probes, probes starting in the same cell share one broadphase query and the cells run in parallel
+    /// @note probes have no contact response and are not swept against, so the order of the steps doesn't matter
+    static void sim_step_batch(ot::discrete_dynamics_world* world_ptr, const navigation_probe_step* steps, uint count, float dt);
+
     double3 get_pos() const;
     quat get_rot() const;
 
@@ -32,10 +43,18 @@ protected: // methods only
     btTransform calculate_transform_internal(const double3& pos, const quat& rot) const;
 
     bool needs_collision_with_internal(const btCollisionObject* other_ptr);
+
+    /// common part of the single and batch step, sweep_fn(start, end, callback) performs the convex sweep
+    template <class SweepFn>
+    void sim_step_internal(const double3& target_position, const quat& target_rotation, SweepFn sweep_fn);
+
+    /// aabb of the shape swept from the current transform to the target
+    void get_sweep_aabb(const double3& target_position, const quat& target_rotation, btVector3& aabb_min, btVector3& aabb_max) const;
+
 protected: // members only
     btPairCachingGhostObject* _ghost_object = nullptr;
     btConvexShape* _collision_shape = nullptr;
     float3 _shape_offset = float3(0);
 };
 
-}; // end of namespace bt
\ No newline at end of file
+}; // end of namespace bt
\ No newline at end of file
@@ -12,8 +12,6 @@
 
 //#include <ot/world.h>
 
-const bt::triangle* current_processed_triangle = nullptr;
-
 ot_terrain_contact_common::ot_terrain_contact_common(float triangle_collision_margin, ot::discrete_dynamics_world* world, btCollisionObjectWrapper* planet_body_wrap)
     :_curr_collider(ctCount)
     , _triangle_collision_margin(triangle_collision_margin)
@@ -26,6 +24,9 @@ ot_terrain_contact_common::ot_terrain_contact_common(float triangle_collision_ma
     , _convex_object(0)
     , _internal_object(0)
     , _bt_ca(0)
+    , _bt_ca_shape_type(-1)
+    , _current_triangle(0)
+    , _triangle_kernels_enabled(true)
 {
     _triangle_cache.reserve(256, true);
     _contact_point_cache.reserve(256, true);
@@ -55,6 +56,7 @@ void ot_terrain_contact_common::prepare_sphere_collision(btManifoldResult* resul
     _collider_collision_margin = collision_margin;
     _sphere_origin_g = center;
     _curr_algo = &ot_terrain_contact_common::collide_sphere_triangle;
+    _manifold->setContactAddedHook(friction_combiner_cbk, this);
 }
 
 void ot_terrain_contact_common::prepare_capsule_collision(btManifoldResult* result, const glm::dvec3& p0, const glm::dvec3& p1, float radius, float collision_margin)
@@ -66,6 +68,7 @@ void ot_terrain_contact_common::prepare_capsule_collision(btManifoldResult* resu
     _capsule_p1_g = p1;
     _collider_collision_margin = collision_margin;
     _curr_algo = &ot_terrain_contact_common::collide_capsule_triangle;
+    _manifold->setContactAddedHook(friction_combiner_cbk, this);
 }
 
 void ot_terrain_contact_common::prepare_bt_convex_collision(btManifoldResult* result, btCollisionObjectWrapper* convex_object, btDispatcher* dispatcher)
@@ -73,15 +76,29 @@ void ot_terrain_contact_common::prepare_bt_convex_collision(btManifoldResult* re
     prepare(result);
     _curr_collider = ctBox;
     _curr_algo = &ot_terrain_contact_common::collide_convex_triangle;
+    _manifold->setContactAddedHook(GJK_contact_added, this);
     _box_local_transform = convex_object->getWorldTransform();
     _convex_object = convex_object;
 
+    // convex-triangle algorithm is kept per terrain context and only retargeted to the manifold of the object,
+    // gjk solvers come from the thread local pools of multithread_default_collision_configuration
+    const int shape_type = convex_object->getCollisionShape()->getShapeType();
+
+    if (_bt_ca && _bt_ca_shape_type == shape_type) {
+        static_cast<btConvexConvexAlgorithm*>(_bt_ca)->setManifold(result->getPersistentManifold());
+        return;
+    }
+
+    // dispatcher pools are shared by the terrain pass workers
+    std::lock_guard<std::mutex> lock(_collision_world->dispatcher_mutex());
+
     if (_bt_ca) {
         _bt_ca->~btCollisionAlgorithm();
         _collision_world->getDispatcher()->freeCollisionAlgorithm(_bt_ca);
     }
 
-    _bt_ca = _collision_world->getDispatcher()->findAlgorithm2(convex_object->getCollisionShape()->getShapeType(), btTriangleShape().getShapeType(), result->getPersistentManifold());
+    _bt_ca = _collision_world->getDispatcher()->findAlgorithm2(shape_type, TRIANGLE_SHAPE_PROXYTYPE, result->getPersistentManifold());
+    _bt_ca_shape_type = shape_type;
 }
 
 void ot_terrain_contact_common::process_triangle_cache()
@@ -95,6 +112,11 @@ void ot_terrain_contact_common::process_triangle_cache()
 }
 
 void ot_terrain_contact_common::process_triangle_cache(const coid::dynarray<bt::triangle>& triangle_cache)
+{
+    process_triangle_cache(triangle_cache.ptr(), triangle_cache.ptre());
+}
+
+void ot_terrain_contact_common::process_triangle_cache(const bt::triangle* begin, const bt::triangle* end)
 {
     btPersistentManifold* p_man = _manifold->getPersistentManifold();
 
@@ -118,9 +140,15 @@ void ot_terrain_contact_common::process_triangle_cache(const coid::dynarray<bt::
     }*/
     ///
 
-    triangle_cache.for_each([&](const bt::triangle& t) {
+    if (_triangle_kernels_enabled && (_curr_collider == ctSphere || _curr_collider == ctCapsule)) {
+        process_triangle_blocks(begin, end);
+        return;
+    }
+
+    for (const bt::triangle* tp = begin; tp < end; ++tp) {
+        const bt::triangle& t = *tp;
         set_terrain_mesh_offset(*t.parent_offset_p);
-        current_processed_triangle = &t;
+        _current_triangle = &t;
 
         /*
         this was here for debugging purposes
@@ -173,7 +201,48 @@ void ot_terrain_contact_common::process_triangle_cache(const coid::dynarray<bt::
         }
         */
         (this->*_curr_algo)(t);
-    });
+    }
+}
+
+void ot_terrain_contact_common::process_triangle_blocks(const bt::triangle* begin, const bt::triangle* end)
+{
+    // kernels only reject triangles out of the contact range, the contacts themselves come from the per triangle
+    // algorithm in the original order so the result is the same as without the kernels
+    // slack covers the rounding difference between the kernels and coal3d
+    static const float CULL_SLACK = 0.01f;
+
+    const float collider_rad = _curr_collider == ctSphere ? _sphere_radius : _capsule_radius;
+    const float cull_rad = collider_rad + _collider_collision_margin + _triangle_collision_margin + CULL_SLACK;
+    const float cull_rad_sq = cull_rad * cull_rad;
+
+    bt::triangle_block_soa block;
+    alignas(32) float dist_sq[bt::triangle_block_soa::LANES];
+
+    for (const bt::triangle* tp = begin; tp < end; ) {
+        const uint n = block.build(tp, end);
+        set_terrain_mesh_offset(*block.offset);
+
+        if (_curr_collider == ctSphere) {
+            bt::distance_point_triangle_block(block, _sphere_origin, dist_sq);
+        }
+        else {
+            bt::distance_segment_triangle_block(block, _capsule_p0, _capsule_p1, dist_sq);
+        }
+
+        for (uint i = 0; i < n; i++) {
+            if (dist_sq[i] < cull_rad_sq) {
+                _current_triangle = tp + i;
+                (this->*_curr_algo)(tp[i]);
+            }
+        }
+
+        tp += n;
+    }
+
+    // the contact hooks run in process_collision_points and read the last triangle, as in the per triangle path
+    if (begin < end) {
+        _current_triangle = end - 1;
+    }
 }
 
 void ot_terrain_contact_common::process_collision_points()
@@ -382,7 +451,13 @@ void ot_terrain_contact_common::collide_object_plane(fn_elevation_above_terrain
     const btCollisionObjectWrapper* curr_col_obj_wrapper = _manifold->getBody0Wrap();
     _manifold->setBody0Wrap(_internal_object);
 
-    btCollisionAlgorithm* colAlgo = _collision_world->getDispatcher()->findAlgorithm(_manifold->getBody0Wrap(), &planeObWrap, _manifold->getPersistentManifold());
+    _manifold->setContactAddedHook(plane_contact_added, this);
+
+    btCollisionAlgorithm* colAlgo;
+    {
+        std::lock_guard<std::mutex> lock(_collision_world->dispatcher_mutex());
+        colAlgo = _collision_world->getDispatcher()->findAlgorithm(_manifold->getBody0Wrap(), &planeObWrap, _manifold->getPersistentManifold());
+    }
 
     const btCollisionObjectWrapper* tmpWrap = 0;
 
@@ -398,6 +473,8 @@ void ot_terrain_contact_common::collide_object_plane(fn_elevation_above_terrain
     //    DASSERT(_manifold->getPersistentManifold()->getNumContacts() <= 1);
 
     colAlgo->~btCollisionAlgorithm();
+
+    std::lock_guard<std::mutex> lock(_collision_world->dispatcher_mutex());
     _collision_world->getDispatcher()->freeCollisionAlgorithm(colAlgo);
 }
 
@@ -421,6 +498,7 @@ void ot_terrain_contact_common::clear_common_data()
     _convex_object = 0;
     _internal_object = 0;
     _bt_ca = 0;
+    _bt_ca_shape_type = -1;
     _triangle_cache.clear();
     _contact_point_cache.clear();
     _additional_col_objs.clear();
@@ -439,8 +517,9 @@ void ot_terrain_contact_common::clear_caches() {
     _additional_col_objs.clear();
 }
 
-bool GJK_contact_added(btManifoldPoint& cp, const btCollisionObjectWrapper* colObj0Wrap, int partId0, int index0, const btCollisionObjectWrapper* colObj1Wrap, int partId1, int index1)
+bool GJK_contact_added(void* user_data, btManifoldPoint& cp, const btCollisionObjectWrapper* colObj0Wrap, int partId0, int index0, const btCollisionObjectWrapper* colObj1Wrap, int partId1, int index1)
 {
+    const bt::triangle* current_processed_triangle = static_cast<ot_terrain_contact_common*>(user_data)->current_processed_triangle();
     DASSERT(current_processed_triangle != nullptr);
 
     const double3* offset = current_processed_triangle->parent_offset_p;
@@ -458,13 +537,13 @@ bool GJK_contact_added(btManifoldPoint& cp, const btCollisionObjectWrapper* colO
         cp.m_normalWorldOnB = btVector3(n.x, n.y, n.z);
     }
 
-    friction_combiner_cbk(cp, colObj0Wrap, partId0, index0, colObj1Wrap, partId1, index1);
+    friction_combiner_cbk(user_data, cp, colObj0Wrap, partId0, index0, colObj1Wrap, partId1, index1);
 
     return true;
 }
 
 
-bool plane_contact_added(btManifoldPoint& cp, const btCollisionObjectWrapper* colObj0Wrap, int partId0, int index0, const btCollisionObjectWrapper* colObj1Wrap, int partId1, int index1)
+bool plane_contact_added(void* user_data, btManifoldPoint& cp, const btCollisionObjectWrapper* colObj0Wrap, int partId0, int index0, const btCollisionObjectWrapper* colObj1Wrap, int partId1, int index1)
 {
     cp.m_combinedFriction = calculate_combined_friction(1.0f, float(colObj0Wrap->getCollisionObject()->getFriction()));
     cp.m_combinedRollingFriction = calculate_combined_rolling_friction(1.0f, float(colObj0Wrap->getCollisionObject()->getRollingFriction()));
@@ -473,8 +552,9 @@ bool plane_contact_added(btManifoldPoint& cp, const btCollisionObjectWrapper* co
 }
 
 
-bool friction_combiner_cbk(btManifoldPoint& cp, const btCollisionObjectWrapper* colObj0Wrap, int partId0, int index0, const btCollisionObjectWrapper* colObj1Wrap, int partId1, int index1)
+bool friction_combiner_cbk(void* user_data, btManifoldPoint& cp, const btCollisionObjectWrapper* colObj0Wrap, int partId0, int index0, const btCollisionObjectWrapper* colObj1Wrap, int partId1, int index1)
 {
+    const bt::triangle* current_processed_triangle = static_cast<ot_terrain_contact_common*>(user_data)->current_processed_triangle();
     DASSERT(current_processed_triangle != nullptr);
     cp.m_combinedFriction = calculate_combined_friction(current_processed_triangle->fric, float(colObj0Wrap->getCollisionObject()->getFriction()));
     cp.m_combinedRollingFriction = calculate_combined_rolling_friction(current_processed_triangle->roll_fric, float(colObj0Wrap->getCollisionObject()->getRollingFriction()));
@@ -7,6 +7,7 @@
 #include "BulletCollision/CollisionDispatch/btManifoldResult.h"
 
 #include "physics_cfg.h"
+#include "triangle_collider.h"
 
 class btConvexPolyhedron;
 class btBoxShape;
@@ -70,10 +71,11 @@ struct contact_point
     {}
 };
 
-bool GJK_contact_added(btManifoldPoint& cp, const btCollisionObjectWrapper* colObj0Wrap, int partId0, int index0, const btCollisionObjectWrapper* colObj1Wrap, int partId1, int index1);
-bool friction_combiner_cbk(btManifoldPoint& cp, const btCollisionObjectWrapper* colObj0Wrap, int partId0, int index0, const btCollisionObjectWrapper* colObj1Wrap, int partId1, int index1);
+/// btManifoldResult contact added hooks, user_data is the ot_terrain_contact_common
+bool GJK_contact_added(void* user_data, btManifoldPoint& cp, const btCollisionObjectWrapper* colObj0Wrap, int partId0, int index0, const btCollisionObjectWrapper* colObj1Wrap, int partId1, int index1);
+bool friction_combiner_cbk(void* user_data, btManifoldPoint& cp, const btCollisionObjectWrapper* colObj0Wrap, int partId0, int index0, const btCollisionObjectWrapper* colObj1Wrap, int partId1, int index1);
 
-bool plane_contact_added(btManifoldPoint& cp, const btCollisionObjectWrapper* colObj0Wrap, int partId0, int index0, const btCollisionObjectWrapper* colObj1Wrap, int partId1, int index1);
+bool plane_contact_added(void* user_data, btManifoldPoint& cp, const btCollisionObjectWrapper* colObj0Wrap, int partId0, int index0, const btCollisionObjectWrapper* colObj1Wrap, int partId1, int index1);
 
 
 /// Copied from the Bullet btManifoldResult
@@ -117,6 +119,7 @@ public:
 
     void process_triangle_cache();
     void process_triangle_cache(const coid::dynarray<bt::triangle>& triangle_cache);
+    void process_triangle_cache(const bt::triangle* begin, const bt::triangle* end);
     void process_collision_points();
     void process_additional_col_objs();
 
@@ -133,8 +136,19 @@ public:
     void clear_common_data();
 
     void set_bounding_sphere_rad(float rad) { _sphere_radius = rad; }
+
+    /// use the batched SoA distance kernels to cull triangles for sphere and capsule colliders
+    /// @note the per triangle path is kept as the reference, both produce the same contacts
+    void set_triangle_kernels_enabled(bool enabled) { _triangle_kernels_enabled = enabled; }
+    bool is_triangle_kernels_enabled() const { return _triangle_kernels_enabled; }
+
+    /// triangle being processed, used by the contact added hooks
+    const bt::triangle* current_processed_triangle() const { return _current_triangle; }
 private:
     typedef void(ot_terrain_contact_common::* CollisionAlgorithm)(const bt::triangle&);
+
+    void process_triangle_blocks(const bt::triangle* begin, const bt::triangle* end);
+
     btCollisionObjectWrapper* _planet_body_wrap;
     btManifoldResult* _manifold;
     ot::discrete_dynamics_world* _collision_world;
@@ -170,5 +184,8 @@ private:
     btCollisionObjectWrapper* _internal_object;
     btTransform _box_local_transform;
     btCollisionAlgorithm* _bt_ca;
+    int _bt_ca_shape_type;              //< shape type _bt_ca was created for, any non-sphere convex vs triangle is a btConvexConvexAlgorithm
+    const bt::triangle* _current_triangle;
+    bool _triangle_kernels_enabled;
 };
 
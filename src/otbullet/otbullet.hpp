@@ -23,6 +23,8 @@ namespace bt {
     class physics;
     struct ot_world_physics_stats;
     struct external_broadphase;
+    struct frustum_query;
+    struct navigation_probe_step;
     class ot_navigation_probe;
 }
 extern bt::physics* BT;
@@ -87,11 +89,18 @@ public:
 
     ifc_fn void update_collision_object(btCollisionObject* obj, const btTransform& tr, bool update_aabb);
     ifc_fn void set_collision_info(btCollisionObject* obj, unsigned int group, unsigned int mask);
+    /// @brief Set or clear bt::EOtFlags of the object
+    /// @note use instead of writing m_otFlags when changing OTF_DISABLE_OT_WORLD_COLLISIONS, the world keeps a set of objects the terrain pass works on
+    ifc_fn void set_ot_flags(btCollisionObject* obj, uint flags, bool enable);
     ifc_fn bool add_collision_object(btCollisionObject* obj, unsigned int group, unsigned int mask, bool inactive);
     ifc_fn bool add_sensor_object(btPairCachingGhostObject* obj, unsigned int group, unsigned int mask);
 
     ifc_fn bt::ot_navigation_probe* create_navigation_probe(float3 half_vec, float3 offset, unsigned int group, unsigned int mask);
     ifc_fn void navigation_probe_sim_step(bt::ot_navigation_probe* probe_ptr, const double3& target_position, const quat& target_rotation, float dt);
+
+    /// @brief Move a batch of probes towards their targets, nearby probes share one broadphase query and the sweeps run on the taskmaster
+    /// @note probes do not block each other, the result is the same as stepping them one by one
+    ifc_fn void navigation_probes_sim_step(const bt::navigation_probe_step* steps, uint count, float dt);
     ifc_fn void update_navigation_probe(bt::ot_navigation_probe* probe_ptr, const double3& position, const quat& rotation);
     ifc_fn void get_navigation_probe_transform(bt::ot_navigation_probe* probe_ptr, double3& position_out, quat& rotation_out);
 
@@ -125,6 +134,14 @@ public:
 
     ifc_fn bt::ot_world_physics_stats get_stats();
     ifc_fn bt::ot_world_physics_stats* get_stats_ptr();
+
+    /// @brief Record every phase of the simulation step and its counters into per-thread ring buffers
+    /// @note when disabled a profiled phase costs a flag test, toggle between steps
+    ifc_fn void set_step_profiler_enabled(bool enabled);
+
+    /// @brief Write the recorded step profile as a Chrome trace JSON (chrome://tracing), must not run during a step
+    /// @return false if the file could not be created
+    ifc_fn bool export_step_profile(const coid::token& path);
     ifc_fn void set_debug_draw_enabled(btIDebugDraw* debug_drawer);
     ifc_fn void set_debug_drawer_mode(int debug_mode);
     ifc_fn void debug_draw_world(btScalar extrapolation_step);
@@ -134,6 +151,12 @@ public:
     ifc_fn btCollisionObject* query_volume_sphere(const double3& pos, float rad, const void* exclude_object);
     ifc_fn void query_volume_sphere(const double3& pos, float rad, ifc_out coid::dynarray<btCollisionObject*>& result);
     ifc_fn void query_volume_frustum(const double3& pos, const float4* f_planes_norms, uint8 nplanes, bool include_partial, ifc_out coid::dynarray<btCollisionObject*>& result);
+
+    /// @brief Batched sphere and frustum queries, each tree is walked once for the whole batch
+    /// @param result pairs of query index and the object found
+    /// @note thread safe, may be called from worker threads while the simulation is not stepping
+    ifc_fn void query_volume_spheres(const double3* centers, const float* radii, uint count, ifc_out coid::dynarray32<std::pair<uint, btCollisionObject*>>& result);
+    ifc_fn void query_volume_frusta(const bt::frustum_query* frusta, uint count, bool include_partial, ifc_out coid::dynarray32<std::pair<uint, btCollisionObject*>>& result);
     ifc_fn void wake_up_objects_in_radius(const double3& pos, float rad);
     ifc_fn void wake_up_object(btCollisionObject* obj);
 
@@ -143,6 +166,15 @@ public:
 
     ifc_fn void pause_simulation(bool pause);
 
+    /// @brief Reuse terrain query results per object while it stays near the place they were fetched
+    /// @note invalidate_terrain_cache() has to be called when terrain meshes or tree batches are released or rebuilt
+    ifc_fn void set_terrain_cache_enabled(bool enabled);
+    ifc_fn void invalidate_terrain_cache();
+
+    /// @brief Sweep bodies faster than their ccd motion threshold against the terrain triangles, instead of substepping
+    /// @note set the ccd motion threshold (and swept sphere radius for non convex shapes) on the rigid bodies that need it
+    ifc_fn void set_terrain_ccd(bool enabled);
+
     /// @brief Get trigerred sensors
     /// @param result_out - result array of std::pairs where the 'first' is sensor object ptr  and 'second' is trigger object ptr
     ifc_fn void get_triggered_sensors(coid::dynarray32<std::pair<btGhostObject*, btCollisionObject*>>& result_out);
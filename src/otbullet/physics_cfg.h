@@ -8,6 +8,8 @@
 
 #include <comm/dynarray.h>
 #include "otflags.h"
+#include "tree_collider.h"
+#include "dbvt_query.h"
 
 class rigid_body_constraint;
 class terrain_mesh;
@@ -114,6 +116,9 @@ struct tree_batch
 
     __declspec(align(16)) uint8 buf[16 * sizeof(tree_collision_info)];
 
+    /// tree capsules for the batched collider, built together with the collision info
+    tree_batch_soa soa;
+
     tree_collision_info* info(int i) { return (tree_collision_info*)buf + i; }
     ~tree_batch() {
         tree_count = 0;
@@ -162,6 +167,28 @@ struct ot_world_physics_stats {
     float tri_list_construction_time_ms;
     float broad_aabb_intersections_time_ms;
     uint32 broad_aabb_intersections_count;
+    uint32 collision_algorithms_created;    //< by tree and terrain broadphase pairs, per step
+    uint32 collision_algorithms_released;   //< by tree and terrain broadphase pairs, per step
+    uint32 terrain_cache_hits;
+    uint32 terrain_cache_misses;
+};
+
+/// frustum of the batched frustum queries, planes are relative to pos
+struct frustum_query
+{
+    double3 pos;
+    const float4* planes;
+    uint8 nplanes;
+};
+
+class ot_navigation_probe;
+
+/// probe and its target in a batch navigation step
+struct navigation_probe_step
+{
+    ot_navigation_probe* probe;
+    double3 target_position;
+    quat target_rotation;
 };
 
 //
@@ -205,12 +232,19 @@ struct external_broadphase {
     bt32BitAxisSweep3* _broadphase;
     coid::dynarray<broadphase_entry> _entries;
     coid::dynarray<btCollisionObject*> _procedural_objects;
+    /// float copy of the broadphase tree relative to the tile, rebuilt by update_terrain_mesh_broadphase
+    dbvt_local_tree _local_tree;
     uint _revision = 0;
     bool _dirty = false;
 
+    /// handle capacity of a new broadphase, grows when a tile brings more objects
+    static const uint INITIAL_CAPACITY = 1024;
+    /// new proxies above which the endpoints are sorted once instead of per proxy
+    static const uint BULK_INSERT_MIN = 32;
+
     external_broadphase(const double3& min, const double3& max)
     {
-        _broadphase = new bt32BitAxisSweep3(btVector3(min.x, min.y, min.z), btVector3(max.x, max.y, max.z), 5000);
+        _broadphase = new bt32BitAxisSweep3(btVector3(min.x, min.y, min.z), btVector3(max.x, max.y, max.z), INITIAL_CAPACITY);
     }
 
 };
@@ -0,0 +1,169 @@
+#include "tree_collider.h"
+#include "physics_cfg.h"
+
+#include <emmintrin.h>
+#include <cmath>
+
+namespace bt {
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void tree_batch_soa::build(const tree* trees, uint tree_count)
+{
+    count = tree_count < LANES ? tree_count : LANES;
+    origin = count ? trees[0].pos : double3(0);
+
+    for (uint i = 0; i < LANES; i++) {
+        if (i < count) {
+            const tree& t = trees[i];
+            const float3 base(t.pos - origin);
+            const float3 dir(glm::normalize(t.pos));
+
+            base_x[i] = base.x;
+            base_y[i] = base.y;
+            base_z[i] = base.z;
+            dir_x[i] = dir.x;
+            dir_y[i] = dir.y;
+            dir_z[i] = dir.z;
+            height[i] = t.height;
+            radius[i] = t.radius;
+        }
+        else {
+            // unused lanes get a degenerate but well defined tree, callers mask them out
+            base_x[i] = base_y[i] = base_z[i] = 0;
+            dir_x[i] = dir_z[i] = 0;
+            dir_y[i] = 1;
+            height[i] = 1;
+            radius[i] = 0;
+        }
+    }
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+static inline __m128 select_ps(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline __m128 clamp01_ps(__m128 v)
+{
+    return _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.f));
+}
+
+static inline __m128 dot3_ps(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz)
+{
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void collide_segment_tree_batch(const tree_batch_soa& soa, const float3& p0, const float3& p1, float radius, tree_segment_contact* contacts)
+{
+    static const float EPS = 1e-6f;
+
+    // closest points between the body segment P(s) = p0 + d1*s and the tree axes Q(t) = base + d2*t,
+    // four trees per iteration (Ericson, Real-Time Collision Detection 5.1.9)
+    const float3 d1 = p1 - p0;
+    const float a = d1.x * d1.x + d1.y * d1.y + d1.z * d1.z;
+    const bool is_point = a <= EPS;
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 veps = _mm_set1_ps(EPS);
+    const __m128 va = _mm_set1_ps(a);
+    const __m128 inv_a = _mm_set1_ps(is_point ? 0.f : 1.f / a);
+
+    const __m128 d1x = _mm_set1_ps(d1.x);
+    const __m128 d1y = _mm_set1_ps(d1.y);
+    const __m128 d1z = _mm_set1_ps(d1.z);
+    const __m128 p0x = _mm_set1_ps(p0.x);
+    const __m128 p0y = _mm_set1_ps(p0.y);
+    const __m128 p0z = _mm_set1_ps(p0.z);
+    const __m128 rad = _mm_set1_ps(radius);
+
+    alignas(16) float out[8][4];
+
+    for (uint i = 0; i < tree_batch_soa::LANES; i += 4) {
+        const __m128 qx = _mm_load_ps(soa.base_x + i);
+        const __m128 qy = _mm_load_ps(soa.base_y + i);
+        const __m128 qz = _mm_load_ps(soa.base_z + i);
+        const __m128 h = _mm_load_ps(soa.height + i);
+        const __m128 d2x = _mm_mul_ps(_mm_load_ps(soa.dir_x + i), h);
+        const __m128 d2y = _mm_mul_ps(_mm_load_ps(soa.dir_y + i), h);
+        const __m128 d2z = _mm_mul_ps(_mm_load_ps(soa.dir_z + i), h);
+        const __m128 rb = _mm_load_ps(soa.radius + i);
+
+        const __m128 rx = _mm_sub_ps(p0x, qx);
+        const __m128 ry = _mm_sub_ps(p0y, qy);
+        const __m128 rz = _mm_sub_ps(p0z, qz);
+
+        const __m128 e = dot3_ps(d2x, d2y, d2z, d2x, d2y, d2z);
+        const __m128 f = dot3_ps(d2x, d2y, d2z, rx, ry, rz);
+        const __m128 inv_e = _mm_div_ps(one, _mm_max_ps(e, veps));
+
+        __m128 s, t;
+        if (is_point) {
+            s = zero;
+            t = clamp01_ps(_mm_mul_ps(f, inv_e));
+        }
+        else {
+            const __m128 c = dot3_ps(d1x, d1y, d1z, rx, ry, rz);
+            const __m128 b = dot3_ps(d1x, d1y, d1z, d2x, d2y, d2z);
+            const __m128 denom = _mm_sub_ps(_mm_mul_ps(va, e), _mm_mul_ps(b, b));
+            const __m128 non_parallel = _mm_cmpgt_ps(denom, veps);
+            const __m128 safe_denom = select_ps(non_parallel, denom, one);
+
+            s = _mm_div_ps(_mm_sub_ps(_mm_mul_ps(b, f), _mm_mul_ps(c, e)), safe_denom);
+            s = select_ps(non_parallel, clamp01_ps(s), zero);
+            t = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(b, s), f), inv_e);
+
+            const __m128 below = _mm_cmplt_ps(t, zero);
+            const __m128 above = _mm_cmpgt_ps(t, one);
+            const __m128 s_below = clamp01_ps(_mm_mul_ps(_mm_sub_ps(zero, c), inv_a));
+            const __m128 s_above = clamp01_ps(_mm_mul_ps(_mm_sub_ps(b, c), inv_a));
+
+            s = select_ps(below, s_below, select_ps(above, s_above, s));
+            t = clamp01_ps(t);
+        }
+
+        const __m128 cax = _mm_add_ps(p0x, _mm_mul_ps(d1x, s));
+        const __m128 cay = _mm_add_ps(p0y, _mm_mul_ps(d1y, s));
+        const __m128 caz = _mm_add_ps(p0z, _mm_mul_ps(d1z, s));
+        const __m128 cbx = _mm_add_ps(qx, _mm_mul_ps(d2x, t));
+        const __m128 cby = _mm_add_ps(qy, _mm_mul_ps(d2y, t));
+        const __m128 cbz = _mm_add_ps(qz, _mm_mul_ps(d2z, t));
+
+        const __m128 vx = _mm_sub_ps(cax, cbx);
+        const __m128 vy = _mm_sub_ps(cay, cby);
+        const __m128 vz = _mm_sub_ps(caz, cbz);
+        const __m128 len2 = dot3_ps(vx, vy, vz, vx, vy, vz);
+        const __m128 len = _mm_sqrt_ps(len2);
+        const __m128 inv_len = _mm_div_ps(one, _mm_max_ps(len, veps));
+
+        _mm_store_ps(out[0], cbx);
+        _mm_store_ps(out[1], cby);
+        _mm_store_ps(out[2], cbz);
+        _mm_store_ps(out[3], _mm_mul_ps(vx, inv_len));
+        _mm_store_ps(out[4], _mm_mul_ps(vy, inv_len));
+        _mm_store_ps(out[5], _mm_mul_ps(vz, inv_len));
+        _mm_store_ps(out[6], _mm_sub_ps(_mm_sub_ps(len, rad), rb));
+        _mm_store_ps(out[7], len2);
+
+        for (uint k = 0; k < 4; k++) {
+            tree_segment_contact& tc = contacts[i + k];
+
+            if (out[7][k] > EPS * EPS) {
+                tc.normal = float3(out[3][k], out[4][k], out[5][k]);
+            }
+            else {
+                // body axis goes through the tree axis, push out perpendicular to the tree
+                const float3 dir(soa.dir_x[i + k], soa.dir_y[i + k], soa.dir_z[i + k]);
+                const float3 ref = std::abs(dir.x) < 0.9f ? float3(1, 0, 0) : float3(0, 1, 0);
+                tc.normal = glm::normalize(glm::cross(dir, ref));
+            }
+
+            tc.point_on_tree = float3(out[0][k], out[1][k], out[2][k]) + tc.normal * soa.radius[i + k];
+            tc.distance = out[6][k];
+        }
+    }
+}
+
+} //namespace bt
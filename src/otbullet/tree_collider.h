@@ -0,0 +1,46 @@
+#pragma once
+
+#include <comm/commtypes.h>
+#include <ot/glm/glm_types.h>
+
+namespace bt {
+
+struct tree;
+
+/// SoA copy of the tree capsules of a tree_batch, used by the batched tree collider
+/// @note tree i is a vertical segment base[i] .. base[i] + dir[i] * height[i] with radius[i],
+/// positions are relative to origin to keep float precision
+struct tree_batch_soa
+{
+    static const uint LANES = 16;
+
+    double3 origin;
+    uint count;
+
+    alignas(16) float base_x[LANES];
+    alignas(16) float base_y[LANES];
+    alignas(16) float base_z[LANES];
+    alignas(16) float dir_x[LANES];
+    alignas(16) float dir_y[LANES];
+    alignas(16) float dir_z[LANES];
+    alignas(16) float height[LANES];
+    alignas(16) float radius[LANES];
+
+    void build(const tree* trees, uint tree_count);
+};
+
+/// closest feature between a body segment and one tree of the batch
+struct tree_segment_contact
+{
+    float3 point_on_tree;               //< on the tree surface, relative to tree_batch_soa::origin
+    float3 normal;                      //< from the tree towards the body
+    float distance;                     //< signed distance between the surfaces, negative when penetrating
+};
+
+/// @brief Collide a sphere-swept segment (a sphere when p0 == p1) with all trees of the batch at once
+/// @param p0,p1 body segment relative to tree_batch_soa::origin
+/// @param radius body radius
+/// @param contacts output, LANES entries, only the first soa.count entries are meaningful
+void collide_segment_tree_batch(const tree_batch_soa& soa, const float3& p0, const float3& p1, float radius, tree_segment_contact* contacts);
+
+} //namespace bt
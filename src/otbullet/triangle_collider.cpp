@@ -0,0 +1,282 @@
+#include "triangle_collider.h"
+#include "physics_cfg.h"
+
+#include <immintrin.h>
+
+namespace bt {
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+uint triangle_block_soa::build(const triangle* begin, const triangle* end)
+{
+    offset = begin < end ? begin->parent_offset_p : 0;
+    count = 0;
+
+    for (const triangle* t = begin; t < end && count < LANES && t->parent_offset_p == offset; ++t, ++count) {
+        a_x[count] = t->a.x;
+        a_y[count] = t->a.y;
+        a_z[count] = t->a.z;
+        b_x[count] = t->b.x;
+        b_y[count] = t->b.y;
+        b_z[count] = t->b.z;
+        c_x[count] = t->c.x;
+        c_y[count] = t->c.y;
+        c_z[count] = t->c.z;
+    }
+
+    // unused lanes get a degenerate triangle at the origin, callers ignore them
+    for (uint i = count; i < LANES; i++) {
+        a_x[i] = a_y[i] = a_z[i] = 0;
+        b_x[i] = b_y[i] = b_z[i] = 0;
+        c_x[i] = c_y[i] = c_z[i] = 0;
+    }
+
+    return count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 8 lanes per op with AVX, 4 with SSE
+
+#ifdef __AVX__
+
+typedef __m256 vfloat;
+static const uint WIDTH = 8;
+
+static inline vfloat v_set1(float f) { return _mm256_set1_ps(f); }
+static inline vfloat v_load(const float* p) { return _mm256_load_ps(p); }
+static inline void v_store(float* p, vfloat v) { _mm256_store_ps(p, v); }
+static inline vfloat v_add(vfloat a, vfloat b) { return _mm256_add_ps(a, b); }
+static inline vfloat v_sub(vfloat a, vfloat b) { return _mm256_sub_ps(a, b); }
+static inline vfloat v_mul(vfloat a, vfloat b) { return _mm256_mul_ps(a, b); }
+static inline vfloat v_div(vfloat a, vfloat b) { return _mm256_div_ps(a, b); }
+static inline vfloat v_min(vfloat a, vfloat b) { return _mm256_min_ps(a, b); }
+static inline vfloat v_max(vfloat a, vfloat b) { return _mm256_max_ps(a, b); }
+static inline vfloat v_and(vfloat a, vfloat b) { return _mm256_and_ps(a, b); }
+static inline vfloat v_or(vfloat a, vfloat b) { return _mm256_or_ps(a, b); }
+static inline vfloat v_le(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+static inline vfloat v_ge(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+static inline vfloat v_gt(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+static inline vfloat v_select(vfloat mask, vfloat a, vfloat b) { return _mm256_blendv_ps(b, a, mask); }
+
+#else
+
+typedef __m128 vfloat;
+static const uint WIDTH = 4;
+
+static inline vfloat v_set1(float f) { return _mm_set1_ps(f); }
+static inline vfloat v_load(const float* p) { return _mm_load_ps(p); }
+static inline void v_store(float* p, vfloat v) { _mm_store_ps(p, v); }
+static inline vfloat v_add(vfloat a, vfloat b) { return _mm_add_ps(a, b); }
+static inline vfloat v_sub(vfloat a, vfloat b) { return _mm_sub_ps(a, b); }
+static inline vfloat v_mul(vfloat a, vfloat b) { return _mm_mul_ps(a, b); }
+static inline vfloat v_div(vfloat a, vfloat b) { return _mm_div_ps(a, b); }
+static inline vfloat v_min(vfloat a, vfloat b) { return _mm_min_ps(a, b); }
+static inline vfloat v_max(vfloat a, vfloat b) { return _mm_max_ps(a, b); }
+static inline vfloat v_and(vfloat a, vfloat b) { return _mm_and_ps(a, b); }
+static inline vfloat v_or(vfloat a, vfloat b) { return _mm_or_ps(a, b); }
+static inline vfloat v_le(vfloat a, vfloat b) { return _mm_cmple_ps(a, b); }
+static inline vfloat v_ge(vfloat a, vfloat b) { return _mm_cmpge_ps(a, b); }
+static inline vfloat v_gt(vfloat a, vfloat b) { return _mm_cmpgt_ps(a, b); }
+static inline vfloat v_select(vfloat mask, vfloat a, vfloat b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+
+#endif
+
+static_assert(triangle_block_soa::LANES % WIDTH == 0, "block size must be a multiple of the simd width");
+
+struct vfloat3
+{
+    vfloat x, y, z;
+
+    vfloat3() {}
+    vfloat3(vfloat vx, vfloat vy, vfloat vz) : x(vx), y(vy), z(vz) {}
+    explicit vfloat3(const float3& v) : x(v_set1(v.x)), y(v_set1(v.y)), z(v_set1(v.z)) {}
+
+    vfloat3 operator + (const vfloat3& o) const { return vfloat3(v_add(x, o.x), v_add(y, o.y), v_add(z, o.z)); }
+    vfloat3 operator - (const vfloat3& o) const { return vfloat3(v_sub(x, o.x), v_sub(y, o.y), v_sub(z, o.z)); }
+    vfloat3 operator * (vfloat s) const { return vfloat3(v_mul(x, s), v_mul(y, s), v_mul(z, s)); }
+};
+
+static inline vfloat dot(const vfloat3& a, const vfloat3& b)
+{
+    return v_add(v_add(v_mul(a.x, b.x), v_mul(a.y, b.y)), v_mul(a.z, b.z));
+}
+
+static inline vfloat3 cross(const vfloat3& a, const vfloat3& b)
+{
+    return vfloat3(
+        v_sub(v_mul(a.y, b.z), v_mul(a.z, b.y)),
+        v_sub(v_mul(a.z, b.x), v_mul(a.x, b.z)),
+        v_sub(v_mul(a.x, b.y), v_mul(a.y, b.x)));
+}
+
+static inline vfloat clamp01(vfloat v)
+{
+    return v_min(v_max(v, v_set1(0.f)), v_set1(1.f));
+}
+
+/// x / y, or 0 in lanes where y is (near) zero
+static inline vfloat safe_div(vfloat x, vfloat y)
+{
+    const vfloat valid = v_gt(v_max(y, v_sub(v_set1(0.f), y)), v_set1(1e-12f));
+    return v_and(valid, v_div(x, v_select(valid, y, v_set1(1.f))));
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+/// closest point on triangles abc to p, branchless form of Ericson, Real-Time Collision Detection 5.1.5
+static vfloat point_triangle_dist_sq(const vfloat3& p, const vfloat3& a, const vfloat3& b, const vfloat3& c)
+{
+    const vfloat zero = v_set1(0.f);
+    const vfloat one = v_set1(1.f);
+
+    const vfloat3 ab = b - a;
+    const vfloat3 ac = c - a;
+    const vfloat3 ap = p - a;
+    const vfloat3 bp = p - b;
+    const vfloat3 cp = p - c;
+
+    const vfloat d1 = dot(ab, ap);
+    const vfloat d2 = dot(ac, ap);
+    const vfloat d3 = dot(ab, bp);
+    const vfloat d4 = dot(ac, bp);
+    const vfloat d5 = dot(ab, cp);
+    const vfloat d6 = dot(ac, cp);
+
+    const vfloat va = v_sub(v_mul(d3, d6), v_mul(d5, d4));
+    const vfloat vb = v_sub(v_mul(d5, d2), v_mul(d1, d6));
+    const vfloat vc = v_sub(v_mul(d1, d4), v_mul(d3, d2));
+
+    // barycentric weights of b and c, resolved from the lowest priority region up
+    const vfloat inv_denom = safe_div(one, v_add(v_add(va, vb), vc));
+    vfloat v = v_mul(vb, inv_denom);
+    vfloat w = v_mul(vc, inv_denom);
+
+    const vfloat d43 = v_sub(d4, d3);
+    const vfloat d56 = v_sub(d5, d6);
+    const vfloat in_bc = v_and(v_le(va, zero), v_and(v_ge(d43, zero), v_ge(d56, zero)));
+    const vfloat w_bc = safe_div(d43, v_add(d43, d56));
+    v = v_select(in_bc, v_sub(one, w_bc), v);
+    w = v_select(in_bc, w_bc, w);
+
+    const vfloat in_ac = v_and(v_le(vb, zero), v_and(v_ge(d2, zero), v_le(d6, zero)));
+    v = v_select(in_ac, zero, v);
+    w = v_select(in_ac, safe_div(d2, v_sub(d2, d6)), w);
+
+    const vfloat in_c = v_and(v_ge(d6, zero), v_le(d5, d6));
+    v = v_select(in_c, zero, v);
+    w = v_select(in_c, one, w);
+
+    const vfloat in_ab = v_and(v_le(vc, zero), v_and(v_ge(d1, zero), v_le(d3, zero)));
+    v = v_select(in_ab, safe_div(d1, v_sub(d1, d3)), v);
+    w = v_select(in_ab, zero, w);
+
+    const vfloat in_b = v_and(v_ge(d3, zero), v_le(d4, d3));
+    v = v_select(in_b, one, v);
+    w = v_select(in_b, zero, w);
+
+    const vfloat in_a = v_and(v_le(d1, zero), v_le(d2, zero));
+    v = v_select(in_a, zero, v);
+    w = v_select(in_a, zero, w);
+
+    const vfloat3 d = ap - (ab * v + ac * w);
+    return dot(d, d);
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+/// squared distance between segment p0 + d1*s and segments q + d2*t (Ericson 5.1.9), d1 must not be degenerate
+static vfloat segment_segment_dist_sq(const vfloat3& p0, const vfloat3& d1, vfloat a, vfloat inv_a, const vfloat3& q, const vfloat3& d2)
+{
+    const vfloat zero = v_set1(0.f);
+    const vfloat one = v_set1(1.f);
+
+    const vfloat3 r = p0 - q;
+    const vfloat e = dot(d2, d2);
+    const vfloat f = dot(d2, r);
+    const vfloat c = dot(d1, r);
+    const vfloat b = dot(d1, d2);
+    const vfloat inv_e = safe_div(one, e);
+
+    const vfloat denom = v_sub(v_mul(a, e), v_mul(b, b));
+    vfloat s = clamp01(safe_div(v_sub(v_mul(b, f), v_mul(c, e)), denom));
+    vfloat t = v_mul(v_add(v_mul(b, s), f), inv_e);
+
+    const vfloat below = v_le(t, zero);
+    const vfloat above = v_ge(t, one);
+    s = v_select(below, clamp01(v_mul(v_sub(zero, c), inv_a)), s);
+    s = v_select(above, clamp01(v_mul(v_sub(b, c), inv_a)), s);
+    t = clamp01(t);
+
+    const vfloat3 d = (p0 + d1 * s) - (q + d2 * t);
+    return dot(d, d);
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+/// lanes where the segment p0 + d*s crosses the triangle abc
+static vfloat segment_crosses_triangle(const vfloat3& p0, const vfloat3& d, const vfloat3& a, const vfloat3& b, const vfloat3& c)
+{
+    const vfloat zero = v_set1(0.f);
+
+    const vfloat3 n = cross(b - a, c - a);
+    const vfloat s0 = dot(n, p0 - a);
+    const vfloat nd = dot(n, d);
+
+    // p0 + d*s lies on the triangle plane at s = -s0 / nd
+    const vfloat s = safe_div(v_sub(zero, s0), nd);
+    const vfloat on_segment = v_and(v_gt(v_max(nd, v_sub(zero, nd)), zero), v_and(v_ge(s, zero), v_le(s, v_set1(1.f))));
+
+    const vfloat3 x = p0 + d * s;
+    const vfloat ea = dot(n, cross(b - a, x - a));
+    const vfloat eb = dot(n, cross(c - b, x - b));
+    const vfloat ec = dot(n, cross(a - c, x - c));
+
+    return v_and(on_segment, v_and(v_ge(ea, zero), v_and(v_ge(eb, zero), v_ge(ec, zero))));
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void distance_point_triangle_block(const triangle_block_soa& block, const float3& p, float* dist_sq)
+{
+    const vfloat3 vp(p);
+
+    for (uint i = 0; i < triangle_block_soa::LANES; i += WIDTH) {
+        const vfloat3 a(v_load(block.a_x + i), v_load(block.a_y + i), v_load(block.a_z + i));
+        const vfloat3 b(v_load(block.b_x + i), v_load(block.b_y + i), v_load(block.b_z + i));
+        const vfloat3 c(v_load(block.c_x + i), v_load(block.c_y + i), v_load(block.c_z + i));
+
+        v_store(dist_sq + i, point_triangle_dist_sq(vp, a, b, c));
+    }
+}
+
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void distance_segment_triangle_block(const triangle_block_soa& block, const float3& p0, const float3& p1, float* dist_sq)
+{
+    static const float EPS = 1e-6f;
+
+    const float3 d1 = p1 - p0;
+    const float a = d1.x * d1.x + d1.y * d1.y + d1.z * d1.z;
+
+    if (a <= EPS) {
+        distance_point_triangle_block(block, p0, dist_sq);
+        return;
+    }
+
+    // the closest pair is either on a segment end point, on a triangle edge, or the segment crosses the triangle
+    const vfloat3 vp0(p0);
+    const vfloat3 vp1(p1);
+    const vfloat3 vd1(d1);
+    const vfloat va = v_set1(a);
+    const vfloat inv_a = v_set1(1.f / a);
+
+    for (uint i = 0; i < triangle_block_soa::LANES; i += WIDTH) {
+        const vfloat3 ta(v_load(block.a_x + i), v_load(block.a_y + i), v_load(block.a_z + i));
+        const vfloat3 tb(v_load(block.b_x + i), v_load(block.b_y + i), v_load(block.b_z + i));
+        const vfloat3 tc(v_load(block.c_x + i), v_load(block.c_y + i), v_load(block.c_z + i));
+
+        vfloat d = v_min(point_triangle_dist_sq(vp0, ta, tb, tc), point_triangle_dist_sq(vp1, ta, tb, tc));
+        d = v_min(d, segment_segment_dist_sq(vp0, vd1, va, inv_a, ta, tb - ta));
+        d = v_min(d, segment_segment_dist_sq(vp0, vd1, va, inv_a, tb, tc - tb));
+        d = v_min(d, segment_segment_dist_sq(vp0, vd1, va, inv_a, tc, ta - tc));
+
+        const vfloat crosses = segment_crosses_triangle(vp0, vd1, ta, tb, tc);
+        v_store(dist_sq + i, v_select(crosses, v_set1(0.f), d));
+    }
+}
+
+} //namespace bt
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <comm/commtypes.h>
+#include <ot/glm/glm_types.h>
+
+namespace bt {
+
+struct triangle;
+
+/// SoA copy of up to LANES terrain triangles sharing the same mesh offset, used by the batched triangle distance kernels
+/// @note vertices are relative to *offset, same as in bt::triangle
+struct triangle_block_soa
+{
+    static const uint LANES = 8;
+
+    const double3* offset;
+    uint count;
+
+    alignas(32) float a_x[LANES];
+    alignas(32) float a_y[LANES];
+    alignas(32) float a_z[LANES];
+    alignas(32) float b_x[LANES];
+    alignas(32) float b_y[LANES];
+    alignas(32) float b_z[LANES];
+    alignas(32) float c_x[LANES];
+    alignas(32) float c_y[LANES];
+    alignas(32) float c_z[LANES];
+
+    /// @brief Fill the block from consecutive triangles, stops at LANES or at the first triangle with a different mesh offset
+    /// @return number of triangles consumed
+    uint build(const triangle* begin, const triangle* end);
+};
+
+/// @brief Squared distance between a point and all triangles of the block at once
+/// @param p point relative to triangle_block_soa::offset
+/// @param dist_sq output, LANES entries, only the first block.count entries are meaningful
+void distance_point_triangle_block(const triangle_block_soa& block, const float3& p, float* dist_sq);
+
+/// @brief Squared distance between a segment and all triangles of the block at once
+/// @param p0,p1 segment relative to triangle_block_soa::offset
+/// @param dist_sq output, LANES entries, only the first block.count entries are meaningful
+void distance_segment_triangle_block(const triangle_block_soa& block, const float3& p0, const float3& p1, float* dist_sq);
+
+} //namespace bt
@@ -15,13 +15,16 @@
 #include <BulletCollision/CollisionDispatch/btGhostObject.h>
 
 #include <BulletCollision/CollisionDispatch/btDefaultCollisionConfiguration.h>
+#include <BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h>
 
 #include <BulletCollision/BroadphaseCollision/btAxisSweep3.h>
 #include <BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolver.h>
+#include <BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolverMt.h>
 
 #include <BulletDynamics/ConstraintSolver/btPoint2PointConstraint.h>
 
 #include <LinearMath/btIDebugDraw.h>
+#include <LinearMath/btStepProfiler.h>
 
 #include "otbullet.hpp"
 #include "physics_cfg.h"
@@ -32,9 +35,11 @@
 #include <comm/commexception.h>
 #include <comm/taskmaster.h>
 #include <comm/singleton.h>
+#include <comm/str.h>
 
 static btBroadphaseInterface* _overlappingPairCache = 0;
 static btCollisionDispatcher* _dispatcher = 0;
+static taskmaster_task_scheduler* _task_scheduler = 0;
 static btConstraintSolver* _constraintSolver = 0;
 static btDefaultCollisionConfiguration* _collisionConfiguration = 0;
 
@@ -214,12 +219,12 @@ public:
 
         if(col_obj0->m_otFlags & bt::EOtFlags::OTF_SENSOR_GHOST_OBJECT)
         {
-            _physics->_world->add_sensor_trigger_data_internal(static_cast<btPairCachingGhostObject*>(col_obj0), col_obj1, result);
+            _physics->_world->add_sensor_trigger_data_internal(static_cast<btPairCachingGhostObject*>(col_obj0), col_obj1);
         }
 
         if (col_obj1->m_otFlags & bt::EOtFlags::OTF_SENSOR_GHOST_OBJECT)
         {
-            _physics->_world->add_sensor_trigger_data_internal(static_cast<btPairCachingGhostObject*>(col_obj1), col_obj0, result);
+            _physics->_world->add_sensor_trigger_data_internal(static_cast<btPairCachingGhostObject*>(col_obj1), col_obj0);
         }
 
         return result;
@@ -242,8 +247,44 @@ public:
 
         return btGhostPairCallback::removeOverlappingPair(proxy0, proxy1, dispatcher);
     }
+
+    /// manifold contact transitions, sensors are updated from these instead of polling their pairs
+    static void contact_started(btPersistentManifold* const& manifold)
+    {
+        contact_transition(manifold, true);
+    }
+
+    static void contact_ended(btPersistentManifold* const& manifold)
+    {
+        contact_transition(manifold, false);
+    }
+
+private:
+    static void contact_transition(btPersistentManifold* manifold, bool started)
+    {
+        const btCollisionObject* col_obj0 = manifold->getBody0();
+        const btCollisionObject* col_obj1 = manifold->getBody1();
+
+        if (col_obj0->m_otFlags & bt::EOtFlags::OTF_SENSOR_GHOST_OBJECT)
+        {
+            _physics->_world->sensor_contact_event_internal(col_obj0, col_obj1, started);
+        }
+
+        if (col_obj1->m_otFlags & bt::EOtFlags::OTF_SENSOR_GHOST_OBJECT)
+        {
+            _physics->_world->sensor_contact_event_internal(col_obj1, col_obj0, started);
+        }
+    }
 };
 
+////////////////////////////////////////////////////////////////////////////////
+static void ot_sleeping_state_changed(const btCollisionObject* obj, int old_state)
+{
+    if (_physics && _physics->_world) {
+        _physics->_world->update_terrain_collider(const_cast<btCollisionObject*>(obj));
+    }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 iref<physics> physics::create(double r, void* context, coid::taskmaster* tm)
 {
@@ -252,13 +293,31 @@ iref<physics> physics::create(double r, void* context, coid::taskmaster* tm)
     dccinfo.m_owns_simplex_and_pd_solver = false;
 
     _collisionConfiguration = new multithread_default_collision_configuration(dccinfo);
-    _dispatcher = new btCollisionDispatcher(_collisionConfiguration);
+    btCollisionDispatcherMt* dispatcher = new btCollisionDispatcherMt(_collisionConfiguration);
+    if (tm) {
+        // the configuration gives each thread its own simplex and penetration depth solver
+        _task_scheduler = new taskmaster_task_scheduler(tm);
+        dispatcher->setTaskScheduler(_task_scheduler);
+    }
+    _dispatcher = dispatcher;
     btVector3 worldMin(-r, -r, -r);
     btVector3 worldMax(r, r, r);
 
     _overlappingPairCache = new bt32BitAxisSweep3(worldMin, worldMax, 10000);
     _overlappingPairCache->getOverlappingPairCache()->setInternalGhostPairCallback(new ot_gost_pair_callback());
-    _constraintSolver = new btSequentialImpulseConstraintSolver();
+    gContactStartedCallback = &ot_gost_pair_callback::contact_started;
+    gContactEndedCallback = &ot_gost_pair_callback::contact_ended;
+    gSleepingStateChangedCallback = &ot_sleeping_state_changed;
+
+    btSequentialImpulseConstraintSolverMt* solver_mt = 0;
+    if (_task_scheduler) {
+        // the rows of large islands are solved on the workers
+        solver_mt = new btSequentialImpulseConstraintSolverMt();
+        solver_mt->setTaskScheduler(_task_scheduler);
+        _constraintSolver = solver_mt;
+    }
+    else
+        _constraintSolver = new btSequentialImpulseConstraintSolver();
 
     ot::discrete_dynamics_world* wrld = new ot::discrete_dynamics_world(
         _dispatcher,
@@ -274,6 +333,13 @@ iref<physics> physics::create(double r, void* context, coid::taskmaster* tm)
 
     wrld->setGravity(btVector3(0, 0, 0));
 
+    if (_task_scheduler) {
+        // one solver per worker and one for the stepping thread, islands are solved concurrently
+        wrld->setIslandTaskScheduler(_task_scheduler, _task_scheduler->num_threads());
+        wrld->setLargeIslandSolver(solver_mt);
+        wrld->getSimulationIslandManager()->setTaskScheduler(_task_scheduler);
+    }
+
     wrld->_aabb_intersect = &_ext_collider_obb;
     wrld->_terrain_ray_intersect_broadphase = &_ext_terrain_ray_intersect_broadphase;
     wrld->_obb_intersect_broadphase = &_ext_collider_obb_intersect_broadphase;
@@ -359,7 +425,7 @@ void physics::update_external_broadphase(bt::external_broadphase* bp)
 bool physics::add_collision_object_to_external_broadphase(bt::external_broadphase* bp, btCollisionObject* co, unsigned int group, unsigned int mask)
 {
     if (bp->_broadphase->is_full()) {
-        return false;
+        _world->grow_external_broadphase(bp, bp->_broadphase->getMaxHandles() * 2);
     }
 
     btTransform trans = co->getWorldTransform();
@@ -367,9 +433,10 @@ bool physics::add_collision_object_to_external_broadphase(bt::external_broadphas
     btVector3	minAabb;
     btVector3	maxAabb;
     co->getCollisionShape()->getAabb(trans, minAabb, maxAabb);
+    bt::refresh_local_box(co);
 
     int type = co->getCollisionShape()->getShapeType();
-    co->setBroadphaseHandle(bp->_broadphase->createProxy(
+    btBroadphaseProxy* proxy = bp->_broadphase->createProxy(
         minAabb,
         maxAabb,
         type,
@@ -377,7 +444,10 @@ bool physics::add_collision_object_to_external_broadphase(bt::external_broadphas
         group,
         mask,
         0, 0
-    ));
+    );
+    proxy->m_ot_owner = bp;
+    co->setBroadphaseHandle(proxy);
+    bp->_local_tree.invalidate();
 
     //bp->_colliders.push(sc);
 
@@ -428,7 +498,7 @@ btCollisionObject* physics::query_volume_sphere(const double3& pos, float rad, c
 
         DASSERT(!ebp->_dirty);*/
 
-        _world->query_volume_sphere(ebp->_broadphase, pos, rad, [&](btCollisionObject* obj) {
+        _world->query_volume_sphere(ebp, pos, rad, [&](btCollisionObject* obj) {
             if (obj->getUserPointer() && obj->getUserPointer() != exclude_object) {
                 result = obj;
                 return true;
@@ -467,7 +537,7 @@ void physics::query_volume_sphere(const double3& pos, float rad, coid::dynarray<
 
         DASSERT(!ebp->_dirty);*/
 
-        _world->query_volume_sphere(ebp->_broadphase, pos, rad, [&](btCollisionObject* obj) {
+        _world->query_volume_sphere(ebp, pos, rad, [&](btCollisionObject* obj) {
             if (obj->getUserPointer())
                 result.push(obj);
             return false;
@@ -508,6 +578,85 @@ void physics::query_volume_frustum(const double3& pos, const float4* f_planes_no
     });
 }
 
+////////////////////////////////////////////////////////////////////////////////
+void physics::query_volume_spheres(const double3* centers, const float* radii, uint count, coid::dynarray32<std::pair<uint, btCollisionObject*>>& result)
+{
+    if (!count)
+        return;
+
+#ifdef _DEBUG
+    bt32BitAxisSweep3* broad = dynamic_cast<bt32BitAxisSweep3*>(_world->getBroadphase());
+    DASSERT(broad != nullptr);
+#else
+    bt32BitAxisSweep3* broad = static_cast<bt32BitAxisSweep3*>(_world->getBroadphase());
+#endif
+
+    bt::query_stack_scope scope;
+
+    auto add_result = [&](uint query, btCollisionObject* obj) {
+        if (obj->getUserPointer())
+            *result.add() = std::make_pair(query, obj);
+        return false;
+    };
+
+    _world->query_volume_spheres(scope.stack, broad, centers, radii, count, add_result);
+
+    // external broadphases are fetched once for the sphere enclosing the whole batch
+    double3 bmin = centers[0] - double3(radii[0]);
+    double3 bmax = centers[0] + double3(radii[0]);
+    for (uint i = 1; i < count; i++) {
+        bmin = glm::min(bmin, centers[i] - double3(radii[i]));
+        bmax = glm::max(bmax, centers[i] + double3(radii[i]));
+    }
+
+    THREAD_LOCAL_SINGLETON_DEF(coid::dynarray<bt::external_broadphase*>) ebps;
+    ebps->reset();
+    _physics->external_broadphases_in_radius(_world->getContext(), (bmin + bmax) * 0.5, float(glm::length(bmax - bmin) * 0.5), gCurrentFrame, *ebps);
+
+    ebps->for_each([&](bt::external_broadphase* ebp) {
+        _world->query_volume_spheres(scope.stack, ebp->_broadphase, centers, radii, count, add_result);
+    });
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void physics::query_volume_frusta(const bt::frustum_query* frusta, uint count, bool include_partial, coid::dynarray32<std::pair<uint, btCollisionObject*>>& result)
+{
+    if (!count)
+        return;
+
+#ifdef _DEBUG
+    bt32BitAxisSweep3* broad = dynamic_cast<bt32BitAxisSweep3*>(_world->getBroadphase());
+    DASSERT(broad != nullptr);
+#else
+    bt32BitAxisSweep3* broad = static_cast<bt32BitAxisSweep3*>(_world->getBroadphase());
+#endif
+
+    bt::query_stack_scope scope;
+
+    auto add_result = [&](uint query, btCollisionObject* obj) {
+        if (obj->getUserPointer())
+            *result.add() = std::make_pair(query, obj);
+    };
+
+    _world->query_volume_frustums(scope.stack, broad, frusta, count, include_partial, add_result);
+
+    // external broadphases are selected per frustum by the host
+    THREAD_LOCAL_SINGLETON_DEF(coid::dynarray<bt::external_broadphase*>) ebps;
+
+    for (uint q = 0; q < count; q++) {
+        const bt::frustum_query& f = frusta[q];
+
+        ebps->reset();
+        _physics->external_broadphases_in_frustum(_world->getContext(), f.pos, f.planes, f.nplanes, gCurrentFrame, *ebps);
+
+        ebps->for_each([&](bt::external_broadphase* ebp) {
+            _world->query_volume_frustum(scope.stack, ebp->_broadphase, f.pos, f.planes, f.nplanes, include_partial, [&](btCollisionObject* obj) {
+                add_result(q, obj);
+            });
+        });
+    }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void physics::wake_up_objects_in_radius(const double3& pos, float rad) {
 #ifdef _DEBUG
@@ -551,6 +700,24 @@ void physics::pause_simulation(bool pause)
     _world->pause_simulation(pause);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+void physics::set_terrain_cache_enabled(bool enabled)
+{
+    _world->set_terrain_cache_enabled(enabled);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void physics::invalidate_terrain_cache()
+{
+    _world->invalidate_terrain_cache();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void physics::set_terrain_ccd(bool enabled)
+{
+    _world->set_terrain_ccd(enabled);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void physics::get_triggered_sensors(coid::dynarray32<std::pair<btGhostObject*, btCollisionObject*>>& result_out)
 {
@@ -762,9 +929,20 @@ void physics::set_collision_info(btCollisionObject* obj, unsigned int group, uns
         bp->m_collisionFilterMask = mask;
         _overlappingPairCache->getOverlappingPairCache()->cleanProxyFromPairs(bp, _dispatcher);
         _world->clean_external_broadphase_proxy_from_pairs(bp);
+        _world->update_terrain_collider(obj);
     }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+void physics::set_ot_flags(btCollisionObject* obj, uint flags, bool enable)
+{
+    obj->m_otFlags = enable
+        ? obj->m_otFlags | flags
+        : obj->m_otFlags & ~flags;
+
+    _world->update_terrain_collider(obj);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void physics::destroy_collision_object(btCollisionObject*& obj)
 {
@@ -850,6 +1028,12 @@ void physics::navigation_probe_sim_step(bt::ot_navigation_probe* probe_ptr, cons
     probe_ptr->sim_step(_world ,target_position, target_rotation, dt);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+void physics::navigation_probes_sim_step(const bt::navigation_probe_step* steps, uint count, float dt)
+{
+    bt::ot_navigation_probe::sim_step_batch(_world, steps, count, dt);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void physics::update_navigation_probe(bt::ot_navigation_probe* probe_ptr, const double3& position, const quat& rotation)
 {
@@ -901,7 +1085,8 @@ int physics::get_collision_flags(const btCollisionObject* co)
 ////////////////////////////////////////////////////////////////////////////////
 void physics::set_collision_flags(btCollisionObject* co, int flags)
 {
-    return co->setCollisionFlags(flags);
+    co->setCollisionFlags(flags);
+    _world->update_terrain_collider(co);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -961,6 +1146,18 @@ bt::ot_world_physics_stats* physics::get_stats_ptr()
     return const_cast<bt::ot_world_physics_stats*>(&((ot::discrete_dynamics_world*)(_world))->get_stats());
 }
 
+////////////////////////////////////////////////////////////////////////////////
+void physics::set_step_profiler_enabled(bool enabled)
+{
+    btStepProfiler::setEnabled(enabled);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool physics::export_step_profile(const coid::token& path)
+{
+    return btStepProfiler::exportChromeTrace(coid::charstr(path).c_str());
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 void physics::set_debug_draw_enabled(btIDebugDraw* debug_drawer)
@@ -0,0 +1,336 @@
+/*
+Bullet Continuous Collision Detection and Physics Library
+Copyright (c) 2003-2006 Erwin Coumans  http://continuousphysics.com/Bullet/
+
+This software is provided 'as-is', without any express or implied warranty.
+In no event will the authors be held liable for any damages arising from the use of this software.
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it freely,
+subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must not claim that you wrote the original software. If you use this software in a product, an acknowledgment in the product documentation would be appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+///Tests of btActionSchedule: the stages keep the per body order of the actions, and a world updating
+///the parallel stages from several threads steps exactly like the serial btDiscreteDynamicsWorld::updateActions
+
+
+#include <gtest/gtest.h>
+
+#include "btBulletDynamicsCommon.h"
+#include "BulletDynamics/Dynamics/btActionSchedule.h"
+#include "BulletDynamics/Vehicle/btRaycastVehicle.h"
+
+#include <string.h>
+#include <thread>
+#include <vector>
+
+///pulls two bodies together, the action touches both of them
+class TestSpringAction : public btActionInterface
+{
+public:
+	btRigidBody*	m_bodyA;
+	btRigidBody*	m_bodyB;
+	btScalar		m_stiffness;
+
+	TestSpringAction(btRigidBody* bodyA, btRigidBody* bodyB, btScalar stiffness)
+		: m_bodyA(bodyA), m_bodyB(bodyB), m_stiffness(stiffness)
+	{
+	}
+
+	virtual void updateAction(btCollisionWorld* collisionWorld, btScalar deltaTimeStep)
+	{
+		(void)collisionWorld;
+		const btVector3 delta = m_bodyB->getCenterOfMassPosition() - m_bodyA->getCenterOfMassPosition();
+		const btVector3 impulse = delta * (m_stiffness * deltaTimeStep);
+		m_bodyA->applyCentralImpulse(impulse);
+		m_bodyB->applyCentralImpulse(-impulse);
+	}
+
+	virtual void debugDraw(btIDebugDraw* debugDrawer) { (void)debugDrawer; }
+
+	virtual bool getActionBodies(btAlignedObjectArray<btRigidBody*>& bodies) const
+	{
+		bodies.push_back(m_bodyA);
+		bodies.push_back(m_bodyB);
+		return true;
+	}
+};
+
+///damps every body of the world, gives no hints
+class TestDragAction : public btActionInterface
+{
+public:
+	virtual void updateAction(btCollisionWorld* collisionWorld, btScalar deltaTimeStep)
+	{
+		for (int i = 0; i < collisionWorld->getNumCollisionObjects(); i++)
+		{
+			btRigidBody* body = btRigidBody::upcast(collisionWorld->getCollisionObjectArray()[i]);
+			if (body && body->getInvMass() > 0)
+				body->setLinearVelocity(body->getLinearVelocity() * (btScalar(1) - btScalar(0.5) * deltaTimeStep));
+		}
+	}
+
+	virtual void debugDraw(btIDebugDraw* debugDrawer) { (void)debugDrawer; }
+};
+
+///updates the actions by the schedule, the actions of a parallel stage are split between numThreads threads
+class ScheduledWorld : public btDiscreteDynamicsWorld
+{
+public:
+	btActionSchedule	m_schedule;
+	int					m_numThreads;
+
+	ScheduledWorld(btDispatcher* dispatcher, btBroadphaseInterface* pairCache, btConstraintSolver* constraintSolver, btCollisionConfiguration* collisionConfiguration, int numThreads)
+		: btDiscreteDynamicsWorld(dispatcher, pairCache, constraintSolver, collisionConfiguration), m_numThreads(numThreads)
+	{
+	}
+
+	virtual void updateActions(btScalar timeStep)
+	{
+		if (!m_actions.size())
+			return;
+
+		m_schedule.build(&m_actions[0], m_actions.size());
+
+		for (int s = 0; s < m_schedule.m_stages.size(); s++)
+		{
+			const btActionSchedule::Stage& stage = m_schedule.m_stages[s];
+
+			if (stage.m_serial || m_numThreads == 1)
+			{
+				for (int i = stage.m_begin; i < stage.m_end; i++)
+					m_actions[m_schedule.m_order[i]]->updateAction(this, timeStep);
+				continue;
+			}
+
+			std::vector<std::thread> threads;
+			for (int t = 0; t < m_numThreads; t++)
+			{
+				threads.push_back(std::thread([this, &stage, t, timeStep]() {
+					for (int i = stage.m_begin + t; i < stage.m_end; i += m_numThreads)
+						m_actions[m_schedule.m_order[i]]->updateAction(this, timeStep);
+				}));
+			}
+			for (size_t t = 0; t < threads.size(); t++)
+				threads[t].join();
+		}
+	}
+};
+
+static const int NUM_VEHICLES = 24;
+static const int NUM_STEPS = 120;
+
+///steps a row of vehicles coupled by springs on a static ground, numThreads 0 uses the plain world
+static void simulateVehicles(int numThreads, btAlignedObjectArray<btTransform>& result)
+{
+	btDefaultCollisionConfiguration collisionConfiguration;
+	btCollisionDispatcher dispatcher(&collisionConfiguration);
+	btDbvtBroadphase broadphase;
+	btSequentialImpulseConstraintSolver solver;
+
+	btDiscreteDynamicsWorld* world = numThreads
+		? new ScheduledWorld(&dispatcher, &broadphase, &solver, &collisionConfiguration, numThreads)
+		: new btDiscreteDynamicsWorld(&dispatcher, &broadphase, &solver, &collisionConfiguration);
+
+	btBoxShape groundShape(btVector3(500, 1, 500));
+	btRigidBody ground(0, 0, &groundShape);
+	ground.setWorldTransform(btTransform(btQuaternion::getIdentity(), btVector3(0, -1, 0)));
+	world->addRigidBody(&ground);
+
+	btBoxShape chassisShape(btVector3(1, btScalar(0.5), 2));
+	btVector3 inertia;
+	chassisShape.calculateLocalInertia(800, inertia);
+
+	btDefaultVehicleRaycaster raycaster(world);
+	btRaycastVehicle::btVehicleTuning tuning;
+
+	btAlignedObjectArray<btRigidBody*> chassis;
+	btAlignedObjectArray<btActionInterface*> actions;
+
+	for (int i = 0; i < NUM_VEHICLES; i++)
+	{
+		btRigidBody* body = new btRigidBody(800, 0, &chassisShape, inertia);
+		body->setWorldTransform(btTransform(btQuaternion::getIdentity(), btVector3(btScalar(i * 8), 2, 0)));
+		body->setActivationState(DISABLE_DEACTIVATION);
+		world->addRigidBody(body);
+		chassis.push_back(body);
+
+		btRaycastVehicle* vehicle = new btRaycastVehicle(tuning, body, &raycaster);
+		vehicle->setCoordinateSystem(0, 1, 2);
+
+		const btVector3 down(0, -1, 0);
+		const btVector3 axle(-1, 0, 0);
+		for (int w = 0; w < 4; w++)
+		{
+			const btVector3 connection(w & 1 ? btScalar(0.9) : btScalar(-0.9), 0, w & 2 ? btScalar(-1.6) : btScalar(1.6));
+			vehicle->addWheel(connection, down, axle, btScalar(0.6), btScalar(0.5), tuning, w < 2);
+		}
+
+		vehicle->applyEngineForce(btScalar(200 + 50 * i), 2);
+		vehicle->applyEngineForce(btScalar(200 + 50 * i), 3);
+		vehicle->setSteeringValue(btScalar(0.01 * (i % 5)), 0);
+		vehicle->setSteeringValue(btScalar(0.01 * (i % 5)), 1);
+
+		world->addAction(vehicle);
+		actions.push_back(vehicle);
+
+		//springs chain the vehicles so the actions of neighbours depend on each other
+		if (i > 0)
+		{
+			btActionInterface* spring = new TestSpringAction(chassis[i - 1], body, btScalar(50));
+			world->addAction(spring);
+			actions.push_back(spring);
+		}
+
+		if (i == NUM_VEHICLES / 2)
+		{
+			btActionInterface* drag = new TestDragAction();
+			world->addAction(drag);
+			actions.push_back(drag);
+		}
+	}
+
+	for (int s = 0; s < NUM_STEPS; s++)
+		world->stepSimulation(btScalar(1. / 60.), 0);
+
+	result.resize(0);
+	for (int i = 0; i < chassis.size(); i++)
+		result.push_back(chassis[i]->getWorldTransform());
+
+	for (int i = 0; i < actions.size(); i++)
+	{
+		world->removeAction(actions[i]);
+		delete actions[i];
+	}
+	for (int i = 0; i < chassis.size(); i++)
+	{
+		world->removeRigidBody(chassis[i]);
+		delete chassis[i];
+	}
+	world->removeRigidBody(&ground);
+	delete world;
+}
+
+TEST(BulletDynamicsTest, ActionScheduleKeepsBodyOrder)
+{
+	const int numBodies = 16;
+	const int numActions = 200;
+
+	btAlignedObjectArray<btRigidBody*> bodies;
+	btAlignedObjectArray<btActionInterface*> actions;
+
+	btSphereShape shape(1);
+	for (int i = 0; i < numBodies; i++)
+		bodies.push_back(new btRigidBody(1, 0, &shape));
+
+	unsigned int seed = 12345;
+	for (int i = 0; i < numActions; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		if ((seed >> 16) % 17 == 0)
+			actions.push_back(new TestDragAction());
+		else
+		{
+			const int bodyA = (seed >> 8) % numBodies;
+			const int bodyB = (bodyA + 1 + (seed >> 20) % (numBodies - 1)) % numBodies;
+			actions.push_back(new TestSpringAction(bodies[bodyA], bodies[bodyB], 1));
+		}
+	}
+
+	btActionSchedule schedule;
+	schedule.build(&actions[0], actions.size());
+
+	ASSERT_EQ(schedule.m_order.size(), numActions);
+	ASSERT_GT(schedule.m_stages.size(), 0);
+	ASSERT_EQ(schedule.m_stages[0].m_begin, 0);
+	ASSERT_EQ(schedule.m_stages[schedule.m_stages.size() - 1].m_end, numActions);
+
+	std::vector<int> lastActionOfBody(numBodies, -1);
+	std::vector<int> lastSerialAction(1, -1);
+	std::vector<int> seen(numActions, 0);
+
+	for (int s = 0; s < schedule.m_stages.size(); s++)
+	{
+		const btActionSchedule::Stage& stage = schedule.m_stages[s];
+		ASSERT_LT(stage.m_begin, stage.m_end);
+		if (s > 0)
+		{
+			ASSERT_EQ(stage.m_begin, schedule.m_stages[s - 1].m_end);
+		}
+
+		std::vector<int> stageOfBody(numBodies, 0);
+
+		for (int i = stage.m_begin; i < stage.m_end; i++)
+		{
+			const int a = schedule.m_order[i];
+			seen[a]++;
+
+			btAlignedObjectArray<btRigidBody*> touched;
+			const bool hinted = actions[a]->getActionBodies(touched);
+			EXPECT_EQ(hinted, !stage.m_serial);
+
+			//serial actions split the sequence, nothing crosses them
+			EXPECT_GT(a, lastSerialAction[0]);
+			if (!hinted)
+			{
+				EXPECT_EQ(stage.m_end - stage.m_begin, 1);
+				for (int b = 0; b < numBodies; b++)
+					EXPECT_LT(lastActionOfBody[b], a);
+				lastSerialAction[0] = a;
+				continue;
+			}
+
+			for (int b = 0; b < touched.size(); b++)
+			{
+				const int body = bodies.findLinearSearch(touched[b]);
+				if (stageOfBody[body]++)
+					ADD_FAILURE() << "body " << body << " used twice in stage " << s;
+				EXPECT_LT(lastActionOfBody[body], a);
+				lastActionOfBody[body] = a;
+			}
+		}
+	}
+
+	for (int i = 0; i < numActions; i++)
+		EXPECT_EQ(seen[i], 1);
+
+	for (int i = 0; i < actions.size(); i++)
+		delete actions[i];
+	for (int i = 0; i < bodies.size(); i++)
+		delete bodies[i];
+}
+
+TEST(BulletDynamicsTest, ParallelActionsDeterministic)
+{
+	btAlignedObjectArray<btTransform> reference;
+	simulateVehicles(0, reference);
+	ASSERT_EQ(reference.size(), NUM_VEHICLES);
+
+	//the vehicles must have moved, otherwise the comparison says nothing
+	EXPECT_GT(btFabs(reference[NUM_VEHICLES - 1].getOrigin().getZ()), btScalar(0.1));
+
+	const int threadCounts[] = { 1, 2, 4, 8 };
+	for (int t = 0; t < 4; t++)
+	{
+		btAlignedObjectArray<btTransform> result;
+		simulateVehicles(threadCounts[t], result);
+		ASSERT_EQ(result.size(), reference.size());
+
+		for (int i = 0; i < result.size(); i++)
+		{
+			EXPECT_EQ(0, memcmp(&result[i], &reference[i], sizeof(btTransform)))
+				<< "vehicle " << i << " differs with " << threadCounts[t] << " threads";
+		}
+	}
+}
+
+int main(int argc, char **argv) {
+#if _MSC_VER
+        _CrtSetDbgFlag ( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF );
+#endif
+        ::testing::InitGoogleTest(&argc, argv);
+        return RUN_ALL_TESTS();
+}
@@ -0,0 +1,597 @@
+/*
+Bullet Continuous Collision Detection and Physics Library
+Copyright (c) 2003-2006 Erwin Coumans  http://continuousphysics.com/Bullet/
+
+This software is provided 'as-is', without any express or implied warranty.
+In no event will the authors be held liable for any damages arising from the use of this software.
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it freely,
+subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must not claim that you wrote the original software. If you use this software in a product, an acknowledgment in the product documentation would be appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+///Tests of the concurrent island solving: islands solved on a task scheduler step exactly like the serial
+///btDiscreteDynamicsWorld, with any number of threads, and the islands built with the concurrent union find
+///and the parallel gather match the serial btSimulationIslandManager. The batched btSequentialImpulseConstraintSolverMt
+///gives the same result with any number of threads
+
+
+#include <gtest/gtest.h>
+
+#include "btBulletDynamicsCommon.h"
+#include "BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolverMt.h"
+#include "BulletCollision/CollisionDispatch/btSimulationIslandManager.h"
+#include "BulletCollision/NarrowPhaseCollision/btGjkEpaPenetrationDepthSolver.h"
+#include "BulletCollision/NarrowPhaseCollision/btVoronoiSimplexSolver.h"
+#include "LinearMath/btThreads.h"
+
+#include <algorithm>
+#include <atomic>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+static const int NUM_STEPS = 120;
+
+///runs the loops on numThreads threads, taking grainSize iterations at a time
+class ThreadTaskScheduler : public btITaskScheduler
+{
+public:
+	explicit ThreadTaskScheduler(int numThreads) : m_numThreads(numThreads) {}
+
+	virtual void parallelFor(int iBegin, int iEnd, int grainSize, const btIParallelForBody& body)
+	{
+		std::atomic<int> next(iBegin);
+		auto work = [&]() {
+			for (;;)
+			{
+				const int begin = next.fetch_add(grainSize);
+				if (begin >= iEnd)
+					break;
+				body.forLoop(begin, std::min(begin + grainSize, iEnd));
+			}
+		};
+
+		std::vector<std::thread> threads;
+		for (int i = 1; i < m_numThreads; i++)
+			threads.push_back(std::thread(work));
+		work();
+		for (size_t i = 0; i < threads.size(); i++)
+			threads[i].join();
+	}
+
+private:
+	int m_numThreads;
+};
+
+static const int NUM_STACKS = 12;
+static const int STACK_HEIGHT = 5;
+
+///steps stacks of boxes and hinged pairs, all standing on one moving kinematic platform,
+///numThreads 0 solves the islands serially
+static void simulateIslands(int numThreads, int minimumSolverBatchSize, btAlignedObjectArray<btTransform>& result)
+{
+	btDefaultCollisionConfiguration collisionConfiguration;
+	btCollisionDispatcher dispatcher(&collisionConfiguration);
+	btDbvtBroadphase broadphase;
+	btSequentialImpulseConstraintSolver solver;
+	btDiscreteDynamicsWorld world(&dispatcher, &broadphase, &solver, &collisionConfiguration);
+	world.getSolverInfo().m_minimumSolverBatchSize = minimumSolverBatchSize;
+
+	ThreadTaskScheduler scheduler(numThreads);
+	if (numThreads)
+		world.setIslandTaskScheduler(&scheduler, numThreads);
+
+	btBoxShape platformShape(btVector3(100, 1, 10));
+	btRigidBody platform(0, 0, &platformShape);
+	platform.setCollisionFlags(platform.getCollisionFlags() | btCollisionObject::CF_KINEMATIC_OBJECT);
+	platform.setActivationState(DISABLE_DEACTIVATION);
+	platform.setWorldTransform(btTransform(btQuaternion::getIdentity(), btVector3(0, -1, 0)));
+	world.addRigidBody(&platform);
+
+	btBoxShape boxShape(btVector3(btScalar(0.5), btScalar(0.5), btScalar(0.5)));
+	btVector3 inertia;
+	boxShape.calculateLocalInertia(1, inertia);
+
+	btAlignedObjectArray<btRigidBody*> boxes;
+	btAlignedObjectArray<btTypedConstraint*> hinges;
+
+	for (int s = 0; s < NUM_STACKS; s++)
+	{
+		const btScalar x = btScalar(s * 6 - NUM_STACKS * 3);
+		for (int h = 0; h < STACK_HEIGHT; h++)
+		{
+			btRigidBody* box = new btRigidBody(1, 0, &boxShape, inertia);
+			box->setWorldTransform(btTransform(btQuaternion::getIdentity(), btVector3(x + btScalar(0.05 * h), btScalar(0.5 + h * 1.01), 0)));
+			world.addRigidBody(box);
+			boxes.push_back(box);
+		}
+
+		//a hinged pair next to every stack
+		btRigidBody* boxA = new btRigidBody(1, 0, &boxShape, inertia);
+		boxA->setWorldTransform(btTransform(btQuaternion::getIdentity(), btVector3(x, btScalar(0.5), 3)));
+		btRigidBody* boxB = new btRigidBody(1, 0, &boxShape, inertia);
+		boxB->setWorldTransform(btTransform(btQuaternion::getIdentity(), btVector3(x, btScalar(2.5), 3)));
+		world.addRigidBody(boxA);
+		world.addRigidBody(boxB);
+		boxes.push_back(boxA);
+		boxes.push_back(boxB);
+
+		btHingeConstraint* hinge = new btHingeConstraint(*boxA, *boxB, btVector3(0, 1, 0), btVector3(0, -1, 0), btVector3(1, 0, 0), btVector3(1, 0, 0));
+		world.addConstraint(hinge, true);
+		hinges.push_back(hinge);
+	}
+
+	for (int i = 0; i < NUM_STEPS; i++)
+	{
+		platform.getWorldTransform().getOrigin() += btVector3(btScalar(0.01), 0, 0);
+		world.stepSimulation(btScalar(1. / 60.), 0);
+	}
+
+	result.resize(0);
+	for (int i = 0; i < boxes.size(); i++)
+		result.push_back(boxes[i]->getWorldTransform());
+
+	for (int i = 0; i < hinges.size(); i++)
+	{
+		world.removeConstraint(hinges[i]);
+		delete hinges[i];
+	}
+	for (int i = 0; i < boxes.size(); i++)
+	{
+		world.removeRigidBody(boxes[i]);
+		delete boxes[i];
+	}
+	world.removeRigidBody(&platform);
+}
+
+TEST(BulletDynamicsTest, ParallelIslandsMatchSerial)
+{
+	//with a batch size of 1 every island is solved on its own, serially as well as in parallel
+	btAlignedObjectArray<btTransform> reference;
+	simulateIslands(0, 1, reference);
+	ASSERT_EQ(reference.size(), NUM_STACKS * (STACK_HEIGHT + 2));
+
+	const int threadCounts[] = { 1, 2, 4, 8 };
+	for (int t = 0; t < 4; t++)
+	{
+		btAlignedObjectArray<btTransform> result;
+		simulateIslands(threadCounts[t], 1, result);
+		ASSERT_EQ(result.size(), reference.size());
+
+		for (int i = 0; i < result.size(); i++)
+		{
+			EXPECT_EQ(0, memcmp(&result[i], &reference[i], sizeof(btTransform)))
+				<< "box " << i << " differs with " << threadCounts[t] << " threads";
+		}
+	}
+
+	//batched islands end up in other solver groups than the serial ones, the bodies stay close
+	btAlignedObjectArray<btTransform> batchedReference;
+	simulateIslands(0, 128, batchedReference);
+
+	btAlignedObjectArray<btTransform> batched;
+	simulateIslands(4, 128, batched);
+	ASSERT_EQ(batched.size(), batchedReference.size());
+
+	for (int i = 0; i < batched.size(); i++)
+		EXPECT_LT((batched[i].getOrigin() - batchedReference[i].getOrigin()).length(), btScalar(0.01)) << "box " << i;
+}
+
+///a simplex and penetration depth solver per thread, as the multithreaded collision configurations provide
+class ThreadLocalSolverConfiguration : public btDefaultCollisionConfiguration
+{
+public:
+	virtual btVoronoiSimplexSolver* getSimplexSolver()
+	{
+		static thread_local btVoronoiSimplexSolver solver;
+		return &solver;
+	}
+
+	virtual btConvexPenetrationDepthSolver* getPdSolver()
+	{
+		static thread_local btGjkEpaPenetrationDepthSolver solver;
+		return &solver;
+	}
+};
+
+TEST(BulletDynamicsTest, ConcurrentUnionFind)
+{
+	const int numElements = 5000;
+	btConcurrentUnionFind concurrent;
+	concurrent.reset(numElements);
+	btUnionFind serial;
+	serial.reset(numElements);
+
+	std::vector<std::pair<int, int> > unions;
+	unsigned seed = 4321u;
+	for (int i = 0; i < 3000; i++)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		const int p = (seed >> 8) % numElements;
+		seed = seed * 1664525u + 1013904223u;
+		unions.push_back(std::make_pair(p, (seed >> 8) % numElements));
+		serial.unite(unions.back().first, unions.back().second);
+	}
+
+	const int numThreads = 4;
+	std::vector<std::thread> threads;
+	for (int t = 0; t < numThreads; t++)
+	{
+		threads.push_back(std::thread([&concurrent, &unions, t]() {
+			for (size_t i = t; i < unions.size(); i += numThreads)
+				concurrent.unite(unions[i].first, unions[i].second);
+		}));
+	}
+	for (size_t t = 0; t < threads.size(); t++)
+		threads[t].join();
+
+	// every subset has its smallest element as the root
+	std::vector<int> smallest(numElements, numElements);
+	for (int i = 0; i < numElements; i++)
+		smallest[serial.find(i)] = std::min(smallest[serial.find(i)], i);
+	for (int i = 0; i < numElements; i++)
+		EXPECT_EQ(concurrent.find(i), smallest[serial.find(i)]) << "element " << i;
+}
+
+struct IslandTestWorld
+{
+	ThreadLocalSolverConfiguration config;
+	btCollisionDispatcher dispatcher;
+	btDbvtBroadphase broadphase;
+	btCollisionWorld world;
+	btSphereShape sphere;
+	btSimulationIslandManager islandManager;
+	std::vector<btCollisionObject> objects;
+
+	IslandTestWorld()
+		: dispatcher(&config)
+		, world(&dispatcher, &broadphase, &config)
+		, sphere(0.6)
+		, objects(600)
+	{
+		for (int i = 0; i < int(objects.size()); i++)
+		{
+			// clusters of touching spheres with gaps between them, a few static and kinematic objects join clusters
+			const int cluster = i / 6;
+			objects[i].setCollisionShape(&sphere);
+			objects[i].setCollisionFlags(i % 11 == 0 ? btCollisionObject::CF_STATIC_OBJECT : i % 13 == 0 ? btCollisionObject::CF_KINEMATIC_OBJECT : 0);
+			objects[i].setActivationState(i % 4 == 0 ? ISLAND_SLEEPING : i % 9 == 0 ? DISABLE_DEACTIVATION : ACTIVE_TAG);
+			objects[i].getWorldTransform().setOrigin(btVector3(btScalar(cluster % 10 * 4 + (i % 6)), 0, btScalar(cluster / 10 * 4)));
+			world.addCollisionObject(&objects[i]);
+		}
+	}
+
+	~IslandTestWorld()
+	{
+		for (int i = 0; i < int(objects.size()); i++)
+			world.removeCollisionObject(&objects[i]);
+	}
+
+	void buildIslands(btAlignedObjectArray<btSimulationIslandManager::Island>& islands)
+	{
+		world.performDiscreteCollisionDetection();
+		islandManager.updateActivationState(&world, &dispatcher);
+		islandManager.storeIslandActivationState(&world);
+		islandManager.buildIslandList(&dispatcher, &world, islands);
+	}
+
+	int objectIndex(const btCollisionObject* obj) const
+	{
+		return int(obj - &objects[0]);
+	}
+
+	// islands as sorted object indices, with the number of manifolds appended
+	std::vector<std::vector<int> > islandContents(const btAlignedObjectArray<btSimulationIslandManager::Island>& islands)
+	{
+		std::vector<std::vector<int> > contents;
+		for (int i = 0; i < islands.size(); i++)
+		{
+			std::vector<int> bodies;
+			for (int b = 0; b < islands[i].m_numBodies; b++)
+				bodies.push_back(objectIndex(islandManager.getIslandBodyArray()[islands[i].m_firstBody + b]));
+			std::sort(bodies.begin(), bodies.end());
+			bodies.push_back(islands[i].m_numManifolds);
+			contents.push_back(bodies);
+		}
+		std::sort(contents.begin(), contents.end());
+		return contents;
+	}
+};
+
+///runs every range of a loop on a thread of its own, nothing is done by the calling thread
+class WorkerThreadTaskScheduler : public btITaskScheduler
+{
+public:
+	virtual void parallelFor(int iBegin, int iEnd, int grainSize, const btIParallelForBody& body)
+	{
+		std::vector<std::thread> threads;
+		for (int begin = iBegin; begin < iEnd; begin += grainSize)
+			threads.emplace_back([&body, begin, grainSize, iEnd]() { body.forLoop(begin, std::min(begin + grainSize, iEnd)); });
+		for (std::thread& t : threads)
+			t.join();
+	}
+};
+
+static std::vector<const btCollisionObject*> gSleepingChangedObjects;
+static std::thread::id gSleepingChangedThread;
+static bool gSleepingChangedOffThread = false;
+
+static void recordSleepingChange(const btCollisionObject* colObj, int)
+{
+	gSleepingChangedObjects.push_back(colObj);
+	gSleepingChangedOffThread |= std::this_thread::get_id() != gSleepingChangedThread;
+}
+
+///activation changes of the island build, as object indices
+static std::vector<int> buildIslandsRecordingSleepingChanges(IslandTestWorld& world, btAlignedObjectArray<btSimulationIslandManager::Island>& islands)
+{
+	gSleepingChangedObjects.clear();
+	gSleepingChangedThread = std::this_thread::get_id();
+	gSleepingStateChangedCallback = recordSleepingChange;
+	world.buildIslands(islands);
+	gSleepingStateChangedCallback = 0;
+
+	std::vector<int> changes;
+	for (size_t i = 0; i < gSleepingChangedObjects.size(); i++)
+		changes.push_back(world.objectIndex(gSleepingChangedObjects[i]));
+	return changes;
+}
+
+TEST(BulletDynamicsTest, ParallelIslandGatherMatchesSerial)
+{
+	IslandTestWorld serial;
+	IslandTestWorld parallel;
+	IslandTestWorld workerThreads;
+
+	ThreadTaskScheduler scheduler(4);
+	parallel.islandManager.setTaskScheduler(&scheduler, 16);
+
+	WorkerThreadTaskScheduler workerScheduler;
+	workerThreads.islandManager.setTaskScheduler(&workerScheduler, 16);
+
+	for (int step = 0; step < 3; step++)
+	{
+		for (int i = 0; i < 600; i += 5)
+		{
+			const btVector3 offset(0, 0, btScalar(0.5 * step));
+			serial.objects[i].getWorldTransform().getOrigin() += offset;
+			parallel.objects[i].getWorldTransform().getOrigin() += offset;
+			workerThreads.objects[i].getWorldTransform().getOrigin() += offset;
+		}
+
+		btAlignedObjectArray<btSimulationIslandManager::Island> serialIslands;
+		btAlignedObjectArray<btSimulationIslandManager::Island> parallelIslands;
+		btAlignedObjectArray<btSimulationIslandManager::Island> workerThreadIslands;
+		serial.buildIslands(serialIslands);
+
+		// the activation changes are reported on the calling thread, in the same order with any number of threads
+		gSleepingChangedOffThread = false;
+		const std::vector<int> parallelChanges = buildIslandsRecordingSleepingChanges(parallel, parallelIslands);
+		const std::vector<int> workerThreadChanges = buildIslandsRecordingSleepingChanges(workerThreads, workerThreadIslands);
+		EXPECT_FALSE(gSleepingChangedOffThread);
+		if (step == 0)
+		{
+			EXPECT_FALSE(parallelChanges.empty());
+		}
+		EXPECT_TRUE(parallelChanges == workerThreadChanges);
+
+		ASSERT_GT(serialIslands.size(), 20);
+		int numMerged = 0;
+		for (int i = 0; i < serialIslands.size(); i++)
+			numMerged += serialIslands[i].m_numBodies > 1 && serialIslands[i].m_numManifolds > 0;
+		ASSERT_GT(numMerged, 10);
+		EXPECT_TRUE(serial.islandContents(serialIslands) == parallel.islandContents(parallelIslands));
+
+		for (int i = 0; i < 600; i++)
+		{
+			EXPECT_EQ(serial.objects[i].getActivationState(), parallel.objects[i].getActivationState()) << "object " << i;
+			EXPECT_EQ(serial.objects[i].getIslandTag() < 0, parallel.objects[i].getIslandTag() < 0) << "object " << i;
+		}
+
+		// the gathered islands come in id order, with their bodies and manifolds in object and dispatcher order
+		btSimulationIslandManager& manager = parallel.islandManager;
+		for (int i = 0; i < parallelIslands.size(); i++)
+		{
+			const btSimulationIslandManager::Island& island = parallelIslands[i];
+			if (i > 0)
+			{
+				EXPECT_LT(parallelIslands[i - 1].m_id, island.m_id);
+			}
+			for (int b = 0; b < island.m_numBodies; b++)
+			{
+				const btCollisionObject* body = manager.getIslandBodyArray()[island.m_firstBody + b];
+				EXPECT_EQ(body->getIslandTag(), island.m_id);
+				if (b > 0)
+				{
+					EXPECT_LT(parallel.objectIndex(manager.getIslandBodyArray()[island.m_firstBody + b - 1]), parallel.objectIndex(body));
+				}
+			}
+			for (int m = 1; m < island.m_numManifolds; m++)
+				EXPECT_LT(manager.getIslandManifoldArray()[island.m_firstManifold + m - 1]->m_index1a, manager.getIslandManifoldArray()[island.m_firstManifold + m]->m_index1a);
+		}
+	}
+}
+
+static const int PILE_SIZE = 6;
+static const int PILE_HEIGHT = 3;
+static const int CHAIN_LINKS = 16;
+static const int PILE_STEPS = 60;
+static const int LONE_BOXES = 4;
+
+///steps one island of touching boxes with a hinged chain on top, on static ground.
+///numThreads 0 uses btSequentialImpulseConstraintSolver, otherwise the batched solver with the rows of every batch split in chunks of 8.
+///With islandScheduler the islands are solved on the island task scheduler, the pile by the batched solver as the large island solver
+///and LONE_BOXES boxes of their own islands by the solver pool
+static void simulatePile(int numThreads, bool islandScheduler, btAlignedObjectArray<btTransform>& result, int& numContactBatches)
+{
+	btDefaultCollisionConfiguration collisionConfiguration;
+	btCollisionDispatcher dispatcher(&collisionConfiguration);
+	btDbvtBroadphase broadphase;
+	btSequentialImpulseConstraintSolver serialSolver;
+	btSequentialImpulseConstraintSolverMt batchedSolver;
+	ThreadTaskScheduler scheduler(numThreads);
+	batchedSolver.setTaskScheduler(&scheduler);
+	batchedSolver.setMinBatchedConstraints(1);
+	batchedSolver.setGrainSize(8);
+
+	btConstraintSolver* solver = numThreads ? static_cast<btConstraintSolver*>(&batchedSolver) : &serialSolver;
+	btDiscreteDynamicsWorld world(&dispatcher, &broadphase, solver, &collisionConfiguration);
+
+	if (islandScheduler)
+	{
+		world.setIslandTaskScheduler(&scheduler, numThreads + 1);
+		world.setLargeIslandSolver(&batchedSolver);
+		world.getSolverInfo().m_minimumSolverBatchSize = 1;
+		batchedSolver.setMinBatchedConstraints(32);
+	}
+
+	btBoxShape groundShape(btVector3(50, 1, 50));
+	btRigidBody ground(0, 0, &groundShape);
+	ground.setWorldTransform(btTransform(btQuaternion::getIdentity(), btVector3(0, -1, 0)));
+	world.addRigidBody(&ground);
+
+	btBoxShape boxShape(btVector3(btScalar(0.5), btScalar(0.5), btScalar(0.5)));
+	btVector3 inertia;
+	boxShape.calculateLocalInertia(1, inertia);
+
+	btAlignedObjectArray<btRigidBody*> boxes;
+	btAlignedObjectArray<btTypedConstraint*> hinges;
+
+	//the boxes touch their neighbours, so the whole pile is one island
+	for (int y = 0; y < PILE_HEIGHT; y++)
+	{
+		for (int z = 0; z < PILE_SIZE; z++)
+		{
+			for (int x = 0; x < PILE_SIZE; x++)
+			{
+				btRigidBody* box = new btRigidBody(1, 0, &boxShape, inertia);
+				box->setWorldTransform(btTransform(btQuaternion::getIdentity(), btVector3(btScalar(x), btScalar(0.5 + y), btScalar(z))));
+				world.addRigidBody(box);
+				boxes.push_back(box);
+			}
+		}
+	}
+
+	btRigidBody* prev = 0;
+	for (int i = 0; i < CHAIN_LINKS; i++)
+	{
+		btRigidBody* link = new btRigidBody(1, 0, &boxShape, inertia);
+		link->setWorldTransform(btTransform(btQuaternion::getIdentity(), btVector3(btScalar(i) * btScalar(0.3), btScalar(PILE_HEIGHT + 1), btScalar(PILE_SIZE / 2))));
+		world.addRigidBody(link);
+		boxes.push_back(link);
+
+		if (prev)
+		{
+			btHingeConstraint* hinge = new btHingeConstraint(*prev, *link, btVector3(btScalar(0.5), 0, 0), btVector3(btScalar(-0.5), 0, 0), btVector3(0, 0, 1), btVector3(0, 0, 1));
+			world.addConstraint(hinge, true);
+			hinges.push_back(hinge);
+		}
+		prev = link;
+	}
+
+	for (int i = 0; islandScheduler && i < LONE_BOXES; i++)
+	{
+		btRigidBody* box = new btRigidBody(1, 0, &boxShape, inertia);
+		box->setWorldTransform(btTransform(btQuaternion::getIdentity(), btVector3(btScalar(-10 - 3 * i), btScalar(0.5), btScalar(-10))));
+		world.addRigidBody(box);
+		boxes.push_back(box);
+	}
+
+	for (int i = 0; i < PILE_STEPS; i++)
+		world.stepSimulation(btScalar(1. / 60.), 0);
+
+	numContactBatches = batchedSolver.getContactBatches().getNumBatches();
+
+	result.resize(0);
+	for (int i = 0; i < boxes.size(); i++)
+		result.push_back(boxes[i]->getWorldTransform());
+
+	for (int i = 0; i < hinges.size(); i++)
+	{
+		world.removeConstraint(hinges[i]);
+		delete hinges[i];
+	}
+	for (int i = 0; i < boxes.size(); i++)
+	{
+		world.removeRigidBody(boxes[i]);
+		delete boxes[i];
+	}
+	world.removeRigidBody(&ground);
+}
+
+TEST(BulletDynamicsTest, BatchedSolverDeterministic)
+{
+	int numContactBatches = 0;
+	btAlignedObjectArray<btTransform> reference;
+	simulatePile(1, false, reference, numContactBatches);
+	ASSERT_EQ(reference.size(), PILE_SIZE * PILE_SIZE * PILE_HEIGHT + CHAIN_LINKS);
+	EXPECT_GT(numContactBatches, 1);
+
+	//the rows of a batch share no dynamic body, the thread count does not change the result
+	const int threadCounts[] = { 2, 4, 8 };
+	for (int t = 0; t < 3; t++)
+	{
+		btAlignedObjectArray<btTransform> result;
+		simulatePile(threadCounts[t], false, result, numContactBatches);
+		ASSERT_EQ(result.size(), reference.size());
+
+		for (int i = 0; i < result.size(); i++)
+		{
+			EXPECT_EQ(0, memcmp(&result[i], &reference[i], sizeof(btTransform)))
+				<< "box " << i << " differs with " << threadCounts[t] << " threads";
+		}
+	}
+
+	//the batches solve the rows in another order than the serial solver, the pile settles the same way
+	btAlignedObjectArray<btTransform> serial;
+	simulatePile(0, false, serial, numContactBatches);
+	ASSERT_EQ(serial.size(), reference.size());
+
+	for (int i = 0; i < PILE_SIZE * PILE_SIZE * PILE_HEIGHT; i++)
+		EXPECT_LT((serial[i].getOrigin() - reference[i].getOrigin()).length(), btScalar(0.05)) << "box " << i;
+}
+
+TEST(BulletDynamicsTest, LargeIslandSolverOnIslandScheduler)
+{
+	//the pile goes to the batched solver, the lone boxes stay below its minimum and go to the solver pool
+	int numContactBatches = 0;
+	btAlignedObjectArray<btTransform> reference;
+	simulatePile(1, true, reference, numContactBatches);
+	ASSERT_EQ(reference.size(), PILE_SIZE * PILE_SIZE * PILE_HEIGHT + CHAIN_LINKS + LONE_BOXES);
+	EXPECT_GT(numContactBatches, 1);
+
+	const int threadCounts[] = { 2, 4, 8 };
+	for (int t = 0; t < 3; t++)
+	{
+		btAlignedObjectArray<btTransform> result;
+		simulatePile(threadCounts[t], true, result, numContactBatches);
+		ASSERT_EQ(result.size(), reference.size());
+
+		for (int i = 0; i < result.size(); i++)
+		{
+			EXPECT_EQ(0, memcmp(&result[i], &reference[i], sizeof(btTransform)))
+				<< "box " << i << " differs with " << threadCounts[t] << " threads";
+		}
+	}
+
+	btAlignedObjectArray<btTransform> serial;
+	simulatePile(0, false, serial, numContactBatches);
+
+	for (int i = 0; i < PILE_SIZE * PILE_SIZE * PILE_HEIGHT; i++)
+		EXPECT_LT((serial[i].getOrigin() - reference[i].getOrigin()).length(), btScalar(0.05)) << "box " << i;
+
+	for (int i = reference.size() - LONE_BOXES; i < reference.size(); i++)
+		EXPECT_NEAR(reference[i].getOrigin().getY(), btScalar(0.5), btScalar(0.05)) << "lone box " << i;
+}
+
+int main(int argc, char **argv) {
+#if _MSC_VER
+        _CrtSetDbgFlag ( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF );
+#endif
+        ::testing::InitGoogleTest(&argc, argv);
+        return RUN_ALL_TESTS();
+}
@@ -34,6 +34,35 @@ subject to the following restrictions:
 #include "BulletCollision/NarrowPhaseCollision/btGjkEpa3.h"
 #include "BulletCollision/NarrowPhaseCollision/btMprPenetration.h"
 
+#include "BulletCollision/CollisionShapes/btBoxShape.h"
+#include "BulletCollision/CollisionShapes/btCompoundShape.h"
+#include "BulletCollision/CollisionShapes/btTriangleShape.h"
+#include "BulletCollision/NarrowPhaseCollision/btGjkPairDetector.h"
+#include "BulletCollision/NarrowPhaseCollision/btGjkEpaPenetrationDepthSolver.h"
+#include "BulletCollision/NarrowPhaseCollision/btPointCollector.h"
+#include "BulletCollision/NarrowPhaseCollision/btVoronoiSimplexSolver.h"
+#include "BulletCollision/BroadphaseCollision/btAxisSweep3.h"
+#include "BulletCollision/CollisionDispatch/btCollisionObject.h"
+#include "BulletCollision/NarrowPhaseCollision/btPersistentManifold.h"
+#include "BulletCollision/CollisionDispatch/btCollisionWorld.h"
+#include "BulletCollision/CollisionDispatch/btDefaultCollisionConfiguration.h"
+#include "BulletCollision/BroadphaseCollision/btDbvtBroadphase.h"
+#include "LinearMath/btStepProfiler.h"
+#include "LinearMath/btThreads.h"
+#include "LinearMath/btThreadSafePoolAllocator.h"
+#include "BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h"
+#include "BulletCollision/CollisionDispatch/btCollisionCreateFunc.h"
+#include "BulletCollision/CollisionDispatch/btCollisionObjectWrapper.h"
+#include "BulletCollision/CollisionDispatch/btManifoldResult.h"
+#include "BulletCollision/BroadphaseCollision/btCollisionAlgorithm.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
 
 
 btVector3 MyBulletShapeSupportFunc(const void* shapeAptr, const btVector3& dir, bool includeMargin)
@@ -257,10 +286,619 @@ TEST(BulletCollisionTest, AnalyticSphereSphereDistance) {
  testSphereSphereDistance(SSTM_ANALYTIC, 0.00001);
 }
 
+///deterministic per query, so the result does not depend on which thread computes it
+static btScalar queryRand(unsigned int& seed)
+{
+    seed = seed * 1664525u + 1013904223u;
+    return btScalar(seed >> 8) / btScalar(1 << 24) * 2 - 1;
+}
+
+///box vs triangle closest points for queries [begin, end), with the solvers owned by the calling thread
+///the way the multithreaded collision configuration hands them out
+static void computeBoxTriangleDistances(int begin, int end, btScalar* distances, btVector3* normals)
+{
+    btVoronoiSimplexSolver simplexSolver;
+    btGjkEpaPenetrationDepthSolver pdSolver;
+    btBoxShape box(btVector3(0.5, 0.25, 0.75));
+
+    for (int i = begin; i < end; i++)
+    {
+        unsigned int seed = 12345u + 7919u * unsigned(i);
+
+        btTriangleShape triangle(
+            btVector3(queryRand(seed), queryRand(seed), queryRand(seed)) * 2,
+            btVector3(queryRand(seed), queryRand(seed), queryRand(seed)) * 2,
+            btVector3(queryRand(seed), queryRand(seed), queryRand(seed)) * 2);
+
+        btGjkPairDetector::ClosestPointInput input;
+        input.m_transformA.setIdentity();
+        input.m_transformA.setOrigin(btVector3(queryRand(seed), queryRand(seed), queryRand(seed)));
+        input.m_transformA.setRotation(btQuaternion(btVector3(queryRand(seed), queryRand(seed), 1).normalized(), queryRand(seed) * SIMD_PI));
+        input.m_transformB.setIdentity();
+
+        btGjkPairDetector gjk(&box, &triangle, &simplexSolver, &pdSolver);
+        btPointCollector result;
+        gjk.getClosestPoints(input, result, 0);
+
+        distances[i] = result.m_hasResult ? result.m_distance : BT_LARGE_FLOAT;
+        normals[i] = result.m_hasResult ? result.m_normalOnBInWorld : btVector3(0, 0, 0);
+    }
+}
+
+TEST(BulletCollisionTest, GjkEpaPerThreadSolversMatchSerial) {
+    const int numQueries = 4096;
+    const int numThreads = 8;
+    const int numRounds = 4;
+
+    std::vector<btScalar> serialDistances(numQueries);
+    std::vector<btVector3> serialNormals(numQueries);
+    computeBoxTriangleDistances(0, numQueries, &serialDistances[0], &serialNormals[0]);
+
+    for (int round = 0; round < numRounds; round++)
+    {
+        std::vector<btScalar> distances(numQueries);
+        std::vector<btVector3> normals(numQueries);
+        std::vector<std::thread> threads;
+
+        // interleaved slices so the threads run different queries at the same time
+        const int sliceSize = 64;
+        for (int t = 0; t < numThreads; t++)
+        {
+            threads.push_back(std::thread([&, t]() {
+                for (int begin = t * sliceSize; begin < numQueries; begin += numThreads * sliceSize)
+                {
+                    const int end = begin + sliceSize < numQueries ? begin + sliceSize : numQueries;
+                    computeBoxTriangleDistances(begin, end, &distances[0], &normals[0]);
+                }
+            }));
+        }
+
+        for (size_t t = 0; t < threads.size(); t++)
+        {
+            threads[t].join();
+        }
+
+        for (int i = 0; i < numQueries; i++)
+        {
+            ASSERT_EQ(serialDistances[i], distances[i]) << "query " << i;
+            ASSERT_EQ(serialNormals[i], normals[i]) << "query " << i;
+        }
+    }
+}
+
+static void randomAabb(unsigned int& seed, btVector3& aabbMin, btVector3& aabbMax)
+{
+    const btVector3 center(queryRand(seed) * 100, queryRand(seed) * 100, queryRand(seed) * 100);
+    const btVector3 half(queryRand(seed) * 2 + 2.5f, queryRand(seed) * 2 + 2.5f, queryRand(seed) * 2 + 2.5f);
+    aabbMin = center - half;
+    aabbMax = center + half;
+}
+
+static void sortedPairs(btOverlappingPairCache* cache, std::vector<std::pair<int, int> >& pairs)
+{
+    pairs.clear();
+    for (int i = 0; i < cache->getNumOverlappingPairs(); i++)
+    {
+        const btBroadphasePair& pair = cache->getOverlappingPairArrayPtr()[i];
+        const int uid0 = pair.m_pProxy0->getUid();
+        const int uid1 = pair.m_pProxy1->getUid();
+        pairs.push_back(std::make_pair(btMin(uid0, uid1), btMax(uid0, uid1)));
+    }
+    std::sort(pairs.begin(), pairs.end());
+}
+
+TEST(BulletCollisionTest, AxisSweepDeferredProxiesMatchIncremental) {
+    const int numProxies = 1500;
+    const btVector3 worldMin(-200, -200, -200);
+    const btVector3 worldMax(200, 200, 200);
+
+    bt32BitAxisSweep3 incremental(worldMin, worldMax, 2000);
+    bt32BitAxisSweep3 deferred(worldMin, worldMax, 2000);
+
+    // the pair cache touches the client objects when removing pairs
+    btAlignedObjectArray<btCollisionObject> objects;
+    objects.resize(numProxies);
+
+    std::vector<btBroadphaseProxy*> incrementalProxies;
+    std::vector<btBroadphaseProxy*> deferredProxies;
+
+    unsigned int seed = 7;
+    for (int i = 0; i < numProxies; i++)
+    {
+        btVector3 aabbMin, aabbMax;
+        randomAabb(seed, aabbMin, aabbMax);
+        incrementalProxies.push_back(incremental.createProxy(aabbMin, aabbMax, 0, &objects[i], 1, -1, 0, 0));
+        deferredProxies.push_back(deferred.createProxyDeferred(aabbMin, aabbMax, 0, &objects[i], 1, -1, 0, 0));
+    }
+    deferred.endDeferredProxies(0, true);
+
+    std::vector<std::pair<int, int> > incrementalPairs, deferredPairs;
+    sortedPairs(incremental.getOverlappingPairCache(), incrementalPairs);
+    sortedPairs(deferred.getOverlappingPairCache(), deferredPairs);
+    ASSERT_FALSE(incrementalPairs.empty());
+    ASSERT_EQ(incrementalPairs, deferredPairs);
+
+    // the sorted edges must support the incremental operations afterwards
+    for (int i = 0; i < numProxies; i += 3)
+    {
+        btVector3 aabbMin, aabbMax;
+        randomAabb(seed, aabbMin, aabbMax);
+        incremental.setAabb(incrementalProxies[i], aabbMin, aabbMax, 0);
+        deferred.setAabb(deferredProxies[i], aabbMin, aabbMax, 0);
+    }
+    for (int i = 1; i < numProxies; i += 5)
+    {
+        incremental.destroyProxy(incrementalProxies[i], 0);
+        deferred.destroyProxy(deferredProxies[i], 0);
+    }
+
+    for (int i = 0; i < numProxies; i++)
+    {
+        if (i % 5 == 1)
+            continue;
+        for (int j = i + 1; j < numProxies; j += 7)
+        {
+            if (j % 5 == 1)
+                continue;
+            ASSERT_EQ(incremental.testAabbOverlap(incrementalProxies[i], incrementalProxies[j]),
+                deferred.testAabbOverlap(deferredProxies[i], deferredProxies[j])) << i << " " << j;
+        }
+    }
+}
+
 
 
 
 
+static int gStartedManifolds = 0;
+static int gEndedManifolds = 0;
+
+static void countContactStarted(btPersistentManifold* const& /*manifold*/)
+{
+	gStartedManifolds++;
+}
+
+static void countContactEnded(btPersistentManifold* const& /*manifold*/)
+{
+	gEndedManifolds++;
+}
+
+static btManifoldPoint contactPoint(btScalar x)
+{
+	return btManifoldPoint(btVector3(x, 0, 0), btVector3(x, 0, 0), btVector3(0, 1, 0), btVector3(0, 1, 0), btScalar(-0.01));
+}
+
+TEST(BulletCollisionTest, ManifoldContactStartedEndedCallbacks) {
+	btCollisionObject body0, body1;
+	btPersistentManifold manifold(&body0, &body1, 0, btScalar(0.02), btScalar(0.02));
+
+	gStartedManifolds = gEndedManifolds = 0;
+	gContactStartedCallback = countContactStarted;
+	gContactEndedCallback = countContactEnded;
+
+	// only the first point starts the contact
+	manifold.addManifoldPoint(contactPoint(0));
+	manifold.addManifoldPoint(contactPoint(1));
+	EXPECT_EQ(gStartedManifolds, 1);
+	EXPECT_EQ(gEndedManifolds, 0);
+
+	// and only the last one removed ends it
+	manifold.removeContactPoint(0);
+	EXPECT_EQ(gEndedManifolds, 0);
+	manifold.removeContactPoint(0);
+	EXPECT_EQ(gEndedManifolds, 1);
+
+	manifold.addManifoldPoint(contactPoint(0));
+	EXPECT_EQ(gStartedManifolds, 2);
+	manifold.clearManifold();
+	EXPECT_EQ(gEndedManifolds, 2);
+
+	// clearing an empty manifold is no transition
+	manifold.clearManifold();
+	EXPECT_EQ(gEndedManifolds, 2);
+
+	gContactStartedCallback = 0;
+	gContactEndedCallback = 0;
+}
+
+static int gSleepingChanges = 0;
+static int gLastOldState = 0;
+
+static void countSleepingChanges(const btCollisionObject* colObj, int oldState)
+{
+	(void)colObj;
+	gSleepingChanges++;
+	gLastOldState = oldState;
+}
+
+TEST(BulletCollisionTest, SleepingStateChangedCallback) {
+	btCollisionObject obj;
+
+	gSleepingChanges = 0;
+	gSleepingStateChangedCallback = countSleepingChanges;
+
+	// changes between awake states are not reported
+	obj.setActivationState(WANTS_DEACTIVATION);
+	obj.activate(true);
+	EXPECT_EQ(gSleepingChanges, 0);
+
+	obj.setActivationState(ISLAND_SLEEPING);
+	EXPECT_EQ(gSleepingChanges, 1);
+	EXPECT_EQ(gLastOldState, ACTIVE_TAG);
+
+	obj.setActivationState(ISLAND_SLEEPING);
+	EXPECT_EQ(gSleepingChanges, 1);
+
+	obj.activate(true);
+	EXPECT_EQ(gSleepingChanges, 2);
+	EXPECT_EQ(gLastOldState, ISLAND_SLEEPING);
+
+	// objects that can't deactivate ignore the request and report nothing
+	obj.forceActivationState(DISABLE_DEACTIVATION);
+	obj.setActivationState(ISLAND_SLEEPING);
+	EXPECT_EQ(gSleepingChanges, 2);
+	EXPECT_EQ(obj.getActivationState(), DISABLE_DEACTIVATION);
+
+	obj.forceActivationState(ISLAND_SLEEPING);
+	EXPECT_EQ(gSleepingChanges, 3);
+
+	gSleepingStateChangedCallback = 0;
+}
+
+TEST(BulletCollisionTest, CompoundShapeLeaves) {
+	btSphereShape sphere(1);
+	btBoxShape box(btVector3(1, 1, 1));
+
+	btCompoundShape nested;
+	nested.addChildShape(btTransform(btQuaternion::getIdentity(), btVector3(0, 2, 0)), &sphere);
+	nested.addChildShape(btTransform(btQuaternion::getIdentity(), btVector3(0, 4, 0)), &box);
+
+	btCompoundShape compound;
+	compound.addChildShape(btTransform(btQuaternion::getIdentity(), btVector3(1, 0, 0)), &box);
+	compound.addChildShape(btTransform(btQuaternion(btVector3(0, 0, 1), SIMD_HALF_PI), btVector3(10, 0, 0)), &nested);
+
+	compound.updateLeaves();
+	const btAlignedObjectArray<btCompoundShapeLeaf>& leaves = compound.getLeaves();
+	ASSERT_EQ(leaves.size(), 3);
+
+	EXPECT_EQ(leaves[0].m_shape, &box);
+	EXPECT_EQ(leaves[0].m_childIndex, 0);
+	EXPECT_EQ(leaves[1].m_shape, &sphere);
+	EXPECT_EQ(leaves[1].m_childIndex, 1);
+	EXPECT_EQ(leaves[2].m_childIndex, 1);
+
+	// nested (0,2,0) rotated by 90 degrees about z
+	EXPECT_NEAR(leaves[1].m_transform.getOrigin().getX(), 8, 1e-5);
+	EXPECT_NEAR(leaves[1].m_transform.getOrigin().getY(), 0, 1e-5);
+
+	// a change of the nested compound is picked up by the top one
+	nested.updateChildTransform(0, btTransform(btQuaternion::getIdentity(), btVector3(0, 3, 0)));
+	compound.updateLeaves();
+	EXPECT_NEAR(leaves[1].m_transform.getOrigin().getX(), 7, 1e-5);
+
+	compound.removeChildShapeByIndex(0);
+	compound.updateLeaves();
+	ASSERT_EQ(leaves.size(), 2);
+	EXPECT_EQ(leaves[0].m_childIndex, 0);
+	EXPECT_EQ(leaves[1].m_shape, &box);
+}
+
+TEST(BulletCollisionTest, StepProfilerChromeTrace) {
+	btDefaultCollisionConfiguration config;
+	btCollisionDispatcher dispatcher(&config);
+	btDbvtBroadphase broadphase;
+	btCollisionWorld world(&dispatcher, &broadphase, &config);
+
+	btSphereShape sphere(1);
+	btBoxShape box(btVector3(1, 1, 1));
+	btCollisionObject obj0, obj1;
+	obj0.setCollisionShape(&sphere);
+	obj1.setCollisionShape(&box);
+	obj1.getWorldTransform().setOrigin(btVector3(0, 1.5, 0));
+	world.addCollisionObject(&obj0);
+	world.addCollisionObject(&obj1);
+
+	// nothing is recorded while disabled
+	btStepProfiler::reset();
+	world.performDiscreteCollisionDetection();
+	for (int t = 0; t < btStepProfiler::getNumThreads(); t++) {
+		btStepProfileEvent ev;
+		EXPECT_EQ(btStepProfiler::getEvents(t, &ev, 1), 0);
+	}
+
+	btStepProfiler::setEnabled(true);
+	world.performDiscreteCollisionDetection();
+	btStepProfiler::setEnabled(false);
+
+	std::vector<btStepProfileEvent> events(BT_STEP_PROFILER_RING_SIZE);
+	bool nearCallback = false;
+	unsigned long long contacts = 0;
+	for (int t = 0; t < btStepProfiler::getNumThreads(); t++) {
+		const int n = btStepProfiler::getEvents(t, events.data(), int(events.size()));
+		for (int i = 0; i < n; i++) {
+			const btStepProfileEvent& ev = events[i];
+			if (ev.m_type == btStepProfileEvent::ZONE && strcmp(ev.m_name, "nearCallback") == 0)
+				nearCallback = ev.m_detail0 && ev.m_detail1;
+			if (ev.m_type == btStepProfileEvent::COUNTER && strcmp(ev.m_name, "contacts") == 0)
+				contacts = ev.m_value;
+		}
+	}
+	EXPECT_TRUE(nearCallback);
+	EXPECT_GT(contacts, 0u);
+
+	FILE* file = tmpfile();
+	ASSERT_TRUE(file != 0);
+	btStepProfiler::exportChromeTrace(file);
+
+	std::string json(size_t(ftell(file)), '\0');
+	rewind(file);
+	EXPECT_EQ(fread(&json[0], 1, json.size(), file), json.size());
+	fclose(file);
+
+	EXPECT_EQ(json.find("{\"traceEvents\":["), 0u);
+	EXPECT_NE(json.find("\"name\":\"dispatchAllCollisionPairs\""), std::string::npos);
+	EXPECT_TRUE(json.find("\"name\":\"nearCallback SPHERE/Box\"") != std::string::npos ||
+		json.find("\"name\":\"nearCallback Box/SPHERE\"") != std::string::npos);
+	EXPECT_NE(json.find("\"ph\":\"C\""), std::string::npos);
+
+	world.removeCollisionObject(&obj1);
+	world.removeCollisionObject(&obj0);
+	btStepProfiler::reset();
+}
+
+class ThreadTaskScheduler : public btITaskScheduler {
+public:
+	explicit ThreadTaskScheduler(int numThreads) : m_numThreads(numThreads) {}
+
+	void parallelFor(int iBegin, int iEnd, int grainSize, const btIParallelForBody& body) override {
+		std::atomic<int> next(iBegin);
+		auto work = [&]() {
+			for (;;) {
+				const int begin = next.fetch_add(grainSize);
+				if (begin >= iEnd)
+					break;
+				body.forLoop(begin, std::min(begin + grainSize, iEnd));
+			}
+		};
+
+		std::vector<std::thread> threads;
+		for (int i = 1; i < m_numThreads; i++)
+			threads.emplace_back(work);
+		work();
+		for (std::thread& t : threads)
+			t.join();
+	}
+
+private:
+	int m_numThreads;
+};
+
+// the narrowphase of the parallel dispatcher needs a simplex and penetration depth solver per thread
+class ThreadLocalSolverConfiguration : public btDefaultCollisionConfiguration {
+public:
+	btVoronoiSimplexSolver* getSimplexSolver() override {
+		static thread_local btVoronoiSimplexSolver solver;
+		return &solver;
+	}
+
+	btConvexPenetrationDepthSolver* getPdSolver() override {
+		static thread_local btGjkEpaPenetrationDepthSolver solver;
+		return &solver;
+	}
+};
+
+struct DispatcherTestWorld {
+	ThreadLocalSolverConfiguration config;
+	btCollisionDispatcher& dispatcher;
+	btDbvtBroadphase broadphase;
+	btCollisionWorld world;
+	btSphereShape sphere;
+	btBoxShape box;
+	std::vector<btCollisionObject> objects;
+
+	DispatcherTestWorld(btCollisionDispatcher* (*create)(btCollisionConfiguration*))
+		: dispatcher(*create(&config))
+		, world(&dispatcher, &broadphase, &config)
+		, sphere(0.6)
+		, box(btVector3(0.5, 0.5, 0.5))
+		, objects(200)
+	{
+		for (int i = 0; i < int(objects.size()); i++) {
+			objects[i].setCollisionShape(i % 3 ? (btCollisionShape*)&sphere : &box);
+			objects[i].getWorldTransform().setOrigin(btVector3(btScalar(i % 10), btScalar((i / 10) % 5), btScalar(i / 50)));
+			world.addCollisionObject(&objects[i]);
+		}
+	}
+
+	~DispatcherTestWorld() {
+		for (int i = 0; i < int(objects.size()); i++)
+			world.removeCollisionObject(&objects[i]);
+		delete &dispatcher;
+	}
+
+	int objectIndex(const btCollisionObject* obj) const {
+		return int(obj - &objects[0]);
+	}
+};
+
+static btCollisionDispatcher* createSerialDispatcher(btCollisionConfiguration* config) {
+	return new btCollisionDispatcher(config);
+}
+
+static btCollisionDispatcher* createParallelDispatcher(btCollisionConfiguration* config) {
+	return new btCollisionDispatcherMt(config, 8);
+}
+
+static void expectSameManifolds(const DispatcherTestWorld& serial, const DispatcherTestWorld& parallel) {
+	ASSERT_EQ(serial.dispatcher.getNumManifolds(), parallel.dispatcher.getNumManifolds());
+
+	for (int m = 0; m < serial.dispatcher.getNumManifolds(); m++) {
+		const btPersistentManifold* ms = serial.dispatcher.getManifoldByIndexInternal(m);
+		const btPersistentManifold* mp = parallel.dispatcher.getManifoldByIndexInternal(m);
+		EXPECT_EQ(mp->m_index1a, m);
+		EXPECT_EQ(serial.objectIndex(ms->getBody0()), parallel.objectIndex(mp->getBody0()));
+		EXPECT_EQ(serial.objectIndex(ms->getBody1()), parallel.objectIndex(mp->getBody1()));
+		ASSERT_EQ(ms->getNumContacts(), mp->getNumContacts());
+		for (int c = 0; c < ms->getNumContacts(); c++)
+			EXPECT_EQ(ms->getContactPoint(c).getDistance(), mp->getContactPoint(c).getDistance());
+	}
+}
+
+TEST(BulletCollisionTest, CollisionDispatcherMtMatchesSerial) {
+	DispatcherTestWorld serial(createSerialDispatcher);
+	DispatcherTestWorld parallel(createParallelDispatcher);
+
+	ThreadTaskScheduler scheduler(4);
+	static_cast<btCollisionDispatcherMt&>(parallel.dispatcher).setTaskScheduler(&scheduler);
+
+	for (int step = 0; step < 3; step++) {
+		// move a few objects so that pairs are added and removed between the steps
+		for (int i = 0; i < 200; i += 7) {
+			const btVector3 offset(btScalar(0.3 * step), 0, 0);
+			serial.objects[i].getWorldTransform().getOrigin() += offset;
+			parallel.objects[i].getWorldTransform().getOrigin() += offset;
+		}
+
+		serial.world.performDiscreteCollisionDetection();
+		parallel.world.performDiscreteCollisionDetection();
+
+		ASSERT_GT(serial.broadphase.getOverlappingPairCache()->getNumOverlappingPairs(), 8);
+		expectSameManifolds(serial, parallel);
+	}
+}
+
+// sphere pairs replacing their manifold on every dispatch, the manifolds are released by the pairs of the parallel batches
+class ReplacingManifoldAlgorithm : public btCollisionAlgorithm {
+public:
+	ReplacingManifoldAlgorithm(const btCollisionAlgorithmConstructionInfo& ci, const btCollisionObjectWrapper* body0Wrap, const btCollisionObjectWrapper* body1Wrap)
+		: btCollisionAlgorithm(ci)
+		, m_manifold(ci.m_dispatcher1->getNewManifold(body0Wrap->getCollisionObject(), body1Wrap->getCollisionObject())) {
+	}
+
+	~ReplacingManifoldAlgorithm() {
+		m_dispatcher->releaseManifold(m_manifold);
+	}
+
+	void processCollision(const btCollisionObjectWrapper* body0Wrap, const btCollisionObjectWrapper* body1Wrap, const btDispatcherInfo&, btManifoldResult* resultOut) override {
+		m_dispatcher->releaseManifold(m_manifold);
+		m_manifold = m_dispatcher->getNewManifold(body0Wrap->getCollisionObject(), body1Wrap->getCollisionObject());
+		resultOut->setPersistentManifold(m_manifold);
+
+		const btVector3 diff = body0Wrap->getWorldTransform().getOrigin() - body1Wrap->getWorldTransform().getOrigin();
+		const btScalar radius0 = static_cast<const btSphereShape*>(body0Wrap->getCollisionShape())->getRadius();
+		const btScalar radius1 = static_cast<const btSphereShape*>(body1Wrap->getCollisionShape())->getRadius();
+		const btScalar dist = diff.length() - radius0 - radius1;
+		if (dist < 0) {
+			const btVector3 normal = diff.normalized();
+			resultOut->addContactPoint(normal, body1Wrap->getWorldTransform().getOrigin() + normal * radius1, dist);
+		}
+	}
+
+	btScalar calculateTimeOfImpact(btCollisionObject*, btCollisionObject*, const btDispatcherInfo&, btManifoldResult*) override {
+		return btScalar(1.);
+	}
+
+	void getAllContactManifolds(btManifoldArray& manifoldArray) override {
+		manifoldArray.push_back(m_manifold);
+	}
+
+	struct CreateFunc : public btCollisionAlgorithmCreateFunc {
+		btCollisionAlgorithm* CreateCollisionAlgorithm(btCollisionAlgorithmConstructionInfo& ci, const btCollisionObjectWrapper* body0Wrap, const btCollisionObjectWrapper* body1Wrap) override {
+			void* mem = ci.m_dispatcher1->allocateCollisionAlgorithm(sizeof(ReplacingManifoldAlgorithm));
+			return new (mem) ReplacingManifoldAlgorithm(ci, body0Wrap, body1Wrap);
+		}
+	};
+
+private:
+	btPersistentManifold* m_manifold;
+};
+
+TEST(BulletCollisionTest, CollisionDispatcherMtReleasesInPairOrder) {
+	DispatcherTestWorld serial(createSerialDispatcher);
+	DispatcherTestWorld parallel(createParallelDispatcher);
+
+	ReplacingManifoldAlgorithm::CreateFunc createFunc;
+	serial.dispatcher.registerCollisionCreateFunc(SPHERE_SHAPE_PROXYTYPE, SPHERE_SHAPE_PROXYTYPE, &createFunc);
+	parallel.dispatcher.registerCollisionCreateFunc(SPHERE_SHAPE_PROXYTYPE, SPHERE_SHAPE_PROXYTYPE, &createFunc);
+
+	ThreadTaskScheduler scheduler(4);
+	static_cast<btCollisionDispatcherMt&>(parallel.dispatcher).setTaskScheduler(&scheduler);
+
+	for (int step = 0; step < 4; step++) {
+		serial.world.performDiscreteCollisionDetection();
+		parallel.world.performDiscreteCollisionDetection();
+
+		// the releases swap the last manifold into the freed slot, the order only matches when they are applied in pair order
+		expectSameManifolds(serial, parallel);
+	}
+}
+
+TEST(BulletCollisionTest, ThreadSafePoolAllocator) {
+	btThreadSafePoolAllocator pool(40, 64);
+	ASSERT_EQ(pool.getElementSize(), 48);
+	ASSERT_EQ(pool.getNumChunks(), 1);
+
+	const int numThreads = 4;
+	const int maxLive = 300;
+	std::atomic<int> errors(0);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < numThreads; t++) {
+		threads.push_back(std::thread([&pool, &errors, t]() {
+			std::vector<unsigned*> live;
+			unsigned seed = 1234u + t;
+			for (int i = 0; i < 20000; i++) {
+				seed = seed * 1664525u + 1013904223u;
+				if (live.size() < size_t(maxLive) && (live.empty() || (seed >> 16) % 3 != 0)) {
+					unsigned* mem = static_cast<unsigned*>(pool.allocate(40));
+					for (int w = 0; w < 10; w++)
+						mem[w] = (t << 24) | i;
+					live.push_back(mem);
+				} else {
+					const size_t k = (seed >> 8) % live.size();
+					unsigned* mem = live[k];
+					for (int w = 1; w < 10; w++)
+						if (mem[w] != mem[0] || (mem[0] >> 24) != unsigned(t))
+							errors++;
+					pool.freeMemory(mem);
+					live[k] = live.back();
+					live.pop_back();
+				}
+			}
+			for (size_t k = 0; k < live.size(); k++)
+				pool.freeMemory(live[k]);
+		}));
+	}
+	for (size_t t = 0; t < threads.size(); t++)
+		threads[t].join();
+
+	EXPECT_EQ(errors.load(), 0);
+	EXPECT_EQ(pool.getUsedCount(), 0);
+	EXPECT_GE(pool.getHighWaterMark(), maxLive);
+	EXPECT_LE(pool.getHighWaterMark(), numThreads * maxLive);
+	EXPECT_GT(pool.getNumChunks(), 1);
+	EXPECT_EQ(pool.getFallbackCount(), 0);
+
+	//larger requests go to the heap
+	void* large = pool.allocate(100);
+	EXPECT_FALSE(pool.validPtr(large));
+	EXPECT_EQ(pool.getFallbackCount(), 1);
+	pool.freeMemory(large);
+
+	//without fallback an exhausted pool returns 0
+	btThreadSafePoolAllocator small(16, 8, 2);
+	std::vector<void*> elements;
+	for (int i = 0; i < 16; i++) {
+		elements.push_back(small.allocate(16, false));
+		EXPECT_TRUE(small.validPtr(elements.back()));
+	}
+	EXPECT_TRUE(small.allocate(16, false) == 0);
+	EXPECT_EQ(small.getFallbackCount(), 0);
+	for (size_t i = 0; i < elements.size(); i++)
+		small.freeMemory(elements[i]);
+	EXPECT_EQ(small.getUsedCount(), 0);
+	EXPECT_EQ(small.getHighWaterMark(), 16);
+}
+
 int main(int argc, char **argv) {
 #if _MSC_VER
         _CrtSetDbgFlag ( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF );
@@ -21,7 +21,7 @@
 		defines {"_VARIADIC_MAX=10"}
 	end
 	
-	links {"LinearMath", "gtest"}
+	links {"BulletCollision", "LinearMath", "gtest"}
 	
 	files {
 		"**.cpp",
@@ -37,6 +37,10 @@
 		"../../src/BulletCollision/CollisionShapes/btConvexInternalShape.cpp",
 		"../../src/BulletCollision/CollisionShapes/btCollisionShape.cpp",
 		"../../src/BulletCollision/CollisionShapes/btConvexPolyhedron.cpp",
+		"../../src/BulletCollision/CollisionShapes/btBoxShape.cpp",
+		"../../src/BulletCollision/NarrowPhaseCollision/btGjkPairDetector.cpp",
+		"../../src/BulletCollision/NarrowPhaseCollision/btGjkEpa2.cpp",
+		"../../src/BulletCollision/NarrowPhaseCollision/btGjkEpaPenetrationDepthSolver.cpp",
 
 	}
 
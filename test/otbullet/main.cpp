@@ -0,0 +1,1229 @@
+/*
+Bullet Continuous Collision Detection and Physics Library
+Copyright (c) 2003-2006 Erwin Coumans  http://continuousphysics.com/Bullet/
+
+This software is provided 'as-is', without any express or implied warranty.
+In no event will the authors be held liable for any damages arising from the use of this software.
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it freely,
+subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must not claim that you wrote the original software. If you use this software in a product, an acknowledgment in the product documentation would be appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+///Tests of ot::discrete_dynamics_world: the terrain pass run by several taskmaster workers steps exactly
+///like the serial pass with the terrain callbacks running concurrently, and the tree batches they add end up once in the world cache.
+///The frustum query test also prints the per-frame latency of query_volume_frustum next to the exact per-object test
+
+
+#include <gtest/gtest.h>
+
+#include "btBulletDynamicsCommon.h"
+
+#include "discrete_dynamics_world.h"
+#include "multithread_default_collision_configuration.h"
+#include "navigation_probe.h"
+#include "ot_terrain_contact_common.h"
+#include "tree_collider.h"
+
+#include <BulletCollision/CollisionDispatch/btGhostObject.h>
+
+#include <ot/sys/object_cfg.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <math.h>
+#include <mutex>
+#include <set>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+static const int NUM_BODIES_X = 8;
+static const int NUM_BODIES_Z = 8;
+static const int NUM_STEPS = 90;
+static const int NUM_THREADS = 4;
+static const float GROUND_HALF_SIZE = 1000.f;
+
+static const double3 g_ground_offset(0, 0, 0);
+
+static std::atomic<int> g_callers(0);
+static std::atomic<int> g_max_callers(0);
+/// the next callback waits for another worker to enter, serialized callbacks never overlap
+static std::atomic<bool> g_wait_for_overlap(false);
+
+/// terrain mesh of the tree batches, one batch per 16m cell
+static const char g_tree_mesh = 0;
+static std::mutex g_tree_cells_mutex;
+static std::set<int> g_tree_cells;
+
+///flat ground at y=0, every query returns the tree batch of its cell, added to the passed array like the engine does
+static int ground_obb_intersect(
+	const void* context,
+	const double3& center,
+	const float3x3& basis,
+	float lod_dimension,
+	coid::dynarray<bt::triangle>& data,
+	coid::dynarray<uint>& trees,
+	coid::slotalloc<bt::tree_batch>& tree_batches,
+	uint frame,
+	bool& is_above_tm,
+	double3& under_contact,
+	float3& under_normal,
+	coid::dynarray<bt::external_broadphase*>& broadphases)
+{
+	const int callers = ++g_callers;
+	int max_callers = g_max_callers;
+	while (callers > max_callers && !g_max_callers.compare_exchange_weak(max_callers, callers)) {}
+
+	bool wait = true;
+	if (g_wait_for_overlap.compare_exchange_strong(wait, false)) {
+		const std::chrono::steady_clock::time_point until = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+		while (g_callers < 2 && std::chrono::steady_clock::now() < until) {
+			std::this_thread::yield();
+		}
+	}
+
+	const float l = GROUND_HALF_SIZE;
+	*data.add() = bt::triangle(float3(-l, 0, -l), float3(-l, 0, l), float3(l, 0, -l), 0, 1, 2, 0, &g_ground_offset, 0);
+	*data.add() = bt::triangle(float3(l, 0, l), float3(l, 0, -l), float3(-l, 0, l), 3, 2, 1, 0, &g_ground_offset, 1);
+
+	// empty batch, reused while it's in the passed array
+	const bt::terrain_mesh* tm = reinterpret_cast<const bt::terrain_mesh*>(&g_tree_mesh);
+	const int cell = (int(floor(center.x / 16)) & 0xff) | (int(floor(center.z / 16)) & 0xff) << 8;
+
+	uint bid = UMAX32;
+	tree_batches.for_each([&](bt::tree_batch& tb) {
+		if (tb.tm == tm && tb.idx_in_tm == cell) {
+			bid = uint(tree_batches.get_item_id(&tb));
+		}
+	});
+
+	if (bid == UMAX32) {
+		bt::tree_batch* tb = tree_batches.add();
+		tb->tm = tm;
+		tb->tm_version = 0;
+		tb->idx_in_tm = uint16(cell);
+		tb->last_frame_used = UMAX32;
+		tb->tree_count = 0;
+		bid = uint(tree_batches.get_item_id(tb));
+	}
+	*trees.add() = bid;
+
+	{
+		std::lock_guard<std::mutex> lock(g_tree_cells_mutex);
+		g_tree_cells.insert(cell);
+	}
+
+	is_above_tm = true;
+	under_contact = double3(center.x, 0, center.z);
+	under_normal = float3(0, 1, 0);
+
+	--g_callers;
+	return 1;
+}
+
+static bool no_sphere_intersect(const void*, const double3&, float, float, coid::dynarray<bt::triangle>&,
+	coid::dynarray<uint>&, coid::slotalloc<bt::tree_batch>&, uint)
+{
+	return false;
+}
+
+static float3 no_tree_collision(btRigidBody*, bt::tree_collision_contex&, float, coid::slotalloc<bt::tree_batch>&)
+{
+	return float3(0);
+}
+
+static float no_ray_intersect(const void*, const double3&, const float3&, const float2&, float3*, double3*)
+{
+	return -1.f;
+}
+
+static void no_ray_intersect_broadphase(const void*, const double3&, const float3&, const float2&, coid::dynarray32<bt::external_broadphase*>&)
+{
+}
+
+static void no_obb_intersect_broadphase(const void*, const double3&, const float3x3&, coid::dynarray32<bt::external_broadphase*>&)
+{
+}
+
+static float no_elevation(const double3&, float, float3*, double3*)
+{
+	return -1.f;
+}
+
+///drops a grid of spheres, capsules and boxes on the terrain, returns the final transforms and the number of cached tree batches
+static void simulateGrid(coid::taskmaster* tm, bool parallelTerrain, std::vector<btTransform>& transforms, int& numTreeBatches)
+{
+	btDefaultCollisionConstructionInfo dccinfo;
+	dccinfo.m_owns_simplex_and_pd_solver = false;
+
+	multithread_default_collision_configuration config(dccinfo);
+	btCollisionDispatcher dispatcher(&config);
+	bt32BitAxisSweep3 broadphase(btVector3(-2000, -2000, -2000), btVector3(2000, 2000, 2000), 1024);
+	btSequentialImpulseConstraintSolver solver;
+	bt::bullet_stats stats;
+
+	ot::discrete_dynamics_world world(&dispatcher, &broadphase, &solver, &config,
+		&no_sphere_intersect, &no_tree_collision, &no_ray_intersect, &no_elevation, nullptr, tm);
+
+	world._aabb_intersect = &ground_obb_intersect;
+	world._obb_intersect_broadphase = &no_obb_intersect_broadphase;
+	world._terrain_ray_intersect_broadphase = &no_ray_intersect_broadphase;
+	world.set_ot_stats(&stats);
+	world.set_parallel_terrain_step(parallelTerrain);
+	world.setGravity(btVector3(0, -10, 0));
+
+	btSphereShape sphere(0.5f);
+	btCapsuleShape capsule(0.3f, 0.6f);
+	btBoxShape box(btVector3(0.4f, 0.4f, 0.4f));
+	btCollisionShape* shapes[] = { &sphere, &capsule, &box };
+
+	std::vector<btRigidBody*> bodies;
+	for (int x = 0; x < NUM_BODIES_X; x++) {
+		for (int z = 0; z < NUM_BODIES_Z; z++) {
+			const int i = x * NUM_BODIES_Z + z;
+			btCollisionShape* shape = shapes[i % 3];
+
+			btVector3 inertia(0, 0, 0);
+			shape->calculateLocalInertia(1, inertia);
+
+			btTransform trans;
+			trans.setIdentity();
+			trans.setOrigin(btVector3(x * 3.f, 1.f + 0.1f * (i % 5), z * 3.f));
+			trans.setRotation(btQuaternion(btVector3(0, 1, 0), 0.2f * i));
+
+			btRigidBody* body = new btRigidBody(btRigidBody::btRigidBodyConstructionInfo(1, 0, shape, inertia));
+			body->setWorldTransform(trans);
+			body->setActivationState(DISABLE_DEACTIVATION);
+			world.addRigidBody(body, btBroadphaseProxy::DefaultFilter, short(btBroadphaseProxy::AllFilter | ot::collision::cg_terrain));
+			bodies.push_back(body);
+		}
+	}
+
+	for (int step = 0; step < NUM_STEPS; step++) {
+		g_wait_for_overlap = parallelTerrain && step == 0;
+		world.stepSimulation(btScalar(1. / 60.), 0);
+	}
+
+	numTreeBatches = 0;
+	world.tree_batches().for_each([&](const bt::tree_batch&) {
+		numTreeBatches++;
+	});
+
+	transforms.clear();
+	for (size_t i = 0; i < bodies.size(); i++) {
+		transforms.push_back(bodies[i]->getWorldTransform());
+		world.removeRigidBody(bodies[i]);
+		delete bodies[i];
+	}
+}
+
+TEST(OtBullet, ParallelTerrainPassMatchesSerial)
+{
+	coid::taskmaster tm(NUM_THREADS, 0);
+
+	g_max_callers = 0;
+	g_tree_cells.clear();
+
+	std::vector<btTransform> serial;
+	int serialTreeBatches = 0;
+	simulateGrid(&tm, false, serial, serialTreeBatches);
+
+	EXPECT_EQ(g_max_callers, 1);
+	EXPECT_EQ(serialTreeBatches, int(g_tree_cells.size()));
+
+	g_max_callers = 0;
+	g_tree_cells.clear();
+
+	std::vector<btTransform> parallel;
+	int parallelTreeBatches = 0;
+	simulateGrid(&tm, true, parallel, parallelTreeBatches);
+
+	// the workers query the terrain at the same time, the batches they added for the same cell are merged
+	EXPECT_GT(g_max_callers, 1);
+	EXPECT_GT(g_tree_cells.size(), 1u);
+	EXPECT_EQ(parallelTreeBatches, int(g_tree_cells.size()));
+
+	ASSERT_EQ(serial.size(), parallel.size());
+	for (size_t i = 0; i < serial.size(); i++) {
+		EXPECT_EQ(memcmp(&serial[i], &parallel[i], sizeof(btTransform)), 0) << "body " << i;
+
+		// resting on the ground, not fallen through
+		EXPECT_GT(parallel[i].getOrigin().getY(), btScalar(0.1));
+	}
+}
+
+static const int NUM_FRUSTUM_OBJECTS = 20000;
+static const int NUM_FRUSTUM_FRAMES = 50;
+
+///culls a cloud of static objects of mixed shapes through the world query, everything accepted by the exact
+///per-plane test must be reported and nothing that is entirely outside
+TEST(OtBullet, FrustumQueryMatchesObjectTest)
+{
+	btDefaultCollisionConfiguration config;
+	btCollisionDispatcher dispatcher(&config);
+	bt32BitAxisSweep3 broadphase(btVector3(-2000, -2000, -2000), btVector3(2000, 2000, 2000), NUM_FRUSTUM_OBJECTS + 16);
+	btSequentialImpulseConstraintSolver solver;
+
+	ot::discrete_dynamics_world world(&dispatcher, &broadphase, &solver, &config,
+		&no_sphere_intersect, &no_tree_collision, &no_ray_intersect, &no_elevation);
+
+	btSphereShape sphere(1.f);
+	btCapsuleShape capsule(0.5f, 3.f);
+	btBoxShape box(btVector3(2.f, 0.5f, 1.f));
+	btCylinderShape cylinder(btVector3(1.f, 2.f, 1.f));
+	btCollisionShape* shapes[] = { &sphere, &capsule, &box, &cylinder };
+
+	std::vector<btCollisionObject*> objects;
+	unsigned int seed = 12345;
+	for (int i = 0; i < NUM_FRUSTUM_OBJECTS; i++) {
+		float r[4];
+		for (int k = 0; k < 4; k++) {
+			seed = seed * 1664525u + 1013904223u;
+			r[k] = float(seed >> 8) / float(1 << 24);
+		}
+
+		btTransform trans;
+		trans.setIdentity();
+		trans.setOrigin(btVector3(1000.f * r[0] - 500.f, 1000.f * r[1] - 500.f, 1000.f * r[2] - 500.f));
+		trans.setRotation(btQuaternion(btVector3(1, 1, 0).normalized(), 6.28f * r[3]));
+
+		btCollisionObject* obj = new btCollisionObject();
+		obj->setCollisionShape(shapes[i % 4]);
+		obj->setWorldTransform(trans);
+		world.addCollisionObject(obj);
+		objects.push_back(obj);
+	}
+
+	// builds the cached local boxes
+	world.updateAabbs();
+
+	// 90 degrees field of view looking along +z, near and far plane
+	const float c = sqrtf(0.5f);
+	const float4 planes[] = {
+		float4(c, 0, c, 0),
+		float4(-c, 0, c, 0),
+		float4(0, c, c, 0),
+		float4(0, -c, c, 0),
+		float4(0, 0, 1, -1),
+		float4(0, 0, -1, 400),
+	};
+	const double3 pos(10, -20, -100);
+
+	bt::frustum_query frustum;
+	frustum.pos = pos;
+	frustum.planes = planes;
+	frustum.nplanes = 6;
+
+	for (int partial = 0; partial < 2; partial++) {
+		const bool include_partial = partial != 0;
+
+		std::set<btCollisionObject*> queried;
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		for (int frame = 0; frame < NUM_FRUSTUM_FRAMES; frame++) {
+			queried.clear();
+			world.query_volume_frustum(&broadphase, pos, planes, 6, include_partial, [&](btCollisionObject* obj) {
+				queried.insert(obj);
+			});
+		}
+		const double query_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		std::set<btCollisionObject*> exact;
+		start = std::chrono::high_resolution_clock::now();
+		for (int frame = 0; frame < NUM_FRUSTUM_FRAMES; frame++) {
+			exact.clear();
+			for (size_t i = 0; i < objects.size(); i++) {
+				if (bt::frustum_object_test(objects[i], frustum, include_partial)) {
+					exact.insert(objects[i]);
+				}
+			}
+		}
+		const double exact_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		printf("frustum query (%s, %d objects, %d hits): query_volume_frustum %.3f ms, per-object test %.3f ms per frame\n",
+			include_partial ? "partial" : "inside", NUM_FRUSTUM_OBJECTS, int(queried.size()),
+			query_ms / NUM_FRUSTUM_FRAMES, exact_ms / NUM_FRUSTUM_FRAMES);
+
+		EXPECT_GT(exact.size(), 0u);
+		EXPECT_TRUE(std::includes(queried.begin(), queried.end(), exact.begin(), exact.end()));
+
+		// the cached box bounds the shape, nothing outside of the frustum is reported
+		for (std::set<btCollisionObject*>::const_iterator it = queried.begin(); it != queried.end(); ++it) {
+			EXPECT_TRUE(bt::frustum_object_test(*it, frustum, true));
+		}
+	}
+
+	for (size_t i = 0; i < objects.size(); i++) {
+		world.removeCollisionObject(objects[i]);
+		delete objects[i];
+	}
+}
+
+///moving a child of a compound changes its local box without a change of the shape or its scaling,
+///the query must not reject the object with the box cached before the move
+TEST(OtBullet, FrustumQueryFollowsCompoundChildren)
+{
+	btDefaultCollisionConfiguration config;
+	btCollisionDispatcher dispatcher(&config);
+	bt32BitAxisSweep3 broadphase(btVector3(-2000, -2000, -2000), btVector3(2000, 2000, 2000), 16);
+	btSequentialImpulseConstraintSolver solver;
+
+	ot::discrete_dynamics_world world(&dispatcher, &broadphase, &solver, &config,
+		&no_sphere_intersect, &no_tree_collision, &no_ray_intersect, &no_elevation);
+
+	// both children start behind the viewer
+	btBoxShape box(btVector3(1.f, 1.f, 1.f));
+	btCompoundShape compound;
+	compound.addChildShape(btTransform::getIdentity(), &box);
+	compound.addChildShape(btTransform(btQuaternion::getIdentity(), btVector3(0, 0, -10)), &box);
+
+	btCollisionObject obj;
+	obj.setCollisionShape(&compound);
+	obj.setWorldTransform(btTransform(btQuaternion::getIdentity(), btVector3(0, 0, -50)));
+	world.addCollisionObject(&obj);
+	world.updateAabbs();
+
+	// 90 degrees field of view looking along +z from the origin
+	const float c = sqrtf(0.5f);
+	const float4 planes[] = {
+		float4(c, 0, c, 0),
+		float4(-c, 0, c, 0),
+		float4(0, c, c, 0),
+		float4(0, -c, c, 0),
+		float4(0, 0, 1, -1),
+		float4(0, 0, -1, 400),
+	};
+	const double3 pos(0, 0, 0);
+
+	bt::frustum_query frustum;
+	frustum.pos = pos;
+	frustum.planes = planes;
+	frustum.nplanes = 6;
+
+	int hits = 0;
+	world.query_volume_frustum(&broadphase, pos, planes, 6, true, [&](btCollisionObject*) { hits++; });
+	EXPECT_EQ(0, hits);
+	EXPECT_FALSE(bt::frustum_object_test(&obj, frustum, true));
+
+	// the second child moves in front of the viewer
+	compound.updateChildTransform(1, btTransform(btQuaternion::getIdentity(), btVector3(0, 0, 120)));
+	world.updateAabbs();
+
+	hits = 0;
+	world.query_volume_frustum(&broadphase, pos, planes, 6, true, [&](btCollisionObject*) { hits++; });
+	EXPECT_TRUE(bt::frustum_object_test(&obj, frustum, true));
+	EXPECT_EQ(1, hits);
+
+	world.removeCollisionObject(&obj);
+}
+
+static const int NUM_NESTED_GRID = 20;
+
+///query callbacks may issue nested queries, each nesting level borrows its own traversal stack of the thread,
+///the nested results match the same queries run one after another and the warm stacks are not reallocated
+TEST(OtBullet, NestedQueriesReuseThreadStacks)
+{
+	btDefaultCollisionConfiguration config;
+	btCollisionDispatcher dispatcher(&config);
+	bt32BitAxisSweep3 broadphase(btVector3(-2000, -2000, -2000), btVector3(2000, 2000, 2000), NUM_NESTED_GRID * NUM_NESTED_GRID + 16);
+	btSequentialImpulseConstraintSolver solver;
+
+	ot::discrete_dynamics_world world(&dispatcher, &broadphase, &solver, &config,
+		&no_sphere_intersect, &no_tree_collision, &no_ray_intersect, &no_elevation);
+
+	btSphereShape sphere(0.5f);
+	std::vector<btCollisionObject*> objects;
+	for (int x = 0; x < NUM_NESTED_GRID; x++) {
+		for (int z = 0; z < NUM_NESTED_GRID; z++) {
+			btCollisionObject* obj = new btCollisionObject;
+			obj->setCollisionShape(&sphere);
+			obj->setWorldTransform(btTransform(btQuaternion::getIdentity(), btVector3(x * 2.f - NUM_NESTED_GRID, 0.3f * (x % 3), 10.f + z * 2.f)));
+			world.addCollisionObject(obj);
+			objects.push_back(obj);
+		}
+	}
+	world.updateAabbs();
+
+	// 90 degrees field of view looking along +z from the origin
+	const float c = sqrtf(0.5f);
+	const float4 planes[] = {
+		float4(c, 0, c, 0),
+		float4(-c, 0, c, 0),
+		float4(0, c, c, 0),
+		float4(0, -c, c, 0),
+		float4(0, 0, 1, -1),
+		float4(0, 0, -1, 400),
+	};
+	const double3 pos(0, 0, 0);
+	const float radius = 2.5f;
+
+	auto neighbours = [&](btCollisionObject* obj) {
+		const btVector3& p = obj->getWorldTransform().getOrigin();
+		int n = 0;
+		world.query_volume_sphere(&broadphase, double3(p.x(), p.y(), p.z()), radius, [&](btCollisionObject*) {
+			EXPECT_GE(bt::dbvt_thread_query_stacks::get().depth, 1u);
+			n++;
+			return false;
+		});
+		return n;
+	};
+
+	// reference, the frustum query and then the sphere queries of its hits
+	std::vector<std::pair<btCollisionObject*, int> > serial;
+	world.query_volume_frustum(&broadphase, pos, planes, 6, true, [&](btCollisionObject* obj) {
+		serial.push_back(std::make_pair(obj, 0));
+	});
+	for (size_t i = 0; i < serial.size(); i++) {
+		serial[i].second = neighbours(serial[i].first);
+	}
+
+	ASSERT_GT(serial.size(), 0u);
+	ASSERT_LT(serial.size(), objects.size());
+
+	bt::dbvt_thread_query_stacks& ts = bt::dbvt_thread_query_stacks::get();
+	std::vector<std::pair<btCollisionObject*, int> > nested;
+	nested.reserve(serial.size());
+
+	const bt::dbvt_query_node* warm[2] = { 0, 0 };
+	for (int run = 0; run < 3; run++) {
+		nested.clear();
+		EXPECT_EQ(0u, ts.depth);
+
+		world.query_volume_frustum(&broadphase, pos, planes, 6, true, [&](btCollisionObject* obj) {
+			EXPECT_EQ(1u, ts.depth);
+			nested.push_back(std::make_pair(obj, neighbours(obj)));
+			EXPECT_EQ(1u, ts.depth);
+		});
+
+		EXPECT_EQ(0u, ts.depth);
+		ASSERT_EQ(serial.size(), nested.size());
+		for (size_t i = 0; i < serial.size(); i++) {
+			EXPECT_EQ(serial[i].first, nested[i].first);
+			EXPECT_EQ(serial[i].second, nested[i].second);
+		}
+
+		// the first run grows the stacks of both levels, later runs walk them without allocating
+		if (run == 0) {
+			warm[0] = ts.stacks[0].ptr();
+			warm[1] = ts.stacks[1].ptr();
+		}
+		else {
+			EXPECT_EQ(warm[0], ts.stacks[0].ptr());
+			EXPECT_EQ(warm[1], ts.stacks[1].ptr());
+		}
+	}
+
+	for (size_t i = 0; i < objects.size(); i++) {
+		world.removeCollisionObject(objects[i]);
+		delete objects[i];
+	}
+}
+
+static const int TERRAIN_GRID = 16;
+static const double3 g_mesh_offset(1200, 40, -2300);
+
+static float meshHeight(int x, int z)
+{
+	return 0.3f * sinf(x * 0.7f) * cosf(z * 0.9f);
+}
+
+///grid of size x size quads at g_mesh_offset, with per triangle materials
+static void bumpyMesh(int size, std::vector<bt::triangle>& triangles)
+{
+	triangles.clear();
+	for (int z = 0; z < size; z++) {
+		for (int x = 0; x < size; x++) {
+			const float3 a(float(x), meshHeight(x, z), float(z));
+			const float3 b(float(x + 1), meshHeight(x + 1, z), float(z));
+			const float3 c(float(x), meshHeight(x, z + 1), float(z + 1));
+			const float3 d(float(x + 1), meshHeight(x + 1, z + 1), float(z + 1));
+			const uint idx = uint(triangles.size());
+
+			triangles.push_back(bt::triangle(a, c, b, 0, 1, 2, 0, &g_mesh_offset, idx));
+			triangles.push_back(bt::triangle(b, c, d, 2, 1, 3, 0, &g_mesh_offset, idx + 1));
+		}
+	}
+
+	// the contact hooks combine the material of the processed triangle
+	for (size_t i = 0; i < triangles.size(); i++) {
+		triangles[i].fric = 0.5f + 0.05f * (i % 7);
+		triangles[i].roll_fric = 0.1f + 0.01f * (i % 5);
+		triangles[i].rest = 0.2f + 0.1f * (i % 3);
+	}
+}
+
+///contacts of a sphere or capsule with the triangles, through the batched culling kernels or the per triangle path
+static void collideTriangles(bool kernels, bool capsule, const double3& p0, const double3& p1, float radius,
+	const std::vector<bt::triangle>& triangles, std::vector<btManifoldPoint>& points)
+{
+	btSphereShape shape(radius);
+	btCollisionObject body, terrain;
+	body.setCollisionShape(&shape);
+	terrain.setCollisionShape(&shape);
+
+	btCollisionObjectWrapper body_wrap(0, &shape, &body, body.getWorldTransform(), -1, -1);
+	btCollisionObjectWrapper terrain_wrap(0, &shape, &terrain, terrain.getWorldTransform(), -1, -1);
+	btPersistentManifold manifold(&body, &terrain, 0, 1.f, 1.f);
+	btManifoldResult result(&body_wrap, &terrain_wrap);
+	result.setPersistentManifold(&manifold);
+
+	ot_terrain_contact_common common(0.f, nullptr, nullptr);
+	common.set_triangle_kernels_enabled(kernels);
+
+	if (capsule) {
+		common.prepare_capsule_collision(&result, p0, p1, radius, 0.04f);
+	}
+	else {
+		common.prepare_sphere_collision(&result, p0, radius, 0.04f);
+	}
+
+	common.process_triangle_cache(&triangles[0], &triangles[0] + triangles.size());
+	common.process_collision_points();
+
+	points.clear();
+	for (int i = 0; i < manifold.getNumContacts(); i++) {
+		points.push_back(manifold.getContactPoint(i));
+	}
+}
+
+///the kernels only cull the triangles out of reach, the contacts still come from the per triangle algorithms
+///in the original order, so both paths must produce the same manifold for spheres and capsules on a bumpy mesh
+TEST(OtBullet, TriangleKernelsMatchPerTriangleContacts)
+{
+	std::vector<bt::triangle> triangles;
+	bumpyMesh(TERRAIN_GRID, triangles);
+
+	int ncontacts = 0;
+	int nempty = 0;
+	std::vector<btManifoldPoint> batched, single;
+
+	for (int capsule = 0; capsule < 2; capsule++) {
+		for (int i = 0; i < 40; i++) {
+			const float x = 1.f + 0.37f * i;
+			const float z = 2.f + 0.29f * i;
+			const float above = i % 4 == 3 ? 2.f : 0.1f * (i % 3);
+			const float radius = capsule ? 0.3f : 0.5f;
+
+			const double3 p0 = g_mesh_offset + double3(x, meshHeight(int(x), int(z)) + radius + above - 0.1f, z);
+			const double3 p1 = p0 + double3(1.2, 0.2, 0.5);
+
+			collideTriangles(true, capsule != 0, p0, p1, radius, triangles, batched);
+			collideTriangles(false, capsule != 0, p0, p1, radius, triangles, single);
+
+			ASSERT_EQ(batched.size(), single.size()) << (capsule ? "capsule " : "sphere ") << i;
+			for (size_t k = 0; k < batched.size(); k++) {
+				EXPECT_EQ(0, memcmp(&batched[k].m_positionWorldOnB, &single[k].m_positionWorldOnB, sizeof(btVector3)));
+				EXPECT_EQ(0, memcmp(&batched[k].m_normalWorldOnB, &single[k].m_normalWorldOnB, sizeof(btVector3)));
+				EXPECT_EQ(batched[k].m_distance1, single[k].m_distance1);
+				EXPECT_EQ(batched[k].m_combinedFriction, single[k].m_combinedFriction);
+				EXPECT_EQ(batched[k].m_combinedRestitution, single[k].m_combinedRestitution);
+			}
+
+			ncontacts += int(single.size());
+			nempty += single.empty() ? 1 : 0;
+		}
+	}
+
+	EXPECT_GT(ncontacts, 0);
+	EXPECT_GT(nempty, 0);
+}
+
+static const int NUM_CONVEX_QUERIES = 512;
+static const int NUM_CONVEX_ROUNDS = 4;
+static const int CONVEX_MESH_GRID = 4;
+
+///box and cylinder vs triangle contacts of queries [begin, end) through one terrain context, the context keeps
+///its convex-triangle algorithm and only retargets it to the manifold of each query, gjk runs with the solvers
+///the collision configuration hands out to the calling thread
+static void collideConvexTriangles(ot_terrain_contact_common& common, ot::discrete_dynamics_world& world, int begin, int end,
+	const std::vector<bt::triangle>& triangles, std::vector<std::vector<btManifoldPoint> >& points)
+{
+	btBoxShape box(btVector3(0.5f, 0.25f, 0.75f));
+	btCylinderShape cylinder(btVector3(0.4f, 0.5f, 0.4f));
+	btSphereShape terrain_shape(1.f);
+	btCollisionObject terrain;
+	terrain.setCollisionShape(&terrain_shape);
+	btCollisionObjectWrapper terrain_wrap(0, &terrain_shape, &terrain, terrain.getWorldTransform(), -1, -1);
+
+	for (int i = begin; i < end; i++) {
+		// runs of the same shape reuse the algorithm, a shape change takes a new one from the dispatcher pool
+		btConvexShape* shape = (i / 8) % 2 ? static_cast<btConvexShape*>(&cylinder) : &box;
+
+		unsigned int seed = 12345u + 7919u * unsigned(i);
+		float r[4];
+		for (int k = 0; k < 4; k++) {
+			seed = seed * 1664525u + 1013904223u;
+			r[k] = float(seed >> 8) / float(1 << 24);
+		}
+
+		const float x = 0.5f + r[0] * (CONVEX_MESH_GRID - 1);
+		const float z = 0.5f + r[1] * (CONVEX_MESH_GRID - 1);
+		const double3 pos = g_mesh_offset + double3(x, meshHeight(int(x), int(z)) + 0.2f + 0.3f * r[2], z);
+
+		btCollisionObject body;
+		body.setCollisionShape(shape);
+		body.setWorldTransform(btTransform(btQuaternion(btVector3(0.3f, 1, 0.2f).normalized(), r[3] * SIMD_PI),
+			btVector3(btScalar(pos.x), btScalar(pos.y), btScalar(pos.z))));
+
+		btCollisionObjectWrapper body_wrap(0, shape, &body, body.getWorldTransform(), -1, -1);
+		btPersistentManifold manifold(&body, &terrain, 0, 1.f, 1.f);
+		btManifoldResult result(&body_wrap, &terrain_wrap);
+		result.setPersistentManifold(&manifold);
+
+		common.prepare_bt_convex_collision(&result, &body_wrap, world.getDispatcher());
+		common.process_triangle_cache(&triangles[0], &triangles[0] + triangles.size());
+		common.process_collision_points();
+
+		points[i].clear();
+		for (int k = 0; k < manifold.getNumContacts(); k++) {
+			points[i].push_back(manifold.getContactPoint(k));
+		}
+	}
+}
+
+///the gjk solvers of multithread_default_collision_configuration are per thread, and the terrain contexts run
+///concurrently with their cached convex-triangle algorithms retargeted by setManifold, the contacts must match a serial run
+TEST(OtBullet, PerThreadConvexContactsMatchSerial)
+{
+	btDefaultCollisionConstructionInfo dccinfo;
+	dccinfo.m_owns_simplex_and_pd_solver = false;
+
+	multithread_default_collision_configuration config(dccinfo);
+	btCollisionDispatcher dispatcher(&config);
+	bt32BitAxisSweep3 broadphase(btVector3(-2000, -2000, -2000), btVector3(2000, 2000, 2000), 16);
+	btSequentialImpulseConstraintSolver solver;
+
+	ot::discrete_dynamics_world world(&dispatcher, &broadphase, &solver, &config,
+		&no_sphere_intersect, &no_tree_collision, &no_ray_intersect, &no_elevation);
+
+	// each live thread gets its own solvers, the same ones on every call
+	{
+		const int nthreads = 8;
+		std::vector<const void*> solvers(2 * nthreads);
+		std::atomic<int> arrived(0);
+		std::vector<std::thread> threads;
+
+		for (int t = 0; t < nthreads; t++) {
+			threads.push_back(std::thread([&, t]() {
+				solvers[2 * t] = config.getSimplexSolver();
+				solvers[2 * t + 1] = config.getPdSolver();
+				EXPECT_EQ(solvers[2 * t], static_cast<const void*>(config.getSimplexSolver()));
+				EXPECT_EQ(solvers[2 * t + 1], static_cast<const void*>(config.getPdSolver()));
+
+				// keep the threads alive until all have taken theirs, so a thread exit can't hand its solvers over
+				arrived++;
+				while (arrived < nthreads) {
+					std::this_thread::yield();
+				}
+			}));
+		}
+
+		for (size_t t = 0; t < threads.size(); t++) {
+			threads[t].join();
+		}
+
+		std::set<const void*> distinct(solvers.begin(), solvers.end());
+		EXPECT_EQ(solvers.size(), distinct.size());
+	}
+
+	std::vector<bt::triangle> triangles;
+	bumpyMesh(CONVEX_MESH_GRID, triangles);
+
+	std::vector<std::vector<btManifoldPoint> > serial(NUM_CONVEX_QUERIES);
+	{
+		ot_terrain_contact_common common(0.f, &world, nullptr);
+		collideConvexTriangles(common, world, 0, NUM_CONVEX_QUERIES, triangles, serial);
+	}
+
+	int ncontacts = 0;
+	for (int i = 0; i < NUM_CONVEX_QUERIES; i++) {
+		ncontacts += int(serial[i].size());
+	}
+	EXPECT_GT(ncontacts, NUM_CONVEX_QUERIES / 2);
+
+	for (int round = 0; round < NUM_CONVEX_ROUNDS; round++) {
+		std::vector<std::vector<btManifoldPoint> > points(NUM_CONVEX_QUERIES);
+		std::vector<std::thread> threads;
+
+		// interleaved slices so the contexts switch shapes and run gjk at the same time
+		const int slice = 16;
+		for (int t = 0; t < NUM_THREADS; t++) {
+			threads.push_back(std::thread([&, t]() {
+				ot_terrain_contact_common common(0.f, &world, nullptr);
+				for (int begin = t * slice; begin < NUM_CONVEX_QUERIES; begin += NUM_THREADS * slice) {
+					collideConvexTriangles(common, world, begin, std::min(begin + slice, NUM_CONVEX_QUERIES), triangles, points);
+				}
+			}));
+		}
+
+		for (size_t t = 0; t < threads.size(); t++) {
+			threads[t].join();
+		}
+
+		for (int i = 0; i < NUM_CONVEX_QUERIES; i++) {
+			ASSERT_EQ(serial[i].size(), points[i].size()) << "query " << i;
+			for (size_t k = 0; k < points[i].size(); k++) {
+				EXPECT_EQ(0, memcmp(&serial[i][k].m_positionWorldOnB, &points[i][k].m_positionWorldOnB, sizeof(btVector3))) << "query " << i;
+				EXPECT_EQ(0, memcmp(&serial[i][k].m_normalWorldOnB, &points[i][k].m_normalWorldOnB, sizeof(btVector3))) << "query " << i;
+				EXPECT_EQ(serial[i][k].m_distance1, points[i][k].m_distance1) << "query " << i;
+			}
+		}
+	}
+}
+
+///exposes the predictive manifolds made in the last step
+class ccd_world : public ot::discrete_dynamics_world
+{
+public:
+	using ot::discrete_dynamics_world::discrete_dynamics_world;
+
+	const btAlignedObjectArray<btPersistentManifold*>& predictive_manifolds() const { return m_predictiveManifolds; }
+};
+
+///fast sphere crossing the zero thickness ground within one step, returns the height after the step
+static float dropThroughGround(bool terrainCcd, int& numPredictive, btManifoldPoint& predictive)
+{
+	btDefaultCollisionConstructionInfo dccinfo;
+	dccinfo.m_owns_simplex_and_pd_solver = false;
+
+	multithread_default_collision_configuration config(dccinfo);
+	btCollisionDispatcher dispatcher(&config);
+	bt32BitAxisSweep3 broadphase(btVector3(-2000, -2000, -2000), btVector3(2000, 2000, 2000), 16);
+	btSequentialImpulseConstraintSolver solver;
+
+	ccd_world world(&dispatcher, &broadphase, &solver, &config,
+		&no_sphere_intersect, &no_tree_collision, &no_ray_intersect, &no_elevation);
+
+	world._aabb_intersect = &ground_obb_intersect;
+	world._obb_intersect_broadphase = &no_obb_intersect_broadphase;
+	world._terrain_ray_intersect_broadphase = &no_ray_intersect_broadphase;
+	world.set_terrain_ccd(terrainCcd);
+	world.setGravity(btVector3(0, 0, 0));
+
+	// 4 m per step from 2 m above the ground, nothing touches at the start of the step
+	btSphereShape sphere(0.25f);
+	btRigidBody body(btRigidBody::btRigidBodyConstructionInfo(1, 0, &sphere, btVector3(0.1f, 0.1f, 0.1f)));
+	body.setWorldTransform(btTransform(btQuaternion::getIdentity(), btVector3(3, 2, 5)));
+	body.setLinearVelocity(btVector3(0, -240, 0));
+	body.setCcdMotionThreshold(0.1f);
+	body.setCcdSweptSphereRadius(0.2f);
+	body.setActivationState(DISABLE_DEACTIVATION);
+	world.addRigidBody(&body, btBroadphaseProxy::DefaultFilter, short(btBroadphaseProxy::AllFilter | ot::collision::cg_terrain));
+
+	world.stepSimulation(btScalar(1. / 60.), 0);
+
+	numPredictive = 0;
+	const btAlignedObjectArray<btPersistentManifold*>& manifolds = world.predictive_manifolds();
+	for (int i = 0; i < manifolds.size(); i++) {
+		if (manifolds[i]->getBody0() == &body && manifolds[i]->getNumContacts() > 0) {
+			predictive = manifolds[i]->getContactPoint(0);
+			numPredictive++;
+		}
+	}
+
+	const float height = float(body.getWorldTransform().getOrigin().y());
+	world.removeRigidBody(&body);
+	return height;
+}
+
+///the terrain ccd makes a predictive contact at the time of impact with the terrain triangle,
+///without it the body passes through the ground in a single step
+TEST(OtBullet, TerrainCcdStopsFastBody)
+{
+	int numPredictive = 0;
+	btManifoldPoint predictive;
+
+	const float tunnelled = dropThroughGround(false, numPredictive, predictive);
+	EXPECT_EQ(0, numPredictive);
+	EXPECT_LT(tunnelled, 0.f);
+
+	const float stopped = dropThroughGround(true, numPredictive, predictive);
+	ASSERT_EQ(1, numPredictive);
+
+	// ground normal, the point is where the sphere touches and the distance is how far it travels until then
+	EXPECT_NEAR(1.f, predictive.m_normalWorldOnB.y(), 1e-3f);
+	EXPECT_NEAR(1.75f, predictive.getDistance(), 1e-2f);
+	EXPECT_NEAR(3.f, predictive.m_positionWorldOnB.x(), 1e-3f);
+	EXPECT_NEAR(5.f, predictive.m_positionWorldOnB.z(), 1e-3f);
+
+	EXPECT_GT(stopped, 0.f);
+	EXPECT_LT(stopped, 0.5f);
+}
+
+static const int NUM_TREE_BODIES = 64;
+
+///the batched kernel gives the closest features of a sphere or capsule and all trees of a batch at once,
+///the scalar path collides the body with the capsule object of each tree, both must give the same contacts
+TEST(OtBullet, TreeBatchKernelMatchesCapsuleAlgorithm)
+{
+	btDefaultCollisionConfiguration config;
+	btCollisionDispatcher dispatcher(&config);
+	btDispatcherInfo dispatch_info;
+
+	// 4x4 trees, up is the direction from the planet center
+	const uint ntrees = bt::tree_batch_soa::LANES;
+	const double3 patch(300, 2000, -500);
+	bt::tree trees[ntrees] = {};
+	for (uint i = 0; i < ntrees; i++) {
+		trees[i].pos = patch + double3((i % 4) * 3.0, 0.1 * (i % 3), (i / 4) * 3.0);
+		trees[i].radius = 0.2f + 0.05f * (i % 5);
+		trees[i].height = 4.f + 0.5f * (i % 7);
+	}
+
+	bt::tree_batch_soa soa;
+	soa.build(trees, ntrees);
+
+	btSphereShape sphere(0.4f);
+	btCapsuleShape capsule(0.3f, 1.2f);
+
+	unsigned int seed = 4321;
+	auto rnd = [&]() {
+		seed = seed * 1664525u + 1013904223u;
+		return float(seed >> 8) / float(1 << 24);
+	};
+
+	int ncompared = 0;
+	int npenetrating = 0;
+
+	for (int i = 0; i < NUM_TREE_BODIES; i++) {
+		const bool is_capsule = i % 2 != 0;
+		btConvexShape* shape = is_capsule ? static_cast<btConvexShape*>(&capsule) : &sphere;
+		const float radius = is_capsule ? 0.3f : 0.4f;
+
+		// beside a tree, from a bit apart to penetrating, a capsule lies across the offset so the cores stay apart
+		const bt::tree& host = trees[i % ntrees];
+		const double3 up = glm::normalize(host.pos);
+		const double3 side = glm::normalize(glm::cross(up, double3(cos(double(i)), 0, sin(double(i)))));
+		const double3 across = glm::cross(up, side);
+		const double gap = host.radius + radius + 0.05 - 0.2 * rnd();
+		const double3 center = host.pos + up * double(host.height * (0.2f + 0.6f * rnd())) + side * gap;
+
+		const btTransform trans(shortestArcQuat(btVector3(0, 1, 0), btVector3(btScalar(across.x), btScalar(across.y), btScalar(across.z))),
+			btVector3(btScalar(center.x), btScalar(center.y), btScalar(center.z)));
+
+		// body segment relative to the batch origin, as process_tree_batch_queries makes it
+		const btVector3& o = trans.getOrigin();
+		const double3 rel(o.x() - soa.origin.x, o.y() - soa.origin.y, o.z() - soa.origin.z);
+		float3 p0(rel), p1(rel);
+		if (is_capsule) {
+			const btVector3 axis = trans.getBasis().getColumn(capsule.getUpAxis()) * capsule.getHalfHeight();
+			p0 = float3(rel + double3(axis.x(), axis.y(), axis.z()));
+			p1 = float3(rel - double3(axis.x(), axis.y(), axis.z()));
+		}
+
+		bt::tree_segment_contact contacts[bt::tree_batch_soa::LANES];
+		bt::collide_segment_tree_batch(soa, p0, p1, radius, contacts);
+
+		btCollisionObject body;
+		body.setCollisionShape(shape);
+		body.setWorldTransform(trans);
+		btCollisionObjectWrapper body_wrap(0, shape, &body, trans, -1, -1);
+
+		for (uint j = 0; j < ntrees; j++) {
+			// the tree object as build_tb_collision_info makes it
+			const bt::tree& t = trees[j];
+			const double3 tree_up = glm::normalize(t.pos);
+			const double3 tree_center = t.pos + tree_up * double(t.height) * 0.5;
+
+			btCapsuleShape tree_shape(t.radius, t.height);
+			btCollisionObject tree_obj;
+			tree_obj.setCollisionShape(&tree_shape);
+			tree_obj.setWorldTransform(btTransform(
+				shortestArcQuat(btVector3(0, 1, 0), btVector3(btScalar(tree_up.x), btScalar(tree_up.y), btScalar(tree_up.z))),
+				btVector3(btScalar(tree_center.x), btScalar(tree_center.y), btScalar(tree_center.z))));
+			btCollisionObjectWrapper tree_wrap(0, &tree_shape, &tree_obj, tree_obj.getWorldTransform(), -1, -1);
+
+			btPersistentManifold manifold(&body, &tree_obj, 0, 0.5f, 0.5f);
+			btManifoldResult res(&body_wrap, &tree_wrap);
+			res.setPersistentManifold(&manifold);
+
+			btCollisionAlgorithm* algorithm = dispatcher.findAlgorithm(&body_wrap, &tree_wrap, &manifold);
+			ASSERT_TRUE(algorithm != nullptr);
+			algorithm->processCollision(&body_wrap, &tree_wrap, dispatch_info, &res);
+			algorithm->~btCollisionAlgorithm();
+			dispatcher.freeCollisionAlgorithm(algorithm);
+
+			const bt::tree_segment_contact& tc = contacts[j];
+			if (manifold.getNumContacts() == 0) {
+				EXPECT_GT(tc.distance, manifold.getContactBreakingThreshold() - 1e-2f) << "body " << i << " tree " << j;
+				continue;
+			}
+
+			const btManifoldPoint& cp = manifold.getContactPoint(0);
+			const double3 pt = soa.origin + double3(tc.point_on_tree);
+
+			EXPECT_NEAR(cp.getDistance(), tc.distance, 2e-3f) << "body " << i << " tree " << j;
+			EXPECT_GT(cp.m_normalWorldOnB.dot(btVector3(tc.normal.x, tc.normal.y, tc.normal.z)), 0.999f) << "body " << i << " tree " << j;
+			EXPECT_LT((cp.m_positionWorldOnB - btVector3(btScalar(pt.x), btScalar(pt.y), btScalar(pt.z))).length(), 2e-3f) << "body " << i << " tree " << j;
+
+			ncompared++;
+			npenetrating += tc.distance < 0 ? 1 : 0;
+		}
+	}
+
+	EXPECT_GE(ncompared, NUM_TREE_BODIES);
+	EXPECT_GT(npenetrating, 0);
+}
+
+static const int NUM_TILE_PROXIES = 30000;
+static const int NUM_TILE_QUERIES = 20000;
+
+///fills a 2 km tile away from the world origin with small boxes and queries it both by walking the double precision
+///dbvt of the sweep and through the tile local float tree. The float boxes are rounded outwards, the tree must report
+///everything the sweep walk reports
+TEST(OtBullet, LocalTreeContainsSweepResults)
+{
+	btDefaultCollisionConfiguration config;
+	btCollisionDispatcher dispatcher(&config);
+	bt32BitAxisSweep3 broadphase(btVector3(-2000, -2000, -2000), btVector3(2000, 2000, 2000), 16);
+	btSequentialImpulseConstraintSolver solver;
+
+	ot::discrete_dynamics_world world(&dispatcher, &broadphase, &solver, &config,
+		&no_sphere_intersect, &no_tree_collision, &no_ray_intersect, &no_elevation);
+
+	unsigned int seed = 54321;
+	auto rnd = [&seed]() {
+		seed = seed * 1664525u + 1013904223u;
+		return double(seed >> 8) / double(1 << 24);
+	};
+
+	const double3 center(250000.0, 300.0, -410000.0);
+	const btVector3 tile_center(btScalar(center.x), btScalar(center.y), btScalar(center.z));
+	const btVector3 tile_half(1000, 1000, 1000);
+	bt32BitAxisSweep3 tile(tile_center - tile_half, tile_center + tile_half, NUM_TILE_PROXIES + 16);
+
+	btBoxShape box(btVector3(1.5f, 2.f, 1.f));
+	std::vector<btCollisionObject*> objects;
+	for (int i = 0; i < NUM_TILE_PROXIES; i++) {
+		btTransform trans;
+		trans.setIdentity();
+		trans.setOrigin(tile_center + btVector3(btScalar(1900 * (rnd() - 0.5)), btScalar(1900 * (rnd() - 0.5)), btScalar(1900 * (rnd() - 0.5))));
+
+		btCollisionObject* obj = new btCollisionObject();
+		obj->setCollisionShape(&box);
+		obj->setWorldTransform(trans);
+
+		btVector3 min, max;
+		box.getAabb(trans, min, max);
+		btBroadphaseProxy* proxy = tile.createProxyDeferred(min, max, box.getShapeType(), obj,
+			btBroadphaseProxy::StaticFilter, btBroadphaseProxy::AllFilter, &dispatcher, 0);
+		proxy->m_ot_owner = &tile;
+		obj->setBroadphaseHandle(proxy);
+		objects.push_back(obj);
+	}
+	tile.endDeferredProxies(&dispatcher, false);
+
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	bt::dbvt_local_tree tree;
+	tree.build(&tile, &tile);
+	const double build_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	std::vector<double3> centers;
+	std::vector<float> sizes;
+	for (int q = 0; q < NUM_TILE_QUERIES; q++) {
+		centers.push_back(center + double3(1900 * (rnd() - 0.5), 1900 * (rnd() - 0.5), 1900 * (rnd() - 0.5)));
+		sizes.push_back(float(2 + 18 * rnd()));
+	}
+
+	bt::dbvt_local_stack stack;
+	std::vector<btCollisionObject*> sweep_hits, tree_hits;
+
+	// timed first, then compared query by query
+	for (int shape = 0; shape < 2; shape++) {
+		const bool sphere = shape != 0;
+		int nsweep = 0, ntree = 0;
+
+		start = std::chrono::high_resolution_clock::now();
+		for (int q = 0; q < NUM_TILE_QUERIES; q++) {
+			if (sphere) {
+				world.query_volume_sphere(&tile, centers[q], sizes[q], [&](btCollisionObject*) { nsweep++; return false; });
+			}
+			else {
+				world.query_volume_aabb(&tile, centers[q], double3(sizes[q]), [&](btBroadphaseProxy*) { nsweep++; });
+			}
+		}
+		const double sweep_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		start = std::chrono::high_resolution_clock::now();
+		for (int q = 0; q < NUM_TILE_QUERIES; q++) {
+			const float3 cen(centers[q] - tree.origin);
+			if (sphere) {
+				tree.query_sphere(stack, cen, sizes[q], [&](btBroadphaseProxy*) { ntree++; return false; });
+			}
+			else {
+				tree.query_aabb(stack, cen, float3(sizes[q]), [&](btBroadphaseProxy*) { ntree++; return false; });
+			}
+		}
+		const double tree_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		printf("tile %s query (%d proxies, %d queries, %d hits): sweep dbvt %.3f ms, local tree %.3f ms, tree build %.3f ms\n",
+			sphere ? "sphere" : "aabb", NUM_TILE_PROXIES, NUM_TILE_QUERIES, nsweep, sweep_ms, tree_ms, build_ms);
+
+		EXPECT_GT(nsweep, 0);
+		EXPECT_GE(ntree, nsweep);
+
+		for (int q = 0; q < NUM_TILE_QUERIES; q++) {
+			sweep_hits.clear();
+			tree_hits.clear();
+
+			const float3 cen(centers[q] - tree.origin);
+			if (sphere) {
+				world.query_volume_sphere(&tile, centers[q], sizes[q], [&](btCollisionObject* obj) { sweep_hits.push_back(obj); return false; });
+				tree.query_sphere(stack, cen, sizes[q], [&](btBroadphaseProxy* proxy) {
+					tree_hits.push_back(static_cast<btCollisionObject*>(proxy->m_clientObject));
+					return false;
+				});
+			}
+			else {
+				world.query_volume_aabb(&tile, centers[q], double3(sizes[q]), [&](btBroadphaseProxy* proxy) {
+					sweep_hits.push_back(static_cast<btCollisionObject*>(proxy->m_clientObject));
+				});
+				tree.query_aabb(stack, cen, float3(sizes[q]), [&](btBroadphaseProxy* proxy) {
+					tree_hits.push_back(static_cast<btCollisionObject*>(proxy->m_clientObject));
+					return false;
+				});
+			}
+
+			// both walks round to float near the boundary, only the hits that overlap by more than that are required
+			size_t nrequired = 0;
+			for (size_t i = 0; i < sweep_hits.size(); i++) {
+				const btBroadphaseProxy* proxy = sweep_hits[i]->getBroadphaseHandle();
+				double dist_sq = 0;
+				bool inside = true;
+				for (int k = 0; k < 3; k++) {
+					const double c = centers[q][k];
+					const double d = glm::max(glm::max(double(proxy->m_aabbMin[k]) - c, c - double(proxy->m_aabbMax[k])), 0.0);
+					dist_sq += d * d;
+					inside = inside && d < sizes[q] - 1e-2;
+				}
+				if (sphere ? dist_sq < (sizes[q] - 1e-2) * (sizes[q] - 1e-2) : inside) {
+					sweep_hits[nrequired++] = sweep_hits[i];
+				}
+			}
+			sweep_hits.resize(nrequired);
+
+			std::sort(sweep_hits.begin(), sweep_hits.end());
+			std::sort(tree_hits.begin(), tree_hits.end());
+			EXPECT_TRUE(std::includes(tree_hits.begin(), tree_hits.end(), sweep_hits.begin(), sweep_hits.end()))
+				<< (sphere ? "sphere" : "aabb") << " query " << q;
+		}
+	}
+
+	for (size_t i = 0; i < objects.size(); i++) {
+		delete objects[i];
+	}
+}
+
+static const int NUM_PROBE_CELLS = 4;
+static const int NUM_CROWDED_PROBES = 100;
+static const int NUM_CELL_PROBES = 8;
+static const int NUM_PROBE_STEPS = 3;
+
+///probes moving towards walls, stepped one by one with sim_step and together with sim_step_batch.
+///One cell holds more probes than share a query, the others are spread one cell apart
+TEST(OtBullet, ProbeBatchStepMatchesSingleSteps)
+{
+	coid::taskmaster tm(NUM_THREADS, 0);
+
+	btDefaultCollisionConfiguration config;
+	btCollisionDispatcher dispatcher(&config);
+	bt32BitAxisSweep3 broadphase(btVector3(-2000, -2000, -2000), btVector3(2000, 2000, 2000), 1024);
+	btSequentialImpulseConstraintSolver solver;
+
+	ot::discrete_dynamics_world world(&dispatcher, &broadphase, &solver, &config,
+		&no_sphere_intersect, &no_tree_collision, &no_ray_intersect, &no_elevation, nullptr, &tm);
+	world._obb_intersect_broadphase = &no_obb_intersect_broadphase;
+	world._terrain_ray_intersect_broadphase = &no_ray_intersect_broadphase;
+
+	// a wall across every cell, in the way of the probes in the last columns
+	btBoxShape wallShape(btVector3(0.5f, 2.f, 16.f));
+	std::vector<btCollisionObject*> walls;
+	for (int c = 0; c < NUM_PROBE_CELLS; c++) {
+		btCollisionObject* wall = new btCollisionObject();
+		wall->setCollisionShape(&wallShape);
+		wall->setWorldTransform(btTransform(btQuaternion::getIdentity(), btVector3(64.f * c + 26.f, 2.f, 16.f)));
+		world.addCollisionObject(wall);
+		walls.push_back(wall);
+	}
+
+	btSphereShape probeShape(0.5f);
+	std::vector<btPairCachingGhostObject*> ghosts;
+	std::vector<bt::ot_navigation_probe*> single;
+	std::vector<bt::ot_navigation_probe*> batched;
+	std::vector<double3> targets;
+	const quat rot(1, 0, 0, 0);
+
+	for (int c = 0; c < NUM_PROBE_CELLS; c++) {
+		const int n = c == 0 ? NUM_CROWDED_PROBES : NUM_CELL_PROBES;
+		for (int i = 0; i < n; i++) {
+			const double3 pos(64.0 * c + 1.0 + (i % 10) * 2.3, 2.0, 1.0 + (i / 10) * 2.9);
+
+			for (int k = 0; k < 2; k++) {
+				btPairCachingGhostObject* ghost = new btPairCachingGhostObject();
+				ghost->setCollisionShape(&probeShape);
+				ghost->setCollisionFlags(btCollisionObject::CF_NO_CONTACT_RESPONSE);
+				world.addCollisionObject(ghost, btBroadphaseProxy::CharacterFilter, btBroadphaseProxy::StaticFilter | btBroadphaseProxy::DefaultFilter);
+				ghosts.push_back(ghost);
+
+				bt::ot_navigation_probe* probe = new bt::ot_navigation_probe(ghost, float3(0));
+				probe->set_transform(pos, rot);
+				(k ? batched : single).push_back(probe);
+			}
+			targets.push_back(pos);
+		}
+	}
+
+	std::vector<bt::navigation_probe_step> steps(batched.size());
+	for (int s = 0; s < NUM_PROBE_STEPS; s++) {
+		for (size_t i = 0; i < targets.size(); i++) {
+			targets[i].x += 6.0;
+			single[i]->sim_step(&world, targets[i], rot, 1.f / 60.f);
+
+			steps[i].probe = batched[i];
+			steps[i].target_position = targets[i];
+			steps[i].target_rotation = rot;
+		}
+		bt::ot_navigation_probe::sim_step_batch(&world, &steps[0], uint(steps.size()), 1.f / 60.f);
+	}
+
+	int blocked = 0;
+	for (size_t i = 0; i < targets.size(); i++) {
+		const double3 a = single[i]->get_pos();
+		const double3 b = batched[i]->get_pos();
+		EXPECT_NEAR(a.x, b.x, 1e-5) << "probe " << i;
+		EXPECT_NEAR(a.y, b.y, 1e-5) << "probe " << i;
+		EXPECT_NEAR(a.z, b.z, 1e-5) << "probe " << i;
+
+		if (a.x < targets[i].x - 1e-3) {
+			blocked++;
+		}
+	}
+
+	// the walls stopped some of the probes in every cell, the others reached their targets
+	EXPECT_GE(blocked, NUM_PROBE_CELLS);
+	EXPECT_LT(blocked, int(targets.size()));
+
+	for (size_t i = 0; i < single.size(); i++) {
+		delete single[i];
+		delete batched[i];
+	}
+	for (size_t i = 0; i < ghosts.size(); i++) {
+		world.removeCollisionObject(ghosts[i]);
+		delete ghosts[i];
+	}
+	for (size_t i = 0; i < walls.size(); i++) {
+		world.removeCollisionObject(walls[i]);
+		delete walls[i];
+	}
+}
+
+int main(int argc, char** argv)
+{
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}